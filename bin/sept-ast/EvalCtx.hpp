@@ -1,12 +1,42 @@
 // 2021.04.19 - Victor Dods
 
+#pragma once
+
 #include <lvd/aliases.hpp>
+#include <memory>
+#include <optional>
 #include "sept/GlobalSymRef.hpp"
+#include "sept/Interner.hpp"
 #include "sept/LocalSymRef.hpp"
 #include "sept/SymbolTable.hpp"
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace memo {
+
+class Memoizer;
+
+} // end namespace memo
+
+namespace par {
+
+class TaskPool;
+
+} // end namespace par
+
+namespace typecheck {
+
+class CheckedProgram;
+struct FuncFacts;
+
+} // end namespace typecheck
 
 namespace sem {
 
+struct FuncClosure;
+
 class EvalCtx {
 public:
 
@@ -20,17 +50,171 @@ public:
     // This will return a ScopeGuard object which facilitates exception-safe popping of scope.
     // That ScopeGuard object should be kept alive as long as the scope is meant to live.
     [[nodiscard]] lvd::ScopeGuard push_scope () {
-        m_current_scope = m_current_scope->push_symbol_table();
+        push_reused_scope();
         return lvd::ScopeGuard{[this](){ this->pop_scope(); }};
     }
+    // This destroys the scope's symbols (unless it escaped), so it takes time linear in their number.
     void pop_scope () {
-        // This will throw if there is no parent.
-        m_current_scope = m_current_scope->parent_symbol_table();
+        if (m_pushed_scope_count == 0)
+            throw std::runtime_error("there is no pushed scope to pop");
+
+        auto &pushed_scope = m_pushed_scopes[--m_pushed_scope_count];
+        m_current_scope = pushed_scope.m_symbol_table->parent_symbol_table();
+        // If anything besides m_pushed_scopes still holds the SymbolTable, then the scope escaped, so it's
+        // left to its holders.  Otherwise it's cleared for reuse by the next scope pushed at this depth.
+        if (pushed_scope.m_escaped || pushed_scope.m_symbol_table.use_count() > 1) {
+            pushed_scope.m_symbol_table.reset();
+            pushed_scope.m_escaped = false;
+        } else {
+            pushed_scope.m_symbol_table->clear();
+        }
+    }
+
+    // Same as push_scope, but for a function call whose params are about to be defined (in order) in the
+    // new scope.  Because the param scope of a function is known statically, param i is always at slot i,
+    // and references to it can be resolved via func_param_slot.  param_symbol_ids must outlive the scope.
+    // If the function was statically checked, func_facts should be its facts, and must also outlive the scope.
+    [[nodiscard]] lvd::ScopeGuard push_func_scope (std::vector<sept::InternedId> const &param_symbol_ids, typecheck::FuncFacts const *func_facts = nullptr) {
+        push_func_scope_unguarded(param_symbol_ids, func_facts);
+        return lvd::ScopeGuard{[this](){ this->pop_func_scope(); }};
+    }
+
+    // These are the same as push_scope and push_func_scope, except that the caller is responsible for
+    // calling pop_scope (or pop_func_scope).  This is for evaluators that don't nest scopes on the C++
+    // stack (see iter.hpp).
+    void push_scope_unguarded () {
+        push_reused_scope();
+    }
+    void push_func_scope_unguarded (std::vector<sept::InternedId> const &param_symbol_ids, typecheck::FuncFacts const *func_facts = nullptr) {
+        push_reused_scope();
+        m_func_frame_stack.emplace_back(FuncFrame{m_current_scope.get().get(), &param_symbol_ids, func_facts});
+    }
+    void pop_func_scope () {
+        if (m_func_frame_stack.empty())
+            throw std::runtime_error("there is no pushed function scope to pop");
+        m_func_frame_stack.pop_back();
+        pop_scope();
+    }
+
+    // Marks the given scope, if it's a pushed scope, as having escaped even if nothing holds it when it's
+    // popped, e.g. because something refers to it via a std::weak_ptr.  See push_reused_scope.
+    void mark_scope_escaped (sept::SymbolTable const *scope) {
+        for (size_t i = 0; i < m_pushed_scope_count; ++i)
+            if (m_pushed_scopes[i].m_symbol_table.get() == scope)
+                m_pushed_scopes[i].m_escaped = true;
+    }
+
+    // If symbol_id refers to a param of the innermost function call (and isn't shadowed by a definition
+    // in an intervening block scope), this returns its (depth, slot) relative to current_scope().
+    std::optional<sept::SymbolSlot> func_param_slot (sept::InternedId symbol_id) const {
+        if (m_func_frame_stack.empty())
+            return std::nullopt;
+
+        auto const &func_frame = m_func_frame_stack.back();
+        size_t depth = 0;
+        sept::SymbolTable const *scope = m_current_scope.get().get();
+        for ( ; scope != func_frame.m_param_scope; scope = scope->parent_symbol_table().get().get(), ++depth) {
+            // Check for shadowing.
+            if (scope->local_slot(symbol_id).has_value())
+                return std::nullopt;
+        }
+        auto const &param_symbol_ids = *func_frame.m_param_symbol_ids;
+        for (size_t slot = 0; slot < param_symbol_ids.size(); ++slot)
+            if (param_symbol_ids[slot] == symbol_id)
+                return sept::SymbolSlot{depth, slot};
+        return std::nullopt;
+    }
+
+    // Returns the facts given to push_func_scope for the innermost function call, or nullptr if there
+    // are none (or there's no function call).
+    typecheck::FuncFacts const *current_func_facts () const {
+        return m_func_frame_stack.empty() ? nullptr : m_func_frame_stack.back().m_func_facts;
+    }
+
+    // If set, evaluation trusts the facts proved by this CheckedProgram (see typecheck.hpp), and skips
+    // the dynamic checks that they make redundant.  Set it to nullptr to check everything dynamically.
+    lvd::sp<typecheck::CheckedProgram const> const &checked_program () const { return m_checked_program; }
+    void set_checked_program (lvd::sp<typecheck::CheckedProgram const> checked_program) {
+        m_checked_program = std::move(checked_program);
+    }
+
+    // If set, calls to the functions that it considers pure are memoized (see memo.hpp).  Set it to
+    // nullptr to turn memoization off.
+    lvd::sp<memo::Memoizer> const &memoizer () const { return m_memoizer; }
+    void set_memoizer (lvd::sp<memo::Memoizer> memoizer) {
+        m_memoizer = std::move(memoizer);
     }
 
+    // If set, independent subexpressions that are expensive enough are evaluated in parallel using this
+    // TaskPool (see par.hpp).  Set it to nullptr to evaluate everything sequentially.
+    lvd::sp<par::TaskPool> const &task_pool () const { return m_task_pool; }
+    void set_task_pool (lvd::sp<par::TaskPool> task_pool) {
+        m_task_pool = std::move(task_pool);
+    }
+
+    // Returns an EvalCtx for evaluating a subexpression on another thread while this one isn't used (see
+    // par.hpp).  It has the same current scope, checked_program, and task_pool, but no pushed scopes, no
+    // memoizer (Memoizer isn't thread-safe), and an empty func_closure_map, since find_func_closure falls
+    // back (read-only) to the func_closure_map of the EvalCtx it was split from, which must outlive it.
+    EvalCtx split () const {
+        EvalCtx task_ctx;
+        task_ctx.m_current_scope = m_current_scope;
+        task_ctx.m_checked_program = m_checked_program;
+        task_ctx.m_task_pool = m_task_pool;
+        task_ctx.m_split_from = this;
+        return task_ctx;
+    }
+    // The EvalCtx that this one was split from, or nullptr if it wasn't.
+    EvalCtx const *split_from () const { return m_split_from; }
+
+    // The FuncClosures created by bind_func_closure (see sem.hpp), keyed by the address of the Data that
+    // each was created from.  The Data is stored in a SymbolTable, so its address is stable.
+    using FuncClosureMap = std::unordered_map<sept::Data const *,lvd::nnsp<FuncClosure const>>;
+    FuncClosureMap const &func_closure_map () const { return m_func_closure_map; }
+    FuncClosureMap &func_closure_map () { return m_func_closure_map; }
+
 private:
 
+    // Popped SymbolTables are kept (one per depth) so that pushing another scope at the same depth
+    // reuses the SymbolTable (along with its allocated storage) instead of allocating a new one.  A
+    // SymbolTable that escaped (see pop_scope) is replaced by a new one instead.  Each scope is still a
+    // whole SymbolTable, whose symbols are looked up by symbol id, and popping it destroys its values.
+    // Defining a symbol in a reused scope doesn't allocate as long as it stays within
+    // SymbolTable::SMALL_SLOT_COUNT slots.
+    void push_reused_scope () {
+        if (m_pushed_scope_count == m_pushed_scopes.size())
+            m_pushed_scopes.emplace_back(PushedScope{nullptr, false});
+        auto &pushed_scope = m_pushed_scopes[m_pushed_scope_count];
+        if (pushed_scope.m_symbol_table == nullptr)
+            pushed_scope.m_symbol_table = std::make_shared<sept::SymbolTable>(m_current_scope.get());
+        else
+            pushed_scope.m_symbol_table->reset(m_current_scope.get());
+        ++m_pushed_scope_count;
+        m_current_scope = pushed_scope.m_symbol_table;
+    }
+
+    struct PushedScope {
+        // This is null iff nothing has been pushed at this depth yet, or its last SymbolTable escaped.
+        lvd::sp<sept::SymbolTable> m_symbol_table;
+        bool m_escaped;
+    };
+
+    struct FuncFrame {
+        sept::SymbolTable const *m_param_scope;
+        std::vector<sept::InternedId> const *m_param_symbol_ids;
+        typecheck::FuncFacts const *m_func_facts;
+    };
+
     lvd::nnsp<sept::SymbolTable> m_current_scope;
+    // Only the first m_pushed_scope_count of these are currently pushed; the rest are kept for reuse.
+    std::vector<PushedScope> m_pushed_scopes;
+    size_t m_pushed_scope_count = 0;
+    std::vector<FuncFrame> m_func_frame_stack;
+    lvd::sp<typecheck::CheckedProgram const> m_checked_program;
+    lvd::sp<memo::Memoizer> m_memoizer;
+    lvd::sp<par::TaskPool> m_task_pool;
+    EvalCtx const *m_split_from = nullptr;
+    FuncClosureMap m_func_closure_map;
 };
 
 } // end namespace sem
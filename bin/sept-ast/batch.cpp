@@ -0,0 +1,314 @@
+// 2021.05.27 - Victor Dods
+
+#include "batch.hpp"
+
+// Includes from this program's source
+#include "common.hpp"
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include "sept/ArrayTerm.hpp"
+#include "sept/TupleTerm.hpp"
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace batch {
+
+namespace {
+
+// Intermediate columns have either one value per row, or a single value which applies to all rows.
+
+template <typename Out_, typename In_, typename Op_>
+std::vector<Out_> map_unary (std::vector<In_> const &operand, Op_ op) {
+    std::vector<Out_> out(operand.size());
+    auto *o = out.data();
+    auto const *x = operand.data();
+    for (size_t i = 0, n = operand.size(); i < n; ++i)
+        o[i] = op(x[i]);
+    return out;
+}
+
+// The loops are separate for each combination of broadcasting, so that each is a simple loop.
+template <typename Out_, typename In_, typename Op_>
+std::vector<Out_> map_binary (std::vector<In_> const &lhs, std::vector<In_> const &rhs, Op_ op) {
+    if (lhs.size() == 1 && rhs.size() == 1)
+        return std::vector<Out_>{op(lhs[0], rhs[0])};
+    std::vector<Out_> out(std::max(lhs.size(), rhs.size()));
+    auto *o = out.data();
+    auto const *l = lhs.data();
+    auto const *r = rhs.data();
+    auto n = out.size();
+    if (lhs.size() == 1) {
+        auto l0 = l[0];
+        for (size_t i = 0; i < n; ++i)
+            o[i] = op(l0, r[i]);
+    } else if (rhs.size() == 1) {
+        auto r0 = r[0];
+        for (size_t i = 0; i < n; ++i)
+            o[i] = op(l[i], r0);
+    } else {
+        assert(lhs.size() == rhs.size());
+        for (size_t i = 0; i < n; ++i)
+            o[i] = op(l[i], r[i]);
+    }
+    return out;
+}
+
+template <typename T_>
+std::vector<T_> select (BoolColumn const &condition, std::vector<T_> const &positive, std::vector<T_> const &negative) {
+    std::vector<T_> out(condition.size());
+    auto *o = out.data();
+    auto const *c = condition.data();
+    auto const *a = positive.data();
+    auto const *b = negative.data();
+    auto n = out.size();
+    // Broadcast branches are rare enough that they're simply handled by stride.
+    size_t a_stride = positive.size() == 1 ? 0 : 1;
+    size_t b_stride = negative.size() == 1 ? 0 : 1;
+    if (a_stride == 1 && b_stride == 1) {
+        for (size_t i = 0; i < n; ++i)
+            o[i] = c[i] ? a[i] : b[i];
+    } else {
+        for (size_t i = 0; i < n; ++i)
+            o[i] = c[i] ? a[i*a_stride] : b[i*b_stride];
+    }
+    return out;
+}
+
+char const *column_type_name (Column const &column) {
+    return std::holds_alternative<FloatColumn>(column) ? "Float64" : "Bool";
+}
+
+size_t column_size (Column const &column) {
+    return std::visit([](auto const &c){ return c.size(); }, column);
+}
+
+// Returns the column for a single Float64 or Bool value, or std::nullopt if it's neither.
+std::optional<Column> scalar_column (sept::Data const &value) {
+    if (value.type() == typeid(double))
+        return Column{FloatColumn{value.cast<double>()}};
+    else if (value.type() == typeid(bool))
+        return Column{BoolColumn{uint8_t(value.cast<bool>())}};
+    else
+        return std::nullopt;
+}
+
+class BatchEvaluator {
+public:
+
+    BatchEvaluator (Bindings const &bindings, size_t row_count, sem::EvalCtx &ctx)
+        :   m_bindings(bindings)
+        ,   m_row_count(row_count)
+        ,   m_ctx(ctx)
+    { }
+
+    // If mask is not null, then only the rows where it's 1 are needed, and the rest of the returned
+    // column is unspecified.
+    Column evaluate (sept::Data const &expr, BoolColumn const *mask) noexcept(false);
+
+private:
+
+    Column evaluate_symbol (std::string const &symbol_id);
+    Column evaluate_bin_op (sept::TupleTerm_c const &t, BoolColumn const *mask);
+    Column evaluate_un_op (sept::TupleTerm_c const &t, BoolColumn const *mask);
+    Column evaluate_cond (sept::TupleTerm_c const &t, BoolColumn const *mask);
+    Column evaluate_rowwise (sept::Data const &expr, BoolColumn const *mask);
+
+    Bindings const &m_bindings;
+    size_t m_row_count;
+    sem::EvalCtx &m_ctx;
+};
+
+Column BatchEvaluator::evaluate (sept::Data const &expr, BoolColumn const *mask) noexcept(false) {
+    auto const &e = expr.deref();
+    if (e.type() == typeid(std::string))
+        return evaluate_symbol(e.cast<std::string const &>());
+    if (e.type() == typeid(sept::TupleTerm_c)) {
+        auto const &t = e.cast<sept::TupleTerm_c const &>();
+        switch (syn::classify_expr_shallowly(t).value_or(syn::ExprKind::VALUE_TERMINAL)) {
+            case syn::ExprKind::BIN_OP_EXPR: return evaluate_bin_op(t, mask);
+            case syn::ExprKind::UN_OP_EXPR: return evaluate_un_op(t, mask);
+            case syn::ExprKind::COND_EXPR: return evaluate_cond(t, mask);
+            // This includes RoundExpr, which the tree-walker evaluates to an Array, even if it has one element.
+            default: return evaluate_rowwise(e, mask);
+        }
+    }
+    if (auto column = scalar_column(e); column.has_value())
+        return std::move(*column);
+    throw std::runtime_error(LVD_FMT("evaluate_batch only supports Float64 and Bool values, but got " << e));
+}
+
+Column BatchEvaluator::evaluate_symbol (std::string const &symbol_id) {
+    auto it = m_bindings.find(sept::intern(symbol_id));
+    if (it != m_bindings.end())
+        return it->second;
+    // Otherwise it's the same value for every row.
+    auto const &value = syn::evaluate_expr__as_SymbolId(symbol_id, m_ctx).deref();
+    if (auto column = scalar_column(value); column.has_value())
+        return std::move(*column);
+    throw std::runtime_error(LVD_FMT("evaluate_batch only supports Float64 and Bool values, but symbol " << symbol_id << " is " << value));
+}
+
+Column BatchEvaluator::evaluate_bin_op (sept::TupleTerm_c const &t, BoolColumn const *mask) {
+    auto bin_op = t[1].cast<ASTNPTerm>();
+    auto lhs = evaluate(t[0], mask);
+    auto rhs = evaluate(t[2], mask);
+    switch (bin_op) {
+        case ASTNPTerm::AND:
+        case ASTNPTerm::OR:
+        case ASTNPTerm::XOR: {
+            if (!std::holds_alternative<BoolColumn>(lhs) || !std::holds_alternative<BoolColumn>(rhs))
+                throw std::runtime_error(LVD_FMT("BinOp " << t[1] << " expects Bool operands, but got " << column_type_name(lhs) << " and " << column_type_name(rhs)));
+            auto const &l = std::get<BoolColumn>(lhs);
+            auto const &r = std::get<BoolColumn>(rhs);
+            switch (bin_op) {
+                case ASTNPTerm::AND: return map_binary<uint8_t>(l, r, [](uint8_t a, uint8_t b) -> uint8_t { return a & b; });
+                case ASTNPTerm::OR:  return map_binary<uint8_t>(l, r, [](uint8_t a, uint8_t b) -> uint8_t { return a | b; });
+                default:             return map_binary<uint8_t>(l, r, [](uint8_t a, uint8_t b) -> uint8_t { return a ^ b; });
+            }
+        }
+        case ASTNPTerm::ADD:
+        case ASTNPTerm::SUB:
+        case ASTNPTerm::MUL:
+        case ASTNPTerm::DIV:
+        case ASTNPTerm::POW: {
+            if (!std::holds_alternative<FloatColumn>(lhs) || !std::holds_alternative<FloatColumn>(rhs))
+                throw std::runtime_error(LVD_FMT("BinOp " << t[1] << " expects Float64 operands, but got " << column_type_name(lhs) << " and " << column_type_name(rhs)));
+            auto const &l = std::get<FloatColumn>(lhs);
+            auto const &r = std::get<FloatColumn>(rhs);
+            switch (bin_op) {
+                case ASTNPTerm::ADD: return map_binary<double>(l, r, [](double a, double b){ return a + b; });
+                case ASTNPTerm::SUB: return map_binary<double>(l, r, [](double a, double b){ return a - b; });
+                case ASTNPTerm::MUL: return map_binary<double>(l, r, [](double a, double b){ return a * b; });
+                case ASTNPTerm::DIV: return map_binary<double>(l, r, [](double a, double b){ return a / b; });
+                default:             return map_binary<double>(l, r, [](double a, double b){ return std::pow(a, b); });
+            }
+        }
+        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as a BinOp: " << uint32_t(bin_op)));
+    }
+}
+
+Column BatchEvaluator::evaluate_un_op (sept::TupleTerm_c const &t, BoolColumn const *mask) {
+    auto un_op = t[0].cast<ASTNPTerm>();
+    auto operand = evaluate(t[1], mask);
+    switch (un_op) {
+        case ASTNPTerm::NOT:
+            if (!std::holds_alternative<BoolColumn>(operand))
+                throw std::runtime_error(LVD_FMT("UnOp " << t[0] << " expects a Bool operand, but got " << column_type_name(operand)));
+            return map_unary<uint8_t>(std::get<BoolColumn>(operand), [](uint8_t a) -> uint8_t { return a ^ 1; });
+        case ASTNPTerm::NEG:
+            if (!std::holds_alternative<FloatColumn>(operand))
+                throw std::runtime_error(LVD_FMT("UnOp " << t[0] << " expects a Float64 operand, but got " << column_type_name(operand)));
+            return map_unary<double>(std::get<FloatColumn>(operand), [](double a){ return -a; });
+        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as an UnOp: " << uint32_t(un_op)));
+    }
+}
+
+Column BatchEvaluator::evaluate_cond (sept::TupleTerm_c const &t, BoolColumn const *mask) {
+    // t[0], t[2], t[4] are If, Then, Else respectively.
+    auto condition_column = evaluate(t[1], mask);
+    if (!std::holds_alternative<BoolColumn>(condition_column))
+        throw std::runtime_error(LVD_FMT("CondExpr expects a Bool condition, but got " << column_type_name(condition_column)));
+    auto const &condition = std::get<BoolColumn>(condition_column);
+    if (condition.size() == 1)
+        return evaluate(condition[0] ? t[3] : t[5], mask);
+
+    // Each branch only has to be evaluated for the (needed) rows that take it.
+    BoolColumn positive_mask(m_row_count);
+    BoolColumn negative_mask(m_row_count);
+    size_t positive_count = 0;
+    size_t negative_count = 0;
+    for (size_t i = 0; i < m_row_count; ++i) {
+        uint8_t is_needed = mask != nullptr ? (*mask)[i] : 1;
+        positive_mask[i] = is_needed & condition[i];
+        negative_mask[i] = is_needed & (condition[i] ^ 1);
+        positive_count += positive_mask[i];
+        negative_count += negative_mask[i];
+    }
+    if (negative_count == 0)
+        return evaluate(t[3], mask);
+    if (positive_count == 0)
+        return evaluate(t[5], mask);
+
+    auto positive = evaluate(t[3], &positive_mask);
+    auto negative = evaluate(t[5], &negative_mask);
+    if (positive.index() != negative.index())
+        throw std::runtime_error(LVD_FMT("evaluate_batch requires both branches of a CondExpr to have the same type, but got " << column_type_name(positive) << " and " << column_type_name(negative)));
+    if (std::holds_alternative<FloatColumn>(positive))
+        return select(condition, std::get<FloatColumn>(positive), std::get<FloatColumn>(negative));
+    else
+        return select(condition, std::get<BoolColumn>(positive), std::get<BoolColumn>(negative));
+}
+
+Column BatchEvaluator::evaluate_rowwise (sept::Data const &expr, BoolColumn const *mask) {
+    // Define the bound symbols once, and then just assign them for each row.
+    auto scope_guard = m_ctx.push_scope();
+    auto const &scope = m_ctx.current_scope();
+    std::vector<std::pair<size_t,Column const *>> bound_slots;
+    bound_slots.reserve(m_bindings.size());
+    for (auto const &[symbol_id, column] : m_bindings)
+        bound_slots.emplace_back(scope->define_symbol(symbol_id, sept::Data{false}), &column);
+
+    std::optional<Column> out;
+    for (size_t i = 0; i < m_row_count; ++i) {
+        if (mask != nullptr && (*mask)[i] == 0)
+            continue;
+        for (auto const &[slot, column] : bound_slots) {
+            if (std::holds_alternative<FloatColumn>(*column))
+                scope->slot_value(slot) = std::get<FloatColumn>(*column)[i];
+            else
+                scope->slot_value(slot) = bool(std::get<BoolColumn>(*column)[i]);
+        }
+        auto value = sept::Data{sem::evaluate_expr_data(expr, m_ctx).deref()};
+        auto value_column = scalar_column(value);
+        if (!value_column.has_value())
+            throw std::runtime_error(LVD_FMT("evaluate_batch only supports Float64 and Bool values, but got " << value << " from " << expr));
+        // The type is determined by the first row that's evaluated.
+        if (!out.has_value()) {
+            if (std::holds_alternative<FloatColumn>(*value_column))
+                out = Column{FloatColumn(m_row_count)};
+            else
+                out = Column{BoolColumn(m_row_count)};
+        }
+        if (value_column->index() != out->index())
+            throw std::runtime_error(LVD_FMT("evaluate_batch requires each subexpression to have the same type in every row, but " << expr << " is " << column_type_name(*out) << " and " << column_type_name(*value_column)));
+        if (std::holds_alternative<FloatColumn>(*out))
+            std::get<FloatColumn>(*out)[i] = std::get<FloatColumn>(*value_column)[0];
+        else
+            std::get<BoolColumn>(*out)[i] = std::get<BoolColumn>(*value_column)[0];
+    }
+    // The mask always has at least one row, since a branch that no rows take isn't evaluated.
+    assert(out.has_value());
+    return std::move(*out);
+}
+
+} // end namespace
+
+Column evaluate_batch (sept::Data const &expr, Bindings const &bindings, sem::EvalCtx &ctx) noexcept(false) {
+    size_t row_count = 1;
+    if (!bindings.empty()) {
+        row_count = column_size(bindings.begin()->second);
+        for (auto const &[symbol_id, column] : bindings)
+            if (column_size(column) != row_count)
+                throw std::runtime_error(LVD_FMT("evaluate_batch requires bound columns to have the same size, but " << symbol_id << " has size " << column_size(column) << " instead of " << row_count));
+    }
+    if (row_count == 0)
+        return FloatColumn{};
+
+    auto out = BatchEvaluator(bindings, row_count, ctx).evaluate(expr, nullptr);
+    // Broadcast a value that doesn't depend on the row.
+    if (column_size(out) != row_count) {
+        assert(column_size(out) == 1);
+        if (std::holds_alternative<FloatColumn>(out))
+            out = FloatColumn(row_count, std::get<FloatColumn>(out)[0]);
+        else
+            out = BoolColumn(row_count, std::get<BoolColumn>(out)[0]);
+    }
+    return out;
+}
+
+} // end namespace batch
@@ -0,0 +1,38 @@
+// 2021.05.27 - Victor Dods
+
+#pragma once
+
+// Includes from this program's source
+#include "EvalCtx.hpp"
+
+#include <cstdint>
+#include "sept/Data.hpp"
+#include "sept/Interner.hpp"
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Batch evaluation of an Expr over many bindings of some of its symbols, e.g. sweeping x over a grid.
+// Instead of walking the Expr once per binding, each node is evaluated once over a whole column of
+// values, using tight loops over contiguous arrays (which the compiler can vectorize).  A CondExpr
+// evaluates each branch only for the rows that take it (using a mask), and only if any row does, and
+// then blends the results.
+//
+// BinOpExpr, UnOpExpr, CondExpr, Float64 and Bool literals, and symbols are evaluated column-wise.  Symbols that aren't bound to a column are resolved in ctx, and must be Float64
+// or Bool.  Any other subexpression (e.g. a FuncEval) is evaluated by the tree-walker for each row, with
+// the bound symbols defined in a scope pushed onto ctx, so the values are the same as evaluating the
+// whole Expr for each row, as long as each subexpression has the same type (Float64 or Bool) in every row.
+namespace batch {
+
+using FloatColumn = std::vector<double>;
+// Each element is 0 or 1.  This is uint8_t instead of bool so that it's contiguous and can be vectorized.
+using BoolColumn = std::vector<uint8_t>;
+using Column = std::variant<FloatColumn,BoolColumn>;
+using Bindings = std::unordered_map<sept::InternedId,Column>;
+
+// The bound columns must all have the same size, which is the size of the returned column (or 1 if there
+// are no bindings).  Throws if a value isn't Float64 or Bool, or if an operator is applied to the wrong
+// type, as the tree-walker would.
+Column evaluate_batch (sept::Data const &expr, Bindings const &bindings, sem::EvalCtx &ctx) noexcept(false);
+
+} // end namespace batch
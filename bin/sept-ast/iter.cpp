@@ -0,0 +1,466 @@
+// 2021.05.27 - Victor Dods
+
+#include "iter.hpp"
+
+// Includes from this program's source
+#include "common.hpp"
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include <memory>
+#include <optional>
+#include "sept/ArrayTerm.hpp"
+#include "sept/DataVector.hpp"
+#include "sept/TupleTerm.hpp"
+#include <string>
+#include <typeindex>
+#include <variant>
+#include <vector>
+
+namespace iter {
+
+namespace {
+
+//
+// Continuations, i.e. what to do with the value of the expression currently being evaluated.  The
+// expressions they refer to are in the expression being evaluated, or in the body of a function whose
+// FuncCall is held further down the stack, so they outlive the continuations.
+//
+
+// The lhs of m_t (a BinOpExpr) is being evaluated.
+struct BinOpLhs {
+    sept::TupleTerm_c const *m_t;
+};
+// The rhs of m_t is being evaluated.
+struct BinOpRhs {
+    sept::TupleTerm_c const *m_t;
+    sept::Data m_evaled_lhs;
+};
+// The operand of m_t (a UnOpExpr) is being evaluated.
+struct UnOpOperand {
+    sept::TupleTerm_c const *m_t;
+};
+// The condition of m_t (a CondExpr) is being evaluated.
+struct CondCondition {
+    sept::TupleTerm_c const *m_t;
+};
+// The defn (or value) of statement m_stmt_index of m_t (a BlockExpr) is being evaluated, in the block's scope.
+struct BlockStmt {
+    sept::TupleTerm_c const *m_t;
+    size_t m_stmt_index;
+};
+// The final expression of a BlockExpr is being evaluated, after which the block's scope is popped.
+struct BlockEnd { };
+// Element m_evaled_elements.size() of m_expr_array is being evaluated.
+struct ExprArrayElement {
+    sept::ArrayTerm_c const *m_expr_array;
+    sept::DataVector m_evaled_elements;
+};
+// The type to construct of m_t (a Construction) is being evaluated.
+struct ConstructionType {
+    sept::TupleTerm_c const *m_t;
+};
+// The params of a Construction are being evaluated.
+struct ConstructionParams {
+    sept::Data m_evaled_type_to_construct;
+};
+// The container of m_t (an ElementEval) is being evaluated.
+struct ElementEvalContainer {
+    sept::TupleTerm_c const *m_t;
+};
+// The params of an ElementEval are being evaluated.
+struct ElementEvalParams {
+    sept::Data m_evaled_container;
+};
+// The args of a FuncEval are being evaluated.
+struct FuncEvalArgs {
+    std::unique_ptr<sem::FuncCall> m_func_call;
+};
+// The body of a function is being evaluated, in the function's scope.
+struct FuncBody {
+    std::unique_ptr<sem::FuncCall> m_func_call;
+};
+// A function made a tail call, so the value of that call has to be checked against its return type.
+struct ReturnCheck {
+    sept::Data m_return_type;
+    sept::Data m_codomain;
+};
+
+using Continuation = std::variant<
+    BinOpLhs,
+    BinOpRhs,
+    UnOpOperand,
+    CondCondition,
+    BlockStmt,
+    BlockEnd,
+    ExprArrayElement,
+    ConstructionType,
+    ConstructionParams,
+    ElementEvalContainer,
+    ElementEvalParams,
+    FuncEvalArgs,
+    FuncBody,
+    ReturnCheck
+>;
+
+// Returns the ExprArray of a RoundExpr, SquareExpr, or CurlyExpr, each of which is (open, ExprArray, close).
+sept::ArrayTerm_c const &expr_array_of (sept::Data const &bracketed) {
+    return bracketed.cast<sept::TupleTerm_c const &>()[1].cast<sept::ArrayTerm_c const &>();
+}
+
+// Returns true iff lhs and rhs are certainly the same type, i.e. if checking a value against both is redundant.
+bool are_same_types (sept::Data const &lhs, sept::Data const &rhs) {
+    if (lhs.is_ref() != rhs.is_ref())
+        return false;
+    if (!lhs.is_ref()) {
+        if (lhs.type() != rhs.type())
+            return false;
+        auto const &data_operator_eq_predicate_map = lvd::static_association_singleton<sept::_Data_Eq>();
+        if (data_operator_eq_predicate_map.find(std::type_index(lhs.type())) == data_operator_eq_predicate_map.end())
+            return false;
+    }
+    return sept::eq_data(lhs, rhs);
+}
+
+class Machine {
+public:
+
+    Machine (sem::EvalCtx &ctx, EvalStats *stats)
+        :   m_ctx(ctx)
+        ,   m_stats(stats)
+    { }
+    // If evaluation threw, this pops the scopes that it had pushed.
+    ~Machine ();
+
+    sept::Data run (sept::Data const &expr) noexcept(false);
+
+private:
+
+    // Each of these either sets m_value, or sets m_next_expr (typically after pushing a continuation for it).
+    void evaluate (sept::Data const &expr);
+    void evaluate_tuple (sept::TupleTerm_c const &t);
+    void begin_expr_array (sept::ArrayTerm_c const &expr_array);
+    void continue_block (sept::TupleTerm_c const &t, size_t stmt_index);
+    void call (std::unique_ptr<sem::FuncCall> &&func_call, sept::ArrayTerm_c &&evaled_args);
+    void resume (BinOpLhs &&c, sept::Data &&value);
+    void resume (BinOpRhs &&c, sept::Data &&value);
+    void resume (UnOpOperand &&c, sept::Data &&value);
+    void resume (CondCondition &&c, sept::Data &&value);
+    void resume (BlockStmt &&c, sept::Data &&value);
+    void resume (BlockEnd &&c, sept::Data &&value);
+    void resume (ExprArrayElement &&c, sept::Data &&value);
+    void resume (ConstructionType &&c, sept::Data &&value);
+    void resume (ConstructionParams &&c, sept::Data &&value);
+    void resume (ElementEvalContainer &&c, sept::Data &&value);
+    void resume (ElementEvalParams &&c, sept::Data &&value);
+    void resume (FuncEvalArgs &&c, sept::Data &&value);
+    void resume (FuncBody &&c, sept::Data &&value);
+    void resume (ReturnCheck &&c, sept::Data &&value);
+
+    // Executes stmt (which is in the current scope's block), whose defn (or value) is given.
+    void execute_stmt (sept::TupleTerm_c const &stmt, sept::Data &&value, bool is_func_literal);
+
+    void push_scope () {
+        m_ctx.push_scope_unguarded();
+        m_pushed_scope_is_func_stack.push_back(false);
+    }
+    void pop_scope () {
+        m_pushed_scope_is_func_stack.pop_back();
+        m_ctx.pop_scope();
+    }
+    // Call this after sem::enter_func_call pushes a function scope.
+    void note_func_scope_pushed () {
+        m_pushed_scope_is_func_stack.push_back(true);
+    }
+    void pop_func_scope () {
+        m_pushed_scope_is_func_stack.pop_back();
+        m_ctx.pop_func_scope();
+    }
+
+    sem::EvalCtx &m_ctx;
+    EvalStats *m_stats;
+    std::vector<Continuation> m_continuation_stack;
+    // For each scope pushed by this Machine that's still pushed, whether it's a function scope.
+    std::vector<bool> m_pushed_scope_is_func_stack;
+    sept::Data const *m_next_expr = nullptr;
+    std::optional<sept::Data> m_value;
+};
+
+Machine::~Machine () {
+    while (!m_pushed_scope_is_func_stack.empty()) {
+        if (m_pushed_scope_is_func_stack.back())
+            pop_func_scope();
+        else
+            pop_scope();
+    }
+}
+
+sept::Data Machine::run (sept::Data const &expr) noexcept(false) {
+    m_next_expr = &expr;
+    while (true) {
+        if (m_next_expr != nullptr) {
+            auto const &next_expr = *m_next_expr;
+            m_next_expr = nullptr;
+            evaluate(next_expr);
+        } else {
+            assert(m_value.has_value());
+            auto value = std::move(*m_value);
+            m_value.reset();
+            if (m_continuation_stack.empty())
+                return value;
+            auto continuation = std::move(m_continuation_stack.back());
+            m_continuation_stack.pop_back();
+            std::visit([this, &value](auto &&c){ this->resume(std::move(c), std::move(value)); }, std::move(continuation));
+        }
+        if (m_stats != nullptr && m_continuation_stack.size() > m_stats->m_max_continuation_count)
+            m_stats->m_max_continuation_count = m_continuation_stack.size();
+    }
+}
+
+void Machine::evaluate (sept::Data const &expr) {
+    // This dispatches the same way as the EvaluateExpr registrations for the tree-walker.
+    auto const &e = expr.deref();
+    if (e.type() == typeid(sept::TupleTerm_c))
+        evaluate_tuple(e.cast<sept::TupleTerm_c const &>());
+    else if (e.type() == typeid(sept::ArrayTerm_c))
+        begin_expr_array(e.cast<sept::ArrayTerm_c const &>());
+    else if (e.type() == typeid(std::string))
+        m_value = syn::evaluate_expr__as_SymbolId(e.cast<std::string const &>(), m_ctx);
+    else
+        m_value = sem::evaluate_expr_data(e, m_ctx);
+}
+
+void Machine::evaluate_tuple (sept::TupleTerm_c const &t) {
+    auto expr_kind = syn::classify_expr_shallowly(t);
+    if (!expr_kind.has_value())
+        LVD_ABORT(LVD_FMT("attempting to evaluate_expr for a non-Expr: " << t));
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:
+            m_continuation_stack.emplace_back(BinOpLhs{&t});
+            m_next_expr = &t[0];
+            break;
+        case syn::ExprKind::BLOCK_EXPR:
+            push_scope();
+            continue_block(t, 0);
+            break;
+        case syn::ExprKind::COND_EXPR:
+            // t[0], t[2], t[4] are If, Then, Else respectively.
+            m_continuation_stack.emplace_back(CondCondition{&t});
+            m_next_expr = &t[1];
+            break;
+        case syn::ExprKind::CONSTRUCTION:
+            m_continuation_stack.emplace_back(ConstructionType{&t});
+            m_next_expr = &t[0];
+            break;
+        case syn::ExprKind::ELEMENT_EVAL:
+            m_continuation_stack.emplace_back(ElementEvalContainer{&t});
+            m_next_expr = &t[0];
+            break;
+        case syn::ExprKind::FUNC_EVAL: {
+            auto func_symbol_id = sept::intern(t[0].cast<std::string const &>());
+            m_continuation_stack.emplace_back(FuncEvalArgs{std::make_unique<sem::FuncCall>(sem::begin_func_call(func_symbol_id, m_ctx))});
+            begin_expr_array(expr_array_of(t[1]));
+            break;
+        }
+        case syn::ExprKind::ROUND_EXPR:
+            begin_expr_array(expr_array_of(t));
+            break;
+        case syn::ExprKind::UN_OP_EXPR:
+            m_continuation_stack.emplace_back(UnOpOperand{&t});
+            m_next_expr = &t[1];
+            break;
+        default:
+            LVD_ABORT(LVD_FMT("unhandled Expr: " << t));
+    }
+}
+
+void Machine::begin_expr_array (sept::ArrayTerm_c const &expr_array) {
+    if (expr_array.size() == 0) {
+        m_value = sept::ArrayTerm_c{};
+        return;
+    }
+    sept::DataVector evaled_elements;
+    evaled_elements.reserve(expr_array.size());
+    m_continuation_stack.emplace_back(ExprArrayElement{&expr_array, std::move(evaled_elements)});
+    m_next_expr = &expr_array[0];
+}
+
+void Machine::continue_block (sept::TupleTerm_c const &t, size_t stmt_index) {
+    auto const &stmt_array = t[0].cast<sept::ArrayTerm_c const &>();
+    for ( ; stmt_index < stmt_array.size(); ++stmt_index) {
+        auto const &stmt = stmt_array[stmt_index].cast<sept::TupleTerm_c const &>();
+        // Each kind of Stmt is (SymbolId, op, Expr).  A FuncLiteral is a function value, so it's not evaluated.
+        auto const &defn = stmt[2];
+        if (syn::is_func_literal_shallowly(defn)) {
+            execute_stmt(stmt, sept::Data{defn}, true);
+        } else {
+            m_continuation_stack.emplace_back(BlockStmt{&t, stmt_index});
+            m_next_expr = &defn;
+            return;
+        }
+    }
+    // Evaluate the final expression, which is what renders the value of the BlockExpr
+    m_continuation_stack.emplace_back(BlockEnd{});
+    m_next_expr = &t[1];
+}
+
+void Machine::call (std::unique_ptr<sem::FuncCall> &&func_call, sept::ArrayTerm_c &&evaled_args) {
+    // This is a tail call if the continuations above the calling function's body are all ends of blocks,
+    // and the function's Data would survive popping the scopes of those blocks and of the calling function.
+    size_t block_end_count = 0;
+    while (block_end_count < m_continuation_stack.size() && std::holds_alternative<BlockEnd>(m_continuation_stack[m_continuation_stack.size()-1-block_end_count]))
+        ++block_end_count;
+    bool is_tail_call = block_end_count < m_continuation_stack.size() && std::holds_alternative<FuncBody>(m_continuation_stack[m_continuation_stack.size()-1-block_end_count]);
+    if (is_tail_call) {
+        // The calling function's scope is at depth block_end_count.
+        auto symbol_slot = m_ctx.current_scope()->locate_symbol(func_call->m_func_symbol_id);
+        is_tail_call = symbol_slot.has_value() && symbol_slot->m_depth > block_end_count;
+    }
+
+    if (is_tail_call) {
+        // The args could refer to the scopes about to be popped.
+        for (auto &evaled_arg : evaled_args.elements())
+            evaled_arg = sept::Data{evaled_arg.deref()};
+        for (size_t i = 0; i < block_end_count; ++i) {
+            m_continuation_stack.pop_back();
+            pop_scope();
+        }
+        auto caller = std::move(std::get<FuncBody>(m_continuation_stack.back()).m_func_call);
+        m_continuation_stack.pop_back();
+        pop_func_scope();
+        // The value of this call is what the caller returns, so it still has to be checked against the
+        // caller's return type, unless that same check is already pending (e.g. for a self-recursive call).
+        if (!caller->return_type_is_proved()) {
+            auto const &return_type = caller->return_type();
+            bool is_redundant =
+                !m_continuation_stack.empty() &&
+                std::holds_alternative<ReturnCheck>(m_continuation_stack.back()) &&
+                are_same_types(std::get<ReturnCheck>(m_continuation_stack.back()).m_return_type, return_type);
+            if (!is_redundant)
+                m_continuation_stack.emplace_back(ReturnCheck{return_type, caller->func_literal().m_prototype.m_codomain});
+        }
+        if (m_stats != nullptr)
+            ++m_stats->m_tail_call_count;
+    }
+
+    auto memoized_value = sem::enter_func_call(*func_call, std::move(evaled_args), m_ctx);
+    if (memoized_value.has_value()) {
+        m_value = std::move(*memoized_value);
+        return;
+    }
+    note_func_scope_pushed();
+    // Evaluate the function body using the new scope.  The FuncCall is held by the continuation, so the
+    // body outlives its evaluation.
+    auto const &body_expr = func_call->func_literal().m_body_expr;
+    m_continuation_stack.emplace_back(FuncBody{std::move(func_call)});
+    m_next_expr = &body_expr;
+}
+
+void Machine::resume (BinOpLhs &&c, sept::Data &&value) {
+    m_continuation_stack.emplace_back(BinOpRhs{c.m_t, std::move(value)});
+    m_next_expr = &(*c.m_t)[2];
+}
+
+void Machine::resume (BinOpRhs &&c, sept::Data &&value) {
+    m_value = sem::apply_bin_op((*c.m_t)[1].cast<ASTNPTerm>(), c.m_evaled_lhs, value);
+}
+
+void Machine::resume (UnOpOperand &&c, sept::Data &&value) {
+    m_value = sem::apply_un_op((*c.m_t)[0].cast<ASTNPTerm>(), value);
+}
+
+void Machine::resume (CondCondition &&c, sept::Data &&value) {
+    // The chosen branch is in the same position as the CondExpr, so this doesn't push a continuation.
+    m_next_expr = value.cast<bool>() ? &(*c.m_t)[3] : &(*c.m_t)[5];
+}
+
+void Machine::resume (BlockStmt &&c, sept::Data &&value) {
+    auto const &stmt = (*c.m_t)[0].cast<sept::ArrayTerm_c const &>()[c.m_stmt_index].cast<sept::TupleTerm_c const &>();
+    execute_stmt(stmt, std::move(value), false);
+    continue_block(*c.m_t, c.m_stmt_index+1);
+}
+
+void Machine::resume (BlockEnd &&c, sept::Data &&value) {
+    pop_scope();
+    m_value = std::move(value);
+}
+
+void Machine::resume (ExprArrayElement &&c, sept::Data &&value) {
+    c.m_evaled_elements.emplace_back(std::move(value));
+    auto element_index = c.m_evaled_elements.size();
+    if (element_index < c.m_expr_array->size()) {
+        m_next_expr = &(*c.m_expr_array)[element_index];
+        m_continuation_stack.emplace_back(std::move(c));
+    } else {
+        m_value = sept::ArrayTerm_c{std::move(c.m_evaled_elements)};
+    }
+}
+
+void Machine::resume (ConstructionType &&c, sept::Data &&value) {
+    m_continuation_stack.emplace_back(ConstructionParams{std::move(value)});
+    begin_expr_array(expr_array_of((*c.m_t)[1]));
+}
+
+void Machine::resume (ConstructionParams &&c, sept::Data &&value) {
+    m_value = sem::apply_construction(c.m_evaled_type_to_construct, value.cast<sept::ArrayTerm_c const &>());
+}
+
+void Machine::resume (ElementEvalContainer &&c, sept::Data &&value) {
+    m_continuation_stack.emplace_back(ElementEvalParams{std::move(value)});
+    begin_expr_array(expr_array_of((*c.m_t)[1]));
+}
+
+void Machine::resume (ElementEvalParams &&c, sept::Data &&value) {
+    m_value = sem::apply_element_eval(c.m_evaled_container, value.cast<sept::ArrayTerm_c const &>());
+}
+
+void Machine::resume (FuncEvalArgs &&c, sept::Data &&value) {
+    call(std::move(c.m_func_call), std::move(value.cast<sept::ArrayTerm_c &>()));
+}
+
+void Machine::resume (FuncBody &&c, sept::Data &&value) {
+    // Have to deref the data (before popping the scope), since this might be a reference.
+    auto retval = sept::Data{value.deref()};
+    pop_func_scope();
+    sem::finish_func_call(*c.m_func_call, retval);
+    m_value = std::move(retval);
+}
+
+void Machine::resume (ReturnCheck &&c, sept::Data &&value) {
+    sem::check_return_value(value, c.m_return_type, c.m_codomain);
+    m_value = std::move(value);
+}
+
+void Machine::execute_stmt (sept::TupleTerm_c const &stmt, sept::Data &&value, bool is_func_literal) {
+    auto stmt_kind = syn::classify_stmt_shallowly(stmt);
+    if (!stmt_kind.has_value())
+        LVD_ABORT(LVD_FMT("attempting to execute_stmt for a non-Stmt: " << stmt));
+    auto symbol_id = sept::intern(stmt[0].cast<std::string const &>());
+    // This is the same as syn::execute_stmt__as_SymbolDefn and syn::execute_stmt__as_Assignment.
+    sept::Data *bound_value;
+    switch (*stmt_kind) {
+        case syn::StmtKind::SYMBOL_DEFN: {
+            auto const &scope = m_ctx.current_scope();
+            auto slot = scope->define_symbol(symbol_id, std::move(value));
+            bound_value = &scope->slot_value(slot);
+            break;
+        }
+        case syn::StmtKind::ASSIGNMENT:
+            bound_value = &(m_ctx.current_scope()->resolve_symbol_nonconst(symbol_id) = std::move(value));
+            break;
+        default:
+            LVD_ABORT(LVD_FMT("unhandled Stmt: " << stmt));
+    }
+    if (is_func_literal)
+        sem::bind_func_closure(symbol_id, *bound_value, m_ctx);
+    else
+        sem::unbind_func_closure(*bound_value, m_ctx);
+}
+
+} // end namespace
+
+sept::Data evaluate_expr_data (sept::Data const &expr, sem::EvalCtx &ctx, EvalStats *stats) noexcept(false) {
+    return Machine(ctx, stats).run(expr);
+}
+
+} // end namespace iter
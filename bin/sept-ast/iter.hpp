@@ -0,0 +1,45 @@
+// 2021.05.27 - Victor Dods
+
+#pragma once
+
+// Includes from this program's source
+#include "EvalCtx.hpp"
+
+#include <cstddef>
+#include "sept/Data.hpp"
+
+// An evaluator for syntactic Exprs which doesn't recurse on the C++ stack.  The tree-walking evaluator
+// (evaluate_expr_data) uses C++ stack frames for each level of nesting of the expression being evaluated,
+// and for each function call, so it can overflow the stack on deeply nested expressions (e.g. long chains
+// of BinOpExpr, which are easy to generate) or deep recursion.  This evaluator instead keeps a stack of
+// continuations on the heap, so its depth is limited only by memory, and its C++ stack use is bounded.
+//
+// A FuncEval in tail position in a function body (i.e. whose value is only passed through the ends of
+// blocks and then returned) is a proper tail call: the caller's scope is popped before the callee's is
+// pushed, so e.g. a self-recursive function that only calls itself in tail position runs in constant space.
+//
+// This is meant to produce the same values as the tree-walker, which remains the reference implementation,
+// with the following differences:
+// - Each node is classified by syn::classify_expr_shallowly (and classify_stmt_shallowly) instead of by
+//   checking that it's a well-formed Expr, which would itself recurse through the whole subtree.  So an
+//   ill-formed Expr causes an error when (and if) the ill-formed part is evaluated, which could be a
+//   different error than the tree-walker's.
+// - In a tail call, the args are dereferenced before the caller's scope is popped, and the callee's scope
+//   is a child of the caller's caller's scope.  So the callee can't see the locals of its caller (which
+//   the tree-walker's dynamic scoping allows), and if the function symbol is one of those locals, the call
+//   isn't made a tail call.  The caller's return value is still checked, though consecutive identical
+//   checks are merged, and if the caller was being memoized, its value isn't.
+// - Param types and codomains are evaluated by the tree-walker (they're not expected to be deep), as are
+//   any values that aren't a TupleTerm_c, ArrayTerm_c, or SymbolId (none of which recurse).
+namespace iter {
+
+// Measurements of a call to evaluate_expr_data, e.g. for checking that tail calls don't grow the stack.
+struct EvalStats {
+    size_t m_max_continuation_count = 0;
+    size_t m_tail_call_count = 0;
+};
+
+// If stats is not null, then it's filled in.
+sept::Data evaluate_expr_data (sept::Data const &expr, sem::EvalCtx &ctx, EvalStats *stats = nullptr) noexcept(false);
+
+} // end namespace iter
@@ -1,10 +1,22 @@
 // 2021.03.27 - Victor Dods
 
 // Includes from this program's source
+#include "batch.hpp"
+#include "iter.hpp"
+#include "memo.hpp"
+#include "opt.hpp"
+#include "par.hpp"
 #include "sem.hpp"
 #include "syn.hpp"
+#include "typecheck.hpp"
+#include "vm.hpp"
 
+#include <chrono>
 #include <cmath>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 /*
 AST design notes
@@ -80,68 +92,41 @@ AST design notes
     -   Make sem terms be geared toward efficiency and have them be reasonable C++ patterns.
 */
 
-//
-// sept data model registrations
-//
-
-namespace sept {
-SEPT__REGISTER__PRINT(ASTNPTerm)
-SEPT__REGISTER__PRINT(BinOp_c)
-SEPT__REGISTER__PRINT__GIVE_ID(sem::Expr_Term_c, __sem__Expr_Term_c__)
-SEPT__REGISTER__PRINT(SymbolId_c)
-SEPT__REGISTER__PRINT(UnOp_c)
-SEPT__REGISTER__PRINT__GIVE_ID(char const *, __char_const_ptr__)
-
-SEPT__REGISTER__EQ(BinOp_c)
-SEPT__REGISTER__EQ(UnOp_c)
-SEPT__REGISTER__EQ(ASTNPTerm)
-SEPT__REGISTER__EQ(SymbolId_c)
-
-SEPT__REGISTER__ABSTRACT_TYPE_OF(BinOp_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(UnOp_c)
-
-SEPT__REGISTER__INHABITS__NONDATA(ASTNPTerm, BinOp_c)
-SEPT__REGISTER__INHABITS__NONDATA(ASTNPTerm,     UnOp_c)
-SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(ASTNPTerm,     FormalTypeOf_Term_c, __ASTNPTerm___sem__FormalTypeOf_Term_c__)
-SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(std::string,   SymbolId_c, __std_string___SymbolId_c__)
-SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(char const *,  SymbolId_c, __char_const_ptr___SymbolId_c__)
-// TODO there are probably some missing
-
-SEPT__REGISTER__COMPARE__SINGLETON(BinOp_c)
-SEPT__REGISTER__COMPARE__SINGLETON(UnOp_c)
-SEPT__REGISTER__COMPARE(ASTNPTerm, ASTNPTerm)
-
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(BinOp_c, ASTNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnOp_c, ASTNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(FormalTypeOf_Term_c, ASTNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__GIVE_ID__ABSTRACT_TYPE(SymbolId_c, std::string, __SymbolId_c___std_string__)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__GIVE_ID__ABSTRACT_TYPE(SymbolId_c, char const *, __SymbolId_c___char_const_ptr__)
-
-// TEMP HACK
-SEPT__REGISTER__INHABITS__NONDATA(ASTNPTerm, UnionTerm_c)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnionTerm_c, ASTNPTerm)
-} // end namespace sept
-
-namespace sem {
-
-SEPT__REGISTER__EVALUATE_EXPR(bool)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::True_c, __sept__True_c__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::False_c, __sept__False_c__)
-SEPT__REGISTER__EVALUATE_EXPR(double)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(std::string, __std_string__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::TupleTerm_c, __sept__TupleTerm_c__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::Array_c, __sept__Array_c__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArrayESTerm_c, __sept__ArrayESTerm_c__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArrayETerm_c, __sept__ArrayETerm_c__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArraySTerm_c, __sept__ArraySTerm_c__)
-SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArrayTerm_c, __sept__ArrayTerm_c__)
-SEPT__REGISTER__EVALUATE_EXPR(ValueTerminal_Term_c)
-SEPT__REGISTER__EVALUATE_EXPR(ExprArray_Term_c)
-SEPT__REGISTER__EVALUATE_EXPR(Expr_Term_c)
-
-SEPT__REGISTER__EXECUTE_STMT__GIVE_ID(sept::TupleTerm_c, __sept__TupleTerm_c__)
-
-} // end namespace sem
+namespace {
+
+// One of the evaluations compared by log_timings.  m_unit_count is how many units of work (e.g. rows) one
+// call to m_evaluate does, so that evaluations that do different amounts of it can be compared.
+struct TimedEvaluation {
+    std::string m_label;
+    std::function<void()> m_evaluate;
+    size_t m_unit_count = 1;
+};
+
+// Calls each evaluation run_count times, and logs the time it took per unit, and how many times faster
+// than the first evaluation that is.  Logging below ERR is silenced while timing, since the tree-walker
+// logs a warning for each unregistered type it evaluates (e.g. param types).
+void log_timings (std::string const &unit_name, size_t run_count, std::vector<TimedEvaluation> const &evaluations) {
+    std::vector<double> seconds_per_unit;
+    auto log_level_threshold = lvd::g_log.log_level_threshold();
+    lvd::g_log.set_log_level_threshold(lvd::LogLevel::ERR);
+    for (auto const &evaluation : evaluations) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < run_count; ++i)
+            evaluation.m_evaluate();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        seconds_per_unit.push_back(seconds / double(run_count*evaluation.m_unit_count));
+    }
+    lvd::g_log.set_log_level_threshold(log_level_threshold);
+
+    for (size_t i = 0; i < evaluations.size(); ++i) {
+        lvd::g_log << lvd::Log::dbg() << lvd::IndentGuard() << evaluations[i].m_label << ": " << 1.0e6*seconds_per_unit[i] << " us per " << unit_name;
+        if (i > 0)
+            lvd::g_log << " (" << seconds_per_unit[0]/seconds_per_unit[i] << "x faster)";
+        lvd::g_log << '\n';
+    }
+}
+
+} // end namespace
 
 int main (int argc, char **argv) {
 //     lvd::g_log.set_log_level_threshold(lvd::LogLevel::DBG);
@@ -274,42 +259,40 @@ int main (int argc, char **argv) {
         ctx
     ) << '\n';
 
-    lvd::g_log << lvd::Log::dbg() << evaluate_expr(
+    auto sin_taylor_expr = syn::BinOpExpr(
         syn::BinOpExpr(
             syn::BinOpExpr(
                 syn::BinOpExpr(
+                    x,
+                    Sub,
                     syn::BinOpExpr(
-                        x,
-                        Sub,
-                        syn::BinOpExpr(
-                            syn::BinOpExpr(x, Pow, 3.0),
-                            Div,
-                            three_factorial
-                        )
-                    ),
-                    Add,
-                    syn::BinOpExpr(
-                        syn::BinOpExpr(x, Pow, 5.0),
+                        syn::BinOpExpr(x, Pow, 3.0),
                         Div,
-                        five_factorial
+                        three_factorial
                     )
                 ),
-                Sub,
+                Add,
                 syn::BinOpExpr(
-                    syn::BinOpExpr(x, Pow, 7.0),
+                    syn::BinOpExpr(x, Pow, 5.0),
                     Div,
-                    seven_factorial
+                    five_factorial
                 )
             ),
-            Add,
+            Sub,
             syn::BinOpExpr(
-                syn::BinOpExpr(x, Pow, 9.0),
+                syn::BinOpExpr(x, Pow, 7.0),
                 Div,
-                nine_factorial
+                seven_factorial
             )
         ),
-        ctx
-    ) << '\n';
+        Add,
+        syn::BinOpExpr(
+            syn::BinOpExpr(x, Pow, 9.0),
+            Div,
+            nine_factorial
+        )
+    );
+    lvd::g_log << lvd::Log::dbg() << evaluate_expr(sin_taylor_expr, ctx) << '\n';
     lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(std::sin(x)) << '\n';
 
     auto stuff = sept::Data{sept::Array(sept::True, sept::False, sept::Uint32(456))};
@@ -713,5 +696,520 @@ int main (int argc, char **argv) {
                << LVD_REFLECT(sem::evaluate_Expr_Term(sem::BinOpExpr_Term_c{123.4, Add, 456.7}, ctx)) << '\n'
                << '\n';
 
+    //
+    // Bytecode VM -- each expression is compiled once and then run repeatedly.  test-septast checks that
+    // its values agree with the tree-walking evaluator, which is the reference implementation.
+    //
+
+    auto time_vm_against_reference = [&ctx](char const *name, sept::Data const &expr, size_t run_count) {
+        auto program = vm::compile_expr(expr);
+        lvd::g_log << lvd::Log::dbg() << name << " = " << program.run(ctx) << '\n';
+        log_timings("evaluation", run_count, {
+            {"reference", [&](){ evaluate_expr_data(expr, ctx); }},
+            {"vm", [&](){ program.run(ctx); }},
+        });
+    };
+
+    time_vm_against_reference("sin_taylor_expr", sin_taylor_expr, 1000);
+    time_vm_against_reference(
+        "exp(0.1)",
+        syn::FuncEval(SymbolId("exp"), syn::RoundExpr(RoundOpen, syn::ExprArray(0.1), RoundClose)),
+        1000
+    );
+    time_vm_against_reference(
+        "Complex_mul(Complex{(3, 4)}, Complex{(1, -2)})",
+        syn::FuncEval(
+            SymbolId("Complex_mul"),
+            syn::RoundExpr(
+                RoundOpen,
+                syn::ExprArray(
+                    syn::Construction(SymbolId("Complex"), syn::CurlyExpr(CurlyOpen, syn::ExprArray(sept::Array(3.0, 4.0)), CurlyClose)),
+                    syn::Construction(SymbolId("Complex"), syn::CurlyExpr(CurlyOpen, syn::ExprArray(sept::Array(1.0, -2.0)), CurlyClose))
+                ),
+                RoundClose
+            )
+        ),
+        1000
+    );
+    time_vm_against_reference(
+        "if true xor false then square(3) else -1",
+        syn::CondExpr(
+            If, syn::BinOpExpr(true, Xor, false),
+            Then, syn::FuncEval(SymbolId("square"), syn::RoundExpr(RoundOpen, syn::ExprArray(3.0), RoundClose)),
+            Else, syn::UnOpExpr(Neg, 1.0)
+        ),
+        1000
+    );
+    // The block-local ostrich shadows the global one, whose value is unchanged.
+    auto shadowing_block_expr = syn::BlockExpr(
+        syn::StmtArray(
+            syn::SymbolDefn(SymbolId("ostrich"), DefinedAs, syn::BinOpExpr(SymbolId("ostrich"), Add, 1.0)),
+            syn::Assignment(SymbolId("ostrich"), AssignFrom, syn::BinOpExpr(SymbolId("ostrich"), Mul, 2.0))
+        ),
+        SymbolId("ostrich")
+    );
+    time_vm_against_reference("shadowing_block_expr", shadowing_block_expr, 1000);
+    lvd::g_log << lvd::Log::dbg()
+               << vm::compile_expr(shadowing_block_expr).main_function()
+               << LVD_REFLECT(ctx.current_scope()->resolve_symbol_const(SymbolId("ostrich"))) << '\n'
+               << '\n';
+
+    // Top-level SymbolDefns define symbols in the scope the program runs in.
+    vm::compile_stmt_array(
+        syn::StmtArray(
+            syn::SymbolDefn(SymbolId("square_of_four"), DefinedAs, syn::FuncEval(SymbolId("square"), syn::RoundExpr(RoundOpen, syn::ExprArray(4.0), RoundClose)))
+        )
+    ).run(ctx);
+    lvd::g_log << lvd::Log::dbg()
+               << LVD_REFLECT(ctx.current_scope()->resolve_symbol_const(SymbolId("square_of_four"))) << '\n'
+               << '\n';
+
+    //
+    // Static type checking -- the functions defined so far are checked once, and evaluation then trusts
+    // what was proved, skipping the corresponding dynamic checks.  test-septast checks that this doesn't
+    // change any values, and which checks are skipped.
+    //
+
+    ctx.current_scope()->define_symbol(
+        SymbolId("Complex_cube"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(
+                    syn::SymbolTypeDecl(SymbolId("z"), DeclaredAs, SymbolId("Complex"))
+                ),
+                MapsTo,
+                SymbolId("Complex")
+            ),
+            syn::FuncEval(
+                SymbolId("Complex_mul"),
+                syn::RoundExpr(
+                    RoundOpen,
+                    syn::ExprArray(
+                        SymbolId("z"),
+                        syn::FuncEval(SymbolId("Complex_square"), syn::RoundExpr(RoundOpen, syn::ExprArray(SymbolId("z")), RoundClose))
+                    ),
+                    RoundClose
+                )
+            )
+        )
+    );
+    auto checked_program = typecheck::check_program(ctx.current_scope());
+    for (auto const *func_name : {"square", "exp", "Complex_square", "Complex_mul", "Complex_cube"})
+        lvd::g_log << lvd::Log::dbg() << *checked_program->func_facts(ctx.current_scope()->resolve_symbol_const(SymbolId(func_name))) << '\n';
+
+    auto time_trusted_against_dynamic = [&ctx, &checked_program](char const *name, sept::Data const &expr, size_t run_count) {
+        auto counts_before = sem::call_check_counts();
+        auto value = sept::Data{evaluate_expr_data(expr, ctx).deref()};
+        auto dynamic_counts = sem::call_check_counts() - counts_before;
+        ctx.set_checked_program(checked_program);
+        counts_before = sem::call_check_counts();
+        evaluate_expr_data(expr, ctx);
+        auto trusted_counts = sem::call_check_counts() - counts_before;
+        ctx.set_checked_program(nullptr);
+        lvd::g_log << lvd::Log::dbg() << name << " = " << value << '\n' << lvd::IndentGuard()
+                   << LVD_REFLECT(dynamic_counts) << '\n'
+                   << LVD_REFLECT(trusted_counts) << '\n';
+        log_timings("evaluation", run_count, {
+            {"dynamic", [&](){ evaluate_expr_data(expr, ctx); }},
+            {"trusted", [&](){ ctx.set_checked_program(checked_program); evaluate_expr_data(expr, ctx); ctx.set_checked_program(nullptr); }},
+        });
+    };
+
+    time_trusted_against_dynamic("exp(0.1)", syn::FuncEval(SymbolId("exp"), syn::RoundExpr(RoundOpen, syn::ExprArray(0.1), RoundClose)), 1000);
+    time_trusted_against_dynamic(
+        "Complex_cube(Complex{(3, 4)})",
+        syn::FuncEval(
+            SymbolId("Complex_cube"),
+            syn::RoundExpr(
+                RoundOpen,
+                syn::ExprArray(syn::Construction(SymbolId("Complex"), syn::CurlyExpr(CurlyOpen, syn::ExprArray(sept::Array(3.0, 4.0)), CurlyClose))),
+                RoundClose
+            )
+        ),
+        1000
+    );
+    lvd::g_log << lvd::Log::dbg() << '\n';
+
+    //
+    // Function closures -- a FuncLiteral that's bound by a SymbolDefn gets a closure, so calls through
+    // that symbol don't re-parse it or re-evaluate its prototype.  The same FuncLiterals defined directly
+    // in the SymbolTable have no closures, which is what the timing is compared against.  test-septast
+    // checks that calls through closures have the same values.
+    //
+
+    auto make_square_literal = [](){
+        return syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(
+                    syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)
+                ),
+                MapsTo,
+                sept::Float64
+            ),
+            syn::BinOpExpr(SymbolId("x"), Mul, SymbolId("x"))
+        );
+    };
+    auto make_quartic_literal = [](char const *square_name){
+        return syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(
+                    syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)
+                ),
+                MapsTo,
+                sept::Float64
+            ),
+            syn::FuncEval(
+                SymbolId(square_name),
+                syn::RoundExpr(
+                    RoundOpen,
+                    syn::ExprArray(syn::FuncEval(SymbolId(square_name), syn::RoundExpr(RoundOpen, syn::ExprArray(SymbolId("x")), RoundClose))),
+                    RoundClose
+                )
+            )
+        );
+    };
+    ctx.current_scope()->define_symbol(SymbolId("quartic_direct"), make_quartic_literal("square"));
+    execute_stmt_data(syn::SymbolDefn(SymbolId("square_bound"), DefinedAs, make_square_literal()), ctx);
+    execute_stmt_data(syn::SymbolDefn(SymbolId("quartic_bound"), DefinedAs, make_quartic_literal("square_bound")), ctx);
+    for (auto const *func_name : {"square", "quartic_direct", "square_bound", "quartic_bound"}) {
+        auto func_closure = sem::find_func_closure(ctx.current_scope()->resolve_symbol_const(SymbolId(func_name)), ctx);
+        lvd::g_log << lvd::Log::dbg() << func_name << " has closure: " << (func_closure != nullptr) << '\n';
+    }
+
+    {
+        auto quartic_direct_expr = syn::FuncEval(SymbolId("quartic_direct"), syn::RoundExpr(RoundOpen, syn::ExprArray(1.5), RoundClose));
+        auto quartic_bound_expr = syn::FuncEval(SymbolId("quartic_bound"), syn::RoundExpr(RoundOpen, syn::ExprArray(1.5), RoundClose));
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(evaluate_expr_data(quartic_bound_expr, ctx)) << '\n';
+        log_timings("evaluation", 1000, {
+            {"quartic_direct(1.5)", [&](){ evaluate_expr_data(quartic_direct_expr, ctx); }},
+            {"quartic_bound(1.5)", [&](){ evaluate_expr_data(quartic_bound_expr, ctx); }},
+        });
+    }
+
+    // Rebinding square_bound replaces its closure, which quartic_bound then calls.
+    execute_stmt_data(
+        syn::Assignment(
+            SymbolId("square_bound"),
+            AssignFrom,
+            syn::FuncLiteral(
+                syn::FuncPrototype(
+                    syn::SymbolTypeDeclArray(
+                        syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)
+                    ),
+                    MapsTo,
+                    sept::Float64
+                ),
+                syn::BinOpExpr(SymbolId("x"), Add, SymbolId("x"))
+            )
+        ),
+        ctx
+    );
+    lvd::g_log << lvd::Log::dbg()
+               << LVD_REFLECT(evaluate_expr_data(syn::FuncEval(SymbolId("quartic_bound"), syn::RoundExpr(RoundOpen, syn::ExprArray(1.5), RoundClose)), ctx)) << '\n'
+               << '\n';
+
+    // Popped scopes are reused by later scopes at the same depth, unless they escaped.  Here the value of
+    // the first block is a LocalSymRef into its scope, so that scope must survive the second block (which
+    // test-septast checks).
+    {
+        auto make_block = [](double y){
+            return syn::BlockExpr(
+                syn::StmtArray(
+                    syn::SymbolDefn(SymbolId("y"), DefinedAs, y)
+                ),
+                SymbolId("y")
+            );
+        };
+        auto escaped_ref = evaluate_expr_data(make_block(3.0), ctx);
+        auto other_value = sept::Data{evaluate_expr_data(make_block(4.0), ctx).deref()};
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(escaped_ref.deref()) << '\n' << LVD_REFLECT(other_value) << '\n';
+    }
+
+    //
+    // Memoization -- calls to pure functions are looked up in a bounded LRU cache.  test-septast checks
+    // that this doesn't change any values, and the inference and eviction.
+    //
+
+    {
+        auto memoizer = lvd::make_nnsp<memo::Memoizer>(64);
+        auto pure_func_count = memo::infer_pure_funcs(*memoizer, ctx.current_scope());
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(pure_func_count) << '\n';
+        for (auto const *func_name : {"square", "exp", "Complex_square", "Complex_cube", "quartic_direct", "quartic_bound"})
+            lvd::g_log << lvd::Log::dbg() << func_name << " is pure: " << memoizer->is_pure(ctx.current_scope()->resolve_symbol_const(SymbolId(func_name))) << '\n';
+        // Complex_square refers to the global symbol Complex, so it isn't inferred to be pure, but it can be
+        // marked as pure explicitly.
+        memoizer->set_is_pure(ctx.current_scope()->resolve_symbol_const(SymbolId("Complex_square")), true);
+
+        auto expr = syn::FuncEval(SymbolId("exp"), syn::RoundExpr(RoundOpen, syn::ExprArray(0.1), RoundClose));
+        auto value = sept::Data{evaluate_expr_data(expr, ctx).deref()};
+        lvd::g_log << lvd::Log::dbg() << "exp(0.1) = " << value << '\n';
+        log_timings("evaluation", 1000, {
+            {"unmemoized", [&](){ evaluate_expr_data(expr, ctx); }},
+            {"memoized", [&](){ ctx.set_memoizer(memoizer); evaluate_expr_data(expr, ctx); ctx.set_memoizer(nullptr); }},
+        });
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(memoizer->hit_count()) << ", " << LVD_REFLECT(memoizer->miss_count()) << '\n';
+
+        // The cache is bounded, so calling with more distinct args than its capacity evicts the least
+        // recently used values.
+        auto log_level_threshold = lvd::g_log.log_level_threshold();
+        ctx.set_memoizer(memoizer);
+        lvd::g_log.set_log_level_threshold(lvd::LogLevel::ERR);
+        for (size_t i = 0; i < 2*memoizer->capacity(); ++i)
+            evaluate_expr_data(syn::FuncEval(SymbolId("square"), syn::RoundExpr(RoundOpen, syn::ExprArray(double(i)), RoundClose)), ctx);
+        lvd::g_log.set_log_level_threshold(log_level_threshold);
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(memoizer->size()) << ", " << LVD_REFLECT(memoizer->capacity()) << '\n'
+                   << LVD_REFLECT(memoizer->hit_count()) << ", " << LVD_REFLECT(memoizer->miss_count()) << '\n'
+                   << '\n';
+        ctx.set_memoizer(nullptr);
+    }
+
+    //
+    // Constant folding and common-subexpression elimination.  test-septast checks that these don't change
+    // the value of any expression, on randomly generated ones.
+    //
+
+    {
+        auto folded_sin_taylor_expr = opt::fold_constants(sin_taylor_expr);
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(folded_sin_taylor_expr) << '\n';
+
+        ctx.current_scope()->define_symbol(SymbolId("opt_x"), 1.25);
+        ctx.current_scope()->define_symbol(SymbolId("opt_y"), -0.5);
+        ctx.current_scope()->define_symbol(SymbolId("opt_flag"), true);
+
+        // A common subexpression, and a constant one.
+        auto x_times_y_plus_one = syn::BinOpExpr(syn::BinOpExpr(SymbolId("opt_x"), Mul, SymbolId("opt_y")), Add, 1.0);
+        auto expr = syn::BinOpExpr(
+            syn::BinOpExpr(x_times_y_plus_one, Mul, x_times_y_plus_one),
+            Sub,
+            syn::BinOpExpr(x_times_y_plus_one, Div, syn::BinOpExpr(2.0, Pow, 3.0))
+        );
+        auto optimized_expr = opt::optimize_expr(expr);
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(optimized_expr) << '\n';
+        auto value = sept::Data{evaluate_expr_data(optimized_expr, ctx).deref()};
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(value) << '\n';
+        log_timings("evaluation", 1000, {
+            {"unoptimized", [&](){ evaluate_expr_data(expr, ctx); }},
+            {"optimized", [&](){ evaluate_expr_data(optimized_expr, ctx); }},
+        });
+        lvd::g_log << lvd::Log::dbg() << '\n';
+    }
+
+
+    //
+    // Non-recursive evaluation -- iter::evaluate_expr_data keeps its continuations on the heap, so its C++
+    // stack use doesn't depend on how deeply the expression is nested, and tail calls don't accumulate
+    // scopes.  test-septast checks that its values agree with the tree-walking evaluator, which is the
+    // reference.
+    //
+
+    {
+        // A left-associated chain of additions, i.e. ((1 + 1) + 1) + ... + 1, which is built directly, since
+        // the syn constructors check the whole subexpression.  The tree-walker checks every subexpression of
+        // it too, so its cost is quadratic in the depth, even where the C++ stack is deep enough.
+        auto make_add_chain = [](size_t depth) {
+            auto expr = sept::Data{1.0};
+            for (size_t i = 0; i < depth; ++i)
+                expr = sept::TupleTerm_c{sept::DataVector{std::move(expr), Add, 1.0}};
+            return expr;
+        };
+        {
+            auto shallow_chain = make_add_chain(200);
+            lvd::g_log << lvd::Log::dbg() << "chain of 200 additions = " << iter::evaluate_expr_data(shallow_chain, ctx).deref() << '\n';
+            log_timings("evaluation", 1, {
+                {"recursive", [&](){ evaluate_expr_data(shallow_chain, ctx); }},
+                {"non-recursive", [&](){ iter::evaluate_expr_data(shallow_chain, ctx); }},
+            });
+        }
+        {
+            size_t const depth = 10000;
+            auto deep_chain = make_add_chain(depth);
+            iter::EvalStats stats;
+            auto value = sept::Data{iter::evaluate_expr_data(deep_chain, ctx, &stats).deref()};
+            lvd::g_log << lvd::Log::dbg() << "chain of " << depth << " additions = " << value << '\n' << lvd::IndentGuard()
+                       << LVD_REFLECT(stats.m_max_continuation_count) << '\n';
+        }
+
+        // A k-bit counter which counts from all-false to all-true by calling itself in tail position, i.e.
+        //     count_k(b0: Bool, ..., b{k-1}: Bool, n: Float64) -> Float64 :=
+        //         if b0 and ... and b{k-1} then n else count_k(b0 xor true, b1 xor b0, b2 xor (b0 and b1), ..., n + 1)
+        // which makes 2^k - 1 calls.  Bit i carries into bit i+1 iff bits 0 through i are all true.
+        auto define_counter = [&ctx](size_t bit_count) {
+            auto func_name = "count_" + std::to_string(bit_count);
+            std::vector<sept::Data> param_decls;
+            std::vector<sept::Data> next_args;
+            auto carry = sept::Data{true};
+            for (size_t i = 0; i < bit_count; ++i) {
+                auto bit_name = "b" + std::to_string(i);
+                param_decls.emplace_back(syn::SymbolTypeDecl(SymbolId(bit_name), DeclaredAs, sept::Bool));
+                next_args.emplace_back(syn::BinOpExpr(SymbolId(bit_name), Xor, carry));
+                carry = i == 0 ? sept::Data{SymbolId(bit_name)} : sept::Data{syn::BinOpExpr(carry, And, SymbolId(bit_name))};
+            }
+            param_decls.emplace_back(syn::SymbolTypeDecl(SymbolId("n"), DeclaredAs, sept::Float64));
+            next_args.emplace_back(syn::BinOpExpr(SymbolId("n"), Add, 1.0));
+            execute_stmt_data(
+                syn::SymbolDefn(
+                    SymbolId(func_name),
+                    DefinedAs,
+                    syn::FuncLiteral(
+                        syn::FuncPrototype(
+                            sept::ArrayTerm_c(std::move(param_decls)).with_constraint(syn::SymbolTypeDeclArray),
+                            MapsTo,
+                            sept::Float64
+                        ),
+                        syn::CondExpr(
+                            If,
+                            carry,
+                            Then,
+                            SymbolId("n"),
+                            Else,
+                            syn::FuncEval(SymbolId(func_name), syn::RoundExpr(RoundOpen, sept::ArrayTerm_c(std::move(next_args)).with_constraint(syn::ExprArray), RoundClose))
+                        )
+                    )
+                ),
+                ctx
+            );
+            std::vector<sept::Data> initial_args(bit_count, sept::Data{false});
+            initial_args.emplace_back(0.0);
+            return syn::FuncEval(SymbolId(func_name), syn::RoundExpr(RoundOpen, sept::ArrayTerm_c(std::move(initial_args)).with_constraint(syn::ExprArray), RoundClose));
+        };
+        auto log_level_threshold = lvd::g_log.log_level_threshold();
+        for (size_t bit_count : {8, 12}) {
+            auto counter_expr = define_counter(bit_count);
+            iter::EvalStats stats;
+            lvd::g_log.set_log_level_threshold(lvd::LogLevel::ERR);
+            auto value = sept::Data{iter::evaluate_expr_data(counter_expr, ctx, &stats).deref()};
+            lvd::g_log.set_log_level_threshold(log_level_threshold);
+            lvd::g_log << lvd::Log::dbg() << "count_" << bit_count << " = " << value << '\n' << lvd::IndentGuard()
+                       << LVD_REFLECT(stats.m_tail_call_count) << '\n'
+                       << LVD_REFLECT(stats.m_max_continuation_count) << '\n';
+        }
+        lvd::g_log << lvd::Log::dbg() << '\n';
+    }
+
+
+    //
+    // Batch evaluation -- an Expr is evaluated once per node over whole columns of bindings of its
+    // symbols, instead of once per binding.  test-septast checks that the values agree with the
+    // tree-walker, which is timed on a sample of the rows.
+    //
+
+    {
+        size_t const row_count = 100000;
+        batch::Bindings bindings;
+        {
+            batch::FloatColumn xs(row_count);
+            batch::BoolColumn negate_flags(row_count);
+            batch::BoolColumn rare_flags(row_count);
+            for (size_t i = 0; i < row_count; ++i) {
+                xs[i] = -2.0 + 4.0*double(i)/double(row_count-1);
+                negate_flags[i] = i % 3 == 0;
+                rare_flags[i] = i % 1000 == 0;
+            }
+            bindings.emplace(sept::intern("batch_x"), std::move(xs));
+            bindings.emplace(sept::intern("batch_negate"), std::move(negate_flags));
+            bindings.emplace(sept::intern("batch_rare"), std::move(rare_flags));
+        }
+
+        // x - x^3 / 3! + x^5 / 5! - x^7 / 7! + x^9 / 9!, negated where batch_negate is set, plus square(x)
+        // (which is evaluated row-wise) where batch_rare is set.
+        auto taylor_expr = sept::Data{SymbolId("batch_x")};
+        double factorial = 1.0;
+        for (size_t power = 3; power <= 9; power += 2) {
+            factorial *= double(power-1)*double(power);
+            auto term = syn::BinOpExpr(syn::BinOpExpr(SymbolId("batch_x"), Pow, double(power)), Div, factorial);
+            taylor_expr = syn::BinOpExpr(taylor_expr, power % 4 == 3 ? Sub : Add, term);
+        }
+        auto expr = syn::BinOpExpr(
+            syn::CondExpr(If, SymbolId("batch_negate"), Then, syn::UnOpExpr(Neg, taylor_expr), Else, taylor_expr),
+            Add,
+            syn::CondExpr(
+                If,
+                SymbolId("batch_rare"),
+                Then,
+                syn::FuncEval(SymbolId("square"), syn::RoundExpr(RoundOpen, syn::ExprArray(SymbolId("batch_x")), RoundClose)),
+                Else,
+                0.0
+            )
+        );
+
+        // square is evaluated by the tree-walker, which logs a warning for its param type in each such row.
+        auto log_level_threshold = lvd::g_log.log_level_threshold();
+        lvd::g_log.set_log_level_threshold(lvd::LogLevel::ERR);
+        auto column = batch::evaluate_batch(expr, bindings, ctx);
+        lvd::g_log.set_log_level_threshold(log_level_threshold);
+        auto const &values = std::get<batch::FloatColumn>(column);
+        lvd::g_log << lvd::Log::dbg() << "batch evaluation over " << row_count << " rows\n" << lvd::IndentGuard()
+                   << LVD_REFLECT(values[0]) << ", " << LVD_REFLECT(values[row_count/2]) << ", " << LVD_REFLECT(values[row_count-1]) << '\n';
+
+        size_t const row_stride = 97;
+        size_t const sampled_row_count = (row_count + row_stride - 1) / row_stride;
+        auto evaluate_sampled_rows = [&](){
+            for (size_t i = 0; i < row_count; i += row_stride) {
+                auto scope_guard = ctx.push_scope();
+                for (auto const &[symbol_id, bound_column] : bindings) {
+                    if (std::holds_alternative<batch::FloatColumn>(bound_column))
+                        ctx.current_scope()->define_symbol(symbol_id, std::get<batch::FloatColumn>(bound_column)[i]);
+                    else
+                        ctx.current_scope()->define_symbol(symbol_id, bool(std::get<batch::BoolColumn>(bound_column)[i]));
+                }
+                evaluate_expr_data(expr, ctx);
+            }
+        };
+        log_timings("row", 1, {
+            {"row-wise", evaluate_sampled_rows, sampled_row_count},
+            {"batch", [&](){ batch::evaluate_batch(expr, bindings, ctx); }, row_count},
+        });
+        lvd::g_log << lvd::Log::dbg() << '\n';
+    }
+
+
+    //
+    // Task-parallel evaluation -- independent subexpressions that are expensive enough (here, calls to
+    // exp) are evaluated in parallel on a TaskPool, unless any of them has side effects.  test-septast
+    // checks that the values agree with sequential evaluation, and that side effects aren't reordered.
+    // This uses a TaskPool sized to the hardware, with a calibrated min_fork_cost, and is skipped if
+    // there's only one hardware thread.
+    //
+
+    {
+        // exp(0.1) + exp(0.2) + ... + exp(1.6), as a left-leaning chain of BinOpExprs, so each BinOpExpr
+        // forks its lhs (the rest of the chain) and its rhs (one call to exp).
+        auto exp_call = [](double x) {
+            return syn::FuncEval(SymbolId("exp"), syn::RoundExpr(RoundOpen, syn::ExprArray(x), RoundClose));
+        };
+        auto sum_expr = sept::Data{exp_call(0.1)};
+        for (size_t i = 2; i <= 16; ++i)
+            sum_expr = syn::BinOpExpr(sum_expr, Add, exp_call(0.1*double(i)));
+        // The same calls, as the elements of a RoundExpr.
+        std::vector<sept::Data> exp_calls;
+        for (size_t i = 1; i <= 16; ++i)
+            exp_calls.emplace_back(exp_call(0.1*double(i)));
+        auto array_expr = syn::RoundExpr(RoundOpen, sept::ArrayTerm_c(std::move(exp_calls)).with_constraint(syn::ExprArray), RoundClose);
+
+        auto thread_count = par::TaskPool::default_thread_count();
+        if (thread_count > 0) {
+            auto task_pool = std::make_shared<par::TaskPool>(thread_count, 0);
+            auto log_level_threshold = lvd::g_log.log_level_threshold();
+            lvd::g_log.set_log_level_threshold(lvd::LogLevel::ERR);
+            auto calibrated_min_fork_cost = par::calibrate_min_fork_cost(*task_pool, exp_call(0.5), ctx);
+            lvd::g_log.set_log_level_threshold(log_level_threshold);
+            task_pool->set_min_fork_cost(calibrated_min_fork_cost);
+            lvd::g_log << lvd::Log::dbg() << "parallel evaluation on " << thread_count << " worker threads, with " << LVD_REFLECT(calibrated_min_fork_cost) << '\n';
+            auto time_parallel = [&ctx, &task_pool](char const *name, sept::Data const &expr) {
+                lvd::g_log << lvd::Log::dbg() << lvd::IndentGuard() << name << '\n';
+                log_timings("evaluation", 20, {
+                    {"sequential", [&](){ evaluate_expr_data(expr, ctx); }},
+                    {"parallel", [&](){ ctx.set_task_pool(task_pool); evaluate_expr_data(expr, ctx); ctx.set_task_pool(nullptr); }},
+                });
+            };
+            time_parallel("sum", sum_expr);
+            time_parallel("array", array_expr);
+            lvd::g_log << lvd::Log::dbg() << lvd::IndentGuard() << LVD_REFLECT(task_pool->fork_count()) << '\n';
+        } else {
+            lvd::g_log << lvd::Log::dbg() << "parallel evaluation not timed, since there's only one hardware thread\n";
+        }
+        lvd::g_log << lvd::Log::dbg() << '\n';
+    }
+
     return 0;
 }
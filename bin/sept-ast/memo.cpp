@@ -0,0 +1,321 @@
+// 2021.05.27 - Victor Dods
+
+#include "memo.hpp"
+
+// Includes from this program's source
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include <lvd/hash.hpp>
+#include "sept/ArrayTerm.hpp"
+#include "sept/TupleTerm.hpp"
+#include <stdexcept>
+#include <typeindex>
+#include <vector>
+
+namespace memo {
+
+namespace {
+
+bool is_hashable (sept::Data const &data) {
+    auto const &data_hash_function_map = lvd::static_association_singleton<sept::_Data_Hash>();
+    if (data_hash_function_map.find(std::type_index(data.type())) == data_hash_function_map.end())
+        return false;
+    // These are hashed element-wise.
+    if (data.type() == typeid(sept::ArrayTerm_c)) {
+        for (auto const &element : data.cast<sept::ArrayTerm_c const &>().elements())
+            if (!is_hashable(element))
+                return false;
+    } else if (data.type() == typeid(sept::TupleTerm_c)) {
+        for (auto const &element : data.cast<sept::TupleTerm_c const &>().elements())
+            if (!is_hashable(element))
+                return false;
+    }
+    return true;
+}
+
+// The symbols that a function body can refer to, i.e. its params and its block-local symbols.  The
+// innermost block scope is last, and the params are in the first one.
+using Locals = std::vector<std::vector<sept::InternedId>>;
+
+bool is_local (sept::InternedId symbol_id, Locals const &locals) {
+    for (auto const &scope : locals)
+        for (auto local_symbol_id : scope)
+            if (local_symbol_id == symbol_id)
+                return true;
+    return false;
+}
+
+class PurityInferrer {
+public:
+
+    PurityInferrer (lvd::nnsp<sept::SymbolTable> const &scope)
+        :   m_scope(scope)
+    { }
+
+    // Returns the symbols of the functions in m_scope which are inferred to be pure.
+    std::unordered_map<sept::InternedId,sept::Data const *> infer () noexcept(false);
+
+private:
+
+    bool is_pure_expr (sept::Data const &expr, Locals &locals) const noexcept(false);
+    bool is_pure_expr_array (sept::Data const &expr_array, Locals &locals) const noexcept(false);
+    bool is_pure_stmt (sept::Data const &stmt, Locals &locals) const noexcept(false);
+
+    lvd::nnsp<sept::SymbolTable> m_scope;
+    // The functions which haven't (yet) been found to be impure.
+    std::unordered_map<sept::InternedId,sem::FuncLiteral_Term_c> m_candidates;
+};
+
+std::unordered_map<sept::InternedId,sept::Data const *> PurityInferrer::infer () noexcept(false) {
+    m_scope->materialize_image_symbols();
+    for (size_t slot = 0; slot < m_scope->slot_count(); ++slot) {
+        if (m_scope->slot_is_vacant(slot))
+            continue;
+        auto const &func_data = m_scope->slot_value(slot);
+        if (inhabits_data(func_data, syn::FuncLiteral))
+            m_candidates.emplace(m_scope->slot_symbol(slot), sem::parse_FuncLiteral_Term(func_data));
+    }
+
+    // Start by assuming every candidate is pure, and eliminate the ones which call impure functions
+    // until nothing changes, so that recursive functions can be pure.
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (auto it = m_candidates.begin(); it != m_candidates.end(); ) {
+            auto const &func_literal = it->second;
+            Locals locals{func_literal.m_prototype.m_param_symbol_ids};
+            if (is_pure_expr(func_literal.m_body_expr, locals)) {
+                ++it;
+            } else {
+                it = m_candidates.erase(it);
+                changed = true;
+            }
+        }
+    }
+
+    std::unordered_map<sept::InternedId,sept::Data const *> pure_funcs;
+    for (auto const &[symbol_id, func_literal] : m_candidates)
+        pure_funcs.emplace(symbol_id, &m_scope->resolve_symbol_const(symbol_id));
+    return pure_funcs;
+}
+
+bool PurityInferrer::is_pure_expr (sept::Data const &expr, Locals &locals) const noexcept(false) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return false;
+
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return is_pure_expr(t[0], locals) && is_pure_expr(t[2], locals);
+        }
+        case syn::ExprKind::BLOCK_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            locals.emplace_back();
+            bool is_pure = true;
+            for (auto const &stmt : t[0].deref().cast<sept::ArrayTerm_c const &>().elements())
+                is_pure = is_pure && is_pure_stmt(stmt, locals);
+            is_pure = is_pure && is_pure_expr(t[1], locals);
+            locals.pop_back();
+            return is_pure;
+        }
+        case syn::ExprKind::COND_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return is_pure_expr(t[1], locals) && is_pure_expr(t[3], locals) && is_pure_expr(t[5], locals);
+        }
+        case syn::ExprKind::CONSTRUCTION: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            // The type to construct is a TypeExpr.  A symbolic one could refer to a non-local symbol, whose
+            // value could change, and a Tuple one is evaluated, so only a literal type is known to be pure.
+            auto const &type_to_construct = t[0].deref();
+            if (type_to_construct.type() == typeid(std::string)) {
+                if (!is_local(sept::intern(type_to_construct.cast<std::string const &>()), locals))
+                    return false;
+            } else if (type_to_construct.type() == typeid(sept::TupleTerm_c)) {
+                return false;
+            }
+            return is_pure_expr_array(t[1].deref().cast<sept::TupleTerm_c const &>()[1], locals);
+        }
+        case syn::ExprKind::ELEMENT_EVAL: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return is_pure_expr(t[0], locals) && is_pure_expr_array(t[1].deref().cast<sept::TupleTerm_c const &>()[1], locals);
+        }
+        case syn::ExprKind::FUNC_EVAL: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            auto func_symbol_id = sept::intern(t[0].deref().cast<std::string const &>());
+            // A local function isn't known statically.
+            if (is_local(func_symbol_id, locals) || m_candidates.find(func_symbol_id) == m_candidates.end())
+                return false;
+            return is_pure_expr_array(t[1].deref().cast<sept::TupleTerm_c const &>()[1], locals);
+        }
+        case syn::ExprKind::ROUND_EXPR: {
+            return is_pure_expr_array(e.cast<sept::TupleTerm_c const &>()[1], locals);
+        }
+        case syn::ExprKind::UN_OP_EXPR: {
+            return is_pure_expr(e.cast<sept::TupleTerm_c const &>()[1], locals);
+        }
+        case syn::ExprKind::SYMBOL_ID: {
+            return is_local(sept::intern(e.cast<std::string const &>()), locals);
+        }
+        case syn::ExprKind::VALUE_TERMINAL: {
+            // This is evaluated as an ExprArray.
+            if (e.type() == typeid(sept::ArrayTerm_c))
+                return is_pure_expr_array(e, locals);
+            // E.g. a FuncLiteral, which would have to be bound.
+            if (e.type() == typeid(sept::TupleTerm_c))
+                return false;
+            // Anything else evaluates to itself.
+            return true;
+        }
+        default:
+            LVD_ABORT(LVD_FMT("invalid syn::ExprKind: " << uint32_t(*expr_kind)));
+    }
+}
+
+bool PurityInferrer::is_pure_expr_array (sept::Data const &expr_array, Locals &locals) const noexcept(false) {
+    auto const &a = expr_array.deref();
+    if (a.type() != typeid(sept::ArrayTerm_c))
+        return false;
+    for (auto const &element : a.cast<sept::ArrayTerm_c const &>().elements())
+        if (!is_pure_expr(element, locals))
+            return false;
+    return true;
+}
+
+bool PurityInferrer::is_pure_stmt (sept::Data const &stmt, Locals &locals) const noexcept(false) {
+    auto const &s = stmt.deref();
+    if (s.type() != typeid(sept::TupleTerm_c))
+        return false;
+    auto const &t = s.cast<sept::TupleTerm_c const &>();
+    auto stmt_kind = syn::classify_stmt(t);
+    if (!stmt_kind.has_value())
+        return false;
+
+    auto symbol_id = sept::intern(t[0].deref().cast<std::string const &>());
+    if (!is_pure_expr(t[2], locals))
+        return false;
+    switch (*stmt_kind) {
+        case syn::StmtKind::SYMBOL_DEFN:
+            locals.back().emplace_back(symbol_id);
+            return true;
+        case syn::StmtKind::ASSIGNMENT:
+            // Assigning to a non-local symbol is a side effect.
+            return is_local(symbol_id, locals);
+        default:
+            LVD_ABORT(LVD_FMT("invalid syn::StmtKind: " << uint32_t(*stmt_kind)));
+    }
+}
+
+} // end namespace
+
+Memoizer::Memoizer (size_t capacity) noexcept(false)
+    :   m_capacity(capacity)
+{
+    if (m_capacity == 0)
+        throw std::runtime_error("Memoizer capacity must be positive");
+}
+
+void Memoizer::set_is_pure (sept::Data const &func_data, bool is_pure) {
+    if (is_pure) {
+        m_pure_funcs.insert(&func_data);
+        return;
+    }
+
+    if (m_pure_funcs.erase(&func_data) == 0)
+        return;
+    // Forget its cached values, since they may not be valid for whatever is bound next.
+    for (auto entry_it = m_entry_list.begin(); entry_it != m_entry_list.end(); ) {
+        auto next_it = std::next(entry_it);
+        if (entry_it->m_func_data == &func_data)
+            erase_entry(entry_it);
+        entry_it = next_it;
+    }
+}
+
+std::optional<sept::DataVector> Memoizer::key_args (sept::DataVector const &args) {
+    sept::DataVector retval;
+    retval.reserve(args.size());
+    for (auto const &arg : args) {
+        auto const &a = arg.deref();
+        if (!is_hashable(a))
+            return std::nullopt;
+        retval.emplace_back(a);
+    }
+    return retval;
+}
+
+sept::Data const *Memoizer::find (sept::Data const &func_data, sept::DataVector const &args) {
+    auto entry_it = find_entry(func_data, args, call_hash(func_data, args));
+    if (entry_it == m_entry_list.end()) {
+        ++m_miss_count;
+        return nullptr;
+    }
+
+    ++m_hit_count;
+    // Make it the most recently used.
+    m_entry_list.splice(m_entry_list.begin(), m_entry_list, entry_it);
+    return &entry_it->m_value;
+}
+
+void Memoizer::insert (sept::Data const &func_data, sept::DataVector &&args, sept::Data &&value) {
+    auto hash = call_hash(func_data, args);
+    auto entry_it = find_entry(func_data, args, hash);
+    if (entry_it != m_entry_list.end()) {
+        entry_it->m_value = std::move(value);
+        m_entry_list.splice(m_entry_list.begin(), m_entry_list, entry_it);
+        return;
+    }
+
+    if (m_entry_list.size() == m_capacity)
+        erase_entry(std::prev(m_entry_list.end()));
+    m_entry_list.emplace_front(Entry{&func_data, std::move(args), hash, std::move(value)});
+    m_entry_index.emplace(hash, m_entry_list.begin());
+}
+
+void Memoizer::clear () {
+    m_entry_list.clear();
+    m_entry_index.clear();
+}
+
+size_t Memoizer::call_hash (sept::Data const &func_data, sept::DataVector const &args) {
+    size_t seed = lvd::hash(&func_data);
+    for (auto const &arg : args)
+        seed = lvd::hash(seed, hash_data(arg));
+    return seed;
+}
+
+Memoizer::EntryList::iterator Memoizer::find_entry (sept::Data const &func_data, sept::DataVector const &args, size_t hash) {
+    auto [begin_it, end_it] = m_entry_index.equal_range(hash);
+    for (auto it = begin_it; it != end_it; ++it) {
+        auto const &entry = *it->second;
+        if (entry.m_func_data != &func_data || entry.m_args.size() != args.size())
+            continue;
+        bool args_are_equal = true;
+        for (size_t i = 0; i < args.size() && args_are_equal; ++i)
+            args_are_equal = eq_data(entry.m_args[i], args[i]);
+        if (args_are_equal)
+            return it->second;
+    }
+    return m_entry_list.end();
+}
+
+void Memoizer::erase_entry (EntryList::iterator entry_it) {
+    auto [begin_it, end_it] = m_entry_index.equal_range(entry_it->m_hash);
+    for (auto it = begin_it; it != end_it; ++it) {
+        if (it->second == entry_it) {
+            m_entry_index.erase(it);
+            break;
+        }
+    }
+    m_entry_list.erase(entry_it);
+}
+
+size_t infer_pure_funcs (Memoizer &memoizer, lvd::nnsp<sept::SymbolTable> const &scope) noexcept(false) {
+    auto pure_funcs = PurityInferrer{scope}.infer();
+    for (auto const &[symbol_id, func_data] : pure_funcs)
+        memoizer.set_is_pure(*func_data, true);
+    return pure_funcs.size();
+}
+
+} // end namespace memo
@@ -0,0 +1,94 @@
+// 2021.05.27 - Victor Dods
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <lvd/aliases.hpp>
+#include <optional>
+#include "sept/Data.hpp"
+#include "sept/DataVector.hpp"
+#include "sept/SymbolTable.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+// Memoization of calls to pure functions, i.e. functions whose value depends only on the values of their
+// arguments.  This is opt-in: set a Memoizer on EvalCtx (see set_memoizer), and mark functions as pure,
+// either explicitly (see Memoizer::set_is_pure) or by inference (see infer_pure_funcs).  Then each call
+// to a pure function is looked up in a bounded LRU cache, keyed by the function and its (dereferenced)
+// argument values, which are hashed and compared using hash_data and eq_data.  Calls whose arguments
+// can't be hashed aren't memoized.
+//
+// Functions are identified by the address of their Data (i.e. what the function symbol resolves to), so
+// rebinding a function symbol via a SymbolDefn or Assignment forgets that it was pure, along with its
+// cached values.  NOTE: As with FuncClosure, rebinding a function symbol directly via SymbolTable isn't
+// detected.
+namespace memo {
+
+class Memoizer {
+public:
+
+    // capacity is the maximum number of cached values, and must be positive.
+    explicit Memoizer (size_t capacity) noexcept(false);
+
+    // Marks (or unmarks) the function whose Data is func_data as pure.  Unmarking a function forgets
+    // its cached values.
+    void set_is_pure (sept::Data const &func_data, bool is_pure);
+    bool is_pure (sept::Data const &func_data) const { return m_pure_funcs.find(&func_data) != m_pure_funcs.end(); }
+    // Call this when the symbol whose Data is func_data is rebound.
+    void forget_func (sept::Data const &func_data) {
+        if (is_pure(func_data))
+            set_is_pure(func_data, false);
+    }
+
+    // Returns the dereferenced args, or std::nullopt if they can't all be hashed by hash_data.
+    static std::optional<sept::DataVector> key_args (sept::DataVector const &args);
+
+    // Returns the cached value of the call, or nullptr if there is none, and counts a hit or a miss.
+    // args should come from key_args.  The returned pointer is only valid until the next call to insert.
+    sept::Data const *find (sept::Data const &func_data, sept::DataVector const &args);
+    // Caches the value of the call, evicting the least recently used value if the cache is full.
+    void insert (sept::Data const &func_data, sept::DataVector &&args, sept::Data &&value);
+
+    size_t capacity () const { return m_capacity; }
+    size_t size () const { return m_entry_list.size(); }
+    size_t hit_count () const { return m_hit_count; }
+    size_t miss_count () const { return m_miss_count; }
+    void reset_counts () {
+        m_hit_count = 0;
+        m_miss_count = 0;
+    }
+    // Forgets all cached values, but not which functions are pure.
+    void clear ();
+
+private:
+
+    struct Entry {
+        sept::Data const *m_func_data;
+        sept::DataVector m_args;
+        size_t m_hash;
+        sept::Data m_value;
+    };
+    // The most recently used Entry is first.
+    using EntryList = std::list<Entry>;
+
+    static size_t call_hash (sept::Data const &func_data, sept::DataVector const &args);
+    EntryList::iterator find_entry (sept::Data const &func_data, sept::DataVector const &args, size_t hash);
+    void erase_entry (EntryList::iterator entry_it);
+
+    size_t m_capacity;
+    std::unordered_set<sept::Data const *> m_pure_funcs;
+    EntryList m_entry_list;
+    // Maps the hash of each Entry to it.
+    std::unordered_multimap<size_t,EntryList::iterator> m_entry_index;
+    size_t m_hit_count = 0;
+    size_t m_miss_count = 0;
+};
+
+// Infers which of the FuncLiterals defined in scope (not including its ancestors) are pure, and marks
+// them as such in memoizer.  A function is inferred to be pure if its body only refers to its params and
+// its block-local symbols, and only calls functions which are also inferred to be pure (so recursion is
+// allowed).  Returns the number of functions that were marked.
+size_t infer_pure_funcs (Memoizer &memoizer, lvd::nnsp<sept::SymbolTable> const &scope) noexcept(false);
+
+} // end namespace memo
@@ -0,0 +1,452 @@
+// 2021.05.27 - Victor Dods
+
+#include "opt.hpp"
+
+// Includes from this program's source
+#include "common.hpp"
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <lvd/hash.hpp>
+#include "sept/ArrayTerm.hpp"
+#include "sept/DataVector.hpp"
+#include "sept/TupleTerm.hpp"
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+namespace opt {
+
+namespace {
+
+//
+// Traversal of the subexpressions of an Expr
+//
+
+// Returns a copy of t in which the elements at the given indices are replaced by f of them.
+template <typename F_>
+sept::TupleTerm_c map_tuple_elements (sept::TupleTerm_c const &t, std::initializer_list<size_t> indices, F_ &&f) {
+    sept::DataVector elements;
+    elements.reserve(t.size());
+    for (size_t i = 0; i < t.size(); ++i) {
+        if (std::find(indices.begin(), indices.end(), i) != indices.end())
+            elements.emplace_back(f(t[i]));
+        else
+            elements.emplace_back(t[i]);
+    }
+    return sept::TupleTerm_c{std::move(elements)};
+}
+
+// Returns a copy of a in which each element is replaced by f of it.  The constraint (e.g. ExprArray) is kept.
+template <typename F_>
+sept::ArrayTerm_c map_array_elements (sept::ArrayTerm_c const &a, F_ &&f) {
+    sept::DataVector elements;
+    elements.reserve(a.size());
+    for (auto const &element : a.elements())
+        elements.emplace_back(f(element));
+    sept::ArrayTerm_c retval{std::move(elements)};
+    retval.abstract_type() = a.abstract_type();
+    return retval;
+}
+
+// Returns a copy of e (which is an Expr of the given kind) in which each subexpression is replaced by f of it.
+// The type in a Construction isn't an Expr, so it's left alone.
+template <typename F_>
+sept::Data map_subexprs (sept::Data const &e, syn::ExprKind expr_kind, F_ &&f) {
+    // RoundExpr, SquareExpr, and CurlyExpr are (open, ExprArray, close).
+    auto map_bracketed = [&f](sept::Data const &bracketed) -> sept::Data {
+        return map_tuple_elements(bracketed.cast<sept::TupleTerm_c const &>(), {1}, [&f](sept::Data const &expr_array) -> sept::Data {
+            return map_array_elements(expr_array.cast<sept::ArrayTerm_c const &>(), f);
+        });
+    };
+    switch (expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:
+            return map_tuple_elements(e.cast<sept::TupleTerm_c const &>(), {0, 2}, f);
+        case syn::ExprKind::BLOCK_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            auto map_stmt = [&f](sept::Data const &stmt) -> sept::Data {
+                // Each kind of Stmt is (SymbolId, op, Expr).
+                return map_tuple_elements(stmt.cast<sept::TupleTerm_c const &>(), {2}, f);
+            };
+            return sept::TupleTerm_c{sept::DataVector{map_array_elements(t[0].cast<sept::ArrayTerm_c const &>(), map_stmt), f(t[1])}};
+        }
+        case syn::ExprKind::COND_EXPR:
+            return map_tuple_elements(e.cast<sept::TupleTerm_c const &>(), {1, 3, 5}, f);
+        case syn::ExprKind::CONSTRUCTION:
+        case syn::ExprKind::FUNC_EVAL:
+            return map_tuple_elements(e.cast<sept::TupleTerm_c const &>(), {1}, map_bracketed);
+        case syn::ExprKind::ELEMENT_EVAL: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return sept::TupleTerm_c{sept::DataVector{f(t[0]), map_bracketed(t[1])}};
+        }
+        case syn::ExprKind::ROUND_EXPR:
+            return map_bracketed(e);
+        case syn::ExprKind::UN_OP_EXPR:
+            return map_tuple_elements(e.cast<sept::TupleTerm_c const &>(), {1}, f);
+        case syn::ExprKind::SYMBOL_ID:
+            return e;
+        case syn::ExprKind::VALUE_TERMINAL:
+            // An Array is evaluated as an ExprArray.  Anything else (e.g. a FuncLiteral) is a value.
+            if (e.type() == typeid(sept::ArrayTerm_c))
+                return map_array_elements(e.cast<sept::ArrayTerm_c const &>(), f);
+            return e;
+        default:
+            LVD_ABORT(LVD_FMT("invalid syn::ExprKind: " << uint32_t(expr_kind)));
+    }
+}
+
+// Calls f on each subexpression of e (which is an Expr of the given kind), in the same order as map_subexprs.
+// Returns false as soon as f does, and otherwise true.
+template <typename F_>
+bool all_subexprs (sept::Data const &e, syn::ExprKind expr_kind, F_ &&f) {
+    auto all_bracketed = [&f](sept::Data const &bracketed) -> bool {
+        for (auto const &element : bracketed.cast<sept::TupleTerm_c const &>()[1].cast<sept::ArrayTerm_c const &>().elements())
+            if (!f(element))
+                return false;
+        return true;
+    };
+    switch (expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return f(t[0]) && f(t[2]);
+        }
+        case syn::ExprKind::BLOCK_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            for (auto const &stmt : t[0].cast<sept::ArrayTerm_c const &>().elements())
+                if (!f(stmt.cast<sept::TupleTerm_c const &>()[2]))
+                    return false;
+            return f(t[1]);
+        }
+        case syn::ExprKind::COND_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return f(t[1]) && f(t[3]) && f(t[5]);
+        }
+        case syn::ExprKind::CONSTRUCTION:
+        case syn::ExprKind::FUNC_EVAL:
+            return all_bracketed(e.cast<sept::TupleTerm_c const &>()[1]);
+        case syn::ExprKind::ELEMENT_EVAL: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            return f(t[0]) && all_bracketed(t[1]);
+        }
+        case syn::ExprKind::ROUND_EXPR:
+            return all_bracketed(e);
+        case syn::ExprKind::UN_OP_EXPR:
+            return f(e.cast<sept::TupleTerm_c const &>()[1]);
+        case syn::ExprKind::SYMBOL_ID:
+            return true;
+        case syn::ExprKind::VALUE_TERMINAL:
+            if (e.type() == typeid(sept::ArrayTerm_c)) {
+                for (auto const &element : e.cast<sept::ArrayTerm_c const &>().elements())
+                    if (!f(element))
+                        return false;
+            }
+            return true;
+        default:
+            LVD_ABORT(LVD_FMT("invalid syn::ExprKind: " << uint32_t(expr_kind)));
+    }
+}
+
+//
+// Constant folding
+//
+
+// Returns true iff operand is a literal of the type that op expects (see sem::apply_bin_op and sem::apply_un_op).
+bool is_literal_operand_for (ASTNPTerm op, sept::Data const &operand) {
+    if (operand.is_ref())
+        return false;
+    switch (op) {
+        case ASTNPTerm::AND:
+        case ASTNPTerm::OR:
+        case ASTNPTerm::XOR:
+        case ASTNPTerm::NOT:
+            return operand.type() == typeid(bool);
+        default:
+            return operand.type() == typeid(double);
+    }
+}
+
+//
+// Common-subexpression elimination
+//
+
+// Returns true iff evaluating expr can have no effect other than producing its value (or throwing).
+bool is_side_effect_free (sept::Data const &expr) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return false;
+    switch (*expr_kind) {
+        // A BlockExpr defines symbols, and a FuncEval could do anything.
+        case syn::ExprKind::BLOCK_EXPR:
+        case syn::ExprKind::FUNC_EVAL:
+            return false;
+        default:
+            return all_subexprs(e, *expr_kind, is_side_effect_free);
+    }
+}
+
+// Returns true iff the value of an Expr of the given kind never refers to a symbol defined while evaluating
+// it, i.e. if wrapping it in a BlockExpr won't leave its value with a reference into the popped scope.  A
+// RoundExpr (or Array) is evaluated element-wise, so its value can contain such references.
+bool has_self_contained_value (syn::ExprKind expr_kind) {
+    switch (expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:
+        case syn::ExprKind::COND_EXPR:
+        case syn::ExprKind::CONSTRUCTION:
+        case syn::ExprKind::ELEMENT_EVAL:
+        case syn::ExprKind::UN_OP_EXPR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns true iff two Exprs are identical, as opposed to merely equal; eq_data considers 0.0 and -0.0
+// to be equal, for example.
+bool are_identical_exprs (sept::Data const &lhs, sept::Data const &rhs) {
+    if (&lhs == &rhs)
+        return true;
+    if (lhs.is_ref() || rhs.is_ref() || lhs.type() != rhs.type())
+        return false;
+    if (lhs.type() == typeid(sept::TupleTerm_c) || lhs.type() == typeid(sept::ArrayTerm_c)) {
+        auto const &lhs_elements = lhs.type() == typeid(sept::TupleTerm_c) ? lhs.cast<sept::TupleTerm_c const &>().elements() : lhs.cast<sept::ArrayTerm_c const &>().elements();
+        auto const &rhs_elements = rhs.type() == typeid(sept::TupleTerm_c) ? rhs.cast<sept::TupleTerm_c const &>().elements() : rhs.cast<sept::ArrayTerm_c const &>().elements();
+        if (lhs_elements.size() != rhs_elements.size())
+            return false;
+        for (size_t i = 0; i < lhs_elements.size(); ++i)
+            if (!are_identical_exprs(lhs_elements[i], rhs_elements[i]))
+                return false;
+        return true;
+    }
+    if (lhs.type() == typeid(double)) {
+        auto lhs_value = lhs.cast<double>();
+        auto rhs_value = rhs.cast<double>();
+        return std::memcmp(&lhs_value, &rhs_value, sizeof(double)) == 0;
+    }
+    auto const &data_operator_eq_predicate_map = lvd::static_association_singleton<sept::_Data_Eq>();
+    if (data_operator_eq_predicate_map.find(std::type_index(lhs.type())) == data_operator_eq_predicate_map.end())
+        return false;
+    return eq_data(lhs, rhs);
+}
+
+class CommonSubexprEliminator {
+public:
+
+    sept::Data eliminate (sept::Data const &expr) noexcept(false);
+
+private:
+
+    // Identifies an occurrence of a subexpression.  Identical subexpressions are equal keys.
+    struct ExprKey {
+        sept::Data const *m_expr;
+        size_t m_hash;
+    };
+    struct ExprKeyHash {
+        size_t operator() (ExprKey const &key) const { return key.m_hash; }
+    };
+    struct ExprKeyEq {
+        bool operator() (ExprKey const &lhs, ExprKey const &rhs) const {
+            return lhs.m_hash == rhs.m_hash && are_identical_exprs(*lhs.m_expr, *rhs.m_expr);
+        }
+    };
+
+    // The state of eliminating common subexpressions within a side-effect-free region.
+    struct Region {
+        // The number of occurrences of each subexpression which is evaluated unconditionally, and whose
+        // value is only used as an operand (see count_occurrences).
+        std::unordered_map<ExprKey,size_t,ExprKeyHash,ExprKeyEq> m_occurrence_count_map;
+        // The symbol that each common subexpression has been bound to so far.
+        std::unordered_map<ExprKey,std::string,ExprKeyHash,ExprKeyEq> m_binding_map;
+        // The SymbolDefns of those bindings, in the order they have to be evaluated.
+        sept::DataVector m_symbol_defns;
+    };
+
+    ExprKey key_of (sept::Data const &expr) { return ExprKey{&expr, hash_of(expr)}; }
+    size_t hash_of (sept::Data const &expr);
+
+    // Returns true iff expr is worth binding to a symbol if it occurs more than once.
+    static bool is_nontrivial (sept::Data const &expr) {
+        auto expr_kind = syn::classify_expr(expr);
+        return expr_kind.has_value() && *expr_kind != syn::ExprKind::SYMBOL_ID && *expr_kind != syn::ExprKind::VALUE_TERMINAL;
+    }
+
+    sept::Data eliminate_in_region (sept::Data const &region);
+    // Only occurrences whose value is only used as an operand of a BinOpExpr or UnOpExpr or as the condition
+    // of a CondExpr are counted (and replaced), since those are what implicitly dereference their values.
+    void count_occurrences (Region &region, sept::Data const &expr, bool is_operand);
+    sept::Data rewrite (Region &region, sept::Data const &expr, bool is_operand);
+
+    std::unordered_map<sept::Data const *,size_t> m_hash_map;
+    size_t m_symbol_count = 0;
+};
+
+sept::Data CommonSubexprEliminator::eliminate (sept::Data const &expr) noexcept(false) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return e;
+    if (has_self_contained_value(*expr_kind) && is_side_effect_free(e))
+        return eliminate_in_region(e);
+    // Otherwise each subexpression is independent.
+    return map_subexprs(e, *expr_kind, [this](sept::Data const &subexpr) -> sept::Data { return eliminate(subexpr); });
+}
+
+size_t CommonSubexprEliminator::hash_of (sept::Data const &expr) {
+    auto it = m_hash_map.find(&expr);
+    if (it != m_hash_map.end())
+        return it->second;
+
+    size_t hash;
+    if (expr.is_ref()) {
+        hash = lvd::hash(&expr);
+    } else if (expr.type() == typeid(sept::TupleTerm_c) || expr.type() == typeid(sept::ArrayTerm_c)) {
+        hash = std::type_index(expr.type()).hash_code();
+        auto const &elements = expr.type() == typeid(sept::TupleTerm_c) ? expr.cast<sept::TupleTerm_c const &>().elements() : expr.cast<sept::ArrayTerm_c const &>().elements();
+        for (auto const &element : elements)
+            hash = lvd::hash(hash, hash_of(element));
+    } else {
+        auto const &data_hash_function_map = lvd::static_association_singleton<sept::_Data_Hash>();
+        if (data_hash_function_map.find(std::type_index(expr.type())) != data_hash_function_map.end())
+            hash = hash_data(expr);
+        else
+            hash = std::type_index(expr.type()).hash_code();
+    }
+    m_hash_map.emplace(&expr, hash);
+    return hash;
+}
+
+sept::Data CommonSubexprEliminator::eliminate_in_region (sept::Data const &region_expr) {
+    Region region;
+    count_occurrences(region, region_expr, false);
+    auto rewritten = rewrite(region, region_expr, false);
+    if (region.m_symbol_defns.empty())
+        return rewritten;
+    sept::ArrayTerm_c stmt_array{std::move(region.m_symbol_defns)};
+    stmt_array.abstract_type() = syn::StmtArray;
+    return sept::TupleTerm_c{sept::DataVector{std::move(stmt_array), std::move(rewritten)}};
+}
+
+void CommonSubexprEliminator::count_occurrences (Region &region, sept::Data const &expr, bool is_operand) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return;
+    if (is_operand && is_nontrivial(e)) {
+        // The subexpressions of a repeated occurrence are counted with the first one, since they'll be replaced with it.
+        if (++region.m_occurrence_count_map[key_of(e)] > 1)
+            return;
+    }
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            count_occurrences(region, t[0], true);
+            count_occurrences(region, t[2], true);
+            break;
+        }
+        case syn::ExprKind::COND_EXPR:
+            // The branches are evaluated conditionally, so they're regions of their own.
+            count_occurrences(region, e.cast<sept::TupleTerm_c const &>()[1], true);
+            break;
+        case syn::ExprKind::UN_OP_EXPR:
+            count_occurrences(region, e.cast<sept::TupleTerm_c const &>()[1], true);
+            break;
+        default:
+            all_subexprs(e, *expr_kind, [this, &region](sept::Data const &subexpr) {
+                count_occurrences(region, subexpr, false);
+                return true;
+            });
+            break;
+    }
+}
+
+sept::Data CommonSubexprEliminator::rewrite (Region &region, sept::Data const &expr, bool is_operand) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return e;
+
+    bool is_candidate = is_operand && is_nontrivial(e);
+    if (is_candidate) {
+        auto it = region.m_binding_map.find(key_of(e));
+        if (it != region.m_binding_map.end())
+            return it->second;
+    }
+
+    sept::Data rewritten = [&]() -> sept::Data {
+        switch (*expr_kind) {
+            case syn::ExprKind::BIN_OP_EXPR:
+            case syn::ExprKind::UN_OP_EXPR:
+                return map_subexprs(e, *expr_kind, [this, &region](sept::Data const &operand) -> sept::Data {
+                    return rewrite(region, operand, true);
+                });
+            case syn::ExprKind::COND_EXPR: {
+                auto const &t = e.cast<sept::TupleTerm_c const &>();
+                return sept::TupleTerm_c{sept::DataVector{t[0], rewrite(region, t[1], true), t[2], eliminate(t[3]), t[4], eliminate(t[5])}};
+            }
+            default:
+                return map_subexprs(e, *expr_kind, [this, &region](sept::Data const &subexpr) -> sept::Data {
+                    return rewrite(region, subexpr, false);
+                });
+        }
+    }();
+
+    if (is_candidate && region.m_occurrence_count_map[key_of(e)] > 1) {
+        auto symbol_id = LVD_FMT("__cse" << m_symbol_count);
+        ++m_symbol_count;
+        region.m_symbol_defns.emplace_back(sept::TupleTerm_c{sept::DataVector{symbol_id, DefinedAs, std::move(rewritten)}});
+        region.m_binding_map.emplace(key_of(e), symbol_id);
+        return symbol_id;
+    }
+    return rewritten;
+}
+
+} // end namespace
+
+sept::Data fold_constants (sept::Data const &expr) noexcept(false) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return e;
+
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR: {
+            auto folded = map_subexprs(e, *expr_kind, fold_constants);
+            auto const &t = folded.cast<sept::TupleTerm_c const &>();
+            auto bin_op = t[1].cast<ASTNPTerm>();
+            if (is_literal_operand_for(bin_op, t[0]) && is_literal_operand_for(bin_op, t[2]))
+                return sem::apply_bin_op(bin_op, t[0], t[2]);
+            return folded;
+        }
+        case syn::ExprKind::COND_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            auto condition = fold_constants(t[1]);
+            if (!condition.is_ref() && condition.type() == typeid(bool))
+                return fold_constants(condition.cast<bool>() ? t[3] : t[5]);
+            return sept::TupleTerm_c{sept::DataVector{t[0], std::move(condition), t[2], fold_constants(t[3]), t[4], fold_constants(t[5])}};
+        }
+        case syn::ExprKind::UN_OP_EXPR: {
+            auto folded = map_subexprs(e, *expr_kind, fold_constants);
+            auto const &t = folded.cast<sept::TupleTerm_c const &>();
+            auto un_op = t[0].cast<ASTNPTerm>();
+            if (is_literal_operand_for(un_op, t[1]))
+                return sem::apply_un_op(un_op, t[1]);
+            return folded;
+        }
+        default:
+            return map_subexprs(e, *expr_kind, fold_constants);
+    }
+}
+
+sept::Data eliminate_common_subexprs (sept::Data const &expr) noexcept(false) {
+    return CommonSubexprEliminator().eliminate(expr);
+}
+
+sept::Data optimize_expr (sept::Data const &expr) noexcept(false) {
+    return eliminate_common_subexprs(fold_constants(expr));
+}
+
+} // end namespace opt
@@ -0,0 +1,28 @@
+// 2021.05.27 - Victor Dods
+
+#pragma once
+
+#include "sept/Data.hpp"
+
+// Optimization passes over syntactic Expr data (see syn.hpp).  Each returns an Expr which evaluates to
+// the same value as the given one, and leaves anything that isn't an Expr unchanged.
+//
+// Constant folding evaluates BinOpExpr and UnOpExpr whose operands are literals of the type that the
+// operator expects, and replaces a CondExpr whose condition is a literal bool with the chosen branch.
+// Literals of the wrong type are left alone, so that evaluation still throws.
+//
+// Common-subexpression elimination operates on side-effect-free regions, i.e. subexpressions which
+// contain no FuncEval or BlockExpr.  A subexpression which occurs more than once in a region, not
+// counting the branches of a CondExpr (which are regions of their own), is evaluated once, by wrapping
+// the region in a BlockExpr which binds its value to a symbol named "__cse<n>".  Such symbol names are
+// reserved for this.
+//
+// FuncLiterals are left alone, since they're values, and their bodies aren't evaluated until called.
+namespace opt {
+
+sept::Data fold_constants (sept::Data const &expr) noexcept(false);
+sept::Data eliminate_common_subexprs (sept::Data const &expr) noexcept(false);
+// Folds constants and then eliminates common subexpressions.
+sept::Data optimize_expr (sept::Data const &expr) noexcept(false);
+
+} // end namespace opt
@@ -0,0 +1,636 @@
+// 2021.05.27 - Victor Dods
+
+#include "par.hpp"
+
+// Includes from this program's source
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <lvd/ScopeGuard.hpp>
+#include "sept/ArrayTerm.hpp"
+#include "sept/SymbolTable.hpp"
+#include "sept/TupleTerm.hpp"
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+namespace par {
+
+namespace {
+
+// The TaskPool (if any) that the calling thread is a worker of, and the index of its queue in that TaskPool.
+thread_local TaskPool const *t_worker_pool = nullptr;
+thread_local size_t t_worker_queue_index = 0;
+
+} // end namespace
+
+//
+// TaskPool
+//
+
+TaskPool::TaskPool (size_t thread_count, size_t min_fork_cost)
+    :   m_min_fork_cost(min_fork_cost)
+{
+    if (thread_count == 0)
+        throw std::runtime_error("a TaskPool needs at least 1 thread");
+
+    m_queues.reserve(thread_count+1);
+    for (size_t i = 0; i < thread_count+1; ++i)
+        m_queues.emplace_back(std::make_unique<JobQueue>());
+    m_workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i)
+        m_workers.emplace_back([this, i](){ this->worker_loop(i); });
+}
+
+size_t TaskPool::default_thread_count () {
+    auto hardware_thread_count = std::thread::hardware_concurrency();
+    return hardware_thread_count > 1 ? hardware_thread_count-1 : 0;
+}
+
+TaskPool::~TaskPool () {
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_is_stopping = true;
+    }
+    m_wake_cv.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+void TaskPool::run_all (std::vector<std::function<void()>> const &tasks) {
+    if (tasks.empty())
+        return;
+
+    auto queue_index = own_queue_index();
+    // The Jobs are only referred to by the queues until they're taken, which is before they're done.
+    std::vector<Job> jobs(tasks.size());
+    // Push them in reverse order, so that this thread takes tasks[1] next, while the other threads steal
+    // from the other end.
+    for (size_t i = tasks.size(); i-- > 1; ) {
+        jobs[i].m_task = &tasks[i];
+        push(queue_index, &jobs[i]);
+    }
+    m_fork_count.fetch_add(tasks.size()-1, std::memory_order_relaxed);
+
+    tasks[0]();
+    // Help out until the rest are done.  Any that weren't stolen are taken from this thread's queue first.
+    for (size_t i = 1; i < tasks.size(); ++i) {
+        while (!jobs[i].m_is_done.load(std::memory_order_acquire)) {
+            auto job = take(queue_index);
+            if (job != nullptr)
+                run(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+}
+
+void TaskPool::push (size_t queue_index, Job *job) {
+    // This is incremented first so that it never underflows when the job is taken.
+    m_queued_count.fetch_add(1, std::memory_order_relaxed);
+    {
+        auto &queue = *m_queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        queue.m_jobs.push_back(job);
+    }
+    {
+        // This keeps a worker from missing the notification between checking m_queued_count and waiting.
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+    }
+    m_wake_cv.notify_one();
+}
+
+TaskPool::Job *TaskPool::take (size_t queue_index) {
+    if (m_queued_count.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+
+    for (size_t offset = 0; offset < m_queues.size(); ++offset) {
+        auto &queue = *m_queues[(queue_index + offset) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (queue.m_jobs.empty())
+            continue;
+        Job *job;
+        if (offset == 0) {
+            job = queue.m_jobs.back();
+            queue.m_jobs.pop_back();
+        } else {
+            job = queue.m_jobs.front();
+            queue.m_jobs.pop_front();
+        }
+        m_queued_count.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+    return nullptr;
+}
+
+void TaskPool::run (Job *job) {
+    (*job->m_task)();
+    job->m_is_done.store(true, std::memory_order_release);
+}
+
+void TaskPool::worker_loop (size_t queue_index) {
+    t_worker_pool = this;
+    t_worker_queue_index = queue_index;
+    while (true) {
+        auto job = take(queue_index);
+        if (job != nullptr) {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_wake_mutex);
+        m_wake_cv.wait(lock, [this](){ return m_is_stopping || m_queued_count.load(std::memory_order_relaxed) > 0; });
+        if (m_is_stopping)
+            return;
+    }
+}
+
+size_t TaskPool::own_queue_index () const {
+    return t_worker_pool == this ? t_worker_queue_index : m_workers.size();
+}
+
+//
+// Analysis
+//
+
+namespace {
+
+// Costs saturate at this, which is also the cost of a recursive call.
+constexpr size_t MAX_COST = std::numeric_limits<size_t>::max() / 2;
+
+void accumulate (ExprSummary &summary, ExprSummary const &other) {
+    summary.m_cost = std::min(summary.m_cost + other.m_cost, MAX_COST);
+    summary.m_has_side_effects = summary.m_has_side_effects || other.m_has_side_effects;
+}
+
+// Returns the ExprArray of a RoundExpr, SquareExpr, or CurlyExpr, each of which is (open, ExprArray, close).
+sept::ArrayTerm_c const &expr_array_of (sept::Data const &bracketed) {
+    return bracketed.cast<sept::TupleTerm_c const &>()[1].cast<sept::ArrayTerm_c const &>();
+}
+
+// Walks an Expr the same way that the tree-walker would evaluate it, using syn::classify_expr_shallowly
+// (so an ill-formed Expr is only found to be ill-formed if it would be evaluated).
+//
+// Because scoping is dynamic, a function body can refer to the locals of its callers.  So that the
+// summary of a function doesn't depend on where it's called from, a symbol in a function body that's not
+// one of its params or block-locals is assumed to be non-local: Assigning to it is a side effect, and
+// calling it calls whatever it's defined as in ctx's current scope.  Each function summary lists the
+// symbols that it (or its callees) calls that way, and a call to it is treated as having side effects if
+// any of those are shadowed by a local of the caller, since then it would call something else.  Within a
+// set of mutually recursive functions, only the outermost call is checked for that.
+class Summarizer {
+public:
+
+    explicit Summarizer (sem::EvalCtx const &ctx)
+        :   m_ctx(ctx)
+    {
+        // The frame for the expression being summarized, whose locals are all visible.
+        m_body_stack.emplace_back(BodyFrame{0, {}});
+    }
+
+    ExprSummary summarize (sept::Data const &expr);
+    ExprSummary summarize (sem::Expr_Term_c const &expr_term);
+
+private:
+
+    // A symbol defined within the expression being summarized, or a param of a function whose body is
+    // being summarized.  m_func_literal is the FuncLiteral that it's defined as, if it's known to be one.
+    struct Local {
+        sept::InternedId m_symbol_id;
+        sept::Data const *m_func_literal;
+    };
+
+    // The expression being summarized, or the body of a function being summarized.
+    struct BodyFrame {
+        // The locals before this index belong to callers, and aren't visible.
+        size_t m_locals_begin;
+        std::vector<sept::InternedId> m_free_callee_ids;
+    };
+
+    struct FuncSummary {
+        ExprSummary m_summary;
+        // Sorted, without duplicates.
+        std::vector<sept::InternedId> m_free_callee_ids;
+    };
+
+    ExprSummary summarize_expr_array (sept::ArrayTerm_c const &expr_array);
+    ExprSummary summarize_expr_array (sem::ExprArray_Term_c const &expr_array_term);
+    ExprSummary summarize_block (sept::ArrayTerm_c const &stmt_array, sept::Data const &final_expr);
+    // args_summary is the summary of the args.
+    ExprSummary summarize_func_eval (sept::InternedId func_symbol_id, ExprSummary args_summary);
+    FuncSummary summarize_func (sept::Data const &func_literal);
+    // Returns the innermost visible Local for symbol_id, or nullptr if there is none.
+    Local *find_local (sept::InternedId symbol_id);
+    void pop_locals (size_t locals_size) { m_locals.erase(m_locals.begin() + locals_size, m_locals.end()); }
+
+    sem::EvalCtx const &m_ctx;
+    std::vector<Local> m_locals;
+    std::vector<BodyFrame> m_body_stack;
+    // The functions whose bodies are being summarized, innermost last, for detecting recursion.
+    std::vector<sept::Data const *> m_func_stack;
+    // The lowest index in m_func_stack of a function that was called recursively while summarizing the
+    // functions above it, whose summaries therefore aren't final.
+    size_t m_recursion_index = std::numeric_limits<size_t>::max();
+    std::unordered_map<sept::Data const *,FuncSummary> m_func_summary_map;
+};
+
+ExprSummary Summarizer::summarize (sept::Data const &expr_data) {
+    // This dispatches the same way as the EvaluateExpr registrations for the tree-walker.
+    auto const &expr = expr_data.deref();
+    if (expr.type() == typeid(sept::ArrayTerm_c))
+        return summarize_expr_array(expr.cast<sept::ArrayTerm_c const &>());
+    if (expr.type() != typeid(sept::TupleTerm_c))
+        return ExprSummary{1, false};
+
+    auto const &t = expr.cast<sept::TupleTerm_c const &>();
+    auto expr_kind = syn::classify_expr_shallowly(expr);
+    // Evaluating it would throw, so leave it to sequential evaluation.
+    if (!expr_kind.has_value())
+        return ExprSummary{1, true};
+
+    ExprSummary summary{1, false};
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:
+            accumulate(summary, summarize(t[0]));
+            accumulate(summary, summarize(t[2]));
+            return summary;
+        case syn::ExprKind::BLOCK_EXPR:
+            return summarize_block(t[0].cast<sept::ArrayTerm_c const &>(), t[1]);
+        case syn::ExprKind::COND_EXPR: {
+            // t[0], t[2], t[4] are If, Then, Else respectively.  Only one branch is evaluated.
+            accumulate(summary, summarize(t[1]));
+            auto positive_summary = summarize(t[3]);
+            auto negative_summary = summarize(t[5]);
+            summary.m_cost = std::min(summary.m_cost + std::max(positive_summary.m_cost, negative_summary.m_cost), MAX_COST);
+            summary.m_has_side_effects = summary.m_has_side_effects || positive_summary.m_has_side_effects || negative_summary.m_has_side_effects;
+            return summary;
+        }
+        case syn::ExprKind::CONSTRUCTION:
+        case syn::ExprKind::ELEMENT_EVAL:
+            accumulate(summary, summarize(t[0]));
+            accumulate(summary, summarize_expr_array(expr_array_of(t[1])));
+            return summary;
+        case syn::ExprKind::FUNC_EVAL:
+            return summarize_func_eval(sept::intern(t[0].cast<std::string const &>()), summarize_expr_array(expr_array_of(t[1])));
+        case syn::ExprKind::ROUND_EXPR:
+            accumulate(summary, summarize_expr_array(expr_array_of(expr)));
+            return summary;
+        case syn::ExprKind::UN_OP_EXPR:
+            accumulate(summary, summarize(t[1]));
+            return summary;
+        default:
+            return summary;
+    }
+}
+
+// This mirrors the Data overload, for Exprs that have already been parsed into semantic terms.
+ExprSummary Summarizer::summarize (sem::Expr_Term_c const &expr_term) {
+    return std::visit(
+        lvd::Visitor_t{
+            [this](sem::BinOpExpr_Term_c const &expr) {
+                ExprSummary summary{1, false};
+                accumulate(summary, summarize(expr.m_lhs_expr));
+                accumulate(summary, summarize(expr.m_rhs_expr));
+                return summary;
+            },
+            [this](sem::BlockExpr_Term_c const &expr) {
+                return summarize_block(expr.m_stmt_array, expr.m_final_expr);
+            },
+            [this](sem::CondExpr_Term_c const &expr) {
+                ExprSummary summary{1, false};
+                accumulate(summary, summarize(expr.m_condition));
+                auto positive_summary = summarize(expr.m_positive_expr);
+                auto negative_summary = summarize(expr.m_negative_expr);
+                summary.m_cost = std::min(summary.m_cost + std::max(positive_summary.m_cost, negative_summary.m_cost), MAX_COST);
+                summary.m_has_side_effects = summary.m_has_side_effects || positive_summary.m_has_side_effects || negative_summary.m_has_side_effects;
+                return summary;
+            },
+            [this](sem::Construction_Term_c const &expr) {
+                ExprSummary summary{1, false};
+                accumulate(summary, summarize(expr.m_type_to_construct));
+                accumulate(summary, summarize_expr_array(expr.m_params));
+                return summary;
+            },
+            [this](sem::ElementEval_Term_c const &expr) {
+                ExprSummary summary{1, false};
+                accumulate(summary, summarize(expr.m_container));
+                accumulate(summary, summarize_expr_array(expr.m_params));
+                return summary;
+            },
+            [this](sem::FuncEval_Term_c const &expr) {
+                return summarize_func_eval(expr.m_func_symbol_id, summarize_expr_array(expr.m_params));
+            },
+            [this](sem::RoundExpr_Term_c const &expr) {
+                ExprSummary summary{1, false};
+                accumulate(summary, summarize_expr_array(expr.m_expr_array));
+                return summary;
+            },
+            [this](sem::UnOpExpr_Term_c const &expr) {
+                ExprSummary summary{1, false};
+                accumulate(summary, summarize(expr.m_operand));
+                return summary;
+            },
+            [](auto const &) {
+                // SymbolId_Term_c or ValueTerminal_Term_c
+                return ExprSummary{1, false};
+            }
+        },
+        expr_term
+    );
+}
+
+ExprSummary Summarizer::summarize_expr_array (sept::ArrayTerm_c const &expr_array) {
+    ExprSummary summary{1, false};
+    for (auto const &element : expr_array.elements())
+        accumulate(summary, summarize(element));
+    return summary;
+}
+
+ExprSummary Summarizer::summarize_expr_array (sem::ExprArray_Term_c const &expr_array_term) {
+    ExprSummary summary{1, false};
+    for (auto const &element : expr_array_term)
+        accumulate(summary, summarize(element));
+    return summary;
+}
+
+ExprSummary Summarizer::summarize_block (sept::ArrayTerm_c const &stmt_array, sept::Data const &final_expr) {
+    auto locals_size = m_locals.size();
+    ExprSummary summary{1, false};
+    for (auto const &stmt_data : stmt_array.elements()) {
+        auto stmt_kind = syn::classify_stmt_shallowly(stmt_data);
+        if (!stmt_kind.has_value()) {
+            summary.m_has_side_effects = true;
+            continue;
+        }
+        // Each kind of Stmt is (SymbolId, op, Expr).  A FuncLiteral is a function value, so it's not evaluated.
+        auto const &stmt = stmt_data.cast<sept::TupleTerm_c const &>();
+        auto symbol_id = sept::intern(stmt[0].cast<std::string const &>());
+        auto const &defn = stmt[2];
+        auto is_func_literal = syn::is_func_literal_shallowly(defn);
+        if (!is_func_literal)
+            accumulate(summary, summarize(defn));
+        if (*stmt_kind == syn::StmtKind::SYMBOL_DEFN) {
+            m_locals.emplace_back(Local{symbol_id, is_func_literal ? &defn : nullptr});
+        } else {
+            auto local = find_local(symbol_id);
+            if (local == nullptr)
+                summary.m_has_side_effects = true;
+            else // Which value it has afterward could depend on which branch of a CondExpr ran, so forget it.
+                local->m_func_literal = nullptr;
+        }
+    }
+    accumulate(summary, summarize(final_expr));
+    pop_locals(locals_size);
+    return summary;
+}
+
+ExprSummary Summarizer::summarize_func_eval (sept::InternedId func_symbol_id, ExprSummary args_summary) {
+    auto summary = args_summary;
+    accumulate(summary, ExprSummary{1, false});
+
+    sept::Data const *func_data = nullptr;
+    auto local = find_local(func_symbol_id);
+    if (local != nullptr) {
+        func_data = local->m_func_literal;
+    } else {
+        m_body_stack.back().m_free_callee_ids.emplace_back(func_symbol_id);
+        auto const &scope = m_ctx.current_scope();
+        if (scope->symbol_is_defined(func_symbol_id))
+            func_data = &scope->resolve_symbol_const(func_symbol_id);
+    }
+    // If it's not known what's being called, then assume the worst.
+    if (func_data == nullptr || !syn::is_func_literal_shallowly(*func_data)) {
+        summary.m_has_side_effects = true;
+        return summary;
+    }
+
+    auto func_summary = summarize_func(*func_data);
+    accumulate(summary, func_summary.m_summary);
+    for (auto callee_id : func_summary.m_free_callee_ids) {
+        if (find_local(callee_id) != nullptr)
+            summary.m_has_side_effects = true;
+        else
+            m_body_stack.back().m_free_callee_ids.emplace_back(callee_id);
+    }
+    return summary;
+}
+
+Summarizer::FuncSummary Summarizer::summarize_func (sept::Data const &func_literal) {
+    auto it = m_func_summary_map.find(&func_literal);
+    if (it != m_func_summary_map.end())
+        return it->second;
+
+    // A recursive call's cost is unbounded, and its side effects are accounted for by the outer call.
+    auto func_stack_it = std::find(m_func_stack.begin(), m_func_stack.end(), &func_literal);
+    if (func_stack_it != m_func_stack.end()) {
+        m_recursion_index = std::min(m_recursion_index, size_t(func_stack_it - m_func_stack.begin()));
+        return FuncSummary{ExprSummary{MAX_COST, false}, {}};
+    }
+
+    // FuncLiteral is (FuncPrototype, body), and FuncPrototype is (SymbolTypeDeclArray, MapsTo, codomain).
+    auto const &t = func_literal.cast<sept::TupleTerm_c const &>();
+    auto const &prototype = t[0].cast<sept::TupleTerm_c const &>();
+    auto const &param_decls = prototype[0].cast<sept::ArrayTerm_c const &>();
+
+    auto func_stack_index = m_func_stack.size();
+    auto locals_size = m_locals.size();
+    m_func_stack.push_back(&func_literal);
+    m_body_stack.emplace_back(BodyFrame{locals_size, {}});
+
+    // The param types and codomain are evaluated before the params are defined.  Each SymbolTypeDecl
+    // is (SymbolId, DeclaredAs, type).
+    ExprSummary summary{1, false};
+    for (auto const &param_decl : param_decls.elements())
+        accumulate(summary, summarize(param_decl.cast<sept::TupleTerm_c const &>()[2]));
+    accumulate(summary, summarize(prototype[2]));
+    for (auto const &param_decl : param_decls.elements())
+        m_locals.emplace_back(Local{sept::intern(param_decl.cast<sept::TupleTerm_c const &>()[0].cast<std::string const &>()), nullptr});
+    accumulate(summary, summarize(t[1]));
+
+    FuncSummary func_summary{summary, std::move(m_body_stack.back().m_free_callee_ids)};
+    std::sort(func_summary.m_free_callee_ids.begin(), func_summary.m_free_callee_ids.end());
+    func_summary.m_free_callee_ids.erase(
+        std::unique(func_summary.m_free_callee_ids.begin(), func_summary.m_free_callee_ids.end()),
+        func_summary.m_free_callee_ids.end()
+    );
+    pop_locals(locals_size);
+    m_body_stack.pop_back();
+    m_func_stack.pop_back();
+
+    // If this function is called recursively from a function that's still being summarized, then its
+    // summary depends on that one's, so it isn't cached.
+    if (m_recursion_index >= func_stack_index) {
+        m_recursion_index = std::numeric_limits<size_t>::max();
+        m_func_summary_map.emplace(&func_literal, func_summary);
+    }
+    return func_summary;
+}
+
+Summarizer::Local *Summarizer::find_local (sept::InternedId symbol_id) {
+    auto locals_begin = m_body_stack.back().m_locals_begin;
+    for (auto i = m_locals.size(); i-- > locals_begin; )
+        if (m_locals[i].m_symbol_id == symbol_id)
+            return &m_locals[i];
+    return nullptr;
+}
+
+} // end namespace
+
+ExprSummary summarize_expr (sept::Data const &expr, sem::EvalCtx const &ctx) noexcept(false) {
+    return Summarizer{ctx}.summarize(expr);
+}
+
+size_t calibrate_min_fork_cost (TaskPool &task_pool, sept::Data const &sample_expr, sem::EvalCtx &ctx, double overhead_factor) noexcept(false) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds_since = [](Clock::time_point start){ return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+    auto task_pool_ptr = ctx.task_pool();
+    auto min_fork_cost = task_pool.min_fork_cost();
+    auto sample_cost = summarize_expr(sample_expr, ctx).m_cost;
+    double fork_seconds;
+    double sample_seconds;
+    try {
+        // Forking a pair of trivial exprs, minus evaluating them sequentially, is the overhead of
+        // evaluate_in_parallel (splitting the EvalCtx, running the tasks, and collecting the values).
+        // It's a pointer to task_pool that doesn't own it, so that ctx can be restored as it was.
+        ctx.set_task_pool(lvd::sp<TaskPool>(lvd::sp<TaskPool>{}, &task_pool));
+        task_pool.set_min_fork_cost(0);
+        sept::Data const trivial_expr{0.0};
+        std::vector<sept::Data const *> trivial_exprs{&trivial_expr, &trivial_expr};
+        size_t const fork_repetition_count = 1000;
+        auto start = Clock::now();
+        for (size_t i = 0; i < fork_repetition_count; ++i)
+            evaluate_in_parallel(trivial_exprs, ctx);
+        fork_seconds = seconds_since(start) / fork_repetition_count;
+        ctx.set_task_pool(nullptr);
+        start = Clock::now();
+        for (size_t i = 0; i < fork_repetition_count; ++i)
+            for (auto const *expr : trivial_exprs)
+                sem::evaluate_expr_data(*expr, ctx);
+        fork_seconds = std::max(0.0, fork_seconds - seconds_since(start) / fork_repetition_count);
+
+        // The sample is evaluated sequentially, so that nested forks don't count toward its time.  The
+        // first evaluation is a warmup.
+        size_t const sample_repetition_count = 10;
+        sem::evaluate_expr_data(sample_expr, ctx);
+        start = Clock::now();
+        for (size_t i = 0; i < sample_repetition_count; ++i)
+            sem::evaluate_expr_data(sample_expr, ctx);
+        sample_seconds = seconds_since(start) / sample_repetition_count;
+    } catch (...) {
+        task_pool.set_min_fork_cost(min_fork_cost);
+        ctx.set_task_pool(std::move(task_pool_ptr));
+        throw;
+    }
+    task_pool.set_min_fork_cost(min_fork_cost);
+    ctx.set_task_pool(std::move(task_pool_ptr));
+
+    if (sample_cost == 0 || sample_seconds <= 0.0)
+        throw std::runtime_error("can't calibrate min_fork_cost using a sample_expr that takes no time");
+    auto seconds_per_cost = sample_seconds / double(sample_cost);
+    auto calibrated_cost = std::ceil(overhead_factor * fork_seconds / seconds_per_cost);
+    return calibrated_cost >= double(MAX_COST) ? MAX_COST : std::max(size_t(1), size_t(calibrated_cost));
+}
+
+namespace {
+
+template <typename Expr_>
+std::optional<sept::DataVector> evaluate_in_parallel_impl (std::vector<Expr_ const *> const &exprs, sem::EvalCtx &ctx) {
+    auto const &task_pool = ctx.task_pool();
+    if (task_pool == nullptr || exprs.size() < 2 || task_pool->is_saturated())
+        return std::nullopt;
+
+    // All the exprs have to be free of side effects, since otherwise the order that they're evaluated in
+    // could matter.  Each one that's expensive enough gets its own task, and the rest are evaluated by
+    // the first task.
+    Summarizer summarizer{ctx};
+    std::vector<size_t> task_of_expr(exprs.size(), 0);
+    size_t task_count = 0;
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        auto summary = summarizer.summarize(*exprs[i]);
+        if (summary.m_has_side_effects)
+            return std::nullopt;
+        if (summary.m_cost >= task_pool->min_fork_cost())
+            task_of_expr[i] = task_count++;
+    }
+    if (task_count < 2)
+        return std::nullopt;
+
+    // The tasks' scopes will be children of the current scope, so it and its ancestors have to be safe
+    // to read concurrently.  Concurrent reads bypass the ResolutionCaches, so the scopes that weren't
+    // already in that mode (e.g. by an enclosing evaluate_in_parallel) are put back once the tasks have
+    // finished, even if run_all throws.
+    std::vector<sept::SymbolTable *> concurrent_scopes;
+    for (auto *scope = ctx.current_scope().get().get(); scope != nullptr; ) {
+        if (!scope->concurrent_reads_enabled()) {
+            scope->enable_concurrent_reads();
+            concurrent_scopes.push_back(scope);
+        }
+        scope = scope->has_parent_symbol_table() ? scope->parent_symbol_table().get().get() : nullptr;
+    }
+    lvd::ScopeGuard concurrent_scopes_guard([&concurrent_scopes](){
+        for (auto *scope : concurrent_scopes)
+            scope->disable_concurrent_reads();
+    });
+
+    std::vector<std::optional<sept::Data>> values(exprs.size());
+    std::vector<std::exception_ptr> exceptions(exprs.size());
+    std::deque<sem::EvalCtx> task_ctxs;
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve(task_count);
+    for (size_t task_index = 0; task_index < task_count; ++task_index) {
+        task_ctxs.emplace_back(ctx.split());
+        tasks.emplace_back(
+            [&exprs, &task_of_expr, &values, &exceptions, &task_ctx = task_ctxs.back(), task_index](){
+                for (size_t i = 0; i < exprs.size(); ++i) {
+                    if (task_of_expr[i] != task_index)
+                        continue;
+                    try {
+                        if constexpr (std::is_same_v<Expr_,sem::Expr_Term_c>)
+                            values[i].emplace(sem::evaluate_Expr_Term(*exprs[i], task_ctx));
+                        else
+                            values[i].emplace(sem::evaluate_expr_data(*exprs[i], task_ctx));
+                    } catch (...) {
+                        exceptions[i] = std::current_exception();
+                    }
+                }
+            }
+        );
+    }
+    task_pool->run_all(tasks);
+
+    // Report the exception that sequential evaluation would have.
+    for (auto const &exception : exceptions)
+        if (exception != nullptr)
+            std::rethrow_exception(exception);
+
+    sept::DataVector retval;
+    retval.reserve(exprs.size());
+    for (auto &value : values)
+        retval.emplace_back(std::move(*value));
+    return retval;
+}
+
+} // end namespace
+
+std::optional<sept::DataVector> evaluate_in_parallel (std::vector<sept::Data const *> const &exprs, sem::EvalCtx &ctx) noexcept(false) {
+    return evaluate_in_parallel_impl(exprs, ctx);
+}
+
+std::optional<sept::DataVector> evaluate_in_parallel (sem::ExprArray_Term_c const &expr_array_term, sem::EvalCtx &ctx) noexcept(false) {
+    if (ctx.task_pool() == nullptr || expr_array_term.size() < 2)
+        return std::nullopt;
+    std::vector<sem::Expr_Term_c const *> exprs;
+    exprs.reserve(expr_array_term.size());
+    for (auto const &expr_term : expr_array_term)
+        exprs.emplace_back(&expr_term);
+    return evaluate_in_parallel_impl(exprs, ctx);
+}
+
+} // end namespace par
@@ -0,0 +1,132 @@
+// 2021.05.27 - Victor Dods
+
+#pragma once
+
+// Includes from this program's source
+#include "EvalCtx.hpp"
+#include "sem.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include "sept/Data.hpp"
+#include "sept/DataVector.hpp"
+#include <thread>
+#include <vector>
+
+// Task-parallel evaluation.  If an EvalCtx has a TaskPool (see EvalCtx::set_task_pool), then the
+// tree-walker evaluates independent sibling subexpressions -- the operands of a BinOpExpr, and the
+// elements of an ExprArray (e.g. the args of a FuncEval) -- in parallel, if at least two of them are
+// estimated to be expensive enough to be worth a task (see summarize_expr), and none of them has side
+// effects, i.e. Assignments to symbols defined outside of that subexpression.  Because siblings that
+// have side effects are evaluated sequentially as usual, the order of Assignments (and SymbolDefns,
+// which only ever define local symbols) is the same as in sequential evaluation, and so are the values.
+//
+// Each task is evaluated using its own EvalCtx (see EvalCtx::split), whose scopes are children of the
+// forking EvalCtx's current scope, which is put in concurrent-read mode (see sept::SymbolTable), along
+// with its ancestors (including the global SymbolTable).  The forking EvalCtx isn't used until all the
+// tasks have finished, at which point the scopes that weren't already in concurrent-read mode are taken
+// back out of it, since it bypasses the cached symbol resolution of sequential evaluation and the VM.
+//
+// If a subexpression throws, the exception is rethrown once all the tasks have finished, and if more
+// than one throws, it's the one from the first subexpression (in order), as in sequential evaluation.
+//
+// A task doesn't use the memoizer (if any) of the forking EvalCtx, since Memoizer isn't thread-safe.
+namespace par {
+
+// A fixed set of worker threads that run tasks, each with its own deque of tasks.  A thread that forks
+// tasks pushes them onto its own deque (or a shared one, if it's not a worker), and idle workers steal
+// from the other end of other threads' deques, so that nested forks are mostly run by the thread that
+// forked them, and stealing moves the largest (i.e. outermost) tasks.
+class TaskPool {
+public:
+
+    // Subexpressions estimated (by summarize_expr) to cost less than min_fork_cost are evaluated inline
+    // instead of being forked (see calibrate_min_fork_cost).  thread_count must be at least 1.
+    TaskPool (size_t thread_count, size_t min_fork_cost);
+    ~TaskPool ();
+
+    TaskPool (TaskPool const &) = delete;
+    TaskPool &operator= (TaskPool const &) = delete;
+
+    // The number of workers that keeps every hardware thread busy without oversubscribing them, since the
+    // thread that forks tasks also runs them.  This is 0 if there's only one hardware thread (or it can't
+    // be determined), in which case there's nothing to gain from a TaskPool.
+    static size_t default_thread_count ();
+
+    size_t thread_count () const { return m_workers.size(); }
+    size_t min_fork_cost () const { return m_min_fork_cost; }
+    // This must not be called while tasks are running.
+    void set_min_fork_cost (size_t min_fork_cost) { m_min_fork_cost = min_fork_cost; }
+    // The number of tasks that have been pushed by run_all, i.e. that could have run on another thread.
+    size_t fork_count () const { return m_fork_count.load(std::memory_order_relaxed); }
+    // True if there are already enough queued tasks to keep every worker busy, in which case forking
+    // more won't make anything faster.
+    bool is_saturated () const { return m_queued_count.load(std::memory_order_relaxed) >= 2*m_workers.size(); }
+
+    // Runs all the tasks, possibly in parallel, and returns once they've all finished.  The calling thread
+    // runs tasks[0] itself, and runs queued tasks (not necessarily these) while waiting for the rest.
+    // The tasks must not throw.
+    void run_all (std::vector<std::function<void()>> const &tasks);
+
+private:
+
+    struct Job {
+        std::function<void()> const *m_task = nullptr;
+        std::atomic<bool> m_is_done{false};
+    };
+
+    struct JobQueue {
+        std::mutex m_mutex;
+        std::deque<Job*> m_jobs;
+    };
+
+    void push (size_t queue_index, Job *job);
+    // Pops from the back of the given queue, or steals from the front of another, or returns nullptr.
+    Job *take (size_t queue_index);
+    void run (Job *job);
+    void worker_loop (size_t queue_index);
+    // The index of the calling thread's own queue.
+    size_t own_queue_index () const;
+
+    size_t m_min_fork_cost;
+    // One per worker, then one shared by all other threads.
+    std::vector<std::unique_ptr<JobQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_queued_count{0};
+    std::atomic<size_t> m_fork_count{0};
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake_cv;
+    bool m_is_stopping = false;
+};
+
+// An estimate of the cost of evaluating an Expr, in roughly the number of nodes that would be evaluated,
+// and whether evaluating it could have side effects.
+struct ExprSummary {
+    size_t m_cost = 0;
+    bool m_has_side_effects = false;
+};
+
+// Function calls are resolved in ctx's current scope, and their bodies are included (with the cost of
+// recursive calls being unbounded).  A call to an undefined symbol is treated as having side effects.
+ExprSummary summarize_expr (sept::Data const &expr, sem::EvalCtx const &ctx) noexcept(false);
+
+// Returns the min_fork_cost (see TaskPool) at which a forked task is estimated to take overhead_factor
+// times as long as forking it.  This times evaluate_in_parallel on trivial exprs to find the overhead of
+// a fork, and times the sequential evaluation of sample_expr in ctx (whose TaskPool is ignored) to find the time per
+// unit of the cost estimated by summarize_expr.  sample_expr should be representative of what's going to
+// be evaluated, and free of side effects.
+size_t calibrate_min_fork_cost (TaskPool &task_pool, sept::Data const &sample_expr, sem::EvalCtx &ctx, double overhead_factor = 10.0) noexcept(false);
+
+// If ctx has a TaskPool which isn't saturated, and it's worth evaluating the given Exprs in parallel
+// (see above), then this does so and returns their values (in order).  Otherwise it returns std::nullopt,
+// and they should be evaluated sequentially.
+std::optional<sept::DataVector> evaluate_in_parallel (std::vector<sept::Data const *> const &exprs, sem::EvalCtx &ctx) noexcept(false);
+std::optional<sept::DataVector> evaluate_in_parallel (sem::ExprArray_Term_c const &expr_array_term, sem::EvalCtx &ctx) noexcept(false);
+
+} // end namespace par
@@ -0,0 +1,75 @@
+// 2021.05.28 - Victor Dods
+
+// The sept data model registrations for the types in sept-ast, and the evaluator registrations.  These
+// are in their own translation unit so that both sept-ast and test-septast can link them in.
+
+// Includes from this program's source
+#include "common.hpp"
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include "sept/FormalTypeOf.hpp"
+#include "sept/UnionTerm.hpp"
+
+//
+// sept data model registrations
+//
+
+namespace sept {
+SEPT__REGISTER__PRINT(ASTNPTerm)
+SEPT__REGISTER__PRINT(BinOp_c)
+SEPT__REGISTER__PRINT__GIVE_ID(sem::Expr_Term_c, __sem__Expr_Term_c__)
+SEPT__REGISTER__PRINT(SymbolId_c)
+SEPT__REGISTER__PRINT(UnOp_c)
+SEPT__REGISTER__PRINT__GIVE_ID(char const *, __char_const_ptr__)
+
+SEPT__REGISTER__EQ(BinOp_c)
+SEPT__REGISTER__EQ(UnOp_c)
+SEPT__REGISTER__EQ(ASTNPTerm)
+SEPT__REGISTER__EQ(SymbolId_c)
+
+SEPT__REGISTER__ABSTRACT_TYPE_OF(BinOp_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(UnOp_c)
+
+SEPT__REGISTER__INHABITS__NONDATA(ASTNPTerm, BinOp_c)
+SEPT__REGISTER__INHABITS__NONDATA(ASTNPTerm,     UnOp_c)
+SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(ASTNPTerm,     FormalTypeOf_Term_c, __ASTNPTerm___sem__FormalTypeOf_Term_c__)
+SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(std::string,   SymbolId_c, __std_string___SymbolId_c__)
+SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(char const *,  SymbolId_c, __char_const_ptr___SymbolId_c__)
+// TODO there are probably some missing
+
+SEPT__REGISTER__COMPARE__SINGLETON(BinOp_c)
+SEPT__REGISTER__COMPARE__SINGLETON(UnOp_c)
+SEPT__REGISTER__COMPARE(ASTNPTerm, ASTNPTerm)
+
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(BinOp_c, ASTNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnOp_c, ASTNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(FormalTypeOf_Term_c, ASTNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__GIVE_ID__ABSTRACT_TYPE(SymbolId_c, std::string, __SymbolId_c___std_string__)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__GIVE_ID__ABSTRACT_TYPE(SymbolId_c, char const *, __SymbolId_c___char_const_ptr__)
+
+// TEMP HACK
+SEPT__REGISTER__INHABITS__NONDATA(ASTNPTerm, UnionTerm_c)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnionTerm_c, ASTNPTerm)
+} // end namespace sept
+
+namespace sem {
+
+SEPT__REGISTER__EVALUATE_EXPR(bool)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::True_c, __sept__True_c__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::False_c, __sept__False_c__)
+SEPT__REGISTER__EVALUATE_EXPR(double)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(std::string, __std_string__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::TupleTerm_c, __sept__TupleTerm_c__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::Array_c, __sept__Array_c__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArrayESTerm_c, __sept__ArrayESTerm_c__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArrayETerm_c, __sept__ArrayETerm_c__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArraySTerm_c, __sept__ArraySTerm_c__)
+SEPT__REGISTER__EVALUATE_EXPR__GIVE_ID(sept::ArrayTerm_c, __sept__ArrayTerm_c__)
+SEPT__REGISTER__EVALUATE_EXPR(ValueTerminal_Term_c)
+SEPT__REGISTER__EVALUATE_EXPR(ExprArray_Term_c)
+SEPT__REGISTER__EVALUATE_EXPR(Expr_Term_c)
+
+SEPT__REGISTER__EXECUTE_STMT__GIVE_ID(sept::TupleTerm_c, __sept__TupleTerm_c__)
+
+} // end namespace sem
@@ -2,11 +2,41 @@
 
 #include "sem.hpp"
 
+// Includes from this program's source
+#include "memo.hpp"
+#include "par.hpp"
+#include "typecheck.hpp"
+
+#include <atomic>
 #include <cmath>
 #include <lvd/comma.hpp>
+#include <mutex>
+#include <optional>
 
 namespace sem {
 
+namespace {
+
+// lvd::g_log isn't thread-safe, and the tasks of a parallel evaluation (see par.hpp) can log concurrently,
+// so logging during evaluation is serialized, and skipped (without touching g_log) if it'd be filtered out.
+std::mutex g_log_mutex;
+
+bool log_level_is_enabled (lvd::LogLevel log_level) {
+    return log_level >= lvd::g_log.log_level_threshold();
+}
+
+// The counts for call_check_counts.  These are relaxed, since they're only statistics.
+std::atomic<uint64_t> g_param_type_eval_count{0};
+std::atomic<uint64_t> g_codomain_eval_count{0};
+std::atomic<uint64_t> g_arg_check_count{0};
+std::atomic<uint64_t> g_return_check_count{0};
+
+void count (std::atomic<uint64_t> &counter) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // end namespace
+
 sept::Data evaluate_expr_data (sept::Data const &expr_data, EvalCtx &ctx) {
     // Look up the type pair in the evaluator map.
     auto const &evaluator_map = lvd::static_association_singleton<EvaluateExpr>();
@@ -14,7 +44,10 @@ sept::Data evaluate_expr_data (sept::Data const &expr_data, EvalCtx &ctx) {
     if (it == evaluator_map.end()) {
 //         throw std::runtime_error(LVD_FMT("Data type " << expr_data.type().name() << " is not registered in EvaluateExpr for use in evaluate_expr_data"));
         // Evaluation is the identity.  TODO: Maybe don't do this, because it makes missing registrations harder to detect.
-        lvd::g_log << lvd::Log::wrn() << LVD_FMT("Data type " << expr_data.type().name() << " is not registered in EvaluateExpr for use in evaluate_expr_data; returning data unchanged.") << '\n';
+        if (log_level_is_enabled(lvd::LogLevel::WRN)) {
+            std::lock_guard<std::mutex> log_lock(g_log_mutex);
+            lvd::g_log << lvd::Log::wrn() << LVD_FMT("Data type " << expr_data.type().name() << " is not registered in EvaluateExpr for use in evaluate_expr_data; returning data unchanged.") << '\n';
+        }
         return expr_data;
     }
 
@@ -87,6 +120,10 @@ std::ostream &operator<< (std::ostream &out, FuncLiteral_Term_c const &func_lite
     return out << "FuncLiteral_Term_c(" << func_literal_term.m_prototype << ", " << func_literal_term.m_body_expr << ')';
 }
 
+std::ostream &operator<< (std::ostream &out, FuncClosure const &func_closure) {
+    return out << "FuncClosure(" << func_closure.m_func_literal << ", slot: " << func_closure.m_slot << ')';
+}
+
 std::ostream &operator<< (std::ostream &out, Assignment_Term_c const &assignment_term) {
     return out << "Assignment_Term_c(" << assignment_term.m_symbol_id << ", " << assignment_term.m_value << ')';
 }
@@ -216,7 +253,7 @@ FuncEval_Term_c parse_FuncEval_Term (sept::Data const &d) {
     assert(inhabits_data(d, syn::FuncEval));
     auto const &t = d.cast<sept::TupleTerm_c const &>();
     return FuncEval_Term_c{
-        t[0].cast<std::string const &>(),
+        sept::intern(t[0].cast<std::string const &>()),
         std::move(parse_RoundExpr_Term(t[1]).m_expr_array)
     };
 }
@@ -248,7 +285,7 @@ SymbolTypeDecl_Term_c parse_SymbolTypeDecl_Term (sept::Data const &d) {
     auto const &t = d.cast<sept::TupleTerm_c const &>();
     // Note that t[1] is DeclaredAs, which is only used for syntactical distinction.
     return SymbolTypeDecl_Term_c{
-        t[0].cast<std::string const &>(),
+        sept::intern(t[0].cast<std::string const &>()),
         t[2]
     };
 }
@@ -257,7 +294,7 @@ SymbolDefn_Term_c parse_SymbolDefn_Term (sept::TupleTerm_c const &t) {
     assert(inhabits_data(t, syn::SymbolDefn));
     // Note that t[1] is DefinedAs, which is only used for syntactical distinction.
     return SymbolDefn_Term_c{
-        t[0].cast<std::string const &>(),
+        sept::intern(t[0].cast<std::string const &>()),
         t[2]
     };
 }
@@ -281,9 +318,15 @@ FuncPrototype_Term_c parse_FuncPrototype_Term (sept::Data const &d) {
     assert(inhabits_data(d, syn::FuncPrototype));
     auto const &t = d.cast<sept::TupleTerm_c const &>();
     // t[1] is MapsTo, which is only used for syntactical distinction.
+    auto param_decls = parse_SymbolTypeDeclArray_Term(t[0]);
+    std::vector<sept::InternedId> param_symbol_ids;
+    param_symbol_ids.reserve(param_decls.size());
+    for (auto const &param_decl : param_decls)
+        param_symbol_ids.emplace_back(param_decl.m_symbol_id);
     return FuncPrototype_Term_c{
-        parse_SymbolTypeDeclArray_Term(t[0]),
-        t[2]
+        std::move(param_decls),
+        t[2],
+        std::move(param_symbol_ids)
     };
 }
 
@@ -300,7 +343,7 @@ Assignment_Term_c parse_Assignment_Term (sept::TupleTerm_c const &t) {
     assert(inhabits_data(t, syn::Assignment));
     // Note that t[1] is AssignFrom, which is only used for syntactical distinction.
     return Assignment_Term_c{
-        t[0].cast<std::string const &>(),
+        sept::intern(t[0].cast<std::string const &>()),
         t[2]
     };
 }
@@ -312,7 +355,7 @@ Assignment_Term_c parse_Assignment_Term (sept::Data const &d) {
 
 SymbolId_Term_c parse_SymbolId_Term (std::string const &s) {
     assert(inhabits(s, SymbolId));
-    return SymbolId_Term_c{s};
+    return SymbolId_Term_c{sept::intern(s)};
 }
 
 SymbolId_Term_c parse_SymbolId_Term (sept::Data const &d) {
@@ -326,48 +369,35 @@ ValueTerminal_Term_c parse_ValueTerminal_Term (sept::Data const &d) {
 }
 
 Expr_Term_c parse_Expr_Term (sept::Data const &d) {
-    assert(inhabits_data(d, syn::Expr));
-    // TODO: Implement this search using a poset
-    if (false)
-        { }
-    else if (inhabits_data(d, syn::BinOpExpr))
-        return Expr_Term_c{parse_BinOpExpr_Term(d)};
-    else if (inhabits_data(d, syn::BlockExpr))
-        return Expr_Term_c{parse_BlockExpr_Term(d)};
-    else if (inhabits_data(d, syn::CondExpr))
-        return Expr_Term_c{parse_CondExpr_Term(d)};
-    else if (inhabits_data(d, syn::Construction))
-        return Expr_Term_c{parse_Construction_Term(d)};
-    else if (inhabits_data(d, syn::ElementEval))
-        return Expr_Term_c{parse_ElementEval_Term(d)};
-    else if (inhabits_data(d, syn::FuncEval))
-        return Expr_Term_c{parse_FuncEval_Term(d)};
-    else if (inhabits_data(d, syn::RoundExpr))
-        return Expr_Term_c{parse_RoundExpr_Term(d)};
-    else if (inhabits_data(d, SymbolId))
-        return Expr_Term_c{parse_SymbolId_Term(d)};
-    else if (inhabits_data(d, syn::UnOpExpr))
-        return Expr_Term_c{parse_UnOpExpr_Term(d)};
-    else if (inhabits_data(d, syn::ValueTerminal))
-        return Expr_Term_c{parse_ValueTerminal_Term(d)};
-    else
+    // The elements are checked as they're parsed, so checking the whole subtree here is only for debugging.
+    auto expr_kind = syn::classify_expr_shallowly(d);
+    assert(expr_kind == syn::classify_expr(d));
+    if (!expr_kind.has_value())
         LVD_ABORT(LVD_FMT("data not recognized as Expr: " << d));
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:    return Expr_Term_c{parse_BinOpExpr_Term(d)};
+        case syn::ExprKind::BLOCK_EXPR:     return Expr_Term_c{parse_BlockExpr_Term(d)};
+        case syn::ExprKind::COND_EXPR:      return Expr_Term_c{parse_CondExpr_Term(d)};
+        case syn::ExprKind::CONSTRUCTION:   return Expr_Term_c{parse_Construction_Term(d)};
+        case syn::ExprKind::ELEMENT_EVAL:   return Expr_Term_c{parse_ElementEval_Term(d)};
+        case syn::ExprKind::FUNC_EVAL:      return Expr_Term_c{parse_FuncEval_Term(d)};
+        case syn::ExprKind::ROUND_EXPR:     return Expr_Term_c{parse_RoundExpr_Term(d)};
+        case syn::ExprKind::UN_OP_EXPR:     return Expr_Term_c{parse_UnOpExpr_Term(d)};
+        case syn::ExprKind::SYMBOL_ID:      return Expr_Term_c{parse_SymbolId_Term(d)};
+        case syn::ExprKind::VALUE_TERMINAL: return Expr_Term_c{parse_ValueTerminal_Term(d)};
+        default: LVD_ABORT(LVD_FMT("invalid syn::ExprKind: " << uint32_t(*expr_kind)));
+    }
 }
 
 sept::Data evaluate_BinOpExpr_Term (BinOpExpr_Term_c const &bin_op_expr_term, EvalCtx &ctx) {
+    if (ctx.task_pool() != nullptr) {
+        auto evaled_operands = par::evaluate_in_parallel(std::vector<sept::Data const *>{&bin_op_expr_term.m_lhs_expr, &bin_op_expr_term.m_rhs_expr}, ctx);
+        if (evaled_operands.has_value())
+            return apply_bin_op(bin_op_expr_term.m_bin_op, (*evaled_operands)[0], (*evaled_operands)[1]);
+    }
     auto evaled_lhs_expr = evaluate_expr_data(bin_op_expr_term.m_lhs_expr, ctx);
     auto evaled_rhs_expr = evaluate_expr_data(bin_op_expr_term.m_rhs_expr, ctx);
-    switch (bin_op_expr_term.m_bin_op) {
-        case ASTNPTerm::AND: return evaled_lhs_expr.cast<bool>() && evaled_rhs_expr.cast<bool>();
-        case ASTNPTerm::OR:  return evaled_lhs_expr.cast<bool>() || evaled_rhs_expr.cast<bool>();
-        case ASTNPTerm::XOR: return evaled_lhs_expr.cast<bool>() != evaled_rhs_expr.cast<bool>();
-        case ASTNPTerm::ADD: return evaled_lhs_expr.cast<double>() + evaled_rhs_expr.cast<double>();
-        case ASTNPTerm::SUB: return evaled_lhs_expr.cast<double>() - evaled_rhs_expr.cast<double>();
-        case ASTNPTerm::MUL: return evaled_lhs_expr.cast<double>() * evaled_rhs_expr.cast<double>();
-        case ASTNPTerm::DIV: return evaled_lhs_expr.cast<double>() / evaled_rhs_expr.cast<double>();
-        case ASTNPTerm::POW: return std::pow(evaled_lhs_expr.cast<double>(), evaled_rhs_expr.cast<double>());
-        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as a BinOp: " << uint32_t(bin_op_expr_term.m_bin_op)));
-    }
+    return apply_bin_op(bin_op_expr_term.m_bin_op, evaled_lhs_expr, evaled_rhs_expr);
 }
 
 sept::Data evaluate_BlockExpr_Term (BlockExpr_Term_c const &block_expr_term, EvalCtx &ctx) {
@@ -391,20 +421,21 @@ sept::Data evaluate_Construction_Term (Construction_Term_c const &construction_t
 //                << LVD_REFLECT(evaled_type_to_construct) << '\n'
 //                << LVD_REFLECT(construction_term.m_params.m_expr_array) << '\n'
 //                << LVD_REFLECT(evaled_param_array) << '\n';
-    // TEMP HACK -- this unwraps the ExprArray, which is assumed to contain only a single element for now.
-    assert(evaled_param_array.size() == 1);
-    return evaled_type_to_construct(evaled_param_array[0]).deref();
+    return apply_construction(evaled_type_to_construct, evaled_param_array);
 }
 
 sept::Data evaluate_ElementEval_Term (ElementEval_Term_c const &element_eval_term, EvalCtx &ctx) {
     auto evaled_container = evaluate_expr_data(element_eval_term.m_container, ctx);
     auto evaled_param_array = evaluate_ExprArray_Term(element_eval_term.m_params, ctx);
-    // TEMP HACK -- this unwraps the ExprArray, which is assumed to contain only a single element for now.
-    assert(evaled_param_array.size() == 1);
-    return evaled_container[evaled_param_array[0]].deref();
+    return apply_element_eval(evaled_container, evaled_param_array);
 }
 
 sept::ArrayTerm_c evaluate_ExprArray_Term (ExprArray_Term_c const &expr_array_term, EvalCtx &ctx) {
+    if (ctx.task_pool() != nullptr) {
+        auto evaled_elements = par::evaluate_in_parallel(expr_array_term, ctx);
+        if (evaled_elements.has_value())
+            return sept::ArrayTerm_c{std::move(*evaled_elements)};
+    }
     sept::DataVector evaluated_elements;
     evaluated_elements.reserve(expr_array_term.size());
     for (auto const &element : expr_array_term)
@@ -413,54 +444,146 @@ sept::ArrayTerm_c evaluate_ExprArray_Term (ExprArray_Term_c const &expr_array_te
 }
 
 sept::Data evaluate_FuncEval_Term (FuncEval_Term_c const &func_eval_term, EvalCtx &ctx) {
-    lvd::g_log << lvd::Log::trc() << LVD_CALL_SITE() << '\n'
-               << LVD_REFLECT(func_eval_term.m_func_symbol_id) << '\n'
-               << LVD_REFLECT(func_eval_term.m_params) << '\n';
-
-    // Resolve the function symbol
-    // TODO: Later this will turn into an expression that produces a function.
-    auto func_literal = parse_FuncLiteral_Term(ctx.current_scope()->resolve_symbol_const(func_eval_term.m_func_symbol_id));
-//     lvd::g_log << lvd::Log::trc() << '\n' << LVD_CALL_SITE() << " - " << LVD_REFLECT(func_literal) << '\n';
+    if (log_level_is_enabled(lvd::LogLevel::TRC)) {
+        std::lock_guard<std::mutex> log_lock(g_log_mutex);
+        lvd::g_log << lvd::Log::trc() << LVD_CALL_SITE() << '\n'
+                   << LVD_REFLECT(func_eval_term.m_func_symbol_id) << '\n'
+                   << LVD_REFLECT(func_eval_term.m_params) << '\n';
+    }
 
-//     assert(sept::inhabits_data(func, FuncLiteral));
+    auto func_call = begin_func_call(func_eval_term.m_func_symbol_id, ctx);
     auto evaled_param_array = evaluate_ExprArray_Term(func_eval_term.m_params, ctx);
-//     lvd::g_log << lvd::Log::trc() << LVD_CALL_SITE() << " - " << LVD_REFLECT(evaled_param_array) << '\n';
+    auto memoized_value = enter_func_call(func_call, std::move(evaled_param_array), ctx);
+    if (memoized_value.has_value())
+        return std::move(*memoized_value);
 
+    lvd::ScopeGuard scope_guard{[&ctx](){ ctx.pop_func_scope(); }};
+    // Evaluate the function body using the new scope.
+    // Have to deref the data, since this might be a reference.
+    auto retval = evaluate_expr_data(func_call.func_literal().m_body_expr, ctx).deref();
+    finish_func_call(func_call, retval);
+    return retval;
+}
+
+FuncLiteral_Term_c const &FuncCall::func_literal () const {
+    return m_func_facts != nullptr ? m_func_facts->m_func_literal :
+           m_func_closure != nullptr ? m_func_closure->m_func_literal :
+           *m_parsed_func_literal;
+}
+
+sept::DataVector const *FuncCall::param_types () const {
+    return m_func_facts != nullptr ? &m_func_facts->m_param_types :
+           m_func_closure != nullptr ? &m_func_closure->m_param_types :
+           nullptr;
+}
+
+sept::Data const &FuncCall::return_type () const {
+    return m_func_facts != nullptr ? m_func_facts->m_codomain :
+           m_func_closure != nullptr ? m_func_closure->m_codomain :
+           *m_return_type_eval;
+}
+
+bool FuncCall::return_type_is_proved () const {
+    return m_func_facts != nullptr && m_func_facts->m_return_type_proved;
+}
+
+FuncCall begin_func_call (sept::InternedId func_symbol_id, EvalCtx &ctx) noexcept(false) {
+    // Resolve the function symbol
+    // TODO: Later this will turn into an expression that produces a function.
+    auto const &func_data = ctx.current_scope()->resolve_symbol_const(func_symbol_id);
+    // If the function was statically checked (and ctx trusts that), then it's already parsed, its
+    // prototype is already evaluated, and the checks that were proved can be skipped.
+    auto checked_program = ctx.checked_program();
+    auto const *func_facts = typecheck::trusted_func_facts(ctx, func_data);
+    // Otherwise, if the function symbol was bound by a SymbolDefn (or Assignment), then its closure is
+    // already parsed and has its prototype evaluated.
+    auto func_closure = func_facts == nullptr ? find_func_closure(func_data, ctx) : nullptr;
+    FuncCall func_call{func_symbol_id, &func_data, std::move(checked_program), func_facts, std::move(func_closure), std::nullopt, nullptr, std::nullopt, std::nullopt};
+    if (func_facts == nullptr && func_call.m_func_closure == nullptr)
+        func_call.m_parsed_func_literal.emplace(parse_FuncLiteral_Term(func_data));
+    return func_call;
+}
+
+std::optional<sept::Data> enter_func_call (FuncCall &func_call, sept::ArrayTerm_c &&evaled_param_array, EvalCtx &ctx) noexcept(false) {
+    auto const &func_data = *func_call.m_func_data;
     // Identify the parameter symbol decl
     // NOTE: This probably copy-constructs, instead of returning a const ref.
     // TODO: Could have the stuff return a MemRef.
-    auto const &func_prototype = func_literal.m_prototype;
+    auto const &func_prototype = func_call.func_literal().m_prototype;
+    auto const *param_types = func_call.param_types();
     // Check that there are the expected number of parameters in the FuncEval
     // TODO: Could check this earlier.
     if (func_prototype.m_param_decls.size() != evaled_param_array.size())
-        throw std::runtime_error(LVD_FMT("Expected " << func_prototype.m_param_decls.size() << " parameters in call to function " << func_eval_term.m_func_symbol_id << ", but got " << evaled_param_array.size()));
+        throw std::runtime_error(LVD_FMT("Expected " << func_prototype.m_param_decls.size() << " parameters in call to function " << func_call.m_func_symbol_id << ", but got " << evaled_param_array.size()));
     // Now check that all the param types are as expected.
-    for (size_t i = 0; i < func_prototype.m_param_decls.size(); ++i) {
-        auto const &evaled_param = evaled_param_array[i];
-        auto const &param_decl = func_prototype.m_param_decls[i];
-        // NOTE/TEMP HACK: This will resolve any symbolic references in the param types using the local symbol table,
-        // and not the symbol table of the scope that the function was declared in.  TODO: Fix this.
-        auto evaled_param_decl_type = evaluate_expr_data(param_decl.m_decl_type, ctx);
-        if (!inhabits_data(evaled_param, evaled_param_decl_type))
-            throw std::runtime_error(LVD_FMT("In parameter " << i << " in call to function " << func_eval_term.m_func_symbol_id << ": Expected a value of type " << evaled_param_decl_type << " but got " << evaled_param << " (which has abstract type " << sept::abstract_type_of_data(evaled_param) << ')'));
+    if (!typecheck::call_args_proved(ctx, func_call.m_func_symbol_id, func_data)) {
+        for (size_t i = 0; i < func_prototype.m_param_decls.size(); ++i) {
+            auto const &evaled_param = evaled_param_array[i];
+            auto const &param_decl = func_prototype.m_param_decls[i];
+            // NOTE/TEMP HACK: This will resolve any symbolic references in the param types using the local symbol table,
+            // and not the symbol table of the scope that the function was declared in.  TODO: Fix this.
+            // Closures don't have this problem, since their param types were evaluated where they were bound.
+            std::optional<sept::Data> evaled_param_decl_type_eval;
+            if (param_types == nullptr) {
+                count(g_param_type_eval_count);
+                evaled_param_decl_type_eval.emplace(evaluate_expr_data(param_decl.m_decl_type, ctx));
+            }
+            auto const &evaled_param_decl_type = param_types != nullptr ? (*param_types)[i] : *evaled_param_decl_type_eval;
+            count(g_arg_check_count);
+            if (!inhabits_data(evaled_param, evaled_param_decl_type))
+                throw std::runtime_error(LVD_FMT("In parameter " << i << " in call to function " << func_call.m_func_symbol_id << ": Expected a value of type " << evaled_param_decl_type << " but got " << evaled_param << " (which has abstract type " << sept::abstract_type_of_data(evaled_param) << ')'));
+        }
     }
 
-    auto return_type_eval = evaluate_expr_data(func_prototype.m_codomain, ctx);
+    // If the function is pure and calls to it are being memoized, its value may already be known.  The
+    // Memoizer is held for the same reason as the CheckedProgram.
+    auto const &memoizer = ctx.memoizer();
+    if (memoizer != nullptr && memoizer->is_pure(func_data)) {
+        func_call.m_memoizer = memoizer;
+        func_call.m_memo_args = memo::Memoizer::key_args(evaled_param_array.elements());
+        if (func_call.m_memo_args.has_value()) {
+            auto const *memoized_value = memoizer->find(func_data, *func_call.m_memo_args);
+            if (memoized_value != nullptr)
+                return *memoized_value;
+        }
+    }
 
-    // Push a context, define the function param(s).
-    auto scope_guard = ctx.push_scope();
-    for (size_t i = 0; i < func_prototype.m_param_decls.size(); ++i) {
-        auto const &param_symbol_id = func_prototype.m_param_decls[i].m_symbol_id;
-        auto &evaled_param = evaled_param_array[i];
-        ctx.current_scope()->define_symbol(param_symbol_id, std::move(evaled_param));
+    if (func_call.m_func_facts == nullptr && func_call.m_func_closure == nullptr) {
+        count(g_codomain_eval_count);
+        func_call.m_return_type_eval.emplace(evaluate_expr_data(func_prototype.m_codomain, ctx));
     }
-    // Evaluate the function body using the new scope.
-    // Have to deref the data, since this might be a reference.
-    auto retval = evaluate_expr_data(func_literal.m_body_expr, ctx).deref();
-    // Check that the parameter is the correct type
-    if (!sept::inhabits_data(retval, return_type_eval))
-        throw std::runtime_error(LVD_FMT("Expected return value " << retval << " to evaluate to a term of type " << func_prototype.m_codomain << " but it didn't; retval: " << retval.deref()));
-    return retval;
+
+    // Push a context, define the function param(s).  Param i goes in slot i, which is what lets
+    // evaluate_SymbolId_Term resolve references to params by slot.
+    ctx.push_func_scope_unguarded(func_prototype.m_param_symbol_ids, func_call.m_func_facts);
+    try {
+        for (size_t i = 0; i < func_prototype.m_param_decls.size(); ++i) {
+            auto const &param_symbol_id = func_prototype.m_param_decls[i].m_symbol_id;
+            auto &evaled_param = evaled_param_array[i];
+            auto slot = ctx.current_scope()->define_symbol(param_symbol_id, std::move(evaled_param));
+            if (slot != i)
+                LVD_ABORT(LVD_FMT("param " << param_symbol_id << " was defined in slot " << slot << " instead of slot " << i));
+        }
+    } catch (...) {
+        ctx.pop_func_scope();
+        throw;
+    }
+    return std::nullopt;
+}
+
+void finish_func_call (FuncCall &func_call, sept::Data const &retval) noexcept(false) {
+    // Check that the return value is the correct type
+    if (!func_call.return_type_is_proved())
+        check_return_value(retval, func_call.return_type(), func_call.func_literal().m_prototype.m_codomain);
+    // The body could have rebound the function, in which case it's no longer considered pure.
+    if (func_call.m_memo_args.has_value() && func_call.m_memoizer->is_pure(*func_call.m_func_data))
+        func_call.m_memoizer->insert(*func_call.m_func_data, std::move(*func_call.m_memo_args), sept::Data{retval});
+}
+
+void check_return_value (sept::Data const &retval, sept::Data const &return_type, sept::Data const &codomain) noexcept(false) {
+    count(g_return_check_count);
+    if (!sept::inhabits_data(retval, return_type))
+        throw std::runtime_error(LVD_FMT("Expected return value " << retval << " to evaluate to a term of type " << codomain << " but it didn't; retval: " << retval.deref()));
 }
 
 sept::ArrayTerm_c evaluate_RoundExpr_Term (RoundExpr_Term_c const &round_expr_term, EvalCtx &ctx) {
@@ -468,16 +591,17 @@ sept::ArrayTerm_c evaluate_RoundExpr_Term (RoundExpr_Term_c const &round_expr_te
 }
 
 sept::Data evaluate_SymbolId_Term (SymbolId_Term_c const &symbol_id_term, EvalCtx &ctx) {
-    return sept::LocalSymRef(symbol_id_term.m_symbol_id, ctx.current_scope());
+    // References to function params can be resolved statically to a slot, which makes deref an array index.
+    auto symbol_slot = ctx.func_param_slot(symbol_id_term.m_symbol_id);
+    if (symbol_slot.has_value())
+        return sept::LocalSymRef(symbol_id_term.m_symbol_id, ctx.current_scope(), *symbol_slot);
+    else
+        return sept::LocalSymRef(symbol_id_term.m_symbol_id, ctx.current_scope());
 }
 
 sept::Data evaluate_UnOpExpr_Term (UnOpExpr_Term_c const &un_op_expr_term, EvalCtx &ctx) {
     auto evaled_operand = evaluate_expr_data(un_op_expr_term.m_operand, ctx);
-    switch (un_op_expr_term.m_un_op) {
-        case ASTNPTerm::NOT: return !evaled_operand.cast<bool>();
-        case ASTNPTerm::NEG: return -evaled_operand.cast<double>();
-        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as an UnOp: " << uint32_t(un_op_expr_term.m_un_op)));
-    }
+    return apply_un_op(un_op_expr_term.m_un_op, evaled_operand);
 }
 
 sept::Data evaluate_ValueTerminal_Term (ValueTerminal_Term_c const &value_terminal_term, EvalCtx &ctx) {
@@ -502,6 +626,166 @@ sept::Data evaluate_Expr_Term (Expr_Term_c const &expr_term, EvalCtx &ctx) {
     );
 }
 
+sept::Data apply_bin_op (ASTNPTerm bin_op, sept::Data const &lhs, sept::Data const &rhs) {
+    switch (bin_op) {
+        case ASTNPTerm::AND: return lhs.cast<bool>() && rhs.cast<bool>();
+        case ASTNPTerm::OR:  return lhs.cast<bool>() || rhs.cast<bool>();
+        case ASTNPTerm::XOR: return lhs.cast<bool>() != rhs.cast<bool>();
+        case ASTNPTerm::ADD: return lhs.cast<double>() + rhs.cast<double>();
+        case ASTNPTerm::SUB: return lhs.cast<double>() - rhs.cast<double>();
+        case ASTNPTerm::MUL: return lhs.cast<double>() * rhs.cast<double>();
+        case ASTNPTerm::DIV: return lhs.cast<double>() / rhs.cast<double>();
+        case ASTNPTerm::POW: return std::pow(lhs.cast<double>(), rhs.cast<double>());
+        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as a BinOp: " << uint32_t(bin_op)));
+    }
+}
+
+sept::Data apply_un_op (ASTNPTerm un_op, sept::Data const &operand) {
+    switch (un_op) {
+        case ASTNPTerm::NOT: return !operand.cast<bool>();
+        case ASTNPTerm::NEG: return -operand.cast<double>();
+        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as an UnOp: " << uint32_t(un_op)));
+    }
+}
+
+sept::Data apply_construction (sept::Data const &type_to_construct, sept::ArrayTerm_c const &param_array) {
+    // TEMP HACK -- this unwraps the ExprArray, which is assumed to contain only a single element for now.
+    assert(param_array.size() == 1);
+    return type_to_construct(param_array[0]).deref();
+}
+
+sept::Data apply_element_eval (sept::Data const &container, sept::ArrayTerm_c const &param_array) {
+    // TEMP HACK -- this unwraps the ExprArray, which is assumed to contain only a single element for now.
+    assert(param_array.size() == 1);
+    return container[param_array[0]].deref();
+}
+
+namespace {
+
+std::atomic<uint64_t> g_func_binding_epoch{0};
+
+void advance_func_binding_epoch () {
+    g_func_binding_epoch.fetch_add(1, std::memory_order_release);
+}
+
+} // end namespace
+
+void bind_func_closure (sept::InternedId symbol_id, sept::Data const &func_data, EvalCtx &ctx) {
+    // Find the scope and slot that symbol_id is bound in, so that find_func_closure can tell if func_data
+    // is gone.
+    auto symbol_slot = ctx.current_scope()->locate_symbol(symbol_id);
+    if (!symbol_slot.has_value())
+        LVD_ABORT(LVD_FMT("can't bind a FuncClosure to undefined symbol " << symbol_id));
+    auto defining_scope = ctx.current_scope();
+    for (size_t depth = 0; depth < symbol_slot->m_depth; ++depth)
+        defining_scope = defining_scope->parent_symbol_table();
+    if (&defining_scope->slot_value(symbol_slot->m_slot) != &func_data)
+        LVD_ABORT(LVD_FMT("func_data isn't the Data that symbol " << symbol_id << " is bound to"));
+
+    advance_func_binding_epoch();
+    if (ctx.memoizer() != nullptr)
+        ctx.memoizer()->forget_func(func_data);
+    // The closure refers to its scope weakly, so it has to be kept from being reused for another scope.
+    ctx.mark_scope_escaped(defining_scope.get().get());
+
+    auto func_literal = parse_FuncLiteral_Term(func_data);
+    sept::DataVector param_types;
+    param_types.reserve(func_literal.m_prototype.m_param_decls.size());
+    for (auto const &param_decl : func_literal.m_prototype.m_param_decls)
+        param_types.emplace_back(evaluate_expr_data(param_decl.m_decl_type, ctx));
+    auto codomain = evaluate_expr_data(func_literal.m_prototype.m_codomain, ctx);
+
+    ctx.func_closure_map().insert_or_assign(
+        &func_data,
+        lvd::make_nnsp<FuncClosure const>(
+            FuncClosure{
+                std::move(func_literal),
+                std::move(param_types),
+                std::move(codomain),
+                defining_scope.get(),
+                symbol_slot->m_slot
+            }
+        )
+    );
+}
+
+namespace {
+
+// The Data that a closure was created from may have been erased (or its scope destroyed), in which case
+// some other Data could be at the same address.
+bool func_closure_is_current (FuncClosure const &func_closure, sept::Data const &func_data) {
+    auto defining_scope = func_closure.m_defining_scope.lock();
+    return defining_scope != nullptr
+        && func_closure.m_slot < defining_scope->slot_count()
+        && !defining_scope->slot_is_vacant(func_closure.m_slot)
+        && &defining_scope->slot_value(func_closure.m_slot) == &func_data;
+}
+
+} // end namespace
+
+void unbind_func_closure (sept::Data const &data, EvalCtx &ctx) {
+    // Only a Tuple can be mistaken for a FuncLiteral (see func_binding_epoch).
+    if (data.type() == typeid(sept::TupleTerm_c))
+        advance_func_binding_epoch();
+    ctx.func_closure_map().erase(&data);
+    if (ctx.memoizer() != nullptr)
+        ctx.memoizer()->forget_func(data);
+}
+
+lvd::sp<FuncClosure const> find_func_closure (sept::Data const &func_data, EvalCtx &ctx) {
+    auto &func_closure_map = ctx.func_closure_map();
+    auto it = func_closure_map.find(&func_data);
+    if (it != func_closure_map.end()) {
+        if (func_closure_is_current(*it->second, func_data))
+            return it->second;
+        func_closure_map.erase(it);
+    }
+    // A split EvalCtx can use the closures of the EvalCtx it was split from, but must not modify them,
+    // since other tasks may be reading them.
+    for (auto const *split_from = ctx.split_from(); split_from != nullptr; split_from = split_from->split_from()) {
+        auto split_from_it = split_from->func_closure_map().find(&func_data);
+        if (split_from_it != split_from->func_closure_map().end() && func_closure_is_current(*split_from_it->second, func_data))
+            return split_from_it->second;
+    }
+    return nullptr;
+}
+
+uint64_t func_binding_epoch () {
+    return g_func_binding_epoch.load(std::memory_order_acquire);
+}
+
+bool operator== (CallCheckCounts const &lhs, CallCheckCounts const &rhs) {
+    return lhs.m_param_type_eval_count == rhs.m_param_type_eval_count
+        && lhs.m_codomain_eval_count == rhs.m_codomain_eval_count
+        && lhs.m_arg_check_count == rhs.m_arg_check_count
+        && lhs.m_return_check_count == rhs.m_return_check_count;
+}
+
+CallCheckCounts operator- (CallCheckCounts const &lhs, CallCheckCounts const &rhs) {
+    return CallCheckCounts{
+        lhs.m_param_type_eval_count - rhs.m_param_type_eval_count,
+        lhs.m_codomain_eval_count - rhs.m_codomain_eval_count,
+        lhs.m_arg_check_count - rhs.m_arg_check_count,
+        lhs.m_return_check_count - rhs.m_return_check_count
+    };
+}
+
+std::ostream &operator<< (std::ostream &out, CallCheckCounts const &counts) {
+    return out << "CallCheckCounts{param_type_eval_count: " << counts.m_param_type_eval_count
+               << ", codomain_eval_count: " << counts.m_codomain_eval_count
+               << ", arg_check_count: " << counts.m_arg_check_count
+               << ", return_check_count: " << counts.m_return_check_count << '}';
+}
+
+CallCheckCounts call_check_counts () {
+    return CallCheckCounts{
+        g_param_type_eval_count.load(std::memory_order_relaxed),
+        g_codomain_eval_count.load(std::memory_order_relaxed),
+        g_arg_check_count.load(std::memory_order_relaxed),
+        g_return_check_count.load(std::memory_order_relaxed)
+    };
+}
+
 void execute_stmt__as_StmtArray (sept::ArrayTerm_c const &stmt_array, EvalCtx &ctx) {
     assert(inhabits(stmt_array, syn::StmtArray));
     for (auto const &stmt : stmt_array.elements())
@@ -518,44 +802,37 @@ void execute_stmt__as_StmtArray (sept::Data const &stmt, EvalCtx &ctx) {
 //
 
 sept::Data evaluate_expr (sept::TupleTerm_c const &t, sem::EvalCtx &ctx) {
-    // TODO: Make this efficient -- some sort of poset search.
-    if (false)
-        { }
-    else if (inhabits(t, syn::BinOpExpr))
-        return syn::evaluate_expr__as_BinOpExpr(t, ctx);
-    else if (inhabits(t, syn::BlockExpr))
-        return syn::evaluate_expr__as_BlockExpr(t, ctx);
-    else if (inhabits(t, syn::CondExpr))
-        return syn::evaluate_expr__as_CondExpr(t, ctx);
-    else if (inhabits(t, syn::Construction))
-        return syn::evaluate_expr__as_Construction(t, ctx);
-    else if (inhabits(t, syn::ElementEval))
-        return syn::evaluate_expr__as_ElementEval(t, ctx);
-    else if (inhabits(t, syn::FuncEval))
-        return syn::evaluate_expr__as_FuncEval(t, ctx);
-    else if (inhabits(t, syn::RoundExpr))
-        return syn::evaluate_expr__as_RoundExpr(t, ctx);
-    else if (inhabits(t, syn::UnOpExpr))
-        return syn::evaluate_expr__as_UnOpExpr(t, ctx);
-    else if (inhabits(t, syn::Expr)) {
-        LVD_ABORT(LVD_FMT("unhandled Expr: " << t));
-//         return t; // Just a plain Tuple.
-    } else
+    // The elements are checked as they're evaluated, so checking the whole subtree here is only for debugging.
+    auto expr_kind = syn::classify_expr_shallowly(t);
+    assert(expr_kind == syn::classify_expr(t));
+    if (!expr_kind.has_value())
         LVD_ABORT(LVD_FMT("attempting to evaluate_expr for a non-Expr: " << t));
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:  return syn::evaluate_expr__as_BinOpExpr(t, ctx);
+        case syn::ExprKind::BLOCK_EXPR:   return syn::evaluate_expr__as_BlockExpr(t, ctx);
+        case syn::ExprKind::COND_EXPR:    return syn::evaluate_expr__as_CondExpr(t, ctx);
+        case syn::ExprKind::CONSTRUCTION: return syn::evaluate_expr__as_Construction(t, ctx);
+        case syn::ExprKind::ELEMENT_EVAL: return syn::evaluate_expr__as_ElementEval(t, ctx);
+        case syn::ExprKind::FUNC_EVAL:    return syn::evaluate_expr__as_FuncEval(t, ctx);
+        case syn::ExprKind::ROUND_EXPR:   return syn::evaluate_expr__as_RoundExpr(t, ctx);
+        case syn::ExprKind::UN_OP_EXPR:   return syn::evaluate_expr__as_UnOpExpr(t, ctx);
+        default:
+            LVD_ABORT(LVD_FMT("unhandled Expr: " << t));
+//             return t; // Just a plain Tuple.
+    }
 }
 
 void execute_stmt (sept::TupleTerm_c const &t, sem::EvalCtx &ctx) {
-    // TODO: Make this efficient -- some sort of poset search.
-    if (false)
-        { }
-    else if (inhabits(t, syn::Assignment))
-        return syn::execute_stmt__as_Assignment(t, ctx);
-    else if (inhabits(t, syn::SymbolDefn))
-        return syn::execute_stmt__as_SymbolDefn(t, ctx);
-    else if (inhabits(t, syn::Stmt))
-        LVD_ABORT(LVD_FMT("unhandled Stmt: " << t));
-    else
+    // As in evaluate_expr.
+    auto stmt_kind = syn::classify_stmt_shallowly(t);
+    assert(stmt_kind == syn::classify_stmt(t));
+    if (!stmt_kind.has_value())
         LVD_ABORT(LVD_FMT("attempting to execute_stmt for a non-Stmt: " << t));
+    switch (*stmt_kind) {
+        case syn::StmtKind::ASSIGNMENT:  return syn::execute_stmt__as_Assignment(t, ctx);
+        case syn::StmtKind::SYMBOL_DEFN: return syn::execute_stmt__as_SymbolDefn(t, ctx);
+        default: LVD_ABORT(LVD_FMT("unhandled Stmt: " << t));
+    }
 }
 
 //
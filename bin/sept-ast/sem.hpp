@@ -1,12 +1,34 @@
 // 2021.04.19 - Victor Dods
 
+#pragma once
+
 // Includes from this program's source
 #include "syn.hpp"
 
 #include <functional>
+#include <lvd/aliases.hpp>
 #include <lvd/variant.hpp>
+#include <memory>
+#include <optional>
+#include <ostream>
 #include "sept/ArrayTerm.hpp"
 #include "sept/Data.hpp"
+#include "sept/DataVector.hpp"
+#include "sept/Interner.hpp"
+#include "sept/SymbolTable.hpp"
+
+namespace memo {
+
+class Memoizer;
+
+} // end namespace memo
+
+namespace typecheck {
+
+class CheckedProgram;
+struct FuncFacts;
+
+} // end namespace typecheck
 
 namespace sem {
 
@@ -142,7 +164,7 @@ struct CurlyExpr_Term_c {
 };
 
 struct FuncEval_Term_c {
-    std::string m_func_symbol_id;
+    sept::InternedId m_func_symbol_id;
     ExprArray_Term_c m_params;
 };
 
@@ -164,7 +186,7 @@ struct Construction_Term_c {
 // - Maybe distinguish `SymbolTypeDecl = sept::Tuple(SymbolId, sept::FormalTypeOf(DeclaredAs), TypeExpr_as_Ref)` by calling it
 //   something like `SyntacticalSymbolTypeDecl`, since the syntactical one is just meant as a syntactical representation.
 struct SymbolTypeDecl_Term_c {
-    std::string m_symbol_id;
+    sept::InternedId m_symbol_id;
     // TODO: If some sort of validation is done, this could potentially be destructured into TypeExpr or something.
     sept::Data m_decl_type;
 };
@@ -172,7 +194,7 @@ struct SymbolTypeDecl_Term_c {
 using SymbolTypeDeclArray_Term_c = std::vector<SymbolTypeDecl_Term_c>;
 
 struct SymbolDefn_Term_c {
-    std::string m_symbol_id;
+    sept::InternedId m_symbol_id;
     sept::Data m_defn;
 };
 
@@ -180,6 +202,9 @@ struct FuncPrototype_Term_c {
     SymbolTypeDeclArray_Term_c m_param_decls;
     // TODO: This would eventually be TypeExpr
     sept::Data m_codomain;
+    // The symbol id of each element of m_param_decls, in order.  This is the static layout of the
+    // function's param scope, i.e. param i is defined in slot i.
+    std::vector<sept::InternedId> m_param_symbol_ids;
 };
 
 struct FuncLiteral_Term_c {
@@ -187,13 +212,28 @@ struct FuncLiteral_Term_c {
     sept::Data m_body_expr;
 };
 
+// A FuncLiteral that has been prepared for calling.  This is created when a SymbolDefn (or Assignment)
+// binds a symbol to a FuncLiteral (see bind_func_closure), so that calls through that symbol don't have
+// to parse the FuncLiteral or evaluate its prototype.
+struct FuncClosure {
+    FuncLiteral_Term_c m_func_literal;
+    // The param types and codomain of m_func_literal, evaluated when the closure was created.  Symbolic
+    // types evaluate to references into the scope they were evaluated in, so that scope is captured.
+    sept::DataVector m_param_types;
+    sept::Data m_codomain;
+    // The scope and slot of the symbol that the FuncLiteral was bound to.  These identify the Data that
+    // the closure was created from, and are used to detect when that Data no longer exists.
+    std::weak_ptr<sept::SymbolTable> m_defining_scope;
+    size_t m_slot;
+};
+
 struct Assignment_Term_c {
-    std::string m_symbol_id;
+    sept::InternedId m_symbol_id;
     sept::Data m_value;
 };
 
 struct SymbolId_Term_c {
-    std::string m_symbol_id;
+    sept::InternedId m_symbol_id;
 };
 
 // TODO: Make this a std::variant -- or not?  sept::Data is more flexible and extensible,
@@ -219,6 +259,7 @@ std::ostream &operator<< (std::ostream &out, SymbolDefn_Term_c const &symbol_def
 std::ostream &operator<< (std::ostream &out, SymbolTypeDeclArray_Term_c const &v);
 std::ostream &operator<< (std::ostream &out, FuncPrototype_Term_c const &func_prototype_term);
 std::ostream &operator<< (std::ostream &out, FuncLiteral_Term_c const &func_literal_term);
+std::ostream &operator<< (std::ostream &out, FuncClosure const &func_closure);
 std::ostream &operator<< (std::ostream &out, Assignment_Term_c const &assignment_term);
 std::ostream &operator<< (std::ostream &out, SymbolId_Term_c const &symbol_id_term);
 std::ostream &operator<< (std::ostream &out, ValueTerminal_Term_c const &value_terminal_term);
@@ -276,6 +317,92 @@ sept::Data evaluate_UnOpExpr_Term (UnOpExpr_Term_c const &un_op_expr_term, EvalC
 sept::Data evaluate_ValueTerminal_Term (ValueTerminal_Term_c const &value_terminal_term, EvalCtx &ctx);
 sept::Data evaluate_Expr_Term (Expr_Term_c const &expr_term, EvalCtx &ctx);
 
+// These apply an operator to already-evaluated operands, and are also used by constant folding (see opt.hpp).
+sept::Data apply_bin_op (ASTNPTerm bin_op, sept::Data const &lhs, sept::Data const &rhs);
+sept::Data apply_un_op (ASTNPTerm un_op, sept::Data const &operand);
+// These do the same for Construction and ElementEval, given the evaluated type (or container) and params.
+sept::Data apply_construction (sept::Data const &type_to_construct, sept::ArrayTerm_c const &param_array);
+sept::Data apply_element_eval (sept::Data const &container, sept::ArrayTerm_c const &param_array);
+
+// Call this after binding symbol_id (as resolved in ctx.current_scope()) to func_data, which must be a
+// FuncLiteral.  This creates the FuncClosure for func_data, replacing any existing one.
+void bind_func_closure (sept::InternedId symbol_id, sept::Data const &func_data, EvalCtx &ctx);
+// Call this after binding a symbol to data that isn't a FuncLiteral.  This forgets any FuncClosure that
+// was created for the previous value.
+void unbind_func_closure (sept::Data const &data, EvalCtx &ctx);
+// Returns the FuncClosure for func_data if there is one and func_data is still the Data it was created
+// from, otherwise nullptr.  A shared_ptr is returned so that the closure can outlive a rebinding of the
+// symbol, e.g. by the body of the function itself.
+// NOTE: Rebinding a function symbol without going through bind_func_closure or unbind_func_closure
+// (e.g. directly via SymbolTable) isn't detected.
+lvd::sp<FuncClosure const> find_func_closure (sept::Data const &func_data, EvalCtx &ctx);
+// This is incremented (process-wide) whenever bind_func_closure is called, or unbind_func_closure is
+// called for a Tuple, i.e. whenever a symbol may have been bound in place to a different FuncLiteral
+// (which is a Tuple).  Anything that caches the function that a symbol is bound to (see vm::FunctionLink)
+// can check this, along with the binding still holding a Tuple, to tell that the Data at the same address
+// is still the same function, which the address alone can't tell.
+uint64_t func_binding_epoch ();
+
+// A call to a function, between the stages of evaluating a FuncEval.  evaluate_FuncEval_Term does all
+// of the stages in turn, but they're separate so that an evaluator which doesn't recurse on the C++
+// stack (see iter.hpp) can evaluate the args and the body itself:
+// - begin_func_call resolves the function, before the args are evaluated.
+// - enter_func_call checks the args and pushes the function's scope (unless the value is memoized).
+// - The body is evaluated in that scope, and its value is dereferenced.
+// - finish_func_call checks the return value and memoizes it.  The function's scope is then popped.
+struct FuncCall {
+    sept::InternedId m_func_symbol_id;
+    sept::Data const *m_func_data;
+    // The function's facts if it was statically checked (and ctx trusts that), otherwise its closure if
+    // it has one, otherwise its FuncLiteral parsed for this call.  The CheckedProgram and FuncClosure are
+    // held so that they outlive the call even if ctx stops using them.
+    lvd::sp<typecheck::CheckedProgram const> m_checked_program;
+    typecheck::FuncFacts const *m_func_facts;
+    lvd::sp<FuncClosure const> m_func_closure;
+    std::optional<FuncLiteral_Term_c> m_parsed_func_literal;
+    // This is set iff the function is pure and calls to it are being memoized, in which case m_memo_args
+    // is set iff the args could be used as a key.
+    lvd::sp<memo::Memoizer> m_memoizer;
+    std::optional<sept::DataVector> m_memo_args;
+    // This is set iff the codomain had to be evaluated for this call.
+    std::optional<sept::Data> m_return_type_eval;
+
+    FuncLiteral_Term_c const &func_literal () const;
+    // Returns nullptr if the param types have to be evaluated for this call.
+    sept::DataVector const *param_types () const;
+    // This is only valid after enter_func_call.
+    sept::Data const &return_type () const;
+    // Returns true iff the return value doesn't have to be checked.
+    bool return_type_is_proved () const;
+};
+
+FuncCall begin_func_call (sept::InternedId func_symbol_id, EvalCtx &ctx) noexcept(false);
+// Returns the value of the call if it was memoized, in which case no scope is pushed.
+std::optional<sept::Data> enter_func_call (FuncCall &func_call, sept::ArrayTerm_c &&evaled_param_array, EvalCtx &ctx) noexcept(false);
+void finish_func_call (FuncCall &func_call, sept::Data const &retval) noexcept(false);
+// Throws if retval doesn't inhabit return_type.  codomain is the function's (unevaluated) codomain.
+void check_return_value (sept::Data const &retval, sept::Data const &return_type, sept::Data const &codomain) noexcept(false);
+
+// Counts (process-wide) of the dynamic work done by function calls that a CheckedProgram (see
+// typecheck.hpp) or a FuncClosure can make unnecessary, so that which of it is actually skipped can be
+// observed, e.g. by comparing the counts over the same evaluation with and without a CheckedProgram.
+struct CallCheckCounts {
+    // Param types and codomains evaluated for a particular call.
+    uint64_t m_param_type_eval_count = 0;
+    uint64_t m_codomain_eval_count = 0;
+    // Args checked against their param types, and return values checked against their codomains.
+    uint64_t m_arg_check_count = 0;
+    uint64_t m_return_check_count = 0;
+};
+
+bool operator== (CallCheckCounts const &lhs, CallCheckCounts const &rhs);
+inline bool operator!= (CallCheckCounts const &lhs, CallCheckCounts const &rhs) { return !(lhs == rhs); }
+// Returns the difference of each count.
+CallCheckCounts operator- (CallCheckCounts const &lhs, CallCheckCounts const &rhs);
+std::ostream &operator<< (std::ostream &out, CallCheckCounts const &counts);
+
+CallCheckCounts call_check_counts ();
+
 inline bool evaluate_expr (bool const &expr, EvalCtx &ctx) {
     return expr;
 }
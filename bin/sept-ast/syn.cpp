@@ -5,6 +5,9 @@
 // Includes from this program's source
 #include "sem.hpp"
 
+#include <cassert>
+#include "sept/TypeClassifier.hpp"
+
 namespace syn {
 
 sept::RefTerm_c const Expr_as_Ref = sept::MemRef(&Expr_as_Data);
@@ -115,6 +118,66 @@ sept::Data TypeExpr_as_Data{
 };
 sept::UnionTerm_c const &TypeExpr = TypeExpr_as_Data.cast<sept::UnionTerm_c const &>();
 
+namespace {
+
+// These are constructed on first use so that all the inhabits predicates have been registered.
+
+sept::TypeClassifier const &expr_classifier () {
+    static sept::TypeClassifier const classifier{Expr.elements()};
+    assert(classifier.candidate_count() == size_t(ExprKind::VALUE_TERMINAL)+1);
+    return classifier;
+}
+
+sept::TypeClassifier const &stmt_classifier () {
+    static sept::TypeClassifier const classifier{Stmt.elements()};
+    assert(classifier.candidate_count() == size_t(StmtKind::ASSIGNMENT)+1);
+    return classifier;
+}
+
+sept::TypeClassifier const &func_literal_classifier () {
+    static sept::TypeClassifier const classifier{sept::DataVector{FuncLiteral}};
+    return classifier;
+}
+
+template <typename Kind_>
+std::optional<Kind_> as_kind (std::optional<size_t> const &candidate_index) {
+    return candidate_index.has_value() ? std::make_optional(Kind_(*candidate_index)) : std::nullopt;
+}
+
+} // end namespace
+
+std::optional<ExprKind> classify_expr (sept::Data const &d) {
+    return as_kind<ExprKind>(expr_classifier().classify(d));
+}
+
+std::optional<ExprKind> classify_expr (sept::TupleTerm_c const &t) {
+    return as_kind<ExprKind>(expr_classifier().classify(t));
+}
+
+std::optional<StmtKind> classify_stmt (sept::TupleTerm_c const &t) {
+    return as_kind<StmtKind>(stmt_classifier().classify(t));
+}
+
+std::optional<ExprKind> classify_expr_shallowly (sept::Data const &d) {
+    return as_kind<ExprKind>(expr_classifier().classify_shallowly(d));
+}
+
+std::optional<ExprKind> classify_expr_shallowly (sept::TupleTerm_c const &t) {
+    return as_kind<ExprKind>(expr_classifier().classify_shallowly(t));
+}
+
+std::optional<StmtKind> classify_stmt_shallowly (sept::Data const &d) {
+    return as_kind<StmtKind>(stmt_classifier().classify_shallowly(d));
+}
+
+std::optional<StmtKind> classify_stmt_shallowly (sept::TupleTerm_c const &t) {
+    return as_kind<StmtKind>(stmt_classifier().classify_shallowly(t));
+}
+
+bool is_func_literal_shallowly (sept::Data const &d) {
+    return func_literal_classifier().classify_shallowly(d).has_value();
+}
+
 //
 // TODO: Deprecate these, since semantic term is what does evaluate and execute
 //
@@ -161,15 +224,29 @@ sept::Data evaluate_expr__as_FuncEval (sept::TupleTerm_c const &t, sem::EvalCtx
 
 void execute_stmt__as_SymbolDefn (sept::TupleTerm_c const &t, sem::EvalCtx &ctx) {
     auto symbol_defn_term = sem::parse_SymbolDefn_Term(t);
-    // Simply define the symbol in the current scope.
-    ctx.current_scope()->define_symbol(symbol_defn_term.m_symbol_id, evaluate_expr_data(symbol_defn_term.m_defn, ctx));
+    auto const &scope = ctx.current_scope();
+    // Simply define the symbol in the current scope.  A FuncLiteral is a function value, so it's defined
+    // as-is, and gets a closure so that calls to it don't have to re-parse it.
+    if (inhabits_data(symbol_defn_term.m_defn, FuncLiteral)) {
+        auto slot = scope->define_symbol(symbol_defn_term.m_symbol_id, symbol_defn_term.m_defn);
+        sem::bind_func_closure(symbol_defn_term.m_symbol_id, scope->slot_value(slot), ctx);
+    } else {
+        auto slot = scope->define_symbol(symbol_defn_term.m_symbol_id, evaluate_expr_data(symbol_defn_term.m_defn, ctx));
+        sem::unbind_func_closure(scope->slot_value(slot), ctx);
+    }
     // If a SymbolDefn were a valid Expr, then return Void, or potentially return value, or symbol_id, or some reference.
 }
 
 void execute_stmt__as_Assignment (sept::TupleTerm_c const &t, sem::EvalCtx &ctx) {
     auto assignment_term = sem::parse_Assignment_Term(t);
-    // Simply assign the symbol in the current scope.
-    ctx.current_scope()->resolve_symbol_nonconst(assignment_term.m_symbol_id) = evaluate_expr_data(assignment_term.m_value, ctx);
+    // Simply assign the symbol in the current scope.  See execute_stmt__as_SymbolDefn regarding FuncLiteral.
+    if (inhabits_data(assignment_term.m_value, FuncLiteral)) {
+        auto &value = ctx.current_scope()->resolve_symbol_nonconst(assignment_term.m_symbol_id) = assignment_term.m_value;
+        sem::bind_func_closure(assignment_term.m_symbol_id, value, ctx);
+    } else {
+        auto &value = ctx.current_scope()->resolve_symbol_nonconst(assignment_term.m_symbol_id) = evaluate_expr_data(assignment_term.m_value, ctx);
+        sem::unbind_func_closure(value, ctx);
+    }
     // If an Assignment were a valid Expr, then return value, or symbol_id, or some reference.
 }
 
@@ -7,6 +7,8 @@
 #include "EvalCtx.hpp"
 
 #include <array>
+#include <cstdint>
+#include <optional>
 #include "sept/ArrayTerm.hpp"
 #include "sept/MemRef.hpp"
 #include "sept/Tuple.hpp"
@@ -61,6 +63,43 @@ extern sept::TupleTerm_c const FuncEval;
 extern sept::TupleTerm_c const ElementEval;
 extern sept::TupleTerm_c const Construction;
 
+// The kinds of Expr, in the same order as the elements of the Union that defines Expr.
+enum class ExprKind : uint8_t {
+    BIN_OP_EXPR = 0,
+    BLOCK_EXPR,
+    COND_EXPR,
+    CONSTRUCTION,
+    ELEMENT_EVAL,
+    FUNC_EVAL,
+    ROUND_EXPR,
+    UN_OP_EXPR,
+    SYMBOL_ID,
+    VALUE_TERMINAL,
+};
+
+// The kinds of Stmt, in the same order as the elements of the Union that defines Stmt.
+enum class StmtKind : uint8_t {
+    SYMBOL_DEFN = 0,
+    ASSIGNMENT,
+};
+
+// These return the first kind of Expr (or Stmt) that the given data inhabits, or std::nullopt if it's
+// not an Expr (or Stmt).  They use a sept::TypeClassifier, so they don't check each kind in turn.
+std::optional<ExprKind> classify_expr (sept::Data const &d);
+std::optional<ExprKind> classify_expr (sept::TupleTerm_c const &t);
+std::optional<StmtKind> classify_stmt (sept::TupleTerm_c const &t);
+// These only check the top few levels of the data, namely as deep as the definitions of Expr (or Stmt,
+// or FuncLiteral) go before referring to Expr, so their cost doesn't depend on the size of the data.  See
+// sept::TypeClassifier::classify_shallowly.  The data isn't necessarily well-formed, e.g. the elements of
+// a BinOpExpr could be anything that could be an Expr.
+// The evaluator dispatches on these, since it checks the elements as it evaluates them anyway, and
+// classify_expr would check the whole subtree at every level.
+std::optional<ExprKind> classify_expr_shallowly (sept::Data const &d);
+std::optional<ExprKind> classify_expr_shallowly (sept::TupleTerm_c const &t);
+std::optional<StmtKind> classify_stmt_shallowly (sept::Data const &d);
+std::optional<StmtKind> classify_stmt_shallowly (sept::TupleTerm_c const &t);
+bool is_func_literal_shallowly (sept::Data const &d);
+
 //
 // TODO: Deprecate these, since semantic terms are what do evaluate and execute
 //
@@ -0,0 +1,396 @@
+// 2021.05.25 - Victor Dods
+
+#include "typecheck.hpp"
+
+// Includes from this program's source
+#include "syn.hpp"
+
+#include <lvd/comma.hpp>
+#include <optional>
+#include "sept/ArrayTerm.hpp"
+#include "sept/FormalTypeOf.hpp"
+#include "sept/NPType.hpp"
+#include "sept/TupleTerm.hpp"
+#include "sept/UnionTerm.hpp"
+#include <unordered_set>
+#include <vector>
+
+namespace typecheck {
+
+namespace {
+
+// The static type of an expression is a type that its value (dereferenced) is known to inhabit, or
+// std::nullopt if nothing is known.  FormalTypeOf(x) is used for literals, and UnionTerm_c is used
+// for a value that could come from one of several expressions.
+using StaticType = std::optional<sept::Data>;
+
+enum class Proof : uint8_t { PROVED, DISPROVED, UNKNOWN };
+
+// Determines if every value of static_type inhabits type.
+Proof prove_inhabits (StaticType const &static_type, sept::Data const &type) {
+    auto const &t = type.deref();
+    if (t.type() == typeid(sept::Term_c))
+        return Proof::PROVED;
+    if (!static_type.has_value())
+        return Proof::UNKNOWN;
+
+    auto const &s = static_type->deref();
+    if (s.type() == typeid(sept::FormalTypeOf_Term_c))
+        return inhabits_data(s.cast<sept::FormalTypeOf_Term_c const &>().term(), t) ? Proof::PROVED : Proof::DISPROVED;
+    if (s.type() == typeid(sept::UnionTerm_c)) {
+        bool all_proved = true;
+        bool all_disproved = true;
+        for (auto const &element : s.cast<sept::UnionTerm_c const &>().elements()) {
+            auto proof = prove_inhabits(element, t);
+            all_proved = all_proved && proof == Proof::PROVED;
+            all_disproved = all_disproved && proof == Proof::DISPROVED;
+        }
+        return all_proved ? Proof::PROVED : all_disproved ? Proof::DISPROVED : Proof::UNKNOWN;
+    }
+    if (s.type() == t.type() && eq_data(s, t))
+        return Proof::PROVED;
+    return Proof::UNKNOWN;
+}
+
+bool static_types_are_equal (sept::Data const &lhs, sept::Data const &rhs) {
+    return lhs.type() == rhs.type() && eq_data(lhs, rhs);
+}
+
+// Returns the static type of a value that could come from either of two expressions.
+StaticType join (StaticType const &lhs, StaticType const &rhs) {
+    if (!lhs.has_value() || !rhs.has_value())
+        return std::nullopt;
+    if (static_types_are_equal(*lhs, *rhs))
+        return lhs;
+    if (lhs->type() == typeid(sept::UnionTerm_c)) {
+        auto const &u = lhs->cast<sept::UnionTerm_c const &>();
+        for (auto const &element : u.elements())
+            if (static_types_are_equal(element, *rhs))
+                return lhs;
+        auto elements = u.elements();
+        elements.emplace_back(*rhs);
+        return sept::Data{sept::UnionTerm_c{std::move(elements)}};
+    }
+    return sept::Data{sept::UnionTerm_c{sept::DataVector{*lhs, *rhs}}};
+}
+
+} // end namespace
+
+class Checker {
+public:
+
+    Checker (lvd::nnsp<sept::SymbolTable> const &scope)
+        :   m_scope(scope)
+    { }
+
+    // Returns the facts for the function bound to func_symbol_id (whose Data is func_data), checking
+    // it if it hasn't been already, or nullptr if it's not a FuncLiteral whose prototype can be
+    // evaluated statically.  While a function is being checked, only its prototype facts are valid.
+    FuncFacts *func_facts (sept::InternedId func_symbol_id, sept::Data const &func_data) noexcept(false);
+    // Accounts for assignments to function symbols, which invalidate what was proved about them.
+    void handle_assigned_globals ();
+
+    FuncFactsMap &&move_func_facts_map () && { return std::move(m_func_facts_map); }
+
+private:
+
+    struct Local {
+        sept::InternedId m_symbol_id;
+        StaticType m_static_type;
+    };
+
+    // The static environment of the function body being checked.
+    struct FuncEnv {
+        FuncFacts *m_func_facts;
+        // The innermost block scope is last, and the params are in the first one.
+        std::vector<std::vector<Local>> m_scopes;
+
+        Local *find_local (sept::InternedId symbol_id) {
+            for (auto scope_it = m_scopes.rbegin(); scope_it != m_scopes.rend(); ++scope_it)
+                for (auto local_it = scope_it->rbegin(); local_it != scope_it->rend(); ++local_it)
+                    if (local_it->m_symbol_id == symbol_id)
+                        return &*local_it;
+            return nullptr;
+        }
+    };
+
+    // Evaluates a type expression (e.g. a param type) in m_scope, or returns std::nullopt if that's
+    // not possible statically.
+    StaticType evaluate_type_expr (sept::Data const &type_expr) const;
+    StaticType check_expr (sept::Data const &expr, FuncEnv &env) noexcept(false);
+    void check_expr_array (sept::Data const &expr_array, FuncEnv &env) noexcept(false);
+    void check_stmt (sept::Data const &stmt, FuncEnv &env) noexcept(false);
+
+    lvd::nnsp<sept::SymbolTable> m_scope;
+    FuncFactsMap m_func_facts_map;
+    // Data that was found not to be a statically checkable FuncLiteral.
+    std::unordered_set<sept::Data const *> m_unchecked_func_data;
+    // Non-local symbols that are assigned to within checked function bodies.
+    std::unordered_set<sept::InternedId> m_assigned_globals;
+};
+
+FuncFacts *Checker::func_facts (sept::InternedId func_symbol_id, sept::Data const &func_data) noexcept(false) {
+    if (auto it = m_func_facts_map.find(&func_data); it != m_func_facts_map.end())
+        return &it->second;
+    if (m_unchecked_func_data.find(&func_data) != m_unchecked_func_data.end())
+        return nullptr;
+    if (!inhabits_data(func_data, syn::FuncLiteral)) {
+        m_unchecked_func_data.insert(&func_data);
+        return nullptr;
+    }
+
+    auto func_literal = sem::parse_FuncLiteral_Term(func_data);
+    sept::DataVector param_types;
+    param_types.reserve(func_literal.m_prototype.m_param_decls.size());
+    for (auto const &param_decl : func_literal.m_prototype.m_param_decls) {
+        auto param_type = evaluate_type_expr(param_decl.m_decl_type);
+        if (!param_type.has_value()) {
+            m_unchecked_func_data.insert(&func_data);
+            return nullptr;
+        }
+        param_types.emplace_back(std::move(*param_type));
+    }
+    auto codomain = evaluate_type_expr(func_literal.m_prototype.m_codomain);
+    if (!codomain.has_value()) {
+        m_unchecked_func_data.insert(&func_data);
+        return nullptr;
+    }
+
+    // Add the facts before checking the body, so that recursive calls can use the prototype.
+    auto &facts = m_func_facts_map.emplace(
+        &func_data,
+        FuncFacts{func_symbol_id, std::move(func_literal), std::move(param_types), std::move(*codomain)}
+    ).first->second;
+
+    FuncEnv env{&facts, {{}}};
+    auto const &param_decls = facts.m_func_literal.m_prototype.m_param_decls;
+    for (size_t i = 0; i < param_decls.size(); ++i)
+        env.m_scopes.back().emplace_back(Local{param_decls[i].m_symbol_id, facts.m_param_types[i]});
+    auto body_type = check_expr(facts.m_func_literal.m_body_expr, env);
+    auto proof = prove_inhabits(body_type, facts.m_codomain);
+    if (proof == Proof::DISPROVED)
+        throw std::runtime_error(LVD_FMT("Function " << func_symbol_id << " has a body of static type " << *body_type << ", which doesn't inhabit its codomain " << facts.m_codomain));
+    facts.m_return_type_proved = proof == Proof::PROVED;
+    return &facts;
+}
+
+void Checker::handle_assigned_globals () {
+    for (auto symbol_id : m_assigned_globals) {
+        if (!m_scope->symbol_is_defined(symbol_id))
+            continue;
+        // The function's Data stays at the same address, so it has to be forgotten.
+        m_func_facts_map.erase(&m_scope->resolve_symbol_const(symbol_id));
+        for (auto &[func_data, facts] : m_func_facts_map)
+            if (facts.m_callees.find(symbol_id) != facts.m_callees.end())
+                facts.m_call_args_proved = false;
+    }
+}
+
+StaticType Checker::evaluate_type_expr (sept::Data const &type_expr) const {
+    auto const &t = type_expr.deref();
+    if (t.type() == typeid(std::string)) {
+        auto symbol_id = sept::intern(t.cast<std::string const &>());
+        if (!m_scope->symbol_is_defined(symbol_id))
+            return std::nullopt;
+        return sept::Data{m_scope->resolve_symbol_const(symbol_id).deref()};
+    }
+    // These are evaluated as expressions by the tree-walker, so give up on them.
+    if (t.type() == typeid(sept::TupleTerm_c) || t.type() == typeid(sept::ArrayTerm_c))
+        return std::nullopt;
+    // Anything else evaluates to itself.
+    return t;
+}
+
+StaticType Checker::check_expr (sept::Data const &expr, FuncEnv &env) noexcept(false) {
+    auto const &e = expr.deref();
+    auto expr_kind = syn::classify_expr(e);
+    if (!expr_kind.has_value())
+        return std::nullopt;
+
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            check_expr(t[0], env);
+            check_expr(t[2], env);
+            switch (t[1].cast<ASTNPTerm>()) {
+                case ASTNPTerm::AND:
+                case ASTNPTerm::OR:
+                case ASTNPTerm::XOR:
+                    return sept::Data{sept::Bool};
+                default:
+                    return sept::Data{sept::Float64};
+            }
+        }
+        case syn::ExprKind::BLOCK_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            env.m_scopes.emplace_back();
+            for (auto const &stmt : t[0].deref().cast<sept::ArrayTerm_c const &>().elements())
+                check_stmt(stmt, env);
+            auto static_type = check_expr(t[1], env);
+            env.m_scopes.pop_back();
+            return static_type;
+        }
+        case syn::ExprKind::COND_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            check_expr(t[1], env);
+            auto positive_type = check_expr(t[3], env);
+            auto negative_type = check_expr(t[5], env);
+            return join(positive_type, negative_type);
+        }
+        case syn::ExprKind::CONSTRUCTION: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            check_expr_array(t[1].deref().cast<sept::TupleTerm_c const &>()[1], env);
+            // The type to construct is a TypeExpr.  A constructed value inhabits that type.
+            auto const &type_to_construct = t[0].deref();
+            if (type_to_construct.type() == typeid(std::string) && env.find_local(sept::intern(type_to_construct.cast<std::string const &>())) != nullptr)
+                return std::nullopt;
+            return evaluate_type_expr(type_to_construct);
+        }
+        case syn::ExprKind::ELEMENT_EVAL: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            check_expr(t[0], env);
+            check_expr_array(t[1].deref().cast<sept::TupleTerm_c const &>()[1], env);
+            return std::nullopt;
+        }
+        case syn::ExprKind::FUNC_EVAL: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            auto func_symbol_id = sept::intern(t[0].deref().cast<std::string const &>());
+            auto const &args = t[1].deref().cast<sept::TupleTerm_c const &>()[1].deref().cast<sept::ArrayTerm_c const &>();
+            std::vector<StaticType> arg_types;
+            arg_types.reserve(args.size());
+            for (auto const &arg : args.elements())
+                arg_types.emplace_back(check_expr(arg, env));
+
+            auto &caller_facts = *env.m_func_facts;
+            // A local function isn't known statically.
+            if (env.find_local(func_symbol_id) != nullptr || !m_scope->symbol_is_defined(func_symbol_id)) {
+                caller_facts.m_call_args_proved = false;
+                return std::nullopt;
+            }
+            auto const &func_data = m_scope->resolve_symbol_const(func_symbol_id);
+            auto const *callee_facts = func_facts(func_symbol_id, func_data);
+            if (callee_facts == nullptr) {
+                caller_facts.m_call_args_proved = false;
+                return std::nullopt;
+            }
+            if (arg_types.size() != callee_facts->m_param_types.size())
+                throw std::runtime_error(LVD_FMT("Expected " << callee_facts->m_param_types.size() << " parameters in call to function " << func_symbol_id << " from function " << caller_facts.m_func_symbol_id << ", but got " << arg_types.size()));
+            for (size_t i = 0; i < arg_types.size(); ++i) {
+                auto proof = prove_inhabits(arg_types[i], callee_facts->m_param_types[i]);
+                if (proof == Proof::DISPROVED)
+                    throw std::runtime_error(LVD_FMT("In parameter " << i << " in call to function " << func_symbol_id << " from function " << caller_facts.m_func_symbol_id << ": Expected a value of type " << callee_facts->m_param_types[i] << " but got one of static type " << *arg_types[i]));
+                if (proof == Proof::UNKNOWN)
+                    caller_facts.m_call_args_proved = false;
+            }
+            caller_facts.m_callees[func_symbol_id] = &func_data;
+            // The return value is checked (or proved) to inhabit the codomain.
+            return callee_facts->m_codomain;
+        }
+        case syn::ExprKind::ROUND_EXPR: {
+            check_expr_array(e.cast<sept::TupleTerm_c const &>()[1], env);
+            return std::nullopt;
+        }
+        case syn::ExprKind::UN_OP_EXPR: {
+            auto const &t = e.cast<sept::TupleTerm_c const &>();
+            check_expr(t[1], env);
+            return t[0].cast<ASTNPTerm>() == ASTNPTerm::NOT ? sept::Data{sept::Bool} : sept::Data{sept::Float64};
+        }
+        case syn::ExprKind::SYMBOL_ID: {
+            auto const *local = env.find_local(sept::intern(e.cast<std::string const &>()));
+            // The value of a non-local symbol could be assigned by unchecked code.
+            return local != nullptr ? local->m_static_type : std::nullopt;
+        }
+        case syn::ExprKind::VALUE_TERMINAL: {
+            if (e.type() == typeid(sept::ArrayTerm_c)) {
+                // This is evaluated as an ExprArray.
+                check_expr_array(e, env);
+                return std::nullopt;
+            }
+            if (e.type() == typeid(sept::TupleTerm_c))
+                return std::nullopt;
+            // Anything else evaluates to itself.
+            return sept::Data{sept::FormalTypeOf_Term_c{e}};
+        }
+        default:
+            LVD_ABORT(LVD_FMT("invalid syn::ExprKind: " << uint32_t(*expr_kind)));
+    }
+}
+
+void Checker::check_expr_array (sept::Data const &expr_array, FuncEnv &env) noexcept(false) {
+    auto const &a = expr_array.deref();
+    if (a.type() != typeid(sept::ArrayTerm_c))
+        return;
+    for (auto const &element : a.cast<sept::ArrayTerm_c const &>().elements())
+        check_expr(element, env);
+}
+
+void Checker::check_stmt (sept::Data const &stmt, FuncEnv &env) noexcept(false) {
+    auto const &s = stmt.deref();
+    if (s.type() != typeid(sept::TupleTerm_c))
+        return;
+    auto const &t = s.cast<sept::TupleTerm_c const &>();
+    auto stmt_kind = syn::classify_stmt(t);
+    if (!stmt_kind.has_value())
+        return;
+
+    auto symbol_id = sept::intern(t[0].deref().cast<std::string const &>());
+    auto static_type = check_expr(t[2], env);
+    switch (*stmt_kind) {
+        case syn::StmtKind::SYMBOL_DEFN:
+            env.m_scopes.back().emplace_back(Local{symbol_id, std::move(static_type)});
+            break;
+        case syn::StmtKind::ASSIGNMENT: {
+            // Function bodies have no loops, so a symbol's static type only has to account for each
+            // value assigned to it so far.
+            auto *local = env.find_local(symbol_id);
+            if (local != nullptr)
+                local->m_static_type = join(local->m_static_type, static_type);
+            else
+                m_assigned_globals.insert(symbol_id);
+            break;
+        }
+        default:
+            LVD_ABORT(LVD_FMT("invalid syn::StmtKind: " << uint32_t(*stmt_kind)));
+    }
+}
+
+std::ostream &operator<< (std::ostream &out, FuncFacts const &func_facts) {
+    auto cspace_delim = lvd::make_comma_space_delimiter();
+    out << "FuncFacts(" << func_facts.m_func_symbol_id << ", param types: (";
+    for (auto const &param_type : func_facts.m_param_types)
+        out << cspace_delim << param_type;
+    return out << "), codomain: " << func_facts.m_codomain
+               << ", return type proved: " << func_facts.m_return_type_proved
+               << ", call args proved: " << func_facts.m_call_args_proved << ')';
+}
+
+lvd::nnsp<CheckedProgram const> check_program (lvd::nnsp<sept::SymbolTable> const &scope) noexcept(false) {
+    scope->materialize_image_symbols();
+    auto generation = scope->generation();
+    Checker checker{scope};
+    for (size_t slot = 0; slot < scope->slot_count(); ++slot)
+        if (!scope->slot_is_vacant(slot))
+            checker.func_facts(scope->slot_symbol(slot), scope->slot_value(slot));
+    checker.handle_assigned_globals();
+    return lvd::make_nnsp<CheckedProgram const>(scope, generation, std::move(checker).move_func_facts_map());
+}
+
+FuncFacts const *trusted_func_facts (sem::EvalCtx const &ctx, sept::Data const &func_data) {
+    auto const &checked_program = ctx.checked_program();
+    if (checked_program == nullptr || !checked_program->is_valid())
+        return nullptr;
+    return checked_program->func_facts(func_data);
+}
+
+bool call_args_proved (sem::EvalCtx const &ctx, sept::InternedId func_symbol_id, sept::Data const &func_data) {
+    auto const *caller_facts = ctx.current_func_facts();
+    if (caller_facts == nullptr || !caller_facts->m_call_args_proved)
+        return false;
+    auto const &checked_program = ctx.checked_program();
+    if (checked_program == nullptr || !checked_program->is_valid())
+        return false;
+    auto it = caller_facts->m_callees.find(func_symbol_id);
+    return it != caller_facts->m_callees.end() && it->second == &func_data;
+}
+
+} // end namespace typecheck
@@ -0,0 +1,106 @@
+// 2021.05.25 - Victor Dods
+
+#pragma once
+
+// Includes from this program's source
+#include "EvalCtx.hpp"
+#include "sem.hpp"
+
+#include <cstdint>
+#include <lvd/aliases.hpp>
+#include "sept/Data.hpp"
+#include "sept/DataVector.hpp"
+#include "sept/Interner.hpp"
+#include "sept/SymbolTable.hpp"
+#include <unordered_map>
+#include <utility>
+
+// Static (ahead-of-time) checking of the functions defined in a scope.
+//
+// Every call of a function evaluates its param types and codomain, checks that each argument inhabits
+// its param type, and checks that the return value inhabits the codomain.  check_program proves what
+// it can of these once, by inferring a static type for each expression in each function body (or
+// giving up on it, which just means that the corresponding dynamic checks stay), and records what it
+// proved as FuncFacts.  Setting the resulting CheckedProgram on EvalCtx (see set_checked_program) makes
+// evaluate_FuncEval_Term trust those facts, so that for each checked function:
+// - The FuncLiteral is parsed, and its param types and codomain are evaluated, once (at check time).
+// - If the return value was proved to inhabit the codomain, that isn't checked.
+// - If the function body was proved to only call functions with arguments that inhabit their param
+//   types, those calls don't check their arguments.  Calls from unchecked code (e.g. the top level)
+//   always check their arguments.
+// sem::call_check_counts counts the dynamic checks that are actually done, e.g. to see which were skipped.
+//
+// The facts assume static scoping, i.e. that symbols that aren't params or block-locals are resolved
+// (along with types in prototypes) in the checked scope, which is also what vm does.  This differs from
+// the tree-walker only in the case described in the NOTE/TEMP HACK in evaluate_FuncEval_Term.
+//
+// A CheckedProgram becomes invalid (and is then ignored) when a symbol is defined in or erased from
+// the checked scope.  Assignments to function symbols within checked function bodies are accounted for.
+// NOTE: Other assignments to a function symbol (e.g. directly via SymbolTable, or by unchecked code)
+// aren't detected, so check_program must be run again after doing so.
+namespace typecheck {
+
+// What check_program proved about a particular FuncLiteral.
+struct FuncFacts {
+    sept::InternedId m_func_symbol_id;
+    sem::FuncLiteral_Term_c m_func_literal;
+    // The evaluated param types and codomain of m_func_literal.
+    sept::DataVector m_param_types;
+    sept::Data m_codomain;
+    // True iff the value of the body inhabits m_codomain whenever the params inhabit m_param_types.
+    bool m_return_type_proved = false;
+    // True iff each FuncEval in the body calls the function in m_callees with arguments that inhabit
+    // its param types.
+    bool m_call_args_proved = true;
+    // The (address of the) Data of each function that the body calls, as resolved in the checked scope.
+    std::unordered_map<sept::InternedId,sept::Data const *> m_callees;
+};
+
+// The FuncFacts that check_program proved, keyed by the address of the Data of each function, i.e. the
+// Data that its symbol resolves to.
+using FuncFactsMap = std::unordered_map<sept::Data const *,FuncFacts>;
+
+class CheckedProgram {
+public:
+
+    // generation should be the generation of scope when it was checked.
+    CheckedProgram (lvd::nnsp<sept::SymbolTable> const &scope, uint64_t generation, FuncFactsMap &&func_facts_map)
+        :   m_scope(scope)
+        ,   m_generation(generation)
+        ,   m_func_facts_map(std::move(func_facts_map))
+    { }
+
+    lvd::nnsp<sept::SymbolTable> const &scope () const { return m_scope; }
+    // Returns false if the scope has changed since it was checked.
+    bool is_valid () const { return m_scope->generation() == m_generation; }
+
+    // Returns the facts for the function whose Data is func_data, or nullptr if it wasn't checked.
+    // This doesn't check is_valid.
+    FuncFacts const *func_facts (sept::Data const &func_data) const {
+        auto it = m_func_facts_map.find(&func_data);
+        return it != m_func_facts_map.end() ? &it->second : nullptr;
+    }
+    FuncFactsMap const &func_facts_map () const { return m_func_facts_map; }
+
+private:
+
+    lvd::nnsp<sept::SymbolTable> m_scope;
+    uint64_t m_generation;
+    FuncFactsMap m_func_facts_map;
+};
+
+std::ostream &operator<< (std::ostream &out, FuncFacts const &func_facts);
+
+// Checks each FuncLiteral that's defined in scope (not including its ancestors), as well as each one
+// that those call.  This will throw if it proves that a check would fail whenever it's reached, e.g. if
+// a literal argument doesn't inhabit its param type.
+lvd::nnsp<CheckedProgram const> check_program (lvd::nnsp<sept::SymbolTable> const &scope) noexcept(false);
+
+// Returns the facts for the function whose Data is func_data, if ctx trusts a CheckedProgram which is
+// still valid and which checked that function, otherwise nullptr.
+FuncFacts const *trusted_func_facts (sem::EvalCtx const &ctx, sept::Data const &func_data);
+// Returns true iff the arguments of a call from the innermost function call (e.g. from its body) to the
+// given function (i.e. the Data that func_symbol_id resolved to) are known to inhabit its param types.
+bool call_args_proved (sem::EvalCtx const &ctx, sept::InternedId func_symbol_id, sept::Data const &func_data);
+
+} // end namespace typecheck
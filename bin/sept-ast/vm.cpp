@@ -0,0 +1,673 @@
+// 2021.05.24 - Victor Dods
+
+#include "vm.hpp"
+
+// Includes from this program's source
+#include "syn.hpp"
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <lvd/fmt.hpp>
+#include <lvd/literal.hpp>
+#include "sept/NPTerm.hpp"
+#include <stdexcept>
+#include <typeindex>
+#include <utility>
+
+namespace vm {
+
+namespace {
+
+// Returns the value of data, with any refs dereferenced.  Data::move_deref can't be used for this,
+// since moving out of a ref is disabled.
+sept::Data dereferenced (sept::Data &&data) {
+    if (data.is_ref())
+        return data.deref();
+    else
+        return std::move(data);
+}
+
+} // end namespace
+
+std::string const &as_string (Opcode opcode) {
+    static std::array<std::string,size_t(Opcode::__HIGHEST__)+1> const TABLE{
+        "PUSH_CONST",
+        "LOAD_LOCAL",
+        "STORE_LOCAL",
+        "LOAD_GLOBAL",
+        "STORE_GLOBAL",
+        "DEFINE_GLOBAL",
+        "AND",
+        "OR",
+        "XOR",
+        "ADD",
+        "SUB",
+        "MUL",
+        "DIV",
+        "POW",
+        "NOT",
+        "NEG",
+        "JUMP",
+        "JUMP_IF_FALSE",
+        "MAKE_ARRAY",
+        "ELEMENT",
+        "CONSTRUCT",
+        "CALL",
+        "CHECK_PARAM",
+        "CHECK_RETURN",
+        "RETURN",
+    };
+    return TABLE.at(size_t(opcode));
+}
+
+std::ostream &operator<< (std::ostream &out, Instruction const &instruction) {
+    return out << instruction.m_opcode << ' ' << instruction.m_operand;
+}
+
+std::ostream &operator<< (std::ostream &out, Function const &function) {
+    out << "Function(";
+    if (function.m_name.has_value())
+        out << *function.m_name;
+    else
+        out << "<main>";
+    out << "; param_count = " << function.m_param_count << ", local_count = " << function.m_local_count << ")\n";
+    for (size_t ip = 0; ip < function.m_code.size(); ++ip) {
+        auto const &instruction = function.m_code[ip];
+        out << "    " << ip << ": " << instruction;
+        switch (instruction.m_opcode) {
+            case Opcode::PUSH_CONST: out << " ; " << function.m_constants[instruction.m_operand]; break;
+            case Opcode::LOAD_GLOBAL:
+            case Opcode::STORE_GLOBAL:
+            case Opcode::DEFINE_GLOBAL: out << " ; " << function.m_globals[instruction.m_operand].m_symbol_id; break;
+            case Opcode::CALL: out << " ; " << function.m_call_sites[instruction.m_operand].m_func_symbol_id; break;
+            default: break;
+        }
+        out << '\n';
+    }
+    return out;
+}
+
+//
+// Compiler
+//
+
+class Compiler {
+public:
+
+    Compiler (Program &program, Function &function)
+        :   m_program(program)
+        ,   m_function(function)
+    { }
+
+    void compile_expr_data (sept::Data const &expr_data);
+    void compile_stmt_data (sept::Data const &stmt_data);
+    void compile_stmt_array (sept::ArrayTerm_c const &stmt_array);
+    void compile_func_literal (sept::InternedId func_symbol_id, sem::FuncLiteral_Term_c const &func_literal);
+
+    size_t emit (Opcode opcode, uint32_t operand = 0) {
+        m_function.m_code.emplace_back(Instruction{opcode, operand});
+        return m_function.m_code.size() - 1;
+    }
+    void emit_const (sept::Data &&value) {
+        m_function.m_constants.emplace_back(std::move(value));
+        emit(Opcode::PUSH_CONST, m_function.m_constants.size() - 1);
+    }
+
+private:
+
+    // Maps each symbol defined in a scope to its local index.  These are small, so linear search is fine.
+    using Scope = std::vector<std::pair<sept::InternedId,uint32_t>>;
+
+    void compile_syntactic_expr (sept::TupleTerm_c const &t);
+    void compile_BinOpExpr_Term (sem::BinOpExpr_Term_c const &bin_op_expr_term);
+    void compile_BlockExpr_Term (sem::BlockExpr_Term_c const &block_expr_term);
+    void compile_CondExpr_Term (sem::CondExpr_Term_c const &cond_expr_term);
+    void compile_Construction_Term (sem::Construction_Term_c const &construction_term);
+    void compile_ElementEval_Term (sem::ElementEval_Term_c const &element_eval_term);
+    void compile_ExprArray_Term (sem::ExprArray_Term_c const &expr_array_term);
+    void compile_FuncEval_Term (sem::FuncEval_Term_c const &func_eval_term);
+    void compile_SymbolId_Term (sem::SymbolId_Term_c const &symbol_id_term);
+    void compile_UnOpExpr_Term (sem::UnOpExpr_Term_c const &un_op_expr_term);
+    void compile_Expr_Term (sem::Expr_Term_c const &expr_term);
+    void compile_Assignment_Term (sem::Assignment_Term_c const &assignment_term);
+    void compile_SymbolDefn_Term (sem::SymbolDefn_Term_c const &symbol_defn_term);
+
+    // Returns the local index of the innermost definition of symbol_id, or std::nullopt if it's not a local.
+    std::optional<uint32_t> local_index (sept::InternedId symbol_id) const {
+        for (auto scope_it = m_scope_stack.rbegin(); scope_it != m_scope_stack.rend(); ++scope_it)
+            for (auto const &[id, index] : *scope_it)
+                if (id == symbol_id)
+                    return index;
+        return std::nullopt;
+    }
+    uint32_t global_index (sept::InternedId symbol_id) {
+        auto &globals = m_function.m_globals;
+        for (size_t i = 0; i < globals.size(); ++i)
+            if (globals[i].m_symbol_id == symbol_id)
+                return i;
+        globals.emplace_back(GlobalRef{symbol_id, sept::ResolutionCache{}});
+        return globals.size() - 1;
+    }
+    // Defines symbol_id in the innermost scope, and returns its new local index.
+    uint32_t define_local (sept::InternedId symbol_id) {
+        assert(!m_scope_stack.empty());
+        auto &scope = m_scope_stack.back();
+        for (auto const &[id, index] : scope)
+            if (id == symbol_id)
+                throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " already defined in this scope; can't re-define"));
+        auto index = m_function.m_local_count++;
+        scope.emplace_back(symbol_id, index);
+        return index;
+    }
+
+    Program &m_program;
+    Function &m_function;
+    // If this is empty, then SymbolDefns define symbols in the run scope.
+    std::vector<Scope> m_scope_stack;
+};
+
+void Compiler::compile_expr_data (sept::Data const &expr_data) {
+    // Any refs are transparent to evaluate_expr_data, so deref here.
+    auto const &d = expr_data.deref();
+    auto const &type = d.type();
+    if (false)
+        { }
+    else if (type == typeid(std::string))
+        compile_SymbolId_Term(sem::parse_SymbolId_Term(d));
+    else if (type == typeid(sept::TupleTerm_c))
+        compile_syntactic_expr(d.cast<sept::TupleTerm_c const &>());
+    else if (type == typeid(sept::ArrayTerm_c))
+        compile_ExprArray_Term(sem::parse_ExprArray_Term(d.cast<sept::ArrayTerm_c const &>()));
+    else if (type == typeid(sem::ValueTerminal_Term_c))
+        compile_expr_data(d.cast<sem::ValueTerminal_Term_c const &>().m_value);
+    else if (type == typeid(sem::ExprArray_Term_c))
+        compile_ExprArray_Term(d.cast<sem::ExprArray_Term_c const &>());
+    else if (type == typeid(sem::Expr_Term_c))
+        compile_Expr_Term(d.cast<sem::Expr_Term_c const &>());
+    else {
+        // Anything else is a literal.  If it's registered in EvaluateExpr, then evaluate it now,
+        // otherwise evaluation is the identity (as in evaluate_expr_data).
+        auto const &evaluator_map = lvd::static_association_singleton<sem::EvaluateExpr>();
+        auto it = evaluator_map.find(std::type_index(type));
+        if (it == evaluator_map.end()) {
+            emit_const(sept::Data{d});
+        } else {
+            sem::EvalCtx ctx;
+            emit_const(dereferenced(it->second(d, ctx)));
+        }
+    }
+}
+
+void Compiler::compile_stmt_data (sept::Data const &stmt_data) {
+    auto const &d = stmt_data.deref();
+    if (d.type() != typeid(sept::TupleTerm_c))
+        throw std::runtime_error(LVD_FMT("Data type " << d.type().name() << " is not a Stmt"));
+    auto const &t = d.cast<sept::TupleTerm_c const &>();
+    auto stmt_kind = syn::classify_stmt(t);
+    if (!stmt_kind.has_value())
+        throw std::runtime_error(LVD_FMT("attempting to compile a non-Stmt as a Stmt: " << t));
+    switch (*stmt_kind) {
+        case syn::StmtKind::ASSIGNMENT:  compile_Assignment_Term(sem::parse_Assignment_Term(t)); break;
+        case syn::StmtKind::SYMBOL_DEFN: compile_SymbolDefn_Term(sem::parse_SymbolDefn_Term(t)); break;
+        default: throw std::runtime_error(LVD_FMT("unhandled Stmt: " << t));
+    }
+}
+
+void Compiler::compile_stmt_array (sept::ArrayTerm_c const &stmt_array) {
+    assert(inhabits(stmt_array, syn::StmtArray));
+    for (auto const &stmt : stmt_array.elements())
+        compile_stmt_data(stmt);
+}
+
+void Compiler::compile_func_literal (sept::InternedId func_symbol_id, sem::FuncLiteral_Term_c const &func_literal) {
+    auto const &func_prototype = func_literal.m_prototype;
+    auto param_count = uint32_t(func_prototype.m_param_decls.size());
+    m_function.m_name = func_symbol_id;
+    m_function.m_param_count = param_count;
+    m_function.m_local_count = param_count;
+
+    // The param types and codomain are evaluated before the params are in scope.
+    for (uint32_t i = 0; i < param_count; ++i) {
+        compile_expr_data(func_prototype.m_param_decls[i].m_decl_type);
+        emit(Opcode::CHECK_PARAM, i);
+    }
+    // The codomain stays on the stack (below the body's value) until CHECK_RETURN.
+    compile_expr_data(func_prototype.m_codomain);
+
+    // Param i is local i.
+    m_scope_stack.emplace_back();
+    for (uint32_t i = 0; i < param_count; ++i) {
+        auto param_symbol_id = func_prototype.m_param_symbol_ids[i];
+        for (auto const &[id, index] : m_scope_stack.back())
+            if (id == param_symbol_id)
+                throw std::runtime_error(LVD_FMT("Param " << lvd::literal_of(param_symbol_id.as_string()) << " of function " << func_symbol_id << " is declared more than once"));
+        m_scope_stack.back().emplace_back(param_symbol_id, i);
+    }
+    compile_expr_data(func_literal.m_body_expr);
+    m_scope_stack.pop_back();
+
+    emit(Opcode::CHECK_RETURN);
+    emit(Opcode::RETURN);
+}
+
+void Compiler::compile_syntactic_expr (sept::TupleTerm_c const &t) {
+    // This is the same classification as sem::evaluate_expr(sept::TupleTerm_c const &, ...),
+    // except that it happens only once.
+    auto expr_kind = syn::classify_expr(t);
+    if (!expr_kind.has_value())
+        throw std::runtime_error(LVD_FMT("attempting to compile a non-Expr as an Expr: " << t));
+    switch (*expr_kind) {
+        case syn::ExprKind::BIN_OP_EXPR:  compile_BinOpExpr_Term(sem::parse_BinOpExpr_Term(t)); break;
+        case syn::ExprKind::BLOCK_EXPR:   compile_BlockExpr_Term(sem::parse_BlockExpr_Term(t)); break;
+        case syn::ExprKind::COND_EXPR:    compile_CondExpr_Term(sem::parse_CondExpr_Term(t)); break;
+        case syn::ExprKind::CONSTRUCTION: compile_Construction_Term(sem::parse_Construction_Term(t)); break;
+        case syn::ExprKind::ELEMENT_EVAL: compile_ElementEval_Term(sem::parse_ElementEval_Term(sept::Data{t})); break;
+        case syn::ExprKind::FUNC_EVAL:    compile_FuncEval_Term(sem::parse_FuncEval_Term(sept::Data{t})); break;
+        case syn::ExprKind::ROUND_EXPR:   compile_ExprArray_Term(sem::parse_RoundExpr_Term(sept::Data{t}).m_expr_array); break;
+        case syn::ExprKind::UN_OP_EXPR:   compile_UnOpExpr_Term(sem::parse_UnOpExpr_Term(t)); break;
+        default: throw std::runtime_error(LVD_FMT("unhandled Expr: " << t));
+    }
+}
+
+void Compiler::compile_BinOpExpr_Term (sem::BinOpExpr_Term_c const &bin_op_expr_term) {
+    // Both operands are always evaluated (there's no short-circuiting), as in the tree-walker.
+    compile_expr_data(bin_op_expr_term.m_lhs_expr);
+    compile_expr_data(bin_op_expr_term.m_rhs_expr);
+    switch (bin_op_expr_term.m_bin_op) {
+        case ASTNPTerm::AND: emit(Opcode::AND); break;
+        case ASTNPTerm::OR:  emit(Opcode::OR);  break;
+        case ASTNPTerm::XOR: emit(Opcode::XOR); break;
+        case ASTNPTerm::ADD: emit(Opcode::ADD); break;
+        case ASTNPTerm::SUB: emit(Opcode::SUB); break;
+        case ASTNPTerm::MUL: emit(Opcode::MUL); break;
+        case ASTNPTerm::DIV: emit(Opcode::DIV); break;
+        case ASTNPTerm::POW: emit(Opcode::POW); break;
+        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as a BinOp: " << uint32_t(bin_op_expr_term.m_bin_op)));
+    }
+}
+
+void Compiler::compile_BlockExpr_Term (sem::BlockExpr_Term_c const &block_expr_term) {
+    m_scope_stack.emplace_back();
+    compile_stmt_array(block_expr_term.m_stmt_array);
+    compile_expr_data(block_expr_term.m_final_expr);
+    m_scope_stack.pop_back();
+}
+
+void Compiler::compile_CondExpr_Term (sem::CondExpr_Term_c const &cond_expr_term) {
+    compile_expr_data(cond_expr_term.m_condition);
+    auto jump_to_negative = emit(Opcode::JUMP_IF_FALSE);
+    compile_expr_data(cond_expr_term.m_positive_expr);
+    auto jump_to_end = emit(Opcode::JUMP);
+    m_function.m_code[jump_to_negative].m_operand = m_function.m_code.size();
+    compile_expr_data(cond_expr_term.m_negative_expr);
+    m_function.m_code[jump_to_end].m_operand = m_function.m_code.size();
+}
+
+void Compiler::compile_Construction_Term (sem::Construction_Term_c const &construction_term) {
+    // TEMP HACK (as in evaluate_Construction_Term) -- the ExprArray must contain a single element for now.
+    if (construction_term.m_params.size() != 1)
+        throw std::runtime_error(LVD_FMT("Construction must have exactly 1 param for now, but got " << construction_term.m_params.size()));
+    compile_expr_data(construction_term.m_type_to_construct);
+    compile_Expr_Term(construction_term.m_params[0]);
+    emit(Opcode::CONSTRUCT);
+}
+
+void Compiler::compile_ElementEval_Term (sem::ElementEval_Term_c const &element_eval_term) {
+    // TEMP HACK (as in evaluate_ElementEval_Term) -- the ExprArray must contain a single element for now.
+    if (element_eval_term.m_params.size() != 1)
+        throw std::runtime_error(LVD_FMT("ElementEval must have exactly 1 param for now, but got " << element_eval_term.m_params.size()));
+    compile_expr_data(element_eval_term.m_container);
+    compile_Expr_Term(element_eval_term.m_params[0]);
+    emit(Opcode::ELEMENT);
+}
+
+void Compiler::compile_ExprArray_Term (sem::ExprArray_Term_c const &expr_array_term) {
+    for (auto const &element : expr_array_term)
+        compile_Expr_Term(element);
+    emit(Opcode::MAKE_ARRAY, expr_array_term.size());
+}
+
+void Compiler::compile_FuncEval_Term (sem::FuncEval_Term_c const &func_eval_term) {
+    for (auto const &param : func_eval_term.m_params)
+        compile_Expr_Term(param);
+    auto func_symbol_id = func_eval_term.m_func_symbol_id;
+    auto local = local_index(func_symbol_id);
+    m_function.m_call_sites.emplace_back(
+        CallSite{
+            func_symbol_id,
+            uint32_t(func_eval_term.m_params.size()),
+            local,
+            local.has_value() ? nullptr : &m_program.function_link(func_symbol_id)
+        }
+    );
+    emit(Opcode::CALL, m_function.m_call_sites.size() - 1);
+}
+
+void Compiler::compile_SymbolId_Term (sem::SymbolId_Term_c const &symbol_id_term) {
+    auto local = local_index(symbol_id_term.m_symbol_id);
+    if (local.has_value())
+        emit(Opcode::LOAD_LOCAL, *local);
+    else
+        emit(Opcode::LOAD_GLOBAL, global_index(symbol_id_term.m_symbol_id));
+}
+
+void Compiler::compile_UnOpExpr_Term (sem::UnOpExpr_Term_c const &un_op_expr_term) {
+    compile_expr_data(un_op_expr_term.m_operand);
+    switch (un_op_expr_term.m_un_op) {
+        case ASTNPTerm::NOT: emit(Opcode::NOT); break;
+        case ASTNPTerm::NEG: emit(Opcode::NEG); break;
+        default: LVD_ABORT(LVD_FMT("invalid ASTNPTerm for use as an UnOp: " << uint32_t(un_op_expr_term.m_un_op)));
+    }
+}
+
+void Compiler::compile_Expr_Term (sem::Expr_Term_c const &expr_term) {
+    std::visit(
+        lvd::Visitor_t{
+            [this](sem::BinOpExpr_Term_c const &expr) { compile_BinOpExpr_Term(expr); },
+            [this](sem::BlockExpr_Term_c const &expr) { compile_BlockExpr_Term(expr); },
+            [this](sem::CondExpr_Term_c const &expr) { compile_CondExpr_Term(expr); },
+            [this](sem::Construction_Term_c const &expr) { compile_Construction_Term(expr); },
+            [this](sem::ElementEval_Term_c const &expr) { compile_ElementEval_Term(expr); },
+            [this](sem::FuncEval_Term_c const &expr) { compile_FuncEval_Term(expr); },
+            [this](sem::RoundExpr_Term_c const &expr) { compile_ExprArray_Term(expr.m_expr_array); },
+            [this](sem::SymbolId_Term_c const &expr) { compile_SymbolId_Term(expr); },
+            [this](sem::UnOpExpr_Term_c const &expr) { compile_UnOpExpr_Term(expr); },
+            [this](sem::ValueTerminal_Term_c const &expr) { compile_expr_data(expr.m_value); }
+        },
+        expr_term
+    );
+}
+
+void Compiler::compile_Assignment_Term (sem::Assignment_Term_c const &assignment_term) {
+    compile_expr_data(assignment_term.m_value);
+    auto local = local_index(assignment_term.m_symbol_id);
+    if (local.has_value())
+        emit(Opcode::STORE_LOCAL, *local);
+    else
+        emit(Opcode::STORE_GLOBAL, global_index(assignment_term.m_symbol_id));
+}
+
+void Compiler::compile_SymbolDefn_Term (sem::SymbolDefn_Term_c const &symbol_defn_term) {
+    // The value is compiled before the symbol is in scope, so it refers to any outer definition.
+    compile_expr_data(symbol_defn_term.m_defn);
+    if (m_scope_stack.empty())
+        emit(Opcode::DEFINE_GLOBAL, global_index(symbol_defn_term.m_symbol_id));
+    else
+        emit(Opcode::STORE_LOCAL, define_local(symbol_defn_term.m_symbol_id));
+}
+
+//
+// Machine
+//
+
+class Machine {
+public:
+
+    Machine (Program &program, sem::EvalCtx &ctx)
+        :   m_program(program)
+        ,   m_ctx(ctx)
+        ,   m_run_scope(*ctx.current_scope())
+    {
+        m_stack.reserve(256);
+    }
+
+    sept::Data run () {
+        call(*m_program.m_main);
+        return std::move(m_stack.back());
+    }
+
+private:
+
+    // The function's arguments must be on top of the stack, and are replaced by its return value.
+    void call (Function &function);
+
+    sept::Data pop () {
+        auto retval = std::move(m_stack.back());
+        m_stack.pop_back();
+        return retval;
+    }
+    // Values on the stack are never refs, so they can be raw__cast.
+    template <typename Operand_, typename BinaryOp_>
+    void apply_binary_op (BinaryOp_ const &binary_op) {
+        auto rhs = m_stack.back().raw__cast<Operand_>();
+        m_stack.pop_back();
+        auto &lhs = m_stack.back();
+        lhs = sept::Data{binary_op(lhs.raw__cast<Operand_>(), rhs)};
+    }
+
+    // Binding a global has to go through sem::bind_func_closure or sem::unbind_func_closure, as in the
+    // tree-walker, so that FuncClosures and FunctionLinks (including this Program's) see the change.
+    void bind_global (sept::InternedId symbol_id, sept::Data const &value) {
+        if (value.type() == typeid(sept::TupleTerm_c) && inhabits_data(value, syn::FuncLiteral))
+            sem::bind_func_closure(symbol_id, value, m_ctx);
+        else
+            sem::unbind_func_closure(value, m_ctx);
+    }
+
+    Program &m_program;
+    sem::EvalCtx &m_ctx;
+    sept::SymbolTable &m_run_scope;
+    // Each call's frame is its locals followed by its operand stack.
+    std::vector<sept::Data> m_stack;
+};
+
+void Machine::call (Function &function) {
+    auto base = m_stack.size() - function.m_param_count;
+    for (auto i = function.m_param_count; i < function.m_local_count; ++i)
+        m_stack.emplace_back(sept::Void);
+
+    auto const *code = function.m_code.data();
+    for (size_t ip = 0; ; ) {
+        auto const &instruction = code[ip++];
+        auto operand = instruction.m_operand;
+        switch (instruction.m_opcode) {
+            case Opcode::PUSH_CONST:
+                m_stack.emplace_back(function.m_constants[operand]);
+                break;
+            case Opcode::LOAD_LOCAL: {
+                // Copy first, since emplace_back may reallocate.
+                auto value = m_stack[base + operand];
+                m_stack.emplace_back(std::move(value));
+                break;
+            }
+            case Opcode::STORE_LOCAL:
+                m_stack[base + operand] = pop();
+                break;
+            case Opcode::LOAD_GLOBAL: {
+                auto &global = function.m_globals[operand];
+                m_stack.emplace_back(m_run_scope.resolve_symbol_cached(global.m_symbol_id, global.m_cache).deref());
+                break;
+            }
+            case Opcode::STORE_GLOBAL: {
+                auto &global = function.m_globals[operand];
+                auto &value = m_run_scope.resolve_symbol_cached(global.m_symbol_id, global.m_cache) = pop();
+                bind_global(global.m_symbol_id, value);
+                break;
+            }
+            case Opcode::DEFINE_GLOBAL: {
+                auto symbol_id = function.m_globals[operand].m_symbol_id;
+                auto slot = m_run_scope.define_symbol(symbol_id, pop());
+                bind_global(symbol_id, m_run_scope.slot_value(slot));
+                break;
+            }
+
+            case Opcode::AND: apply_binary_op<bool>([](bool lhs, bool rhs) { return lhs && rhs; }); break;
+            case Opcode::OR:  apply_binary_op<bool>([](bool lhs, bool rhs) { return lhs || rhs; }); break;
+            case Opcode::XOR: apply_binary_op<bool>([](bool lhs, bool rhs) { return lhs != rhs; }); break;
+            case Opcode::ADD: apply_binary_op<double>([](double lhs, double rhs) { return lhs + rhs; }); break;
+            case Opcode::SUB: apply_binary_op<double>([](double lhs, double rhs) { return lhs - rhs; }); break;
+            case Opcode::MUL: apply_binary_op<double>([](double lhs, double rhs) { return lhs * rhs; }); break;
+            case Opcode::DIV: apply_binary_op<double>([](double lhs, double rhs) { return lhs / rhs; }); break;
+            case Opcode::POW: apply_binary_op<double>([](double lhs, double rhs) { return std::pow(lhs, rhs); }); break;
+            case Opcode::NOT: m_stack.back() = sept::Data{!m_stack.back().raw__cast<bool>()}; break;
+            case Opcode::NEG: m_stack.back() = sept::Data{-m_stack.back().raw__cast<double>()}; break;
+
+            case Opcode::JUMP:
+                ip = operand;
+                break;
+            case Opcode::JUMP_IF_FALSE:
+                if (!pop().raw__cast<bool>())
+                    ip = operand;
+                break;
+
+            case Opcode::MAKE_ARRAY: {
+                sept::DataVector elements;
+                elements.reserve(operand);
+                auto first = m_stack.end() - operand;
+                for (auto it = first; it != m_stack.end(); ++it)
+                    elements.emplace_back(std::move(*it));
+                m_stack.erase(first, m_stack.end());
+                m_stack.emplace_back(sept::ArrayTerm_c{std::move(elements)});
+                break;
+            }
+            case Opcode::ELEMENT: {
+                auto param = pop();
+                auto &container = m_stack.back();
+                container = dereferenced(container[param]);
+                break;
+            }
+            case Opcode::CONSTRUCT: {
+                auto param = pop();
+                auto &type = m_stack.back();
+                type = dereferenced(type(param));
+                break;
+            }
+            case Opcode::CALL: {
+                auto &call_site = function.m_call_sites[operand];
+                Function *callee;
+                if (call_site.m_local_index.has_value()) {
+                    auto const &func_data = m_stack[base + *call_site.m_local_index];
+                    if (call_site.m_local_function == nullptr || !(func_data == call_site.m_local_func_value)) {
+                        call_site.m_local_function = &m_program.function_for_value(call_site.m_func_symbol_id, func_data);
+                        call_site.m_local_func_value = func_data;
+                    }
+                    callee = call_site.m_local_function;
+                } else {
+                    auto &link = *call_site.m_link;
+                    auto const *func_data = link.m_cache.get(m_run_scope);
+                    if (link.m_function != nullptr
+                        && func_data != nullptr
+                        && link.m_func_binding_epoch == sem::func_binding_epoch()
+                        && func_data->type() == typeid(sept::TupleTerm_c))
+                    {
+                        callee = link.m_function;
+                    } else {
+                        callee = &m_program.link_function(link, call_site.m_func_symbol_id, m_run_scope);
+                    }
+                }
+                if (callee->m_param_count != call_site.m_arg_count)
+                    throw std::runtime_error(LVD_FMT("Expected " << callee->m_param_count << " parameters in call to function " << call_site.m_func_symbol_id << ", but got " << call_site.m_arg_count));
+                call(*callee);
+                break;
+            }
+
+            case Opcode::CHECK_PARAM: {
+                auto param_type = pop();
+                auto const &param = m_stack[base + operand];
+                if (!inhabits_data(param, param_type))
+                    throw std::runtime_error(LVD_FMT("In parameter " << operand << " in call to function " << *function.m_name << ": Expected a value of type " << param_type << " but got " << param << " (which has abstract type " << sept::abstract_type_of_data(param) << ')'));
+                break;
+            }
+            case Opcode::CHECK_RETURN: {
+                auto retval = pop();
+                auto &return_type = m_stack.back();
+                if (!inhabits_data(retval, return_type))
+                    throw std::runtime_error(LVD_FMT("Expected return value " << retval << " to evaluate to a term of type " << return_type << " but it didn't"));
+                return_type = std::move(retval);
+                break;
+            }
+            case Opcode::RETURN: {
+                auto retval = pop();
+                m_stack.erase(m_stack.begin() + base, m_stack.end());
+                m_stack.emplace_back(std::move(retval));
+                return;
+            }
+
+            default:
+                LVD_ABORT(LVD_FMT("invalid Opcode: " << uint32_t(instruction.m_opcode)));
+        }
+    }
+}
+
+//
+// Program
+//
+
+Program::Program () {
+    m_main = &new_function();
+}
+
+sept::Data Program::run (sem::EvalCtx &ctx) noexcept(false) {
+    auto const &run_scope = ctx.current_scope();
+    if (m_run_scope != run_scope.get()) {
+        reset_caches();
+        m_run_scope = run_scope.get();
+    }
+    return Machine(*this, ctx).run();
+}
+
+Function &Program::new_function () {
+    m_functions.emplace_back(std::make_unique<Function>());
+    return *m_functions.back();
+}
+
+FunctionLink &Program::function_link (sept::InternedId func_symbol_id) {
+    auto &link = m_links[func_symbol_id];
+    if (link == nullptr)
+        link = std::make_unique<FunctionLink>();
+    return *link;
+}
+
+Function &Program::link_function (FunctionLink &link, sept::InternedId func_symbol_id, sept::SymbolTable &run_scope) {
+    // Read the epoch before resolving, so that a concurrent rebinding can only cause a spurious relink.
+    auto func_binding_epoch = sem::func_binding_epoch();
+    auto const &func_data = run_scope.resolve_symbol_cached(func_symbol_id, link.m_cache).deref();
+    if (link.m_function == nullptr || !(func_data == link.m_func_value)) {
+        link.m_function = &function_for_value(func_symbol_id, func_data);
+        link.m_func_value = func_data;
+    }
+    link.m_func_binding_epoch = func_binding_epoch;
+    return *link.m_function;
+}
+
+Function &Program::function_for_value (sept::InternedId func_symbol_id, sept::Data const &func_data) {
+    auto &functions = m_functions_by_value[func_symbol_id];
+    for (auto const &[value, function] : functions)
+        if (value == func_data)
+            return *function;
+
+    if (!inhabits_data(func_data, syn::FuncLiteral))
+        throw std::runtime_error(LVD_FMT("Symbol " << func_symbol_id << " is not a FuncLiteral, so it can't be called; it's " << func_data));
+    auto &function = new_function();
+    Compiler(*this, function).compile_func_literal(func_symbol_id, sem::parse_FuncLiteral_Term(func_data));
+    functions.emplace_back(func_data, &function);
+    return function;
+}
+
+void Program::reset_caches () {
+    for (auto &function : m_functions)
+        for (auto &global : function->m_globals)
+            global.m_cache.reset();
+    for (auto &[func_symbol_id, link] : m_links)
+        link->m_cache.reset();
+}
+
+Program compile_expr (sept::Data const &expr) noexcept(false) {
+    Program program;
+    Compiler compiler(program, *program.m_main);
+    compiler.compile_expr_data(expr);
+    compiler.emit(Opcode::RETURN);
+    return program;
+}
+
+Program compile_stmt_array (sept::ArrayTerm_c const &stmt_array) noexcept(false) {
+    Program program;
+    Compiler compiler(program, *program.m_main);
+    compiler.compile_stmt_array(stmt_array);
+    compiler.emit_const(sept::Data{sept::Void});
+    compiler.emit(Opcode::RETURN);
+    return program;
+}
+
+} // end namespace vm
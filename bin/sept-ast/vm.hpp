@@ -0,0 +1,201 @@
+// 2021.05.24 - Victor Dods
+
+#pragma once
+
+// Includes from this program's source
+#include "EvalCtx.hpp"
+#include "sem.hpp"
+
+#include <cstdint>
+#include <lvd/aliases.hpp>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include "sept/ArrayTerm.hpp"
+#include "sept/Data.hpp"
+#include "sept/Interner.hpp"
+#include "sept/NPTerm.hpp"
+#include "sept/SymbolTable.hpp"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bytecode compiler and stack-based virtual machine for sem/syn expressions and statements.
+//
+// The tree-walking evaluator (evaluate_expr_data, execute_stmt_data) works out the syntactic class
+// of every node (a chain of structural inhabits checks), re-parses it into a sem term, and resolves
+// every symbol by name, each time it's evaluated.  compile_expr and compile_stmt_array do all of
+// that once, producing a Program that can be run many times.  The tree-walking evaluator remains
+// the reference implementation, and the VM is meant to produce the same values as it, with the
+// following differences:
+// - Symbols are scoped statically.  Params and block-local symbols are resolved at compile time
+//   to a register in the function's frame, and any other symbol is resolved in the scope that the
+//   Program is run in (i.e. ctx.current_scope()), which is also where function param types and
+//   codomains are evaluated.  The tree-walker resolves them dynamically, so it can also see the
+//   locals of the caller (see the NOTE/TEMP HACK in evaluate_FuncEval_Term).
+// - Symbols evaluate to (a copy of) their values, not to LocalSymRef, so the result of running a
+//   Program is the deref() of what the tree-walker returns.
+// - Literals (anything that isn't a SymbolId, ExprArray or syntactic Tuple) are evaluated once, at
+//   compile time, and any refs within an expression are dereferenced at compile time.
+// - Redefining a symbol within a block is an error at compile time instead of at run time.
+namespace vm {
+
+enum class Opcode : uint8_t {
+    PUSH_CONST = 0, // Push m_constants[operand].
+    LOAD_LOCAL,     // Push local operand.
+    STORE_LOCAL,    // Pop into local operand.
+    LOAD_GLOBAL,    // Push the value of m_globals[operand], resolved in the run scope.
+    STORE_GLOBAL,   // Pop into the existing definition of m_globals[operand].
+    DEFINE_GLOBAL,  // Pop into a new definition of m_globals[operand] in the run scope.
+
+    // Binary operators pop rhs, then replace lhs with the result.
+    AND,
+    OR,
+    XOR,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    POW,
+    // Unary operators replace the top.
+    NOT,
+    NEG,
+
+    JUMP,           // Jump to operand.
+    JUMP_IF_FALSE,  // Pop a bool, and jump to operand if it's false.
+
+    MAKE_ARRAY,     // Pop operand values and push them as an ArrayTerm_c.
+    ELEMENT,        // Pop the param, then replace the container with container[param].
+    CONSTRUCT,      // Pop the param, then replace the type with type(param).
+    CALL,           // Call m_call_sites[operand], whose arguments are on top of the stack.
+
+    CHECK_PARAM,    // Pop a type, and check that param operand inhabits it.
+    CHECK_RETURN,   // Pop the return value and check that it inhabits the type below it, which it then replaces.
+    RETURN,         // Return the top of the stack to the caller.
+
+    __LOWEST__ = PUSH_CONST,
+    __HIGHEST__ = RETURN,
+};
+
+std::string const &as_string (Opcode opcode);
+
+inline std::ostream &operator<< (std::ostream &out, Opcode opcode) {
+    return out << as_string(opcode);
+}
+
+struct Instruction {
+    Opcode m_opcode;
+    uint32_t m_operand;
+};
+
+std::ostream &operator<< (std::ostream &out, Instruction const &instruction);
+
+class Function;
+
+struct GlobalRef {
+    sept::InternedId m_symbol_id;
+    sept::ResolutionCache m_cache;
+};
+
+// The compiled form of the function currently bound to a global symbol.  It's used as-is as long as
+// the symbol still resolves to the same Data (m_cache sees any define, erase, clear or reparent along
+// the way), sem::func_binding_epoch hasn't changed (which sees the symbol being bound in place to a
+// different FuncLiteral, by the tree-walker or by a Program), and that Data is still a Tuple.  Otherwise
+// the symbol's value is compared with m_func_value, and the function is only looked up again (see
+// Program::function_for_value) if it differs.
+// NOTE: Binding a symbol in place without going through sem::bind_func_closure or
+// sem::unbind_func_closure (e.g. directly via SymbolTable) isn't detected.  If the run scope has
+// concurrent reads enabled, then m_cache isn't used (see SymbolTable), so every call compares values.
+struct FunctionLink {
+    sept::ResolutionCache m_cache;
+    uint64_t m_func_binding_epoch = 0;
+    sept::Data m_func_value{sept::Void};
+    Function *m_function = nullptr;
+};
+
+struct CallSite {
+    sept::InternedId m_func_symbol_id;
+    uint32_t m_arg_count;
+    // If the function symbol is a local, this is its index.
+    std::optional<uint32_t> m_local_index;
+    // Otherwise this is the link for the function symbol, which is owned by the Program.
+    FunctionLink *m_link;
+    // If the function symbol is a local, these are its value in the most recent call through this call
+    // site, and the function compiled from it, which is used as long as the local has the same value.
+    sept::Data m_local_func_value{sept::Void};
+    Function *m_local_function = nullptr;
+};
+
+class Function {
+public:
+
+    std::optional<sept::InternedId> m_name;
+    uint32_t m_param_count = 0;
+    // Params are locals [0, m_param_count), and block-local symbols follow.
+    uint32_t m_local_count = 0;
+    std::vector<Instruction> m_code;
+    std::vector<sept::Data> m_constants;
+    std::vector<GlobalRef> m_globals;
+    std::vector<CallSite> m_call_sites;
+};
+
+std::ostream &operator<< (std::ostream &out, Function const &function);
+
+class Program {
+public:
+
+    Program ();
+    Program (Program const &) = delete;
+    Program (Program &&) = default;
+
+    Program &operator = (Program const &) = delete;
+    Program &operator = (Program &&) = default;
+
+    Function const &main_function () const { return *m_main; }
+    // Number of functions compiled so far, including the main function.
+    size_t function_count () const { return m_functions.size(); }
+
+    // Runs the program in ctx.current_scope(), which is where all non-local symbols are resolved
+    // and where top-level SymbolDefns define their symbols.  Returns the value of the expression,
+    // or Void for a statement array.  Will throw if there's an error, as the tree-walker would.
+    sept::Data run (sem::EvalCtx &ctx) noexcept(false);
+
+private:
+
+    Function &new_function ();
+    FunctionLink &function_link (sept::InternedId func_symbol_id);
+    // Brings link up to date with what func_symbol_id is bound to in run_scope, and returns its function.
+    Function &link_function (FunctionLink &link, sept::InternedId func_symbol_id, sept::SymbolTable &run_scope);
+    // Returns the function compiled from func_data (which must be a FuncLiteral) under the name
+    // func_symbol_id, compiling it if this is the first time.
+    Function &function_for_value (sept::InternedId func_symbol_id, sept::Data const &func_data);
+    // Resets all ResolutionCaches, which is necessary when the run scope changes.
+    void reset_caches ();
+
+    // m_functions owns every Function compiled for this program, including ones which are no longer
+    // linked, since they may still be executing.
+    std::vector<std::unique_ptr<Function>> m_functions;
+    Function *m_main;
+    std::unordered_map<sept::InternedId,std::unique_ptr<FunctionLink>> m_links;
+    // Each function compiled from a FuncLiteral value, by name, so that a value that comes back (e.g. a
+    // function symbol alternating between two FuncLiterals) isn't compiled again.  There are normally
+    // very few values per name, and not every term that can appear in a FuncLiteral is hashable, so these
+    // are searched linearly.
+    std::unordered_map<sept::InternedId,std::vector<std::pair<sept::Data,Function *>>> m_functions_by_value;
+    // The scope that the ResolutionCaches are relative to.  This is held so that it can't be
+    // replaced by a different SymbolTable at the same address.
+    lvd::sp<sept::SymbolTable> m_run_scope;
+
+    friend class Compiler;
+    friend class Machine;
+    friend Program compile_expr (sept::Data const &expr) noexcept(false);
+    friend Program compile_stmt_array (sept::ArrayTerm_c const &stmt_array) noexcept(false);
+};
+
+// These will throw if expr (or stmt_array) isn't well-formed.  Function bodies are compiled when
+// they're first called.
+Program compile_expr (sept::Data const &expr) noexcept(false);
+Program compile_stmt_array (sept::ArrayTerm_c const &stmt_array) noexcept(false);
+
+} // end namespace vm
@@ -158,6 +158,19 @@ LVD_TEST_BEGIN(200__Data__1)
     LVD_TEST_REQ_EQ(d, sept::make_array(22,44,66));
 LVD_TEST_END
 
+LVD_TEST_BEGIN(200__Data__2)
+    // Assigning a non-Data lvalue to a Data copies it, leaving the lvalue unchanged.
+    auto a = sept::make_array(1,2,3);
+    sept::Data d{sept::Float64(1.5)};
+    d = a;
+    LVD_TEST_REQ_EQ(d, sept::make_array(1,2,3));
+    LVD_TEST_REQ_EQ(a, sept::make_array(1,2,3));
+
+    // And an rvalue is moved.
+    d = std::move(a);
+    LVD_TEST_REQ_EQ(d, sept::make_array(1,2,3));
+LVD_TEST_END
+
 LVD_TEST_BEGIN(200__vector_insert__0)
     GoodDonkey::reset_counters();
     std::vector<GoodDonkey> v;
@@ -0,0 +1,110 @@
+// 2021.05.21 - Victor Dods
+
+#include <lvd/test.hpp>
+#include "req.hpp"
+#include "sept/ArrayTerm.hpp"
+#include "sept/ArrayType.hpp"
+#include "sept/FormalTypeOf.hpp"
+#include "sept/FreeVar.hpp"
+#include "sept/Match.hpp"
+#include "sept/NPType.hpp"
+#include "sept/OrderedMapType.hpp"
+#include "sept/Tuple.hpp"
+#include "sept/Union.hpp"
+#include "sept/UnionTerm.hpp"
+
+LVD_TEST_BEGIN(576__Match__0)
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+
+    {
+        auto symbol_table_o = sept::match(X, sept::Uint32(123));
+        LVD_TEST_REQ_IS_TRUE(symbol_table_o.has_value());
+        LVD_TEST_REQ_EQ(symbol_table_o->resolve_symbol_const("X"), sept::Data{sept::Uint32(123)});
+    }
+    {
+        auto symbol_table_o = sept::match(sept::Tuple(X, Y), sept::Tuple(sept::Uint32(123), sept::Float64(456.75)));
+        LVD_TEST_REQ_IS_TRUE(symbol_table_o.has_value());
+        LVD_TEST_REQ_EQ(symbol_table_o->resolve_symbol_const("X"), sept::Data{sept::Uint32(123)});
+        LVD_TEST_REQ_EQ(symbol_table_o->resolve_symbol_const("Y"), sept::Data{sept::Float64(456.75)});
+    }
+    // Non-FreeVar patterns match by equality.
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::Tuple(X, sept::True), sept::Tuple(sept::Uint32(1), sept::True)).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Tuple(X, sept::True), sept::Tuple(sept::Uint32(1), sept::False)).has_value());
+    // Element counts and kinds must agree.
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Tuple(X, Y), sept::Tuple(sept::Uint32(1))).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Tuple(X), sept::Array(sept::Uint32(1))).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Tuple(X), sept::Uint32(1)).has_value());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(576__Match__1__repeated_FreeVar)
+    auto X = sept::FreeVar("X");
+
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::Tuple(X, X), sept::Tuple(sept::Uint32(123), sept::Uint32(123))).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Tuple(X, X), sept::Tuple(sept::Uint32(123), sept::Float64(456.75))).has_value());
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::Union(X, X), sept::Union(sept::Uint32, sept::Uint32)).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Union(X, X), sept::Union(sept::Uint32, sept::Float64)).has_value());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(576__Match__2__structural)
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+
+    {
+        auto symbol_table_o = sept::match(sept::ArrayE(X), sept::ArrayE(sept::Uint32));
+        LVD_TEST_REQ_IS_TRUE(symbol_table_o.has_value());
+        LVD_TEST_REQ_EQ(symbol_table_o->resolve_symbol_const("X"), sept::Data{sept::Uint32});
+    }
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::Array(X, Y), sept::Array(sept::Uint32(123), sept::Float64(456.75))).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::Array(X, Y), sept::Array(sept::Uint32(123))).has_value());
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::OrderedMapDC(X, Y), sept::OrderedMapDC(sept::Uint32, sept::Float64)).has_value());
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::OrderedMapD(X), sept::OrderedMapD(sept::Uint32)).has_value());
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::OrderedMapC(Y), sept::OrderedMapC(sept::Uint32)).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::OrderedMapC(Y), sept::OrderedMapD(sept::Uint32)).has_value());
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::FormalTypeOf(X), sept::FormalTypeOf(sept::Uint32(3))).has_value());
+    LVD_TEST_REQ_IS_TRUE(sept::match(sept::OrderedMapDC(sept::ArrayE(X), sept::ArrayE(X)), sept::OrderedMapDC(sept::ArrayE(sept::Uint32), sept::ArrayE(sept::Uint32))).has_value());
+    LVD_TEST_REQ_IS_FALSE(sept::match(sept::OrderedMapDC(sept::ArrayE(X), sept::ArrayE(X)), sept::OrderedMapDC(sept::ArrayE(sept::Uint32), sept::ArrayE(sept::Bool))).has_value());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(576__Match__3__MatchFrame)
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    auto Z = sept::FreeVar("Z");
+
+    // Two patterns sharing X, i.e. the conjunction (X, Y) and (Y, Z) as a chain.
+    sept::MatchVars vars;
+    sept::MatchPattern p0(sept::Tuple(X, Y), vars);
+    sept::MatchPattern p1(sept::Tuple(Y, Z), vars);
+    LVD_TEST_REQ_EQ(vars.size(), size_t(3));
+    sept::MatchFrame frame(vars.size());
+
+    sept::Data t0 = sept::Tuple(sept::Uint32(1), sept::Uint32(2));
+    sept::Data t1 = sept::Tuple(sept::Uint32(3), sept::Uint32(4));
+    sept::Data t2 = sept::Tuple(sept::Uint32(2), sept::Uint32(5));
+
+    LVD_TEST_REQ_IS_TRUE(sept::match(p0, t0, frame));
+    LVD_TEST_REQ_EQ(frame.trail_mark(), size_t(2));
+    auto mark = frame.trail_mark();
+    // t1 doesn't continue the chain, and a failed match leaves the frame as it was.
+    LVD_TEST_REQ_IS_FALSE(sept::match(p1, t1, frame));
+    LVD_TEST_REQ_EQ(frame.trail_mark(), mark);
+    LVD_TEST_REQ_IS_FALSE(frame.is_bound(*vars.find_slot(sept::intern("Z"))));
+    LVD_TEST_REQ_IS_TRUE(sept::match(p1, t2, frame));
+
+    // The bindings point into the matched terms.
+    auto z_slot = *vars.find_slot(sept::intern("Z"));
+    LVD_TEST_REQ_EQ(frame.binding(z_slot), &t2.cast<sept::TupleTerm_c const &>()[1]);
+
+    auto symbol_table = sept::symbol_table_of(vars, frame);
+    LVD_TEST_REQ_EQ(symbol_table.resolve_symbol_const("X"), sept::Data{sept::Uint32(1)});
+    LVD_TEST_REQ_EQ(symbol_table.resolve_symbol_const("Y"), sept::Data{sept::Uint32(2)});
+    LVD_TEST_REQ_EQ(symbol_table.resolve_symbol_const("Z"), sept::Data{sept::Uint32(5)});
+
+    // Backtrack to before the second match.
+    frame.undo_to(mark);
+    LVD_TEST_REQ_IS_FALSE(frame.is_bound(z_slot));
+    LVD_TEST_REQ_IS_TRUE(frame.is_bound(*vars.find_slot(sept::intern("Y"))));
+    frame.clear();
+    LVD_TEST_REQ_EQ(frame.trail_mark(), size_t(0));
+    LVD_TEST_REQ_IS_TRUE(sept::match(p1, t1, frame));
+LVD_TEST_END
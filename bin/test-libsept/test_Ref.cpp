@@ -212,3 +212,48 @@ LVD_TEST_BEGIN(572__Ref__4__Printing)
              << LVD_REFLECT(d4) << '\n'
              << '\n';
 LVD_TEST_END
+
+// Returns true iff the ref impl lives inside the RefTerm_c itself, i.e. no separate heap allocation
+// was made for it.  Note that this says nothing about where the RefTerm_c lives -- a Data holding one
+// still stores it on the heap, since it's bigger than std::any's small-object buffer.
+inline bool ref_impl_is_inline (sept::RefTerm_c const &r) {
+    auto impl = reinterpret_cast<char const *>(&r.ref_base_get());
+    auto begin = reinterpret_cast<char const *>(&r);
+    return begin <= impl && impl < begin + sizeof(r);
+}
+
+LVD_TEST_BEGIN(572__Ref__5__inline_storage)
+    // The builtin ref impls must stay small enough that RefTerm_c doesn't get bloated.
+    LVD_TEST_REQ_LEQ(sizeof(sept::MemRefTermImpl), 2*sizeof(void*));
+    LVD_TEST_REQ_LEQ(sizeof(sept::GlobalSymRefTermImpl), sept::REF_TERM_INLINE_CAPACITY);
+    LVD_TEST_REQ_LEQ(sizeof(sept::LocalSymRefTermImpl), sept::REF_TERM_INLINE_CAPACITY);
+    LVD_TEST_REQ_EQ(sizeof(sept::RefTerm_c), sept::REF_TERM_INLINE_CAPACITY + sizeof(void*));
+
+    auto d = sept::Data{sept::Uint32(123456)};
+    auto symbol_table = lvd::make_nnsp<sept::SymbolTable>();
+    symbol_table->define_symbol("572__x", d);
+    sept::global_symbol_table()->define_symbol("572__x", d);
+
+    for (auto const &r : {sept::MemRef(&d), sept::GlobalSymRef("572__x"), sept::LocalSymRef("572__x", symbol_table)}) {
+        LVD_TEST_REQ_IS_TRUE(ref_impl_is_inline(r));
+        // Copies and moves must stay inline and keep referring to the same thing.
+        auto copy = r;
+        LVD_TEST_REQ_IS_TRUE(ref_impl_is_inline(copy));
+        LVD_TEST_REQ_EQ(copy, d);
+        auto moved = std::move(copy);
+        LVD_TEST_REQ_IS_TRUE(ref_impl_is_inline(moved));
+        LVD_TEST_REQ_EQ(moved, d);
+        // Assignment across ref kinds.
+        auto assigned = sept::MemRef(&d);
+        assigned = moved;
+        LVD_TEST_REQ_IS_TRUE(ref_impl_is_inline(assigned));
+        LVD_TEST_REQ_EQ(&assigned.referenced_data(), &r.referenced_data());
+    }
+
+    // The nnup constructor moves the impl into the inline storage.
+    auto r = sept::RefTerm_c(lvd::make_nnup<sept::MemRefTermImpl>(&d));
+    LVD_TEST_REQ_IS_TRUE(ref_impl_is_inline(r));
+    LVD_TEST_REQ_EQ(&r.referenced_data(), &d);
+
+    sept::global_symbol_table()->erase_symbol("572__x");
+LVD_TEST_END
@@ -0,0 +1,564 @@
+// 2021.05.20 - Victor Dods
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <lvd/test.hpp>
+#include "req.hpp"
+#include "sept/ArrayTerm.hpp"
+#include "sept/ConcurrentSymbolIndex.hpp"
+#include "sept/GlobalSymRef.hpp"
+#include "sept/Interner.hpp"
+#include "sept/LocalSymRef.hpp"
+#include "sept/NPType.hpp"
+#include "sept/SymbolTable.hpp"
+#include "sept/SymbolTableImage.hpp"
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+LVD_TEST_BEGIN(574__SymbolTable__0__Interner)
+    auto a = sept::intern("574__a");
+    auto b = sept::intern("574__b");
+    // Interning the same string again must produce the same id, even through a different string type.
+    LVD_TEST_REQ_EQ(sept::intern(std::string("574__a")), a);
+    LVD_TEST_REQ_EQ(sept::intern(std::string_view("574__b")), b);
+    LVD_TEST_REQ_NEQ(a, b);
+    LVD_TEST_REQ_EQ(a.as_string(), std::string("574__a"));
+    LVD_TEST_REQ_EQ(b.as_string(), std::string("574__b"));
+
+    // find doesn't intern.
+    auto interned_count = sept::global_interner().size();
+    LVD_TEST_REQ_IS_FALSE(sept::global_interner().find("574__never_interned").has_value());
+    LVD_TEST_REQ_EQ(sept::global_interner().size(), interned_count);
+    LVD_TEST_REQ_IS_TRUE(sept::global_interner().find("574__a").has_value());
+    LVD_TEST_REQ_EQ(*sept::global_interner().find("574__a"), a);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__1__define_and_resolve)
+    auto symbol_table = lvd::make_nnsp<sept::SymbolTable>();
+    // String-based API and interned-id-based API must agree.
+    LVD_TEST_REQ_EQ(symbol_table->define_symbol("x", sept::Data{10.5}), size_t(0));
+    LVD_TEST_REQ_EQ(symbol_table->define_symbol(sept::intern("y"), sept::Data{true}), size_t(1));
+    LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const("x"), sept::Data{10.5});
+    LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const(sept::intern("x")), sept::Data{10.5});
+    LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const(std::string("y")), sept::Data{true});
+    LVD_TEST_REQ_IS_TRUE(symbol_table->symbol_is_defined("x"));
+    LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined("574__never_interned"));
+    LVD_TEST_REQ_EQ(symbol_table->slot_count(), size_t(2));
+    LVD_TEST_REQ_EQ(symbol_table->slot_symbol(0), sept::intern("x"));
+    LVD_TEST_REQ_EQ(symbol_table->slot_symbol(1), sept::intern("y"));
+
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        symbol_table->define_symbol("x", sept::Data{20.5});
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        symbol_table->resolve_symbol_const("574__never_interned");
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        symbol_table->resolve_symbol_const("z");
+    });
+
+    // References returned by resolve must remain valid as further symbols are defined.
+    auto const *x_ptr = &symbol_table->resolve_symbol_const("x");
+    for (int i = 0; i < 100; ++i)
+        symbol_table->define_symbol(LVD_FMT("574__filler" << i), sept::Data{i});
+    LVD_TEST_REQ_EQ(&symbol_table->resolve_symbol_const("x"), x_ptr);
+
+    symbol_table->clear();
+    LVD_TEST_REQ_EQ(symbol_table->slot_count(), size_t(0));
+    LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined("x"));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__2__slots)
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    root->define_symbol("a", sept::Data{1.0});
+    root->define_symbol("b", sept::Data{2.0});
+    auto child = root->push_symbol_table();
+    child->define_symbol("b", sept::Data{20.0}); // Shadows root's b
+    child->define_symbol("c", sept::Data{30.0});
+    auto grandchild = child->push_symbol_table();
+
+    LVD_TEST_REQ_EQ(*grandchild->locate_symbol("a"), (sept::SymbolSlot{2, 0}));
+    LVD_TEST_REQ_EQ(*grandchild->locate_symbol("b"), (sept::SymbolSlot{1, 0}));
+    LVD_TEST_REQ_EQ(*grandchild->locate_symbol("c"), (sept::SymbolSlot{1, 1}));
+    LVD_TEST_REQ_EQ(*root->locate_symbol("b"), (sept::SymbolSlot{0, 1}));
+    LVD_TEST_REQ_IS_FALSE(grandchild->locate_symbol("574__never_interned").has_value());
+    LVD_TEST_REQ_IS_FALSE(root->locate_symbol("c").has_value());
+
+    // Resolving by slot must agree with resolving by symbol.
+    for (auto const &symbol_id : {"a", "b", "c"})
+        LVD_TEST_REQ_EQ(&grandchild->resolve_slot_const(*grandchild->locate_symbol(symbol_id)), &grandchild->resolve_symbol_const(symbol_id));
+
+    grandchild->resolve_slot_nonconst(sept::SymbolSlot{1, 1}) = sept::Data{33.0};
+    LVD_TEST_REQ_EQ(child->resolve_symbol_const("c"), sept::Data{33.0});
+
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        grandchild->resolve_slot_const(sept::SymbolSlot{3, 0});
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        grandchild->resolve_slot_const(sept::SymbolSlot{1, 2});
+    });
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__3__LocalSymRef_with_slot)
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    root->define_symbol("x", sept::Data{10.5});
+    auto child = root->push_symbol_table();
+
+    auto by_symbol = sept::LocalSymRef("x", child);
+    auto by_slot = sept::LocalSymRef(sept::intern("x"), child, *child->locate_symbol("x"));
+    LVD_TEST_REQ_EQ(by_symbol, by_slot);
+    LVD_TEST_REQ_EQ(&by_symbol.referenced_data(), &by_slot.referenced_data());
+    LVD_TEST_REQ_EQ(sept::Data{by_slot}.cast<double>(), 10.5);
+
+    // Copies must retain the slot.
+    auto by_slot_copy = by_slot;
+    LVD_TEST_REQ_EQ(&by_slot_copy.referenced_data(), &by_slot.referenced_data());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__4__resolution_cache)
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    root->define_symbol("x", sept::Data{10.5});
+    auto child = root->push_symbol_table();
+    auto grandchild = child->push_symbol_table();
+
+    auto ref = sept::LocalSymRef("x", grandchild);
+    auto slot_ref = sept::LocalSymRef(sept::intern("x"), grandchild, sept::SymbolSlot{2, 0});
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 10.5);
+    LVD_TEST_REQ_EQ(sept::Data{slot_ref}.cast<double>(), 10.5);
+
+    // Defining something unrelated bumps the generation, but the result must be the same.
+    auto generation = root->generation();
+    root->define_symbol("574__unrelated", sept::Data{true});
+    LVD_TEST_REQ_NEQ(root->generation(), generation);
+    LVD_TEST_REQ_EQ(&ref.referenced_data(), &root->resolve_symbol_const("x"));
+
+    // Shadowing in an intermediate table must invalidate the cached resolution of ref,
+    // but not of slot_ref, since that one refers to a fixed location.
+    child->define_symbol("x", sept::Data{20.5});
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 20.5);
+    LVD_TEST_REQ_EQ(sept::Data{slot_ref}.cast<double>(), 10.5);
+
+    // Erasing the shadowing definition un-shadows.
+    child->erase_symbol("x");
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 10.5);
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        child->erase_symbol("x");
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        grandchild->resolve_slot_const(sept::SymbolSlot{1, 0});
+    });
+
+    // Erasing the referenced definition must cause deref to throw instead of using a stale pointer.
+    root->erase_symbol("x");
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        ref.referenced_data();
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        slot_ref.referenced_data();
+    });
+
+    // Re-defining reuses the vacant slot, so both refs find it.
+    root->define_symbol("x", sept::Data{30.5});
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 30.5);
+    LVD_TEST_REQ_EQ(sept::Data{slot_ref}.cast<double>(), 30.5);
+
+    // If a different symbol reuses the slot, then slot_ref must not resolve to it.
+    root->erase_symbol("x");
+    root->define_symbol("574__reuser", sept::Data{40.5});
+    LVD_TEST_REQ_EQ(*root->local_slot(sept::intern("574__reuser")), size_t(0));
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        ref.referenced_data();
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        slot_ref.referenced_data();
+    });
+    root->erase_symbol("574__reuser");
+    root->define_symbol("x", sept::Data{50.5});
+    LVD_TEST_REQ_EQ(sept::Data{slot_ref}.cast<double>(), 50.5);
+
+    // Same for GlobalSymRef against the global SymbolTable.
+    auto global_ref = sept::GlobalSymRef("574__global_x");
+    sept::global_symbol_table()->define_symbol("574__global_x", sept::Data{1.5});
+    LVD_TEST_REQ_EQ(sept::Data{global_ref}.cast<double>(), 1.5);
+    sept::global_symbol_table()->erase_symbol("574__global_x");
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        global_ref.referenced_data();
+    });
+    sept::global_symbol_table()->define_symbol("574__global_x", sept::Data{2.5});
+    LVD_TEST_REQ_EQ(sept::Data{global_ref}.cast<double>(), 2.5);
+    sept::global_symbol_table()->erase_symbol("574__global_x");
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__5__concurrent_reads_stress)
+    // Each symbol "574__c<i>" is only ever defined with value i, so any resolved value can be checked.
+    size_t const initial_count = 256;
+    size_t const total_count = 4096;
+    std::vector<sept::InternedId> symbol_ids;
+    for (size_t i = 0; i < total_count; ++i)
+        symbol_ids.emplace_back(sept::intern(LVD_FMT("574__c" << i)));
+
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    for (size_t i = 0; i < initial_count; ++i)
+        root->define_symbol(symbol_ids[i], sept::Data{double(i)});
+    root->enable_concurrent_reads();
+    LVD_TEST_REQ_IS_TRUE(root->concurrent_reads_enabled());
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> bad_value_count{0};
+    std::atomic<size_t> missing_initial_count{0};
+    auto reader = [&](size_t seed){
+        size_t i = seed;
+        while (!done.load(std::memory_order_relaxed)) {
+            i = (i * 1103515245 + 12345) % total_count;
+            try {
+                if (root->resolve_symbol_const(symbol_ids[i]).cast<double>() != double(i))
+                    ++bad_value_count;
+            } catch (std::runtime_error const &) {
+                // The writer never erases the initial symbols.
+                if (i < initial_count)
+                    ++missing_initial_count;
+            }
+        }
+    };
+
+    auto thread_count = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < thread_count; ++t)
+        readers.emplace_back(reader, t);
+
+    // Define the rest (which grows the index several times), erasing and re-defining some along the way.
+    for (size_t i = initial_count; i < total_count; ++i) {
+        root->define_symbol(symbol_ids[i], sept::Data{double(i)});
+        if (i % 3 == 0) {
+            root->erase_symbol(symbol_ids[i]);
+            root->define_symbol(symbol_ids[i], sept::Data{double(i)});
+        }
+    }
+    done = true;
+    for (auto &t : readers)
+        t.join();
+
+    LVD_TEST_REQ_EQ(bad_value_count.load(), size_t(0));
+    LVD_TEST_REQ_EQ(missing_initial_count.load(), size_t(0));
+    for (size_t i = 0; i < total_count; ++i)
+        LVD_TEST_REQ_EQ(root->resolve_symbol_const(symbol_ids[i]).cast<double>(), double(i));
+    // The slot-based API still works, since it takes the writer mutex.
+    LVD_TEST_REQ_EQ(root->resolve_slot_const(*root->locate_symbol(symbol_ids[7])).cast<double>(), 7.0);
+
+    // Once the readers are done, concurrent reads can be disabled again, without losing any symbols.
+    root->disable_concurrent_reads();
+    LVD_TEST_REQ_IS_FALSE(root->concurrent_reads_enabled());
+    for (size_t i = 0; i < total_count; ++i)
+        LVD_TEST_REQ_EQ(root->resolve_symbol_const(symbol_ids[i]).cast<double>(), double(i));
+    root->erase_symbol(symbol_ids[0]);
+    LVD_TEST_REQ_IS_FALSE(root->symbol_is_defined(symbol_ids[0]));
+LVD_TEST_END
+
+// This doesn't require anything about the timing (which would make it flaky), it just reports
+// the read throughput for increasing numbers of threads, which should scale roughly linearly.
+LVD_TEST_BEGIN(574__SymbolTable__6__concurrent_read_scaling)
+    size_t const symbol_count = 1024;
+    size_t const reads_per_thread = 1000000;
+    std::vector<sept::InternedId> symbol_ids;
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    for (size_t i = 0; i < symbol_count; ++i) {
+        symbol_ids.emplace_back(sept::intern(LVD_FMT("574__s" << i)));
+        root->define_symbol(symbol_ids.back(), sept::Data{double(i)});
+    }
+    root->enable_concurrent_reads();
+
+    std::atomic<size_t> checksum{0};
+    auto reader = [&](size_t seed){
+        size_t local_checksum = 0;
+        for (size_t n = 0, i = seed; n < reads_per_thread; ++n) {
+            i = (i * 1103515245 + 12345) % symbol_count;
+            local_checksum += size_t(root->resolve_symbol_const(symbol_ids[i]).cast<double>());
+        }
+        checksum += local_checksum;
+    };
+
+    auto max_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> readers;
+        for (size_t t = 0; t < thread_count; ++t)
+            readers.emplace_back(reader, t);
+        for (auto &t : readers)
+            t.join();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        test_log << lvd::Log::inf() << "threads = " << thread_count << ", reads/sec = " << thread_count*reads_per_thread/seconds << '\n';
+    }
+    LVD_TEST_REQ_NEQ(checksum.load(), size_t(0));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__7__image)
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    root->define_symbol("574__a", sept::Data{sept::Uint32(1)});
+    root->define_symbol("574__b", sept::Data{sept::Float64(2.5)});
+    root->define_symbol("574__erased", sept::Data{true});
+    root->erase_symbol("574__erased");
+    auto child = root->push_symbol_table();
+    child->define_symbol("574__b", sept::Data{sept::Array(sept::Uint32(20), sept::Uint32(21))}); // Shadows root's 574__b
+    for (uint32_t i = 0; i < 1000; ++i)
+        child->define_symbol(LVD_FMT("574__filler" << i), sept::Data{sept::Uint32(i)});
+
+    char path[] = "/tmp/574__SymbolTable__7__XXXXXX";
+    auto fd = ::mkstemp(path);
+    LVD_TEST_REQ_IS_TRUE(fd >= 0);
+    ::close(fd);
+    auto remove_file = lvd::ScopeGuard{[&](){ std::remove(path); }};
+    {
+        std::ofstream out(path, std::ios::binary);
+        sept::write_symbol_table_image(*child, out);
+    }
+
+    auto loaded = sept::load_symbol_table_image(path);
+    LVD_TEST_REQ_IS_TRUE(loaded->has_image());
+    LVD_TEST_REQ_IS_TRUE(loaded->has_parent_symbol_table());
+    LVD_TEST_REQ_IS_FALSE(loaded->parent_symbol_table()->has_parent_symbol_table());
+    // Nothing is materialized until it's used.
+    LVD_TEST_REQ_EQ(loaded->slot_count(), size_t(0));
+    LVD_TEST_REQ_IS_TRUE(loaded->symbol_is_defined("574__filler999"));
+    LVD_TEST_REQ_EQ(loaded->slot_count(), size_t(0));
+
+    LVD_TEST_REQ_EQ(loaded->resolve_symbol_const("574__filler123"), sept::Data{sept::Uint32(123)});
+    LVD_TEST_REQ_EQ(loaded->slot_count(), size_t(1));
+    LVD_TEST_REQ_EQ(loaded->resolve_symbol_const("574__b"), (sept::Data{sept::Array(sept::Uint32(20), sept::Uint32(21))}));
+    LVD_TEST_REQ_EQ(loaded->resolve_symbol_const("574__a"), sept::Data{sept::Uint32(1)});
+    LVD_TEST_REQ_EQ(loaded->parent_symbol_table()->resolve_symbol_const("574__b"), sept::Data{sept::Float64(2.5)});
+    LVD_TEST_REQ_IS_FALSE(loaded->symbol_is_defined("574__erased"));
+    // Materialized values are stable.
+    LVD_TEST_REQ_EQ(&loaded->resolve_symbol_const("574__filler123"), &loaded->resolve_symbol_const("574__filler123"));
+
+    // Defining something that's only in the image must still count as a redefinition.
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        loaded->define_symbol("574__filler7", sept::Data{sept::Uint32(7)});
+    });
+    // Erased image symbols must not come back.
+    loaded->erase_symbol("574__filler8");
+    LVD_TEST_REQ_IS_FALSE(loaded->symbol_is_defined("574__filler8"));
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        loaded->resolve_symbol_const("574__filler8");
+    });
+    loaded->define_symbol("574__filler8", sept::Data{sept::Uint32(88)});
+    LVD_TEST_REQ_EQ(loaded->resolve_symbol_const("574__filler8"), sept::Data{sept::Uint32(88)});
+
+    // Refs work through it too, including slot-based ones.
+    auto grandchild = loaded->push_symbol_table();
+    LVD_TEST_REQ_EQ(sept::Data{sept::LocalSymRef("574__filler500", grandchild)}, sept::Data{sept::Uint32(500)});
+    LVD_TEST_REQ_EQ(grandchild->resolve_slot_const(*grandchild->locate_symbol("574__a")), sept::Data{sept::Uint32(1)});
+
+    // Re-writing a loaded image must include the unmaterialized symbols.  This has to go to a different
+    // file, since the original is still mapped.
+    char path2[] = "/tmp/574__SymbolTable__7__XXXXXX";
+    auto fd2 = ::mkstemp(path2);
+    LVD_TEST_REQ_IS_TRUE(fd2 >= 0);
+    ::close(fd2);
+    auto remove_file2 = lvd::ScopeGuard{[&](){ std::remove(path2); }};
+    {
+        std::ofstream out(path2, std::ios::binary);
+        sept::write_symbol_table_image(*loaded, out);
+    }
+    auto reloaded = sept::load_symbol_table_image(path2);
+    LVD_TEST_REQ_EQ(reloaded->resolve_symbol_const("574__filler999"), sept::Data{sept::Uint32(999)});
+    LVD_TEST_REQ_EQ(reloaded->resolve_symbol_const("574__filler8"), sept::Data{sept::Uint32(88)});
+
+    // Malformed images must be rejected at load time.
+    char path3[] = "/tmp/574__SymbolTable__7__XXXXXX";
+    auto fd3 = ::mkstemp(path3);
+    LVD_TEST_REQ_IS_TRUE(fd3 >= 0);
+    ::close(fd3);
+    auto remove_file3 = lvd::ScopeGuard{[&](){ std::remove(path3); }};
+    {
+        std::ofstream out(path3, std::ios::binary);
+        out << "not an image";
+    }
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        sept::load_symbol_table_image(path3);
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        sept::load_symbol_table_image("/nonexistent/574__SymbolTable__7");
+    });
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__8__reset)
+    auto root = lvd::make_nnsp<sept::SymbolTable>();
+    root->define_symbol("x", sept::Data{10.5});
+    auto other_root = lvd::make_nnsp<sept::SymbolTable>();
+    other_root->define_symbol("x", sept::Data{20.5});
+
+    auto frame = root->push_symbol_table();
+    frame->define_symbol("y", sept::Data{true});
+    LVD_TEST_REQ_EQ(frame->resolve_symbol_const("x").cast<double>(), 10.5);
+
+    // Resetting reuses the SymbolTable as a fresh scope with a different parent.
+    auto generation = frame->generation();
+    frame->reset(other_root);
+    LVD_TEST_REQ_NEQ(frame->generation(), generation);
+    LVD_TEST_REQ_EQ(frame->slot_count(), size_t(0));
+    LVD_TEST_REQ_IS_FALSE(frame->symbol_is_defined("y"));
+    LVD_TEST_REQ_EQ(frame->parent_symbol_table().get().get(), other_root.get().get());
+    LVD_TEST_REQ_EQ(frame->resolve_symbol_const("x").cast<double>(), 20.5);
+
+    // Slots start over.
+    LVD_TEST_REQ_EQ(frame->define_symbol("z", sept::Data{false}), size_t(0));
+    LVD_TEST_REQ_EQ(frame->locate_symbol("x")->m_depth, size_t(1));
+
+    frame->reset(nullptr);
+    LVD_TEST_REQ_IS_FALSE(frame->has_parent_symbol_table());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__9__resolution_cache_after_reparent)
+    // These are arranged so that the old root had made exactly one more change than the frame's reset
+    // and the new root together, which would fool a cache that only looked at counts of changes.
+    auto old_root = lvd::make_nnsp<sept::SymbolTable>();
+    old_root->define_symbol("574__pad", sept::Data{false});
+    old_root->define_symbol("x", sept::Data{10.5});
+    auto new_root = lvd::make_nnsp<sept::SymbolTable>();
+    new_root->define_symbol("x", sept::Data{20.5});
+
+    auto frame = old_root->push_symbol_table();
+    auto ref = sept::LocalSymRef("x", frame);
+    auto slot_ref = sept::LocalSymRef(sept::intern("x"), frame, sept::SymbolSlot{1, 1});
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 10.5);
+    LVD_TEST_REQ_EQ(sept::Data{slot_ref}.cast<double>(), 10.5);
+
+    // Reparenting must invalidate both, even though the old root is still alive and unchanged.
+    frame->reset(new_root);
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 20.5);
+    LVD_TEST_REQ_EQ(&ref.referenced_data(), &new_root->resolve_symbol_const("x"));
+    // new_root has no slot 1.
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        slot_ref.referenced_data();
+    });
+
+    // Same for reparenting via assignment.
+    auto other_frame = old_root->push_symbol_table();
+    *frame = *other_frame;
+    LVD_TEST_REQ_EQ(sept::Data{ref}.cast<double>(), 10.5);
+    LVD_TEST_REQ_EQ(&ref.referenced_data(), &old_root->resolve_symbol_const("x"));
+
+    // Every change takes a generation greater than all earlier ones, of any SymbolTable.
+    auto generation = std::max(old_root->generation(), std::max(new_root->generation(), frame->generation()));
+    new_root->define_symbol("574__later", sept::Data{true});
+    LVD_TEST_REQ_IS_TRUE(new_root->generation() > generation);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__10__small_and_large_tables)
+    // Lookup switches from a linear scan to the hash map once there are more than SMALL_SLOT_COUNT
+    // slots; the results must be the same either way, including across erase and clear.
+    auto symbol_table = lvd::make_nnsp<sept::SymbolTable>();
+    auto const symbol_count = 2*sept::SymbolTable::SMALL_SLOT_COUNT;
+    auto symbol_name = [](size_t i){ return LVD_FMT("574__s" << i); };
+    for (size_t round = 0; round < 2; ++round) {
+        for (size_t i = 0; i < symbol_count; ++i) {
+            symbol_table->define_symbol(symbol_name(i), sept::Data{uint32_t(i)});
+            for (size_t j = 0; j <= i; ++j) {
+                LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const(symbol_name(j)).cast<uint32_t>(), uint32_t(j));
+                LVD_TEST_REQ_EQ(*symbol_table->local_slot(sept::intern(symbol_name(j))), j);
+            }
+            LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined(symbol_name(i+1)));
+        }
+
+        // Erasing leaves a vacant slot, and redefining reuses it.
+        symbol_table->erase_symbol(symbol_name(1));
+        LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined(symbol_name(1)));
+        LVD_TEST_REQ_IS_FALSE(symbol_table->local_slot(sept::intern(symbol_name(1))).has_value());
+        symbol_table->define_symbol(symbol_name(1), sept::Data{uint32_t(100)});
+        LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const(symbol_name(1)).cast<uint32_t>(), uint32_t(100));
+        LVD_TEST_REQ_EQ(*symbol_table->local_slot(sept::intern(symbol_name(1))), size_t(1));
+        LVD_TEST_REQ_EQ(symbol_table->slot_count(), symbol_count);
+
+        // Clearing goes back to a small table.
+        symbol_table->clear();
+        for (size_t i = 0; i < symbol_count; ++i)
+            LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined(symbol_name(i)));
+    }
+
+    // A small table with a vacant slot must not find the erased symbol via the scan.
+    symbol_table->define_symbol("574__a", sept::Data{true});
+    symbol_table->erase_symbol("574__a");
+    LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined("574__a"));
+    symbol_table->define_symbol("574__a", sept::Data{false});
+    LVD_TEST_REQ_EQ(*symbol_table->locate_symbol("574__a"), (sept::SymbolSlot{0, 0}));
+    LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const("574__a"), sept::Data{false});
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__11__concurrent_index_assign)
+    std::vector<sept::InternedId> symbol_ids;
+    std::vector<sept::Data> values;
+    for (size_t i = 0; i < 9; ++i) {
+        symbol_ids.emplace_back(sept::intern(LVD_FMT("574__i" << i)));
+        values.emplace_back(uint32_t(i));
+    }
+
+    // The initial table has 16 entries and holds at most 8 keys.
+    sept::ConcurrentSymbolIndex index;
+    auto initial_capacity = index.capacity();
+    LVD_TEST_REQ_EQ(initial_capacity, size_t(16));
+    for (size_t i = 0; i < 8; ++i)
+        index.assign(symbol_ids[i], &values[i]);
+    LVD_TEST_REQ_EQ(index.capacity(), initial_capacity);
+
+    // Overwriting, erasing and re-assigning existing keys must not grow a full table.
+    for (size_t pass = 0; pass < 100; ++pass) {
+        for (size_t i = 0; i < 8; ++i) {
+            index.assign(symbol_ids[i], &values[(i + pass) % 8]);
+            index.assign(symbol_ids[i], nullptr);
+            LVD_TEST_REQ_EQ(index.find(symbol_ids[i]), static_cast<sept::Data *>(nullptr));
+            index.assign(symbol_ids[i], &values[i]);
+        }
+    }
+    LVD_TEST_REQ_EQ(index.capacity(), initial_capacity);
+    for (size_t i = 0; i < 8; ++i)
+        LVD_TEST_REQ_EQ(index.find(symbol_ids[i]), &values[i]);
+
+    // Erasing a key that isn't present is a no-op.
+    index.assign(symbol_ids[8], nullptr);
+    LVD_TEST_REQ_EQ(index.capacity(), initial_capacity);
+    LVD_TEST_REQ_EQ(index.find(symbol_ids[8]), static_cast<sept::Data *>(nullptr));
+
+    // Only inserting a new key grows the table, and everything survives the move.
+    index.assign(symbol_ids[8], &values[8]);
+    LVD_TEST_REQ_EQ(index.capacity(), 2*initial_capacity);
+    for (size_t i = 0; i < 9; ++i)
+        LVD_TEST_REQ_EQ(index.find(symbol_ids[i]), &values[i]);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(574__SymbolTable__12__vacant_slots_are_reused)
+    // Defining and erasing symbols repeatedly must not grow the table, in either the small or large case.
+    auto symbol_table = lvd::make_nnsp<sept::SymbolTable>();
+    auto symbol_name = [](size_t i){ return LVD_FMT("574__v" << i); };
+    for (size_t live_count : {size_t(2), 2*sept::SymbolTable::SMALL_SLOT_COUNT}) {
+        symbol_table->clear();
+        for (size_t i = 0; i < live_count; ++i)
+            symbol_table->define_symbol(symbol_name(i), sept::Data{uint32_t(i)});
+        for (size_t round = 0; round < 100; ++round) {
+            // Cycle through different symbols, so that a slot is reused by other symbols than its last one.
+            auto i = round % live_count;
+            auto j = live_count + round;
+            symbol_table->erase_symbol(symbol_name(i));
+            symbol_table->define_symbol(symbol_name(j), sept::Data{uint32_t(j)});
+            symbol_table->erase_symbol(symbol_name(j));
+            symbol_table->define_symbol(symbol_name(i), sept::Data{uint32_t(i)});
+            LVD_TEST_REQ_EQ(symbol_table->slot_count(), live_count);
+        }
+        for (size_t i = 0; i < live_count; ++i)
+            LVD_TEST_REQ_EQ(symbol_table->resolve_symbol_const(symbol_name(i)).cast<uint32_t>(), uint32_t(i));
+        LVD_TEST_REQ_IS_FALSE(symbol_table->symbol_is_defined(symbol_name(live_count)));
+    }
+
+    // Slots vacated while concurrent reads are enabled aren't reused, since readers may still hold them.
+    symbol_table->enable_concurrent_reads();
+    symbol_table->erase_symbol(symbol_name(0));
+    symbol_table->define_symbol(symbol_name(0), sept::Data{uint32_t(0)});
+    LVD_TEST_REQ_EQ(symbol_table->slot_count(), 2*sept::SymbolTable::SMALL_SLOT_COUNT + 1);
+    symbol_table->disable_concurrent_reads();
+LVD_TEST_END
@@ -0,0 +1,144 @@
+// 2021.05.24 - Victor Dods
+
+#include <lvd/test.hpp>
+#include <optional>
+#include "req.hpp"
+#include "sept/ArrayTerm.hpp"
+#include "sept/ArrayType.hpp"
+#include "sept/FormalTypeOf.hpp"
+#include "sept/MemRef.hpp"
+#include "sept/NPType.hpp"
+#include "sept/Tuple.hpp"
+#include "sept/TypeClassifier.hpp"
+#include "sept/Union.hpp"
+
+namespace {
+
+// -1 stands for std::nullopt.
+int index_of (std::optional<size_t> const &candidate_index) {
+    return candidate_index.has_value() ? int(*candidate_index) : -1;
+}
+
+// The reference implementation of classification: check each candidate in order.
+int sequential_index_of (sept::DataVector const &candidate_types, sept::Data const &value) {
+    for (size_t i = 0; i < candidate_types.size(); ++i)
+        if (inhabits_data(value, candidate_types[i]))
+            return int(i);
+    return -1;
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(575__TypeClassifier__0__classify)
+    sept::Data union_data{sept::Union(sept::Uint32, sept::Tuple(sept::Uint32, sept::Uint32, sept::Uint32))};
+    sept::DataVector candidate_types{
+        sept::Tuple(sept::FormalTypeOf(sept::True), sept::Float64),
+        sept::Tuple(sept::FormalTypeOf(sept::False), sept::Float64),
+        sept::Tuple(sept::Bool, sept::Float64),
+        sept::MemRef(&union_data),
+        sept::ArrayE(sept::Float64),
+        sept::Tuple,
+    };
+    sept::TypeClassifier classifier{candidate_types};
+    LVD_TEST_REQ_EQ(classifier.candidate_count(), candidate_types.size());
+
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple(sept::True, 1.5))), 0);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple(sept::False, 1.5))), 1);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple(true, 1.5))), 2);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple(sept::True, uint32_t(3)))), 5);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(uint32_t(7))), 3);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple(uint32_t(1), uint32_t(2), uint32_t(3)))), 3);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple(uint32_t(1), uint32_t(2)))), 5);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Tuple())), 5);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Array(1.0, 2.0))), 4);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Array(1.0, uint32_t(2)))), -1);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(1.5)), -1);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(575__TypeClassifier__1__matches_sequential)
+    sept::DataVector candidate_types{
+        sept::Tuple(sept::FormalTypeOf(sept::True), sept::Float64, sept::FormalTypeOf(sept::False)),
+        sept::Tuple(sept::FormalTypeOf(sept::True), sept::Uint32, sept::Bool),
+        sept::Tuple(sept::Bool, sept::FormalTypeOf(sept::Float64), sept::Bool),
+        sept::Union(sept::Tuple(sept::FormalTypeOf(sept::False), sept::Term), sept::Float64, sept::Union(sept::Uint32)),
+        sept::FormalTypeOf(sept::Bool),
+        sept::Bool,
+        sept::Term,
+    };
+    sept::DataVector values{
+        sept::Tuple(sept::True, 1.5, sept::False),
+        sept::Tuple(sept::True, 1.5, sept::True),
+        sept::Tuple(sept::True, uint32_t(1), sept::False),
+        sept::Tuple(sept::True, uint32_t(1), true),
+        sept::Tuple(sept::False, sept::Float64, true),
+        sept::Tuple(true, sept::Float64, false),
+        sept::Tuple(sept::False, 1.5),
+        sept::Tuple(sept::False),
+        // A FormalTypeOf_Term_c element inhabits FormalTypeOf(x) structurally, not by equality.
+        sept::Tuple(sept::FormalTypeOf(sept::True), 1.5, sept::False),
+        sept::Tuple(sept::FormalTypeOf(sept::Bool), 1.5, sept::False),
+        1.5,
+        uint32_t(8),
+        sept::Bool,
+        true,
+        sept::Union(sept::Float64),
+        sept::Array(sept::True),
+    };
+    sept::TypeClassifier classifier{candidate_types};
+    for (auto const &value : values) {
+        LVD_TEST_REQ_EQ(index_of(classifier.classify(value)), sequential_index_of(candidate_types, value));
+        if (value.type() == typeid(sept::TupleTerm_c))
+            LVD_TEST_REQ_EQ(index_of(classifier.classify(value.cast<sept::TupleTerm_c const &>())), sequential_index_of(candidate_types, value));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(575__TypeClassifier__2__classify_shallowly)
+    // A recursive type, i.e. a binary tree of Float64 values.
+    sept::Data tree_data{sept::Term};
+    sept::Data tree_ref{sept::MemRef(&tree_data)};
+    tree_data = sept::Union(sept::Float64, sept::Tuple(tree_ref, sept::FormalTypeOf(sept::True), tree_ref));
+    sept::DataVector candidate_types{
+        sept::Tuple(sept::FormalTypeOf(sept::True), sept::Float64),
+        sept::Tuple(sept::Bool, sept::Float64),
+        tree_ref,
+        sept::ArrayE(sept::Float64),
+        sept::Tuple,
+    };
+    sept::TypeClassifier classifier{candidate_types};
+
+    // Only the elements that the candidates constrain are looked at, so the subtrees of a tree aren't checked.
+    auto tree = sept::Tuple(sept::Tuple(1.0, sept::True, 2.0), sept::True, 3.0);
+    auto not_a_tree = sept::Tuple(sept::Tuple(1.0, sept::False, 2.0), sept::True, 3.0);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(tree)), 2);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify_shallowly(tree)), 2);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(not_a_tree)), 4);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify_shallowly(not_a_tree)), 2);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify(sept::Array(1.0, uint32_t(2)))), -1);
+    LVD_TEST_REQ_EQ(index_of(classifier.classify_shallowly(sept::Array(1.0, uint32_t(2)))), 3);
+
+    // Otherwise it agrees with classify.
+    sept::DataVector values{
+        sept::Tuple(sept::True, 1.5),
+        sept::Tuple(true, 1.5),
+        sept::Tuple(sept::True, uint32_t(3)),
+        sept::Tuple(1.0, sept::False, 2.0),
+        sept::Array(1.0, 2.0),
+        sept::Tuple(),
+        4.5,
+        uint32_t(7),
+    };
+    for (auto const &value : values) {
+        LVD_TEST_REQ_EQ(index_of(classifier.classify_shallowly(value)), index_of(classifier.classify(value)));
+    }
+
+    // Where more than one candidate is possible, the most specific one is chosen, not the first one.
+    sept::TypeClassifier specific_classifier{
+        sept::DataVector{
+            sept::Tuple(sept::ArrayE(sept::Float64), sept::Term),
+            sept::Tuple(sept::Term, sept::Tuple(sept::FormalTypeOf(sept::True), sept::Float64)),
+        }
+    };
+    LVD_TEST_REQ_EQ(index_of(specific_classifier.classify_shallowly(sept::Tuple(sept::Array(1.0), sept::Tuple(sept::True, 1.5)))), 1);
+    LVD_TEST_REQ_EQ(index_of(specific_classifier.classify_shallowly(sept::Tuple(sept::Array(1.0), 1.5))), 0);
+    LVD_TEST_REQ_EQ(index_of(specific_classifier.classify_shallowly(sept::Tuple(1.5, sept::Tuple(sept::True, 1.5)))), 1);
+LVD_TEST_END
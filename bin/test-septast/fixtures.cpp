@@ -0,0 +1,141 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+
+#include "sept/ArrayTerm.hpp"
+#include "sept/SymbolTable.hpp"
+#include <utility>
+
+namespace {
+
+sept::Data element_of (char const *symbol_name, uint32_t index) {
+    return syn::ElementEval(SymbolId(symbol_name), syn::SquareExpr(SquareOpen, syn::ExprArray(sept::Uint32(index)), SquareClose));
+}
+
+sept::Data construct_complex (sept::Data const &re_expr, sept::Data const &im_expr) {
+    return syn::Construction(SymbolId("Complex"), syn::CurlyExpr(CurlyOpen, syn::ExprArray(sept::Array(re_expr, im_expr)), CurlyClose));
+}
+
+} // end namespace
+
+void define_standard_symbols () {
+    auto const &scope = sept::global_symbol_table();
+    if (scope->symbol_is_defined("square"))
+        return;
+
+    scope->define_symbol(SymbolId("square"), x_op_x_literal(Mul));
+
+    // Unrolled, as in sept-ast's main.
+    sept::DataVector exp_stmts{
+        syn::SymbolDefn(SymbolId("retval"), DefinedAs, 0.0),
+        syn::SymbolDefn(SymbolId("i"), DefinedAs, 0.0),
+        syn::SymbolDefn(SymbolId("accumulator"), DefinedAs, 1.0)
+    };
+    for (size_t term = 0; term < 7; ++term) {
+        exp_stmts.emplace_back(syn::Assignment(SymbolId("retval"), AssignFrom, syn::BinOpExpr(SymbolId("retval"), Add, SymbolId("accumulator"))));
+        exp_stmts.emplace_back(syn::Assignment(SymbolId("i"), AssignFrom, syn::BinOpExpr(SymbolId("i"), Add, 1.0)));
+        exp_stmts.emplace_back(syn::Assignment(SymbolId("accumulator"), AssignFrom, syn::BinOpExpr(syn::BinOpExpr(SymbolId("accumulator"), Mul, SymbolId("x")), Div, SymbolId("i"))));
+    }
+    scope->define_symbol(
+        SymbolId("exp"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)),
+                MapsTo,
+                sept::Float64
+            ),
+            syn::BlockExpr(sept::ArrayTerm_c(std::move(exp_stmts)).with_constraint(syn::StmtArray), SymbolId("retval"))
+        )
+    );
+
+    scope->define_symbol(SymbolId("Complex"), sept::ArrayES(sept::Float64, sept::Uint32(2)));
+    scope->define_symbol(
+        SymbolId("Complex_square"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("z"), DeclaredAs, SymbolId("Complex"))),
+                MapsTo,
+                SymbolId("Complex")
+            ),
+            syn::BlockExpr(
+                syn::StmtArray(
+                    syn::SymbolDefn(SymbolId("re"), DefinedAs, element_of("z", 0)),
+                    syn::SymbolDefn(SymbolId("im"), DefinedAs, element_of("z", 1))
+                ),
+                construct_complex(
+                    syn::BinOpExpr(syn::BinOpExpr(SymbolId("re"), Mul, SymbolId("re")), Sub, syn::BinOpExpr(SymbolId("im"), Mul, SymbolId("im"))),
+                    syn::BinOpExpr(2.0, Mul, syn::BinOpExpr(SymbolId("re"), Mul, SymbolId("im")))
+                )
+            )
+        )
+    );
+    scope->define_symbol(
+        SymbolId("Complex_mul"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(
+                    syn::SymbolTypeDecl(SymbolId("w"), DeclaredAs, SymbolId("Complex")),
+                    syn::SymbolTypeDecl(SymbolId("z"), DeclaredAs, SymbolId("Complex"))
+                ),
+                MapsTo,
+                SymbolId("Complex")
+            ),
+            syn::BlockExpr(
+                syn::StmtArray(
+                    syn::SymbolDefn(SymbolId("w_re"), DefinedAs, element_of("w", 0)),
+                    syn::SymbolDefn(SymbolId("w_im"), DefinedAs, element_of("w", 1)),
+                    syn::SymbolDefn(SymbolId("z_re"), DefinedAs, element_of("z", 0)),
+                    syn::SymbolDefn(SymbolId("z_im"), DefinedAs, element_of("z", 1))
+                ),
+                construct_complex(
+                    syn::BinOpExpr(syn::BinOpExpr(SymbolId("w_re"), Mul, SymbolId("z_re")), Sub, syn::BinOpExpr(SymbolId("w_im"), Mul, SymbolId("z_im"))),
+                    syn::BinOpExpr(syn::BinOpExpr(SymbolId("w_re"), Mul, SymbolId("z_im")), Add, syn::BinOpExpr(SymbolId("w_im"), Mul, SymbolId("z_re")))
+                )
+            )
+        )
+    );
+    scope->define_symbol(
+        SymbolId("Complex_cube"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("z"), DeclaredAs, SymbolId("Complex"))),
+                MapsTo,
+                SymbolId("Complex")
+            ),
+            func_eval("Complex_mul", {SymbolId("z"), func_eval("Complex_square", {SymbolId("z")})})
+        )
+    );
+}
+
+sept::Data func_eval (std::string const &func_name, std::vector<sept::Data> args) {
+    return syn::FuncEval(SymbolId(func_name), syn::RoundExpr(RoundOpen, sept::ArrayTerm_c(std::move(args)).with_constraint(syn::ExprArray), RoundClose));
+}
+
+sept::Data x_op_x_literal (ASTNPTerm op) {
+    return syn::FuncLiteral(
+        syn::FuncPrototype(
+            syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)),
+            MapsTo,
+            sept::Float64
+        ),
+        syn::BinOpExpr(SymbolId("x"), op, SymbolId("x"))
+    );
+}
+
+sept::Data complex_literal (double re, double im) {
+    return construct_complex(re, im);
+}
+
+sept::Data sin_taylor_expr (double x) {
+    auto expr = sept::Data{x};
+    double factorial = 1.0;
+    for (size_t power = 3; power <= 9; power += 2) {
+        factorial *= double(power-1)*double(power);
+        expr = syn::BinOpExpr(expr, power % 4 == 3 ? Sub : Add, syn::BinOpExpr(syn::BinOpExpr(x, Pow, double(power)), Div, factorial));
+    }
+    return expr;
+}
+
+sept::Data reference_value (sept::Data const &expr, sem::EvalCtx &ctx) {
+    return evaluate_expr_data(expr, ctx).deref();
+}
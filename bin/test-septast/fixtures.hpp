@@ -0,0 +1,38 @@
+// 2021.05.28 - Victor Dods
+
+#pragma once
+
+// Includes from sept-ast's source
+#include "EvalCtx.hpp"
+#include "sem.hpp"
+#include "syn.hpp"
+
+#include "sept/Data.hpp"
+#include <string>
+#include <vector>
+
+// The functions and types that sept-ast's main defines, for the tests to evaluate expressions against:
+// - square(x: Float64) -> Float64
+// - exp(x: Float64) -> Float64, as the first 7 terms of its Taylor series
+// - Complex, which is Array(Float64, 2)
+// - Complex_square(z: Complex) -> Complex
+// - Complex_mul(w: Complex, z: Complex) -> Complex
+// - Complex_cube(z: Complex) -> Complex, which calls Complex_mul and Complex_square
+//
+// These are defined in the global SymbolTable (which is where every EvalCtx starts off) the first time
+// this is called, and later calls do nothing.  Tests that define their own symbols should do so in a
+// scope they push, so that they don't collide with other tests.
+void define_standard_symbols ();
+
+// func_name(args...)
+sept::Data func_eval (std::string const &func_name, std::vector<sept::Data> args);
+// (x: Float64) -> Float64 := x op x
+sept::Data x_op_x_literal (ASTNPTerm op);
+// Complex{(re, im)}
+sept::Data complex_literal (double re, double im);
+// x - x^3 / 3! + x^5 / 5! - x^7 / 7! + x^9 / 9!
+sept::Data sin_taylor_expr (double x);
+
+// The value of expr according to the tree-walking evaluator (which is the reference implementation),
+// dereferenced so that it can be compared with values from the other evaluators.
+sept::Data reference_value (sept::Data const &expr, sem::EvalCtx &ctx);
@@ -0,0 +1,7 @@
+// 2021.05.28 - Victor Dods
+
+#include <lvd/test.hpp>
+
+int main (int argc, char **argv) {
+    return lvd::test::basic_test_main("test-septast -- unit tests for the evaluators in sept-ast", argc, argv);
+}
@@ -0,0 +1,109 @@
+// 2021.05.28 - Victor Dods
+
+#include "batch.hpp"
+#include <cstring>
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+
+namespace {
+
+// The value of expr for the given row of bindings, according to the tree-walker.
+sept::Data rowwise_value (sept::Data const &expr, batch::Bindings const &bindings, size_t row, sem::EvalCtx &ctx) {
+    auto scope_guard = ctx.push_scope();
+    for (auto const &[symbol_id, column] : bindings) {
+        if (std::holds_alternative<batch::FloatColumn>(column))
+            ctx.current_scope()->define_symbol(symbol_id, std::get<batch::FloatColumn>(column)[row]);
+        else
+            ctx.current_scope()->define_symbol(symbol_id, bool(std::get<batch::BoolColumn>(column)[row]));
+    }
+    return reference_value(expr, ctx);
+}
+
+batch::Bindings make_bindings (size_t row_count) {
+    batch::FloatColumn xs(row_count);
+    batch::BoolColumn negate_flags(row_count);
+    batch::BoolColumn rare_flags(row_count);
+    for (size_t i = 0; i < row_count; ++i) {
+        xs[i] = -2.0 + 4.0*double(i)/double(row_count-1);
+        negate_flags[i] = i % 3 == 0;
+        rare_flags[i] = i % 100 == 0;
+    }
+    batch::Bindings bindings;
+    bindings.emplace(sept::intern("bt_x"), std::move(xs));
+    bindings.emplace(sept::intern("bt_negate"), std::move(negate_flags));
+    bindings.emplace(sept::intern("bt_rare"), std::move(rare_flags));
+    return bindings;
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(700__batch__0__float_agrees_with_rowwise)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    // This isn't bound to a column, so it's resolved in ctx.
+    ctx.current_scope()->define_symbol(SymbolId("bt_scale"), 0.75);
+    size_t const row_count = 1000;
+    auto bindings = make_bindings(row_count);
+
+    // bt_scale*(x - x^3 / 3! + x^5 / 5! - x^7 / 7! + x^9 / 9!), negated where bt_negate is set, plus square(x)
+    // (which is evaluated row-wise) where bt_rare is set.
+    auto taylor_expr = sept::Data{SymbolId("bt_x")};
+    double factorial = 1.0;
+    for (size_t power = 3; power <= 9; power += 2) {
+        factorial *= double(power-1)*double(power);
+        auto term = syn::BinOpExpr(syn::BinOpExpr(SymbolId("bt_x"), Pow, double(power)), Div, factorial);
+        taylor_expr = syn::BinOpExpr(taylor_expr, power % 4 == 3 ? Sub : Add, term);
+    }
+    taylor_expr = syn::BinOpExpr(SymbolId("bt_scale"), Mul, taylor_expr);
+    auto expr = syn::BinOpExpr(
+        syn::CondExpr(If, SymbolId("bt_negate"), Then, syn::UnOpExpr(Neg, taylor_expr), Else, taylor_expr),
+        Add,
+        syn::CondExpr(If, SymbolId("bt_rare"), Then, func_eval("square", {SymbolId("bt_x")}), Else, 0.0)
+    );
+
+    auto column = batch::evaluate_batch(expr, bindings, ctx);
+    LVD_TEST_REQ_IS_TRUE(std::holds_alternative<batch::FloatColumn>(column));
+    auto const &values = std::get<batch::FloatColumn>(column);
+    LVD_TEST_REQ_EQ(values.size(), row_count);
+    // The values must be bitwise the same.
+    for (size_t i = 0; i < row_count; ++i) {
+        auto value = rowwise_value(expr, bindings, i, ctx).cast<double>();
+        LVD_TEST_REQ_EQ(std::memcmp(&value, &values[i], sizeof(double)), 0);
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(700__batch__1__bool_agrees_with_rowwise)
+    sem::EvalCtx ctx;
+    size_t const row_count = 300;
+    auto bindings = make_bindings(row_count);
+    // not (bt_negate xor bt_rare) or false
+    auto expr = syn::BinOpExpr(syn::UnOpExpr(Not, syn::BinOpExpr(SymbolId("bt_negate"), Xor, SymbolId("bt_rare"))), Or, false);
+    auto column = batch::evaluate_batch(expr, bindings, ctx);
+    LVD_TEST_REQ_IS_TRUE(std::holds_alternative<batch::BoolColumn>(column));
+    auto const &values = std::get<batch::BoolColumn>(column);
+    LVD_TEST_REQ_EQ(values.size(), row_count);
+    for (size_t i = 0; i < row_count; ++i)
+        LVD_TEST_REQ_EQ(rowwise_value(expr, bindings, i, ctx), sept::Data{bool(values[i])});
+LVD_TEST_END
+
+LVD_TEST_BEGIN(700__batch__2__errors)
+    sem::EvalCtx ctx;
+    auto bindings = make_bindings(10);
+    // An operator applied to the wrong type throws, as it would for the tree-walker.
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        batch::evaluate_batch(syn::BinOpExpr(SymbolId("bt_x"), And, SymbolId("bt_negate")), bindings, ctx);
+    });
+    // A RoundExpr is an Array, even if it has one element, so it's not a Float64 operand.
+    lvd::test::call_function_and_expect_exception<std::exception>([&](){
+        batch::evaluate_batch(syn::BinOpExpr(SymbolId("bt_x"), Mul, syn::RoundExpr(RoundOpen, syn::ExprArray(SymbolId("bt_x")), RoundClose)), bindings, ctx);
+    });
+    lvd::test::call_function_and_expect_exception<std::exception>([&](){
+        rowwise_value(syn::BinOpExpr(SymbolId("bt_x"), Mul, syn::RoundExpr(RoundOpen, syn::ExprArray(SymbolId("bt_x")), RoundClose)), bindings, 0, ctx);
+    });
+    // The bound columns must all have the same size.
+    bindings[sept::intern("bt_y")] = batch::FloatColumn(11);
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        batch::evaluate_batch(syn::BinOpExpr(SymbolId("bt_x"), Add, SymbolId("bt_y")), bindings, ctx);
+    });
+LVD_TEST_END
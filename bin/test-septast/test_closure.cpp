@@ -0,0 +1,60 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+
+namespace {
+
+// (x: Float64) -> Float64 := square_name(square_name(x))
+sept::Data quartic_literal (char const *square_name) {
+    return syn::FuncLiteral(
+        syn::FuncPrototype(
+            syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)),
+            MapsTo,
+            sept::Float64
+        ),
+        func_eval(square_name, {func_eval(square_name, {SymbolId("x")})})
+    );
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(300__closure__0__only_bound_literals_have_closures)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    ctx.current_scope()->define_symbol(SymbolId("cl_quartic_direct"), quartic_literal("square"));
+    execute_stmt_data(syn::SymbolDefn(SymbolId("cl_square_bound"), DefinedAs, x_op_x_literal(Mul)), ctx);
+    execute_stmt_data(syn::SymbolDefn(SymbolId("cl_quartic_bound"), DefinedAs, quartic_literal("cl_square_bound")), ctx);
+
+    auto func_closure = [&ctx](char const *func_name) {
+        return sem::find_func_closure(ctx.current_scope()->resolve_symbol_const(SymbolId(func_name)), ctx);
+    };
+    LVD_TEST_REQ_EQ(func_closure("square"), nullptr);
+    LVD_TEST_REQ_EQ(func_closure("cl_quartic_direct"), nullptr);
+    LVD_TEST_REQ_NEQ_NULLPTR(func_closure("cl_square_bound"));
+    LVD_TEST_REQ_NEQ_NULLPTR(func_closure("cl_quartic_bound"));
+
+    // Calling through closures doesn't change the value.
+    auto direct_value = reference_value(func_eval("cl_quartic_direct", {1.5}), ctx);
+    LVD_TEST_REQ_EQ(direct_value, sept::Data{5.0625});
+    LVD_TEST_REQ_EQ(reference_value(func_eval("cl_quartic_bound", {1.5}), ctx), direct_value);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(300__closure__1__rebinding_replaces_closure)
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    execute_stmt_data(syn::SymbolDefn(SymbolId("cl_square"), DefinedAs, x_op_x_literal(Mul)), ctx);
+    execute_stmt_data(syn::SymbolDefn(SymbolId("cl_quartic"), DefinedAs, quartic_literal("cl_square")), ctx);
+    auto const &square_data = ctx.current_scope()->resolve_symbol_const(SymbolId("cl_square"));
+    auto old_closure = sem::find_func_closure(square_data, ctx);
+    LVD_TEST_REQ_NEQ_NULLPTR(old_closure);
+    LVD_TEST_REQ_EQ(reference_value(func_eval("cl_quartic", {1.5}), ctx), sept::Data{5.0625});
+
+    // cl_quartic then calls the new cl_square, i.e. (x+x)+(x+x).
+    execute_stmt_data(syn::Assignment(SymbolId("cl_square"), AssignFrom, x_op_x_literal(Add)), ctx);
+    auto new_closure = sem::find_func_closure(square_data, ctx);
+    LVD_TEST_REQ_NEQ_NULLPTR(new_closure);
+    LVD_TEST_REQ_NEQ(new_closure, old_closure);
+    LVD_TEST_REQ_EQ(reference_value(func_eval("cl_quartic", {1.5}), ctx), sept::Data{6.0});
+LVD_TEST_END
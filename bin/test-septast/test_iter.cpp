@@ -0,0 +1,108 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include "iter.hpp"
+#include <lvd/test.hpp>
+#include "sept/ArrayTerm.hpp"
+#include "sept/TupleTerm.hpp"
+#include <string>
+#include <vector>
+
+namespace {
+
+// A left-associated chain of additions, i.e. ((1 + 1) + 1) + ... + 1, which is built directly, since
+// the syn constructors check the whole subexpression.
+sept::Data add_chain (size_t depth) {
+    auto expr = sept::Data{1.0};
+    for (size_t i = 0; i < depth; ++i)
+        expr = sept::TupleTerm_c{sept::DataVector{std::move(expr), Add, 1.0}};
+    return expr;
+}
+
+// Defines a k-bit counter which counts from all-false to all-true by calling itself in tail position, i.e.
+//     it_count_k(b0: Bool, ..., b{k-1}: Bool, n: Float64) -> Float64 :=
+//         if b0 and ... and b{k-1} then n else it_count_k(b0 xor true, b1 xor b0, b2 xor (b0 and b1), ..., n + 1)
+// which makes 2^k - 1 calls, and returns the expression that calls it with all-false and 0.  Bit i
+// carries into bit i+1 iff bits 0 through i are all true.
+sept::Data define_counter (size_t bit_count, sem::EvalCtx &ctx) {
+    auto func_name = "it_count_" + std::to_string(bit_count);
+    std::vector<sept::Data> param_decls;
+    std::vector<sept::Data> next_args;
+    auto carry = sept::Data{true};
+    for (size_t i = 0; i < bit_count; ++i) {
+        auto bit_name = "b" + std::to_string(i);
+        param_decls.emplace_back(syn::SymbolTypeDecl(SymbolId(bit_name), DeclaredAs, sept::Bool));
+        next_args.emplace_back(syn::BinOpExpr(SymbolId(bit_name), Xor, carry));
+        carry = i == 0 ? sept::Data{SymbolId(bit_name)} : sept::Data{syn::BinOpExpr(carry, And, SymbolId(bit_name))};
+    }
+    param_decls.emplace_back(syn::SymbolTypeDecl(SymbolId("n"), DeclaredAs, sept::Float64));
+    next_args.emplace_back(syn::BinOpExpr(SymbolId("n"), Add, 1.0));
+    execute_stmt_data(
+        syn::SymbolDefn(
+            SymbolId(func_name),
+            DefinedAs,
+            syn::FuncLiteral(
+                syn::FuncPrototype(
+                    sept::ArrayTerm_c(std::move(param_decls)).with_constraint(syn::SymbolTypeDeclArray),
+                    MapsTo,
+                    sept::Float64
+                ),
+                syn::CondExpr(If, carry, Then, SymbolId("n"), Else, func_eval(func_name, std::move(next_args)))
+            )
+        ),
+        ctx
+    );
+    std::vector<sept::Data> initial_args(bit_count, sept::Data{false});
+    initial_args.emplace_back(0.0);
+    return func_eval(func_name, std::move(initial_args));
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(600__iter__0__agrees_with_reference)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    ctx.current_scope()->define_symbol(SymbolId("it_flag"), true);
+    for (auto const &expr : {
+        sin_taylor_expr(0.1),
+        func_eval("exp", {0.1}),
+        func_eval("Complex_cube", {complex_literal(3.0, 4.0)}),
+        sept::Data{syn::ElementEval(sept::Array(0.5, 1.5, 2.5, 3.5), syn::SquareExpr(SquareOpen, syn::ExprArray(sept::Uint32(2)), SquareClose))},
+        sept::Data{
+            syn::BlockExpr(
+                syn::StmtArray(
+                    syn::SymbolDefn(SymbolId("y"), DefinedAs, 3.0),
+                    syn::Assignment(SymbolId("y"), AssignFrom, syn::BinOpExpr(SymbolId("y"), Mul, SymbolId("y")))
+                ),
+                syn::CondExpr(If, SymbolId("it_flag"), Then, syn::UnOpExpr(Neg, SymbolId("y")), Else, SymbolId("y"))
+            )
+        },
+        add_chain(200),
+        define_counter(6, ctx),
+    }) {
+        LVD_TEST_REQ_EQ(sept::Data{iter::evaluate_expr_data(expr, ctx).deref()}, reference_value(expr, ctx));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(600__iter__1__deep_expr)
+    sem::EvalCtx ctx;
+    // The continuations are on the heap, so this doesn't depend on the size of the C++ stack.
+    size_t const depth = 10000;
+    iter::EvalStats stats;
+    LVD_TEST_REQ_EQ(sept::Data{iter::evaluate_expr_data(add_chain(depth), ctx, &stats).deref()}, sept::Data{double(depth+1)});
+    LVD_TEST_REQ_EQ(stats.m_max_continuation_count, depth);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(600__iter__2__tail_calls)
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    for (size_t bit_count : {8, 12}) {
+        auto call_count = (size_t(1) << bit_count) - 1;
+        iter::EvalStats stats;
+        LVD_TEST_REQ_EQ(sept::Data{iter::evaluate_expr_data(define_counter(bit_count, ctx), ctx, &stats).deref()}, sept::Data{double(call_count)});
+        LVD_TEST_REQ_EQ(stats.m_tail_call_count, call_count);
+        // Tail calls don't accumulate continuations (or scopes).
+        LVD_TEST_REQ_LT(stats.m_max_continuation_count, 2*bit_count);
+    }
+LVD_TEST_END
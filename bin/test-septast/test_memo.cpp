@@ -0,0 +1,106 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "memo.hpp"
+
+LVD_TEST_BEGIN(400__memo__0__infer_pure_funcs)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    auto const &scope = ctx.current_scope();
+    scope->define_symbol(SymbolId("mm_square"), x_op_x_literal(Mul));
+    // This only calls a pure function, so it's pure too.
+    scope->define_symbol(
+        SymbolId("mm_quartic"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)),
+                MapsTo,
+                sept::Float64
+            ),
+            func_eval("mm_square", {func_eval("mm_square", {SymbolId("x")})})
+        )
+    );
+    // This refers to the global symbol Complex, so it isn't.
+    scope->define_symbol(
+        SymbolId("mm_complex_cube"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("z"), DeclaredAs, SymbolId("Complex"))),
+                MapsTo,
+                SymbolId("Complex")
+            ),
+            func_eval("Complex_cube", {SymbolId("z")})
+        )
+    );
+
+    memo::Memoizer memoizer(16);
+    LVD_TEST_REQ_EQ(memo::infer_pure_funcs(memoizer, scope), size_t(2));
+    LVD_TEST_REQ_IS_TRUE(memoizer.is_pure(scope->resolve_symbol_const(SymbolId("mm_square"))));
+    LVD_TEST_REQ_IS_TRUE(memoizer.is_pure(scope->resolve_symbol_const(SymbolId("mm_quartic"))));
+    LVD_TEST_REQ_IS_FALSE(memoizer.is_pure(scope->resolve_symbol_const(SymbolId("mm_complex_cube"))));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(400__memo__1__memoized_calls_agree)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto memoizer = lvd::make_nnsp<memo::Memoizer>(16);
+    memoizer->set_is_pure(ctx.current_scope()->resolve_symbol_const(SymbolId("exp")), true);
+    // Complex_square isn't inferred to be pure, but can be marked as pure explicitly.
+    memoizer->set_is_pure(ctx.current_scope()->resolve_symbol_const(SymbolId("Complex_square")), true);
+
+    auto exp_expr = func_eval("exp", {0.1});
+    auto complex_square_expr = func_eval("Complex_square", {complex_literal(3.0, 4.0)});
+    auto exp_value = reference_value(exp_expr, ctx);
+    auto complex_square_value = reference_value(complex_square_expr, ctx);
+
+    ctx.set_memoizer(memoizer);
+    for (size_t i = 0; i < 3; ++i) {
+        LVD_TEST_REQ_EQ(reference_value(exp_expr, ctx), exp_value);
+        LVD_TEST_REQ_EQ(reference_value(complex_square_expr, ctx), complex_square_value);
+    }
+    ctx.set_memoizer(nullptr);
+    LVD_TEST_REQ_EQ(memoizer->miss_count(), size_t(2));
+    LVD_TEST_REQ_EQ(memoizer->hit_count(), size_t(4));
+    LVD_TEST_REQ_EQ(memoizer->size(), size_t(2));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(400__memo__2__eviction)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto memoizer = lvd::make_nnsp<memo::Memoizer>(4);
+    memoizer->set_is_pure(ctx.current_scope()->resolve_symbol_const(SymbolId("square")), true);
+    ctx.set_memoizer(memoizer);
+    // Calling with more distinct args than the capacity evicts the least recently used values.
+    for (double x : {1.0, 2.0, 3.0, 4.0, 1.0, 5.0})
+        LVD_TEST_REQ_EQ(reference_value(func_eval("square", {x}), ctx), sept::Data{x*x});
+    LVD_TEST_REQ_EQ(memoizer->size(), size_t(4));
+    LVD_TEST_REQ_EQ(memoizer->hit_count(), size_t(1));
+    LVD_TEST_REQ_EQ(memoizer->miss_count(), size_t(5));
+    // 2 was the least recently used when 5 was inserted, and 1 was used more recently than it.
+    memoizer->reset_counts();
+    LVD_TEST_REQ_EQ(reference_value(func_eval("square", {1.0}), ctx), sept::Data{1.0});
+    LVD_TEST_REQ_EQ(reference_value(func_eval("square", {2.0}), ctx), sept::Data{4.0});
+    LVD_TEST_REQ_EQ(memoizer->hit_count(), size_t(1));
+    LVD_TEST_REQ_EQ(memoizer->miss_count(), size_t(1));
+    ctx.set_memoizer(nullptr);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(400__memo__3__rebinding_forgets)
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    execute_stmt_data(syn::SymbolDefn(SymbolId("mm_f"), DefinedAs, x_op_x_literal(Mul)), ctx);
+    auto const &func_data = ctx.current_scope()->resolve_symbol_const(SymbolId("mm_f"));
+    auto memoizer = lvd::make_nnsp<memo::Memoizer>(16);
+    memoizer->set_is_pure(func_data, true);
+    ctx.set_memoizer(memoizer);
+    LVD_TEST_REQ_EQ(reference_value(func_eval("mm_f", {3.0}), ctx), sept::Data{9.0});
+    LVD_TEST_REQ_EQ(memoizer->size(), size_t(1));
+    // Rebinding mm_f forgets that it was pure, along with its cached value.
+    execute_stmt_data(syn::Assignment(SymbolId("mm_f"), AssignFrom, x_op_x_literal(Add)), ctx);
+    LVD_TEST_REQ_IS_FALSE(memoizer->is_pure(func_data));
+    LVD_TEST_REQ_EQ(memoizer->size(), size_t(0));
+    LVD_TEST_REQ_EQ(reference_value(func_eval("mm_f", {3.0}), ctx), sept::Data{6.0});
+    ctx.set_memoizer(nullptr);
+LVD_TEST_END
@@ -0,0 +1,140 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <cmath>
+#include <cstring>
+#include <lvd/test.hpp>
+#include "opt.hpp"
+#include <random>
+#include <vector>
+
+namespace {
+
+// Evaluated values are compared bitwise, so that e.g. 0.0 and -0.0 differ, but NaNs are all the same.
+bool are_same_values (sept::Data const &lhs, sept::Data const &rhs) {
+    if (lhs.type() == typeid(double) && rhs.type() == typeid(double)) {
+        auto lhs_value = lhs.cast<double>();
+        auto rhs_value = rhs.cast<double>();
+        return (std::isnan(lhs_value) && std::isnan(rhs_value)) || std::memcmp(&lhs_value, &rhs_value, sizeof(double)) == 0;
+    }
+    return sept::eq_data(lhs, rhs);
+}
+
+// Generates random Float64- and Bool-valued Exprs in the symbols opt_x, opt_y (Float64) and opt_flag
+// (Bool), which call square.  Generated subexpressions are sometimes reused, so that there are common
+// subexpressions.
+class RandomExprGenerator {
+public:
+
+    explicit RandomExprGenerator (std::mt19937::result_type seed)
+        :   m_rng(seed)
+    { }
+
+    sept::Data float_expr (size_t depth) {
+        static double const FLOAT_LITERALS[] = {0.0, -0.0, 0.5, 2.0, 3.0};
+        static ASTNPTerm const FLOAT_BIN_OPS[] = {Add, Sub, Mul, Div, Pow};
+        if (depth == 0 || m_rng() % 5 == 0) {
+            switch (m_rng() % 4) {
+                case 0: return SymbolId("opt_x");
+                case 1: return SymbolId("opt_y");
+                case 2: return FLOAT_LITERALS[m_rng() % 5];
+                default: return double(m_rng() % 7) - 3.0;
+            }
+        }
+        switch (m_rng() % 6) {
+            case 0: return reuse_or_keep(m_float_expr_pool, syn::UnOpExpr(Neg, float_expr(depth-1)));
+            case 1: return reuse_or_keep(m_float_expr_pool, syn::CondExpr(If, bool_expr(depth-1), Then, float_expr(depth-1), Else, float_expr(depth-1)));
+            case 2: return reuse_or_keep(m_float_expr_pool, func_eval("square", {float_expr(depth-1)}));
+            default: {
+                auto bin_op = FLOAT_BIN_OPS[m_rng() % 5];
+                return reuse_or_keep(m_float_expr_pool, syn::BinOpExpr(float_expr(depth-1), bin_op, float_expr(depth-1)));
+            }
+        }
+    }
+    sept::Data bool_expr (size_t depth) {
+        static ASTNPTerm const BOOL_BIN_OPS[] = {And, Or, Xor};
+        if (depth == 0 || m_rng() % 5 == 0) {
+            switch (m_rng() % 3) {
+                case 0: return SymbolId("opt_flag");
+                case 1: return true;
+                default: return false;
+            }
+        }
+        switch (m_rng() % 4) {
+            case 0: return reuse_or_keep(m_bool_expr_pool, syn::UnOpExpr(Not, bool_expr(depth-1)));
+            case 1: return reuse_or_keep(m_bool_expr_pool, syn::CondExpr(If, bool_expr(depth-1), Then, bool_expr(depth-1), Else, bool_expr(depth-1)));
+            default: {
+                auto bin_op = BOOL_BIN_OPS[m_rng() % 3];
+                return reuse_or_keep(m_bool_expr_pool, syn::BinOpExpr(bool_expr(depth-1), bin_op, bool_expr(depth-1)));
+            }
+        }
+    }
+
+private:
+
+    sept::Data reuse_or_keep (std::vector<sept::Data> &expr_pool, sept::Data &&expr) {
+        if (!expr_pool.empty() && m_rng() % 3 == 0)
+            return expr_pool[m_rng() % expr_pool.size()];
+        expr_pool.emplace_back(expr);
+        return std::move(expr);
+    }
+
+    std::mt19937 m_rng;
+    std::vector<sept::Data> m_float_expr_pool;
+    std::vector<sept::Data> m_bool_expr_pool;
+};
+
+void define_opt_symbols (sem::EvalCtx &ctx) {
+    ctx.current_scope()->define_symbol(SymbolId("opt_x"), 1.25);
+    ctx.current_scope()->define_symbol(SymbolId("opt_y"), -0.5);
+    ctx.current_scope()->define_symbol(SymbolId("opt_flag"), true);
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(500__opt__0__fold_constants)
+    sem::EvalCtx ctx;
+    auto expr = sin_taylor_expr(0.1);
+    auto folded_expr = opt::fold_constants(expr);
+    // The whole expression is constant, so it folds to its value.
+    LVD_TEST_REQ_IS_TRUE(folded_expr.type() == typeid(double));
+    LVD_TEST_REQ_IS_TRUE(are_same_values(folded_expr, reference_value(expr, ctx)));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(500__opt__1__eliminate_common_subexprs)
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    define_opt_symbols(ctx);
+    // A common subexpression, and a constant one.
+    auto x_times_y_plus_one = syn::BinOpExpr(syn::BinOpExpr(SymbolId("opt_x"), Mul, SymbolId("opt_y")), Add, 1.0);
+    auto expr = syn::BinOpExpr(
+        syn::BinOpExpr(x_times_y_plus_one, Mul, x_times_y_plus_one),
+        Sub,
+        syn::BinOpExpr(x_times_y_plus_one, Div, syn::BinOpExpr(2.0, Pow, 3.0))
+    );
+    auto optimized_expr = opt::optimize_expr(expr);
+    LVD_TEST_REQ_IS_TRUE(inhabits_data(optimized_expr, syn::BlockExpr));
+    LVD_TEST_REQ_IS_TRUE(are_same_values(reference_value(optimized_expr, ctx), reference_value(expr, ctx)));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(500__opt__2__random_exprs_keep_their_values)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    define_opt_symbols(ctx);
+    RandomExprGenerator generator(37);
+    size_t changed_expr_count = 0;
+    for (size_t i = 0; i < 400; ++i) {
+        auto expr = i % 2 == 0 ? generator.float_expr(5) : generator.bool_expr(5);
+        auto optimized_expr = opt::optimize_expr(expr);
+        if (!sept::eq_data(optimized_expr, expr))
+            ++changed_expr_count;
+        auto value = reference_value(expr, ctx);
+        auto optimized_value = reference_value(optimized_expr, ctx);
+        if (!are_same_values(optimized_value, value))
+            test_log << lvd::Log::dbg() << LVD_REFLECT(expr) << '\n' << LVD_REFLECT(optimized_expr) << '\n';
+        LVD_TEST_REQ_IS_TRUE(are_same_values(optimized_value, value));
+    }
+    // Make sure that the optimizations actually did something.
+    LVD_TEST_REQ_LT(size_t(0), changed_expr_count);
+LVD_TEST_END
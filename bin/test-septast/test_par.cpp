@@ -0,0 +1,87 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include <memory>
+#include "par.hpp"
+#include "sept/ArrayTerm.hpp"
+#include "sept/GlobalSymRef.hpp"
+#include <vector>
+
+namespace {
+
+// exp(0.1) + exp(0.2) + ... + exp(0.1*count), as a left-leaning chain of BinOpExprs, so each BinOpExpr
+// forks its lhs (the rest of the chain) and its rhs (one call to exp).
+sept::Data exp_sum_expr (size_t count) {
+    auto expr = func_eval("exp", {0.1});
+    for (size_t i = 2; i <= count; ++i)
+        expr = syn::BinOpExpr(expr, Add, func_eval("exp", {0.1*double(i)}));
+    return expr;
+}
+
+// The same calls, as the elements of a RoundExpr.
+sept::Data exp_array_expr (size_t count) {
+    std::vector<sept::Data> exp_calls;
+    for (size_t i = 1; i <= count; ++i)
+        exp_calls.emplace_back(func_eval("exp", {0.1*double(i)}));
+    return syn::RoundExpr(RoundOpen, sept::ArrayTerm_c(std::move(exp_calls)).with_constraint(syn::ExprArray), RoundClose);
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(800__par__0__agrees_with_sequential)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto sum_expr = exp_sum_expr(16);
+    auto array_expr = exp_array_expr(16);
+    auto sequential_sum = reference_value(sum_expr, ctx);
+    auto sequential_array = reference_value(array_expr, ctx);
+
+    // A low min_fork_cost, so that forking happens regardless of the hardware.
+    auto task_pool = std::make_shared<par::TaskPool>(2, 64);
+    ctx.set_task_pool(task_pool);
+    LVD_TEST_REQ_EQ(reference_value(sum_expr, ctx), sequential_sum);
+    auto sum_fork_count = task_pool->fork_count();
+    LVD_TEST_REQ_LT(size_t(0), sum_fork_count);
+    LVD_TEST_REQ_EQ(reference_value(array_expr, ctx), sequential_array);
+    LVD_TEST_REQ_LT(sum_fork_count, task_pool->fork_count());
+    ctx.set_task_pool(nullptr);
+    // The scopes are taken back out of concurrent-read mode, so that sequential evaluation caches
+    // resolutions again.
+    LVD_TEST_REQ_IS_FALSE(ctx.current_scope()->concurrent_reads_enabled());
+    LVD_TEST_REQ_IS_FALSE(sept::global_symbol_table()->concurrent_reads_enabled());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(800__par__1__side_effects_are_not_reordered)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    // Each side assigns to par_counter, which is defined outside the expression, so the order of
+    // evaluation matters, and nothing is forked.
+    ctx.current_scope()->define_symbol(SymbolId("par_counter"), 0.0);
+    auto bump_counter_expr = syn::BlockExpr(
+        syn::StmtArray(
+            syn::Assignment(SymbolId("par_counter"), AssignFrom, syn::BinOpExpr(SymbolId("par_counter"), Add, 1.0))
+        ),
+        func_eval("exp", {SymbolId("par_counter")})
+    );
+    auto task_pool = std::make_shared<par::TaskPool>(2, 64);
+    ctx.set_task_pool(task_pool);
+    auto value = reference_value(syn::BinOpExpr(bump_counter_expr, Div, bump_counter_expr), ctx);
+    ctx.set_task_pool(nullptr);
+    LVD_TEST_REQ_EQ(task_pool->fork_count(), size_t(0));
+    // Evaluated left to right, the lhs sees par_counter = 1 and the rhs sees par_counter = 2.
+    auto expected_value = reference_value(func_eval("exp", {1.0}), ctx).cast<double>() / reference_value(func_eval("exp", {2.0}), ctx).cast<double>();
+    LVD_TEST_REQ_EQ(value, sept::Data{expected_value});
+LVD_TEST_END
+
+LVD_TEST_BEGIN(800__par__2__calibrate_min_fork_cost)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    par::TaskPool task_pool(2, 0);
+    auto min_fork_cost = par::calibrate_min_fork_cost(task_pool, func_eval("exp", {0.5}), ctx);
+    LVD_TEST_REQ_LEQ(size_t(1), min_fork_cost);
+    // Calibrating doesn't change the TaskPool's min_fork_cost (that's up to the caller), or ctx's TaskPool.
+    LVD_TEST_REQ_EQ(task_pool.min_fork_cost(), size_t(0));
+    LVD_TEST_REQ_IS_TRUE(ctx.task_pool() == nullptr);
+LVD_TEST_END
@@ -0,0 +1,38 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "sept/ArrayTerm.hpp"
+#include <string>
+
+namespace {
+
+// { y0 := first_value; y1 := y0 + 1; ...; y{count-1} := y{count-2} + 1; y{count-1} }
+sept::Data chain_block (size_t count, double first_value) {
+    sept::DataVector stmts;
+    for (size_t i = 0; i < count; ++i) {
+        auto value = i == 0 ? sept::Data{first_value} : sept::Data{syn::BinOpExpr(SymbolId("y" + std::to_string(i-1)), Add, 1.0)};
+        stmts.emplace_back(syn::SymbolDefn(SymbolId("y" + std::to_string(i)), DefinedAs, std::move(value)));
+    }
+    return syn::BlockExpr(sept::ArrayTerm_c(std::move(stmts)).with_constraint(syn::StmtArray), SymbolId("y" + std::to_string(count-1)));
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(350__scope__0__escaped_scope_survives)
+    sem::EvalCtx ctx;
+    // The value of the first block is a LocalSymRef into its scope, so that scope must not be reused by
+    // the second block.
+    auto escaped_ref = evaluate_expr_data(chain_block(1, 3.0), ctx);
+    auto other_value = reference_value(chain_block(1, 4.0), ctx);
+    LVD_TEST_REQ_EQ(escaped_ref.deref(), sept::Data{3.0});
+    LVD_TEST_REQ_EQ(other_value, sept::Data{4.0});
+LVD_TEST_END
+
+LVD_TEST_BEGIN(350__scope__1__reused_scope_sizes)
+    sem::EvalCtx ctx;
+    // Scopes with more symbols than sept::SymbolTable::SMALL_SLOT_COUNT switch to a map, and a scope
+    // that's reused must work either way, whatever size it was before.
+    for (size_t count : {1, 20, 2, 9, 8, 40, 1})
+        LVD_TEST_REQ_EQ(reference_value(chain_block(count, 10.0), ctx), sept::Data{10.0 + double(count-1)});
+LVD_TEST_END
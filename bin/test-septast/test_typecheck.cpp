@@ -0,0 +1,98 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "typecheck.hpp"
+#include <utility>
+
+namespace {
+
+// Evaluates expr without and then with trusting checked_program, requires that the values agree, and
+// returns the counts of the dynamic call checks done in each case.
+std::pair<sem::CallCheckCounts,sem::CallCheckCounts> dynamic_and_trusted_counts (
+    lvd::req::Context &req_context,
+    lvd::nnsp<typecheck::CheckedProgram const> const &checked_program,
+    sept::Data const &expr,
+    sem::EvalCtx &ctx
+) {
+    auto counts_before = sem::call_check_counts();
+    auto dynamic_value = reference_value(expr, ctx);
+    auto dynamic_counts = sem::call_check_counts() - counts_before;
+    ctx.set_checked_program(checked_program);
+    counts_before = sem::call_check_counts();
+    auto trusted_value = reference_value(expr, ctx);
+    auto trusted_counts = sem::call_check_counts() - counts_before;
+    ctx.set_checked_program(nullptr);
+    LVD_TEST_REQ_EQ(trusted_value, dynamic_value);
+    return std::make_pair(dynamic_counts, trusted_counts);
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(200__typecheck__0__trusted_skips_checks)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto checked_program = typecheck::check_program(ctx.current_scope());
+
+    // Only the arg of the call from the top level (which is unchecked) is checked.
+    {
+        auto [dynamic_counts, trusted_counts] = dynamic_and_trusted_counts(req_context, checked_program, func_eval("exp", {0.1}), ctx);
+        LVD_TEST_REQ_EQ(dynamic_counts, (sem::CallCheckCounts{1, 1, 1, 1}));
+        LVD_TEST_REQ_EQ(trusted_counts, (sem::CallCheckCounts{0, 0, 1, 0}));
+    }
+    // Likewise, even though the body calls Complex_mul and Complex_square.
+    {
+        auto [dynamic_counts, trusted_counts] = dynamic_and_trusted_counts(req_context, checked_program, func_eval("Complex_cube", {complex_literal(3.0, 4.0)}), ctx);
+        LVD_TEST_REQ_EQ(dynamic_counts, (sem::CallCheckCounts{4, 3, 4, 3}));
+        LVD_TEST_REQ_EQ(trusted_counts, (sem::CallCheckCounts{0, 0, 1, 0}));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(200__typecheck__1__defining_a_symbol_invalidates)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    ctx.current_scope()->define_symbol(
+        SymbolId("tc_quartic"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)),
+                MapsTo,
+                sept::Float64
+            ),
+            func_eval("square", {func_eval("square", {SymbolId("x")})})
+        )
+    );
+    auto const &func_data = ctx.current_scope()->resolve_symbol_const(SymbolId("tc_quartic"));
+    ctx.set_checked_program(typecheck::check_program(ctx.current_scope()));
+    auto func_facts = typecheck::trusted_func_facts(ctx, func_data);
+    LVD_TEST_REQ_NEQ_NULLPTR(func_facts);
+    LVD_TEST_REQ_IS_TRUE(func_facts->m_return_type_proved);
+    LVD_TEST_REQ_IS_TRUE(func_facts->m_call_args_proved);
+    LVD_TEST_REQ_EQ(reference_value(func_eval("tc_quartic", {1.5}), ctx), sept::Data{5.0625});
+
+    ctx.current_scope()->define_symbol(SymbolId("tc_other"), 1.0);
+    LVD_TEST_REQ_EQ(typecheck::trusted_func_facts(ctx, func_data), static_cast<typecheck::FuncFacts const *>(nullptr));
+    LVD_TEST_REQ_EQ(reference_value(func_eval("tc_quartic", {1.5}), ctx), sept::Data{5.0625});
+    ctx.set_checked_program(nullptr);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(200__typecheck__2__literal_arg_of_wrong_type)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    ctx.current_scope()->define_symbol(
+        SymbolId("tc_bad"),
+        syn::FuncLiteral(
+            syn::FuncPrototype(
+                syn::SymbolTypeDeclArray(syn::SymbolTypeDecl(SymbolId("x"), DeclaredAs, sept::Float64)),
+                MapsTo,
+                sept::Float64
+            ),
+            func_eval("square", {true})
+        )
+    );
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        typecheck::check_program(ctx.current_scope());
+    });
+LVD_TEST_END
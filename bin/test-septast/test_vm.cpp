@@ -0,0 +1,90 @@
+// 2021.05.28 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "vm.hpp"
+
+LVD_TEST_BEGIN(100__vm__0__agrees_with_reference)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    for (auto const &expr : {
+        sin_taylor_expr(0.1),
+        func_eval("exp", {0.1}),
+        func_eval("Complex_mul", {complex_literal(3.0, 4.0), complex_literal(1.0, -2.0)}),
+        sept::Data{
+            syn::CondExpr(
+                If, syn::BinOpExpr(true, Xor, false),
+                Then, func_eval("square", {3.0}),
+                Else, syn::UnOpExpr(Neg, 1.0)
+            )
+        },
+    }) {
+        auto program = vm::compile_expr(expr);
+        // Run twice, since the second run uses what the first one linked.
+        LVD_TEST_REQ_EQ(program.run(ctx), reference_value(expr, ctx));
+        LVD_TEST_REQ_EQ(program.run(ctx), reference_value(expr, ctx));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(100__vm__1__shadowing)
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    ctx.current_scope()->define_symbol(SymbolId("vm_ostrich"), 123.0);
+    // The block-local vm_ostrich shadows the outer one, whose value is unchanged.
+    auto expr = syn::BlockExpr(
+        syn::StmtArray(
+            syn::SymbolDefn(SymbolId("vm_ostrich"), DefinedAs, syn::BinOpExpr(SymbolId("vm_ostrich"), Add, 1.0)),
+            syn::Assignment(SymbolId("vm_ostrich"), AssignFrom, syn::BinOpExpr(SymbolId("vm_ostrich"), Mul, 2.0))
+        ),
+        SymbolId("vm_ostrich")
+    );
+    LVD_TEST_REQ_EQ(vm::compile_expr(expr).run(ctx), sept::Data{248.0});
+    LVD_TEST_REQ_EQ(reference_value(expr, ctx), sept::Data{248.0});
+    LVD_TEST_REQ_EQ(ctx.current_scope()->resolve_symbol_const(SymbolId("vm_ostrich")), sept::Data{123.0});
+LVD_TEST_END
+
+LVD_TEST_BEGIN(100__vm__2__top_level_defn)
+    define_standard_symbols();
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    // Top-level SymbolDefns define symbols in the scope the program runs in.
+    vm::compile_stmt_array(
+        syn::StmtArray(syn::SymbolDefn(SymbolId("vm_square_of_four"), DefinedAs, func_eval("square", {4.0})))
+    ).run(ctx);
+    LVD_TEST_REQ_EQ(ctx.current_scope()->resolve_symbol_const(SymbolId("vm_square_of_four")), sept::Data{16.0});
+LVD_TEST_END
+
+LVD_TEST_BEGIN(100__vm__3__rebinding_relinks)
+    sem::EvalCtx ctx;
+    auto scope_guard = ctx.push_scope();
+    execute_stmt_data(syn::SymbolDefn(SymbolId("vm_f"), DefinedAs, x_op_x_literal(Mul)), ctx);
+    auto expr = func_eval("vm_f", {3.0});
+    auto program = vm::compile_expr(expr);
+    LVD_TEST_REQ_EQ(program.run(ctx), sept::Data{9.0});
+    // Assigning vm_f rebinds it in place, i.e. at the same address, which the link must still notice.
+    execute_stmt_data(syn::Assignment(SymbolId("vm_f"), AssignFrom, x_op_x_literal(Add)), ctx);
+    LVD_TEST_REQ_EQ(program.run(ctx), sept::Data{6.0});
+    LVD_TEST_REQ_EQ(reference_value(expr, ctx), sept::Data{6.0});
+    // Going back to the first definition reuses the function compiled from it.
+    auto function_count = program.function_count();
+    execute_stmt_data(syn::Assignment(SymbolId("vm_f"), AssignFrom, x_op_x_literal(Mul)), ctx);
+    LVD_TEST_REQ_EQ(program.run(ctx), sept::Data{9.0});
+    LVD_TEST_REQ_EQ(program.function_count(), function_count);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(100__vm__4__reused_scope_relinks)
+    sem::EvalCtx ctx;
+    auto expr = func_eval("vm_g", {3.0});
+    auto program = vm::compile_expr(expr);
+    // Each scope defines vm_g differently, and a popped scope may be reused for the next one.
+    {
+        auto scope_guard = ctx.push_scope();
+        execute_stmt_data(syn::SymbolDefn(SymbolId("vm_g"), DefinedAs, x_op_x_literal(Mul)), ctx);
+        LVD_TEST_REQ_EQ(program.run(ctx), sept::Data{9.0});
+    }
+    {
+        auto scope_guard = ctx.push_scope();
+        execute_stmt_data(syn::SymbolDefn(SymbolId("vm_g"), DefinedAs, x_op_x_literal(Add)), ctx);
+        LVD_TEST_REQ_EQ(program.run(ctx), sept::Data{6.0});
+    }
+LVD_TEST_END
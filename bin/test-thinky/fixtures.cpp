@@ -0,0 +1,48 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <lvd/fmt.hpp>
+#include "sept/FreeVar.hpp"
+#include "sept/Tuple.hpp"
+#include <stdexcept>
+#include <system_error>
+
+sept::Data smart_likes_cats_rule () {
+    auto X = sept::FreeVar("X");
+    return Implication(SubjVerbObj(X, HasProperty, Smart), Implies, SubjVerbObj(X, LikesA, Cat));
+}
+
+sept::Data smart_tells_truth_rule () {
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    return Implication(Predicate_And(And, sept::Tuple(SubjVerbObj(X, HasProperty, Smart), SubjVerbObj(X, Says, Y))), Implies, Y);
+}
+
+void add_assorted_beliefs (BeliefSystem &bs) {
+    bs.add_belief(SubjVerbObj(Alice, LikesEntity, Bob));
+    bs.add_belief(Predicate_Not(Not, SubjVerbObj(Bob, LikesEntity, Alice)));
+    bs.add_belief(SubjVerbObj(Box, HasProperty, Red));
+    bs.add_belief(SubjVerbObj(Box, HasProperty, Big));
+    bs.add_belief(Predicate_And(And, sept::Tuple(SubjVerbObj(Cup, HasProperty, Blue), SubjVerbObj(Cup, HasProperty, Smart))));
+    bs.add_belief(Predicate_Or(Or, sept::Tuple(SubjVerbObj(Hat, HasProperty, Green), SubjVerbObj(Hat, HasProperty, Small))));
+    bs.add_belief(SubjVerbObj(Charlie, Says, SubjVerbObj(Dave, LikesA, Cat)));
+    bs.add_belief(SubjVerbObj(Charlie, HasProperty, Smart));
+    bs.add_belief(Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat)));
+}
+
+TemporaryDirectory::TemporaryDirectory (std::string const &prefix) {
+    auto path = (std::filesystem::temp_directory_path() / (prefix + ".XXXXXX")).string();
+    if (::mkdtemp(path.data()) == nullptr)
+        throw std::runtime_error(LVD_FMT("couldn't create a temporary directory from template " << path << "; " << std::strerror(errno)));
+    m_path = path;
+}
+
+TemporaryDirectory::~TemporaryDirectory () {
+    // Don't throw from the destructor.
+    std::error_code error_code;
+    std::filesystem::remove_all(m_path, error_code);
+}
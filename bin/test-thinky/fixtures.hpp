@@ -0,0 +1,50 @@
+// 2021.05.29 - Victor Dods
+
+#pragma once
+
+// Includes from thinky's source
+#include "ast.hpp"
+#include "belief.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include "sept/Data.hpp"
+#include "sept/Match.hpp"
+#include <string>
+
+// X HasProperty Smart => X LikesA Cat, i.e. smart people like cats.
+sept::Data smart_likes_cats_rule ();
+// (X HasProperty Smart and X Says Y) => Y, i.e. smart people tell the truth.
+sept::Data smart_tells_truth_rule ();
+
+// Adds some beliefs of various shapes (including a negation, an And, an Or and a nested belief) to bs.
+void add_assorted_beliefs (BeliefSystem &bs);
+
+// The number of the given beliefs that the pattern matches.
+template <typename Beliefs_>
+size_t match_count (sept::Data const &pattern, Beliefs_ const &beliefs) {
+    size_t count = 0;
+    for (auto const &belief : beliefs)
+        if (sept::match(pattern, belief).has_value())
+            ++count;
+    return count;
+}
+
+// A new directory with a unique name under the system's temporary directory, so that concurrent runs
+// don't collide, which is removed along with its contents when this is destroyed.
+class TemporaryDirectory {
+public:
+
+    // Throws if the directory couldn't be created.
+    explicit TemporaryDirectory (std::string const &prefix);
+    ~TemporaryDirectory ();
+
+    TemporaryDirectory (TemporaryDirectory const &) = delete;
+    TemporaryDirectory &operator= (TemporaryDirectory const &) = delete;
+
+    std::filesystem::path const &path () const { return m_path; }
+
+private:
+
+    std::filesystem::path m_path;
+};
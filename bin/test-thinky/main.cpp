@@ -0,0 +1,7 @@
+// 2021.05.29 - Victor Dods
+
+#include <lvd/test.hpp>
+
+int main (int argc, char **argv) {
+    return lvd::test::basic_test_main("test-thinky -- unit tests for thinky's belief system", argc, argv);
+}
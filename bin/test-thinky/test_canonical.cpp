@@ -0,0 +1,135 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <functional>
+#include <lvd/test.hpp>
+#include "sept/Tuple.hpp"
+#include "store.hpp"
+
+LVD_TEST_BEGIN(900__canonical__0__equivalent_predicates_are_equal)
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    sept::Data c = SubjVerbObj(Cup, HasProperty, Blue);
+    // Commutative operands are sorted, and duplicate And/Or operands are removed, so equivalent
+    // predicates are equal.
+    auto p = Predicate_Or(Or, sept::Tuple(a, Predicate_Not(Not, Predicate_And(And, sept::Tuple(b, c)))));
+    auto q = Predicate_Or(Or, sept::Tuple(Predicate_Not(Not, Predicate_And(And, sept::Tuple(c, b, c))), a, a));
+    LVD_TEST_REQ_EQ(demorganize_data(p), demorganize_data(q));
+    LVD_TEST_REQ_EQ(std::hash<sept::Data>()(demorganize_data(p)), std::hash<sept::Data>()(demorganize_data(q)));
+    // demorganize_data is idempotent.
+    LVD_TEST_REQ_EQ(demorganize_data(demorganize_data(p)), demorganize_data(p));
+    // Duplicate Xor operands aren't removed, since they cancel out rather than being redundant.
+    auto canonical_xor = demorganize_data(Predicate_Xor(Xor, sept::Tuple(b, a, b)));
+    LVD_TEST_REQ_EQ(canonical_xor, demorganize_data(Predicate_Xor(Xor, sept::Tuple(a, b, b))));
+    LVD_TEST_REQ_EQ(canonical_xor[1].cast<sept::TupleTerm_c const &>().elements().size(), size_t(3));
+
+    LVD_TEST_REQ_NEQ(compare_predicates(a, b), 0);
+    LVD_TEST_REQ_EQ(compare_predicates(a, b) < 0, compare_predicates(b, a) > 0);
+    LVD_TEST_REQ_EQ(compare_predicates(a, a), 0);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(900__canonical__1__canonicalizer_memo)
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    sept::Data c = SubjVerbObj(Cup, HasProperty, Blue);
+    auto p = Predicate_Or(Or, sept::Tuple(a, Predicate_Not(Not, Predicate_And(And, sept::Tuple(b, c)))));
+    auto q = Predicate_Or(Or, sept::Tuple(Predicate_Not(Not, Predicate_And(And, sept::Tuple(c, b, c))), a, a));
+
+    PredicateCanonicalizer canonicalizer;
+    // A non-logical predicate is returned as is, without a lookup.
+    LVD_TEST_REQ_EQ(&canonicalizer.canonical_form(a), &a);
+    LVD_TEST_REQ_EQ(canonicalizer.memo_size(), size_t(0));
+    auto canonical_p = canonicalizer.canonical_form(p);
+    LVD_TEST_REQ_EQ(canonical_p, demorganize_data(p));
+    LVD_TEST_REQ_EQ(canonicalizer.miss_count(), size_t(1));
+    // The canonical form is marked as such, and q is a different predicate with the same canonical form.
+    LVD_TEST_REQ_EQ(canonicalizer.canonical_form(canonical_p), canonical_p);
+    LVD_TEST_REQ_EQ(canonicalizer.canonical_form(q), canonical_p);
+    LVD_TEST_REQ_EQ(canonicalizer.canonical_form(p), canonical_p);
+    LVD_TEST_REQ_EQ(canonicalizer.hit_count(), size_t(2));
+    LVD_TEST_REQ_EQ(canonicalizer.miss_count(), size_t(2));
+    LVD_TEST_REQ_EQ(canonicalizer.memo_size(), size_t(3));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(900__canonical__2__equivalent_beliefs_are_stored_once)
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    BeliefSystem bs;
+    bs.add_belief(Predicate_Or(Or, sept::Tuple(a, b)));
+    bs.add_belief(Predicate_Or(Or, sept::Tuple(b, a)));
+    bs.add_belief(Predicate_Or(Or, sept::Tuple(b, a, b)));
+    LVD_TEST_REQ_EQ(bs.belief_set().size(), size_t(1));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_Or(Or, sept::Tuple(b, a))), Accept);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(900__canonical__3__remove_unsorted_belief)
+    // Or(a, b) and Or(b, a) have the same stored form, and removing either one as given retracts it.
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    BeliefSystem bs;
+    bs.add_belief(Predicate_Or(Or, sept::Tuple(a, b)));
+    LVD_TEST_REQ_EQ(bs.remove_belief(Predicate_Or(Or, sept::Tuple(b, a))).size(), size_t(1));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+    bs.add_belief(Predicate_Or(Or, sept::Tuple(b, a)));
+    LVD_TEST_REQ_EQ(bs.remove_belief(Predicate_Or(Or, sept::Tuple(b, a))).size(), size_t(1));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+
+    // Likewise for an And, which is stored as its operands, even if it's removed with a duplicate operand.
+    bs.add_belief(Predicate_And(And, sept::Tuple(b, a)));
+    LVD_TEST_REQ_EQ(bs.remove_belief(Predicate_And(And, sept::Tuple(b, a, b))).size(), size_t(2));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+LVD_TEST_END
+
+LVD_TEST_BEGIN(900__canonical__4__journaled_removal_of_unsorted_belief)
+    // Replaying the journal removes the belief the same way.
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    sept::Data c = SubjVerbObj(Cup, HasProperty, Blue);
+    TemporaryDirectory directory("test-thinky-canonical");
+    {
+        BeliefSystem bs;
+        BeliefStore store(directory.path(), bs);
+        store.add_belief(Predicate_Or(Or, sept::Tuple(b, a)));
+        store.add_belief(Predicate_Or(Or, sept::Tuple(c, a)));
+        store.remove_belief(Predicate_Or(Or, sept::Tuple(b, a)));
+        LVD_TEST_REQ_EQ(bs.belief_set().size(), size_t(1));
+    }
+    BeliefSystem recovered_bs;
+    BeliefStore store(directory.path(), recovered_bs);
+    LVD_TEST_REQ_EQ(store.recovery_stats().m_journal_record_count, size_t(3));
+    LVD_TEST_REQ_EQ(recovered_bs.belief_set().size(), size_t(1));
+    LVD_TEST_REQ_IS_TRUE(recovered_bs.contains_belief(demorganize_data(Predicate_Or(Or, sept::Tuple(c, a)))));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(900__canonical__5__negated_compound_belief_denies)
+    // Not(And(a,b)) is stored as Or(Not(a),Not(b)), and evaluating And(a,b) still finds it.
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    BeliefSystem bs;
+    bs.add_belief(Predicate_Not(Not, Predicate_And(And, sept::Tuple(a, b))));
+    LVD_TEST_REQ_IS_FALSE(bs.contains_negation_of(Predicate_And(And, sept::Tuple(a, b))));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_And(And, sept::Tuple(a, b))), Deny);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_And(And, sept::Tuple(b, a))), Deny);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_Not(Not, Predicate_And(And, sept::Tuple(a, b)))), Accept);
+    // Neither operand is known on its own.
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(a), Unknown);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(900__canonical__6__canonical_negation_is_memoized)
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    auto p = Predicate_And(And, sept::Tuple(b, a));
+    PredicateCanonicalizer canonicalizer;
+    sept::Data canonical_negation = canonicalizer.canonical_negation(p);
+    LVD_TEST_REQ_EQ(canonical_negation, demorganize_data(Predicate_Not(Not, p)));
+    // Looking it up again is a single hit, which doesn't add anything to the memo.
+    auto hit_count = canonicalizer.hit_count();
+    auto miss_count = canonicalizer.miss_count();
+    auto memo_size = canonicalizer.memo_size();
+    LVD_TEST_REQ_EQ(canonicalizer.canonical_negation(p), canonical_negation);
+    LVD_TEST_REQ_EQ(canonicalizer.hit_count(), hit_count + 1);
+    LVD_TEST_REQ_EQ(canonicalizer.miss_count(), miss_count);
+    LVD_TEST_REQ_EQ(canonicalizer.memo_size(), memo_size);
+    // The negation's canonical form is shared with the equivalent Predicate_Not.
+    LVD_TEST_REQ_EQ(&canonicalizer.canonical_negation(p), &canonicalizer.canonical_form(Predicate_Not(Not, p)));
+LVD_TEST_END
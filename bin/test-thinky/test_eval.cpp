@@ -0,0 +1,88 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "sept/Tuple.hpp"
+
+namespace {
+
+void add_eval_beliefs (BeliefSystem &bs) {
+    bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    bs.add_belief(SubjVerbObj(Alice, LikesA, Cat));
+    bs.add_belief(Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat)));
+}
+
+sept::Data alice_implication () {
+    return Implication(SubjVerbObj(Alice, HasProperty, Smart), Implies, SubjVerbObj(Alice, LikesA, Cat));
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(500__eval__0__compound_predicates)
+    BeliefSystem bs;
+    add_eval_beliefs(bs);
+    auto compound = Predicate_And(And, sept::Tuple(alice_implication(), Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(compound), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Dave, LikesA, Cat)), Deny);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, LikesA, Cat)), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_Xor(Xor, sept::Tuple(SubjVerbObj(Alice, LikesA, Cat), SubjVerbObj(Dave, LikesA, Cat)))), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_Or(Or, sept::Tuple(SubjVerbObj(Dave, LikesA, Cat), SubjVerbObj(Bob, LikesA, Cat)))), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_Or(Or, sept::Tuple(SubjVerbObj(Bob, LikesA, Cat), SubjVerbObj(Alice, LikesA, Cat)))), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Implication(SubjVerbObj(Dave, LikesA, Cat), Implies, SubjVerbObj(Alice, LikesA, Cat))), Accept);
+
+    // The second and later evaluations come from the memo.
+    auto miss_count = bs.evaluation_memo_miss_count();
+    auto hit_count = bs.evaluation_memo_hit_count();
+    for (size_t i = 0; i < 10; ++i)
+        LVD_TEST_REQ_EQ(bs.evaluate_predicate(compound), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_miss_count(), miss_count);
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_hit_count(), hit_count + 10);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(500__eval__1__operands_are_memoized)
+    BeliefSystem bs;
+    add_eval_beliefs(bs);
+    auto compound = Predicate_And(And, sept::Tuple(alice_implication(), Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(compound), Accept);
+    // The compound predicate, the implication, its premise and conclusion, and the negation (which is a
+    // belief, so its operand isn't evaluated).
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_miss_count(), size_t(5));
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_hit_count(), size_t(0));
+
+    // An operand evaluated on its own comes from the memo.
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(alice_implication()), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_miss_count(), size_t(5));
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_hit_count(), size_t(1));
+
+    // So does an operand shared with another compound predicate, which only evaluates what's new.
+    auto other_compound = Predicate_And(And, sept::Tuple(alice_implication(), SubjVerbObj(Bob, LikesA, Cat)));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(other_compound), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_miss_count(), size_t(7));
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_hit_count(), size_t(2));
+    auto xor_compound = Predicate_Xor(Xor, sept::Tuple(alice_implication(), SubjVerbObj(Bob, LikesA, Cat)));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(xor_compound), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_miss_count(), size_t(8));
+    LVD_TEST_REQ_EQ(bs.evaluation_memo_hit_count(), size_t(4));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(500__eval__2__changing_beliefs_invalidates_the_memo)
+    BeliefSystem bs;
+    add_eval_beliefs(bs);
+    auto compound = Predicate_And(And, sept::Tuple(alice_implication(), Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(compound), Accept);
+
+    auto generation = bs.generation();
+    bs.remove_belief(SubjVerbObj(Alice, LikesA, Cat));
+    LVD_TEST_REQ_NEQ(bs.generation(), generation);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(compound), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(alice_implication()), Unknown);
+
+    generation = bs.generation();
+    bs.add_belief(SubjVerbObj(Alice, LikesA, Cat));
+    LVD_TEST_REQ_NEQ(bs.generation(), generation);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(compound), Accept);
+    // Adding a belief that's already present doesn't change anything.
+    generation = bs.generation();
+    bs.add_belief(SubjVerbObj(Alice, LikesA, Cat));
+    LVD_TEST_REQ_EQ(bs.generation(), generation);
+LVD_TEST_END
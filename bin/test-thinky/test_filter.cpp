@@ -0,0 +1,95 @@
+// 2021.05.29 - Victor Dods
+
+#include "filter.hpp"
+#include "fixtures.hpp"
+#include <functional>
+#include <lvd/test.hpp>
+#include "sept/Tuple.hpp"
+
+LVD_TEST_BEGIN(600__filter__0__no_false_negatives)
+    BlockedBloomFilter filter;
+    // Insert well past the capacity, so that the false positive rate rises, but there must never be a
+    // false negative.
+    for (size_t i = 0; i < 1000; ++i) {
+        filter.insert(std::hash<size_t>()(i));
+        for (size_t j = 0; j <= i; j += 37)
+            LVD_TEST_REQ_IS_TRUE(filter.may_contain(std::hash<size_t>()(j)));
+    }
+    LVD_TEST_REQ_EQ(filter.inserted_count(), size_t(1000));
+    LVD_TEST_REQ_IS_TRUE(filter.should_rebuild());
+
+    // Resetting clears the filter and sizes it for the given count.
+    filter.reset(1000);
+    LVD_TEST_REQ_EQ(filter.inserted_count(), size_t(0));
+    LVD_TEST_REQ_IS_FALSE(filter.should_rebuild());
+    LVD_TEST_REQ_EQ(filter.false_positive_rate(), 0.0);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(600__filter__1__belief_filters)
+    // Enough beliefs to make the filters grow a few times.
+    BeliefSystem bs;
+    std::vector<sept::Data> beliefs;
+    for (uint32_t i = 0; i < 200; ++i) {
+        beliefs.push_back(sept::Tuple(sept::Uint32(i), LikesA, Cat));
+        beliefs.push_back(Predicate_Not(Not, sept::Tuple(sept::Uint32(i), HasProperty, Red)));
+    }
+    for (auto const &belief : beliefs)
+        bs.add_belief(belief);
+    for (auto const &belief : beliefs)
+        LVD_TEST_REQ_IS_TRUE(bs.contains_belief(belief));
+    for (uint32_t i = 0; i < 200; ++i) {
+        LVD_TEST_REQ_IS_TRUE(bs.contains_negation_of(sept::Tuple(sept::Uint32(i), HasProperty, Red)));
+        LVD_TEST_REQ_IS_FALSE(bs.contains_negation_of(sept::Tuple(sept::Uint32(i), LikesA, Cat)));
+    }
+
+    // Count the absent beliefs that get past the filter.
+    size_t false_positive_count = 0;
+    size_t const ABSENT_COUNT = 10000;
+    for (uint32_t i = 200; i < 200+ABSENT_COUNT; ++i) {
+        sept::Data absent_belief = sept::Tuple(sept::Uint32(i), LikesA, Cat);
+        LVD_TEST_REQ_IS_FALSE(bs.contains_belief(absent_belief));
+        if (bs.belief_filter().may_contain(std::hash<sept::Data>()(absent_belief)))
+            ++false_positive_count;
+    }
+    test_log << lvd::Log::dbg() << LVD_REFLECT(bs.belief_filter().false_positive_rate()) << ", measured false positive rate = " << double(false_positive_count) / ABSENT_COUNT << '\n';
+    LVD_TEST_REQ_LT(double(false_positive_count) / ABSENT_COUNT, 0.05);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(600__filter__2__rebuilt_after_removals)
+    BeliefSystem bs;
+    std::vector<sept::Data> beliefs;
+    for (uint32_t i = 0; i < 200; ++i) {
+        beliefs.push_back(sept::Tuple(sept::Uint32(i), LikesA, Cat));
+        beliefs.push_back(Predicate_Not(Not, sept::Tuple(sept::Uint32(i), HasProperty, Red)));
+    }
+    for (auto const &belief : beliefs)
+        bs.add_belief(belief);
+
+    // Removing most of the beliefs makes the filters get rebuilt from the remaining ones.  Both beliefs
+    // of every 10th pair are kept, so that some negations are still present after the rebuild.
+    for (size_t i = 0; i < beliefs.size(); ++i)
+        if (i/2 % 10 != 0)
+            bs.remove_belief(beliefs[i]);
+    LVD_TEST_REQ_LT(bs.belief_filter().inserted_count(), beliefs.size());
+    LVD_TEST_REQ_LT(bs.negated_belief_filter().inserted_count(), beliefs.size() / 2);
+    for (size_t i = 0; i < beliefs.size(); ++i)
+        LVD_TEST_REQ_EQ(bs.contains_belief(beliefs[i]), i/2 % 10 == 0);
+    for (uint32_t i = 0; i < 200; ++i)
+        LVD_TEST_REQ_EQ(bs.contains_negation_of(sept::Tuple(sept::Uint32(i), HasProperty, Red)), i % 10 == 0);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(600__filter__3__sized_by_restore)
+    // Restoring sizes both filters up front, rather than growing them while inserting.
+    std::vector<sept::Data> assertions;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        assertions.push_back(sept::Tuple(sept::Uint32(i), LikesA, Cat));
+        assertions.push_back(Predicate_Not(Not, sept::Tuple(sept::Uint32(i), HasProperty, Red)));
+    }
+    BeliefSystem bs;
+    bs.restore(assertions, {});
+    LVD_TEST_REQ_EQ(bs.belief_filter().byte_count(), BlockedBloomFilter(assertions.size()).byte_count());
+    LVD_TEST_REQ_EQ(bs.negated_belief_filter().byte_count(), BlockedBloomFilter(assertions.size() / 2).byte_count());
+    LVD_TEST_REQ_EQ(bs.negated_belief_filter().inserted_count(), assertions.size() / 2);
+    for (uint32_t i = 0; i < 1000; ++i)
+        LVD_TEST_REQ_IS_TRUE(bs.contains_negation_of(sept::Tuple(sept::Uint32(i), HasProperty, Red)));
+LVD_TEST_END
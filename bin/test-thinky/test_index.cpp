@@ -0,0 +1,85 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include "index.hpp"
+#include <lvd/test.hpp>
+#include "sept/FreeVar.hpp"
+#include "sept/Tuple.hpp"
+#include <unordered_set>
+
+LVD_TEST_BEGIN(100__index__0__candidates_include_every_match)
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    auto Z = sept::FreeVar("Z");
+    BeliefSystem bs;
+    add_assorted_beliefs(bs);
+    // The BeliefIndex should narrow down the beliefs to pattern match against, without missing any matches.
+    for (auto const &pattern : {
+        sept::Data{SubjVerbObj(X, HasProperty, Smart)},
+        sept::Data{Predicate_Not(Not, SubjVerbObj(X, LikesA, Cat))},
+        sept::Data{sept::Tuple(X, Y, Z)},
+        sept::Data{sept::Tuple(X, Y, X)},
+        sept::Data{SubjVerbObj(Charlie, Says, X)},
+        sept::Data{SubjVerbObj(Charlie, Says, SubjVerbObj(X, LikesA, Y))},
+        sept::Data{X},
+    }) {
+        auto candidates = bs.belief_index().candidate_beliefs(pattern);
+        test_log << lvd::Log::dbg() << "pattern " << pattern << " has " << candidates.size() << " candidate(s) out of " << bs.belief_set().size() << " beliefs\n";
+        LVD_TEST_REQ_LEQ(candidates.size(), bs.belief_set().size());
+        LVD_TEST_REQ_EQ(match_count(pattern, candidates), match_count(pattern, bs.belief_set()));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(100__index__1__narrows_candidates)
+    auto X = sept::FreeVar("X");
+    // The index points to the beliefs, so they have to be kept somewhere that they don't move.
+    std::unordered_set<sept::Data> beliefs{
+        SubjVerbObj(Alice, HasProperty, Smart),
+        SubjVerbObj(Bob, HasProperty, Smart),
+        SubjVerbObj(Bob, HasProperty, Red),
+        SubjVerbObj(Bob, LikesA, Cat),
+        Predicate_Not(Not, SubjVerbObj(Bob, LikesA, Cat)),
+    };
+    BeliefIndex index;
+    for (auto const &belief : beliefs)
+        index.insert(belief);
+    LVD_TEST_REQ_EQ(index.candidate_beliefs(SubjVerbObj(X, HasProperty, Smart)).size(), size_t(2));
+    LVD_TEST_REQ_EQ(index.candidate_beliefs(sept::Tuple(Bob, X, Cat)).size(), size_t(1));
+    LVD_TEST_REQ_EQ(index.candidate_beliefs(Predicate_Not(Not, X)).size(), size_t(1));
+    LVD_TEST_REQ_EQ(index.candidate_beliefs(X).size(), size_t(5));
+    LVD_TEST_REQ_EQ(index.candidate_beliefs(SubjVerbObj(X, HasProperty, Big)).size(), size_t(0));
+
+    // Erasing a belief removes it from the candidates, and erasing one that isn't present does nothing.
+    // Beliefs are erased by address, so erasing a copy of one that's present also does nothing.
+    index.erase(*beliefs.find(SubjVerbObj(Alice, HasProperty, Smart)));
+    index.erase(SubjVerbObj(Charlie, HasProperty, Smart));
+    index.erase(SubjVerbObj(Bob, HasProperty, Red));
+    auto candidates = index.candidate_beliefs(SubjVerbObj(X, HasProperty, Smart));
+    LVD_TEST_REQ_EQ(candidates.size(), size_t(1));
+    LVD_TEST_REQ_EQ(candidates[0], sept::Data{SubjVerbObj(Bob, HasProperty, Smart)});
+    LVD_TEST_REQ_EQ(index.candidate_beliefs(X).size(), size_t(4));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(100__index__2__candidate_ptrs)
+    auto X = sept::FreeVar("X");
+    std::unordered_set<sept::Data> beliefs{
+        SubjVerbObj(Alice, HasProperty, Smart),
+        SubjVerbObj(Bob, HasProperty, Smart),
+        SubjVerbObj(Bob, LikesA, Cat),
+    };
+    BeliefIndex index;
+    for (auto const &belief : beliefs)
+        index.insert(belief);
+    // The pointers are to the inserted beliefs themselves, and stay valid while beliefs are inserted.
+    auto candidate_ptrs = index.candidate_belief_ptrs(SubjVerbObj(X, HasProperty, Smart));
+    LVD_TEST_REQ_EQ(candidate_ptrs.size(), size_t(2));
+    for (auto const *belief : candidate_ptrs)
+        LVD_TEST_REQ_EQ(belief, &*beliefs.find(*belief));
+    for (uint32_t i = 0; i < 100; ++i)
+        index.insert(*beliefs.emplace(SubjVerbObj(sept::Uint32(i), HasProperty, Smart)).first);
+    std::vector<sept::Data> candidates;
+    for (auto const *belief : candidate_ptrs)
+        candidates.emplace_back(*belief);
+    LVD_TEST_REQ_EQ(match_count(SubjVerbObj(X, HasProperty, Smart), candidates), size_t(2));
+    LVD_TEST_REQ_EQ(index.candidate_belief_ptrs(SubjVerbObj(X, HasProperty, Smart)).size(), size_t(102));
+LVD_TEST_END
@@ -0,0 +1,79 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "sept/FreeVar.hpp"
+#include "sept/Tuple.hpp"
+#include <stdexcept>
+
+LVD_TEST_BEGIN(200__rete__0__chained_conclusions)
+    // Rules are added once and applied to each belief as it's added.
+    BeliefSystem bs;
+    bs.add_rule(smart_likes_cats_rule());
+    bs.add_rule(smart_tells_truth_rule());
+
+    bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+    bs.add_belief(SubjVerbObj(Box, HasProperty, Red));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, HasProperty, Smart)), Unknown);
+
+    // This enables a chain of conclusions.
+    bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Alice, LikesA, Cat)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, HasProperty, Smart)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, LikesA, Cat)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Box, LikesA, Cat)), Unknown);
+
+    // This enables the contrapositive of smart_likes_cats_rule.
+    bs.add_belief(Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat)));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Dave, HasProperty, Smart)), Deny);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(200__rete__1__rules_apply_to_existing_beliefs)
+    // Adding the rules after the beliefs derives the same beliefs as adding them before.
+    auto add_beliefs_to = [](BeliefSystem &bs) {
+        bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+        bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+        bs.add_belief(SubjVerbObj(Bob, Says, Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+    };
+    BeliefSystem rules_first_bs;
+    rules_first_bs.add_rule(smart_likes_cats_rule());
+    rules_first_bs.add_rule(smart_tells_truth_rule());
+    add_beliefs_to(rules_first_bs);
+    BeliefSystem beliefs_first_bs;
+    add_beliefs_to(beliefs_first_bs);
+    beliefs_first_bs.add_rule(smart_likes_cats_rule());
+    beliefs_first_bs.add_rule(smart_tells_truth_rule());
+
+    LVD_TEST_REQ_IS_TRUE(rules_first_bs.belief_set() == beliefs_first_bs.belief_set());
+    LVD_TEST_REQ_IS_TRUE(beliefs_first_bs.contains_belief(SubjVerbObj(Bob, LikesA, Cat)));
+    LVD_TEST_REQ_IS_TRUE(beliefs_first_bs.contains_belief(Predicate_Not(Not, SubjVerbObj(Dave, HasProperty, Smart))));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(200__rete__2__shared_alpha_memories)
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    BeliefSystem bs;
+    // The contrapositive of smart_tells_truth_rule isn't added, since Y alone doesn't bind X.
+    bs.add_rule(smart_likes_cats_rule());
+    bs.add_rule(smart_tells_truth_rule());
+    LVD_TEST_REQ_EQ(bs.rule_network().rule_count(), size_t(3));
+    auto alpha_memory_count = bs.rule_network().alpha_memory_count();
+    // The same conjunct, up to renaming of FreeVars, shares an alpha memory.
+    bs.add_rule(Implication(SubjVerbObj(Y, HasProperty, Smart), Implies, SubjVerbObj(Y, LikesEntity, Alice)), false);
+    LVD_TEST_REQ_EQ(bs.rule_network().rule_count(), size_t(4));
+    LVD_TEST_REQ_EQ(bs.rule_network().alpha_memory_count(), alpha_memory_count);
+
+    bs.add_belief(SubjVerbObj(Charlie, HasProperty, Smart));
+    LVD_TEST_REQ_IS_TRUE(bs.contains_belief(SubjVerbObj(Charlie, LikesA, Cat)));
+    LVD_TEST_REQ_IS_TRUE(bs.contains_belief(SubjVerbObj(Charlie, LikesEntity, Alice)));
+
+    // Rules whose conclusions would have unbound FreeVars, or that have an Xor premise, are rejected.
+    LVD_TEST_REQ_IS_FALSE(RuleNetwork::can_add_rule(Implication(SubjVerbObj(X, HasProperty, Smart), Implies, SubjVerbObj(X, LikesEntity, Y))));
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        bs.add_rule(Implication(SubjVerbObj(X, HasProperty, Smart), Implies, SubjVerbObj(X, LikesEntity, Y)), false);
+    });
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        bs.add_rule(Implication(Predicate_Xor(Xor, sept::Tuple(SubjVerbObj(X, HasProperty, Smart), SubjVerbObj(X, HasProperty, Big))), Implies, SubjVerbObj(X, LikesA, Cat)), false);
+    });
+    LVD_TEST_REQ_EQ(bs.rule_network().rule_count(), size_t(4));
+LVD_TEST_END
@@ -0,0 +1,78 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include <stdexcept>
+
+namespace {
+
+std::vector<sept::Data> saturation_rules () {
+    return {smart_likes_cats_rule(), smart_tells_truth_rule()};
+}
+
+void add_saturation_beliefs (BeliefSystem &bs) {
+    bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+    bs.add_belief(SubjVerbObj(Bob, Says, SubjVerbObj(Charlie, HasProperty, Smart)));
+    bs.add_belief(SubjVerbObj(Charlie, Says, Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+    bs.add_belief(SubjVerbObj(Box, HasProperty, Red));
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(300__saturate__0__derives_until_nothing_is_new)
+    BeliefSystem bs;
+    add_saturation_beliefs(bs);
+    auto round_stats = bs.saturate(saturation_rules());
+    for (auto const &stats : round_stats)
+        test_log << lvd::Log::dbg() << stats << '\n';
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Charlie, LikesA, Cat)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Dave, HasProperty, Smart)), Deny);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Box, LikesA, Cat)), Unknown);
+    // Each round's new beliefs are the next round's delta, and the last round derives nothing.
+    LVD_TEST_REQ_LT(size_t(1), round_stats.size());
+    for (size_t i = 0; i+1 < round_stats.size(); ++i)
+        LVD_TEST_REQ_EQ(round_stats[i+1].m_delta_size, round_stats[i].m_new_belief_count);
+    LVD_TEST_REQ_EQ(round_stats.back().m_new_belief_count, size_t(0));
+
+    // Saturating again derives nothing new.
+    auto belief_count = bs.belief_set().size();
+    auto resaturated_round_stats = bs.saturate(saturation_rules());
+    LVD_TEST_REQ_EQ(resaturated_round_stats.size(), size_t(1));
+    LVD_TEST_REQ_EQ(resaturated_round_stats[0].m_new_belief_count, size_t(0));
+    LVD_TEST_REQ_EQ(bs.belief_set().size(), belief_count);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(300__saturate__1__parallel_agrees)
+    BeliefSystem sequential_bs;
+    add_saturation_beliefs(sequential_bs);
+    auto sequential_round_stats = sequential_bs.saturate(saturation_rules());
+    for (size_t thread_count : {2, 3, 8}) {
+        BeliefSystem parallel_bs;
+        add_saturation_beliefs(parallel_bs);
+        auto parallel_round_stats = parallel_bs.saturate(saturation_rules(), thread_count);
+        LVD_TEST_REQ_IS_TRUE(parallel_bs.belief_set() == sequential_bs.belief_set());
+        LVD_TEST_REQ_EQ(parallel_round_stats.size(), sequential_round_stats.size());
+        for (size_t i = 0; i < sequential_round_stats.size(); ++i) {
+            LVD_TEST_REQ_EQ(parallel_round_stats[i].m_join_count, sequential_round_stats[i].m_join_count);
+            LVD_TEST_REQ_EQ(parallel_round_stats[i].m_conclusion_count, sequential_round_stats[i].m_conclusion_count);
+            LVD_TEST_REQ_EQ(parallel_round_stats[i].m_new_belief_count, sequential_round_stats[i].m_new_belief_count);
+        }
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(300__saturate__2__agrees_with_rule_network)
+    // Saturating with the rules derives the same beliefs as adding them via add_rule.
+    BeliefSystem saturated_bs;
+    add_saturation_beliefs(saturated_bs);
+    saturated_bs.saturate(saturation_rules());
+    BeliefSystem rete_bs;
+    for (auto const &rule : saturation_rules())
+        rete_bs.add_rule(rule);
+    add_saturation_beliefs(rete_bs);
+    LVD_TEST_REQ_IS_TRUE(saturated_bs.belief_set() == rete_bs.belief_set());
+
+    lvd::test::call_function_and_expect_exception<std::runtime_error>([&](){
+        saturated_bs.saturate(saturation_rules(), 0);
+    });
+LVD_TEST_END
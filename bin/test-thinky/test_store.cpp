@@ -0,0 +1,135 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <fstream>
+#include <lvd/test.hpp>
+#include "sept/FreeVar.hpp"
+#include "store.hpp"
+
+namespace {
+
+sept::Data cat_lovers_are_smart_rule () {
+    auto X = sept::FreeVar("X");
+    return Implication(SubjVerbObj(X, LikesA, Cat), Implies, SubjVerbObj(X, HasProperty, Smart));
+}
+
+sept::Data belief_of (uint32_t i) {
+    return SubjVerbObj(sept::Uint32(i), LikesA, Cat);
+}
+
+// Journals some beliefs to a store in the given directory, compacting partway through (so that the rest
+// go into the next journal), and removes some, some of which are in the snapshot.  original_bs gets the
+// same beliefs.
+void write_store (lvd::req::Context &req_context, std::filesystem::path const &directory, BeliefSystem &original_bs) {
+    original_bs.add_rule(cat_lovers_are_smart_rule());
+    BeliefStore store(directory, original_bs, 16);
+    LVD_TEST_REQ_EQ(store.recovery_stats().m_journal_count, size_t(0));
+    for (uint32_t i = 0; i < 40; ++i)
+        store.add_belief(belief_of(i));
+    store.start_compaction();
+    for (uint32_t i = 40; i < 60; ++i)
+        store.add_belief(belief_of(i));
+    for (uint32_t i = 0; i < 60; i += 7)
+        store.remove_belief(belief_of(i));
+    store.wait_for_compaction();
+    LVD_TEST_REQ_EQ(store.journal_index(), uint64_t(1));
+    LVD_TEST_REQ_IS_FALSE(std::filesystem::exists(directory / "journal.0"));
+}
+
+// Requires that bs has the same beliefs, with the same support, as original_bs.
+void require_same_beliefs (lvd::req::Context &req_context, BeliefSystem const &bs, BeliefSystem const &original_bs) {
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set() == original_bs.belief_set());
+    for (auto const &belief : original_bs.belief_set()) {
+        LVD_TEST_REQ_EQ(bs.truth_maintenance().is_asserted(belief), original_bs.truth_maintenance().is_asserted(belief));
+        LVD_TEST_REQ_EQ(bs.truth_maintenance().justifications_of(belief).size(), original_bs.truth_maintenance().justifications_of(belief).size());
+    }
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(800__store__0__recovery)
+    TemporaryDirectory directory("test-thinky-store");
+    BeliefSystem original_bs;
+    write_store(req_context, directory.path(), original_bs);
+
+    // Recovering restores the snapshot without re-deriving it, and replays the journal on top of it.
+    BeliefSystem recovered_bs;
+    recovered_bs.add_rule(cat_lovers_are_smart_rule());
+    BeliefStore store(directory.path(), recovered_bs);
+    auto const &stats = store.recovery_stats();
+    test_log << lvd::Log::dbg() << stats << '\n';
+    // The 40 beliefs before the compaction, and what they derived.
+    LVD_TEST_REQ_EQ(stats.m_snapshot_belief_count, size_t(80));
+    // The 20 added after it, and the 9 removals.
+    LVD_TEST_REQ_EQ(stats.m_journal_record_count, size_t(20 + 9));
+    LVD_TEST_REQ_EQ(stats.m_discarded_byte_count, size_t(0));
+    require_same_beliefs(req_context, recovered_bs, original_bs);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(800__store__1__torn_record_is_discarded)
+    TemporaryDirectory directory("test-thinky-store");
+    BeliefSystem original_bs;
+    write_store(req_context, directory.path(), original_bs);
+
+    // A record whose write was cut short is discarded, and the journal continues after the intact
+    // records.
+    {
+        std::ofstream journal(directory.path() / "journal.1", std::ios::binary|std::ios::app);
+        journal.write("\x00\x10\x00", 3);
+    }
+    {
+        BeliefSystem recovered_bs;
+        recovered_bs.add_rule(cat_lovers_are_smart_rule());
+        BeliefStore store(directory.path(), recovered_bs);
+        LVD_TEST_REQ_EQ(store.recovery_stats().m_discarded_byte_count, size_t(3));
+        require_same_beliefs(req_context, recovered_bs, original_bs);
+        store.add_belief(belief_of(0));
+        original_bs.add_belief(belief_of(0));
+    }
+    {
+        BeliefSystem recovered_bs;
+        recovered_bs.add_rule(cat_lovers_are_smart_rule());
+        BeliefStore store(directory.path(), recovered_bs);
+        LVD_TEST_REQ_EQ(store.recovery_stats().m_discarded_byte_count, size_t(0));
+        require_same_beliefs(req_context, recovered_bs, original_bs);
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(800__store__2__recovery_without_rules)
+    TemporaryDirectory directory("test-thinky-store");
+    BeliefSystem original_bs;
+    write_store(req_context, directory.path(), original_bs);
+
+    // Without the rule, the snapshot's derived beliefs are still restored, but nothing is derived from the
+    // journaled ones.
+    BeliefSystem recovered_bs;
+    BeliefStore store(directory.path(), recovered_bs);
+    LVD_TEST_REQ_IS_TRUE(recovered_bs.contains_belief(belief_of(1)));
+    LVD_TEST_REQ_IS_TRUE(recovered_bs.contains_belief(SubjVerbObj(sept::Uint32(1), HasProperty, Smart)));
+    LVD_TEST_REQ_IS_FALSE(recovered_bs.contains_belief(belief_of(0)));
+    LVD_TEST_REQ_IS_FALSE(recovered_bs.contains_belief(SubjVerbObj(sept::Uint32(0), HasProperty, Smart)));
+    LVD_TEST_REQ_IS_TRUE(recovered_bs.contains_belief(belief_of(41)));
+    LVD_TEST_REQ_IS_FALSE(recovered_bs.contains_belief(SubjVerbObj(sept::Uint32(41), HasProperty, Smart)));
+LVD_TEST_END
+
+LVD_TEST_BEGIN(800__store__3__directories_are_independent)
+    // Each store only sees its own directory.
+    TemporaryDirectory directory_0("test-thinky-store");
+    TemporaryDirectory directory_1("test-thinky-store");
+    LVD_TEST_REQ_NEQ(directory_0.path(), directory_1.path());
+    {
+        BeliefSystem bs;
+        BeliefStore store(directory_0.path(), bs);
+        store.add_belief(belief_of(0));
+    }
+    {
+        BeliefSystem bs;
+        BeliefStore store(directory_1.path(), bs);
+        LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+    }
+    {
+        BeliefSystem bs;
+        BeliefStore store(directory_0.path(), bs);
+        LVD_TEST_REQ_EQ(bs.belief_set().size(), size_t(1));
+    }
+LVD_TEST_END
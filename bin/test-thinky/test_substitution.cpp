@@ -0,0 +1,108 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "pattern.hpp"
+#include "sept/ArrayTerm.hpp"
+#include "sept/ArrayType.hpp"
+#include "sept/FormalTypeOf.hpp"
+#include "sept/FreeVar.hpp"
+#include "sept/OrderedMapType.hpp"
+#include "sept/SymbolTable.hpp"
+#include "sept/Tuple.hpp"
+#include "sept/Union.hpp"
+#include "sept/UnionTerm.hpp"
+
+namespace {
+
+sept::SymbolTable xyz_assignment () {
+    sept::SymbolTable symbol_assignment;
+    symbol_assignment.define_symbol("X", sept::Uint32);
+    symbol_assignment.define_symbol("Y", sept::Bool);
+    symbol_assignment.define_symbol("Z", sept::Float64(456.75));
+    return symbol_assignment;
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(700__substitution__0__free_var_substitution)
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    auto Z = sept::FreeVar("Z");
+    auto W = sept::FreeVar("W");
+    auto symbol_assignment = xyz_assignment();
+
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::Uint32(3), symbol_assignment), sept::Data{sept::Uint32(3)});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(X, symbol_assignment), sept::Data{sept::Uint32});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(Z, symbol_assignment), sept::Data{sept::Float64(456.75)});
+    // Unbound FreeVars are left as is.
+    LVD_TEST_REQ_EQ(free_var_substitution__data(W, symbol_assignment), sept::Data{W});
+    LVD_TEST_REQ_EQ(
+        free_var_substitution__data(sept::Tuple(X, X, Y, Z, W, sept::Tuple(Cup, HasProperty, Red)), symbol_assignment),
+        sept::Data{sept::Tuple(sept::Uint32, sept::Uint32, sept::Bool, sept::Float64(456.75), W, sept::Tuple(Cup, HasProperty, Red))}
+    );
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::ArrayE(X), symbol_assignment), sept::Data{sept::ArrayE(sept::Uint32)});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::Array(X, Z), symbol_assignment), sept::Data{sept::Array(sept::Uint32, sept::Float64(456.75))});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::OrderedMapDC(X, Y), symbol_assignment), sept::Data{sept::OrderedMapDC(sept::Uint32, sept::Bool)});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::OrderedMapD(X), symbol_assignment), sept::Data{sept::OrderedMapD(sept::Uint32)});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::OrderedMapC(Y), symbol_assignment), sept::Data{sept::OrderedMapC(sept::Bool)});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::Union(X, Y), symbol_assignment), sept::Data{sept::Union(sept::Uint32, sept::Bool)});
+    LVD_TEST_REQ_EQ(free_var_substitution__data(sept::FormalTypeOf(X), symbol_assignment), sept::Data{sept::FormalTypeOf(sept::Uint32)});
+    LVD_TEST_REQ_EQ(
+        free_var_substitution__data(sept::OrderedMapDC(sept::ArrayE(X), sept::ArrayE(W)), symbol_assignment),
+        sept::Data{sept::OrderedMapDC(sept::ArrayE(sept::Uint32), sept::ArrayE(W))}
+    );
+LVD_TEST_END
+
+LVD_TEST_BEGIN(700__substitution__1__template_agrees)
+    // A SubstitutionTemplate substitutes the bindings of a MatchFrame directly, and must agree with
+    // free_var_substitution__data.  W is never bound, so it's left as is.
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    auto Z = sept::FreeVar("Z");
+    auto W = sept::FreeVar("W");
+    auto symbol_assignment = xyz_assignment();
+    sept::MatchVars vars;
+    sept::MatchPattern pattern(sept::Tuple(X, Y, Z), vars);
+    sept::MatchFrame frame(vars.size());
+    // This must be a Data, since the bindings point into it.
+    sept::Data bound = sept::Tuple(sept::Uint32, sept::Bool, sept::Float64(456.75));
+    LVD_TEST_REQ_IS_TRUE(sept::match(pattern, bound, frame));
+    for (auto const &term : {
+        sept::Data{sept::Uint32(3)},
+        sept::Data{W},
+        sept::Data{sept::Tuple(X, sept::Tuple(Cup, HasProperty, Red), Y, W)},
+        sept::Data{sept::Tuple(sept::ArrayE(X), sept::OrderedMapDC(X,Y), sept::Union(Z, W))},
+        sept::Data{sept::OrderedMapDC(sept::ArrayE(X),sept::ArrayE(X))},
+        sept::Data{sept::FormalTypeOf(sept::Array(X, Z))},
+    }) {
+        SubstitutionTemplate substitution_template(term, vars);
+        frame.resize(vars.size());
+        // Instantiating twice gives the same result.
+        for (size_t i = 0; i < 2; ++i)
+            LVD_TEST_REQ_EQ(substitution_template.instantiate(frame), free_var_substitution__data(term, symbol_assignment));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(700__substitution__2__derive_beliefs_2)
+    // derive_beliefs_2 substitutes into the conclusion via a SubstitutionTemplate.
+    auto X = sept::FreeVar("X");
+    auto Y = sept::FreeVar("Y");
+    BeliefSystem bs;
+    bs.add_belief(SubjVerbObj(Charlie, HasProperty, Smart));
+    bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    bs.add_belief(Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat)));
+    bs.derive_beliefs_2(smart_likes_cats_rule());
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Charlie, LikesA, Cat)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Alice, LikesA, Cat)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Dave, HasProperty, Smart)), Deny);
+    // The conclusions are justified by the beliefs that matched the premise.
+    auto const &justifications = bs.truth_maintenance().justifications_of(SubjVerbObj(Alice, LikesA, Cat));
+    LVD_TEST_REQ_EQ(justifications.size(), size_t(1));
+    LVD_TEST_REQ_EQ(justifications[0].m_premises.size(), size_t(1));
+    LVD_TEST_REQ_EQ(justifications[0].m_premises[0], sept::Data{SubjVerbObj(Alice, HasProperty, Smart)});
+
+    // A FreeVar in the conclusion that isn't in the premise is left as is.
+    bs.derive_beliefs_2(Implication(SubjVerbObj(X, HasProperty, Smart), Implies, SubjVerbObj(X, LikesEntity, Y)), false);
+    LVD_TEST_REQ_IS_TRUE(bs.contains_belief(SubjVerbObj(Alice, LikesEntity, Y)));
+LVD_TEST_END
@@ -0,0 +1,98 @@
+// 2021.05.29 - Victor Dods
+
+#include "fixtures.hpp"
+#include <lvd/test.hpp>
+#include "sept/FreeVar.hpp"
+#include "sept/Tuple.hpp"
+
+namespace {
+
+// Smart people like cats and vice versa (so that Smart and LikesA Cat justify each other in a cycle),
+// and smart people tell the truth.
+void add_cyclic_rules (BeliefSystem &bs) {
+    auto X = sept::FreeVar("X");
+    bs.add_rule(smart_likes_cats_rule());
+    bs.add_rule(Implication(SubjVerbObj(X, LikesA, Cat), Implies, SubjVerbObj(X, HasProperty, Smart)));
+    bs.add_rule(smart_tells_truth_rule());
+}
+
+void add_tms_beliefs (BeliefSystem &bs) {
+    bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+    bs.add_belief(SubjVerbObj(Bob, Says, SubjVerbObj(Charlie, HasProperty, Smart)));
+    bs.add_belief(SubjVerbObj(Charlie, HasProperty, Smart));
+}
+
+} // end namespace
+
+LVD_TEST_BEGIN(400__tms__0__retraction_withdraws_unsupported_beliefs)
+    BeliefSystem bs;
+    add_cyclic_rules(bs);
+    add_tms_beliefs(bs);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, LikesA, Cat)), Accept);
+    // Charlie being smart is asserted, and also derived from Bob saying so.
+    LVD_TEST_REQ_IS_TRUE(bs.truth_maintenance().is_asserted(SubjVerbObj(Charlie, HasProperty, Smart)));
+    LVD_TEST_REQ_LT(size_t(0), bs.truth_maintenance().justifications_of(SubjVerbObj(Charlie, HasProperty, Smart)).size());
+
+    // Retracting Alice being smart withdraws everything derived from it, even though Alice being smart
+    // and liking cats justify each other, but Charlie is still smart, since that was also asserted.
+    auto withdrawn_beliefs = bs.remove_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    LVD_TEST_REQ_EQ(withdrawn_beliefs.size(), size_t(4));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Alice, HasProperty, Smart)), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Alice, LikesA, Cat)), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, HasProperty, Smart)), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Bob, LikesA, Cat)), Unknown);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Charlie, HasProperty, Smart)), Accept);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(SubjVerbObj(Charlie, LikesA, Cat)), Accept);
+    // Only the justification from Charlie liking cats is left.
+    LVD_TEST_REQ_EQ(bs.truth_maintenance().justifications_of(SubjVerbObj(Charlie, HasProperty, Smart)).size(), size_t(1));
+    for (auto const &withdrawn_belief : withdrawn_beliefs) {
+        LVD_TEST_REQ_IS_FALSE(bs.contains_belief(withdrawn_belief));
+        LVD_TEST_REQ_IS_FALSE(bs.truth_maintenance().contains(withdrawn_belief));
+    }
+LVD_TEST_END
+
+LVD_TEST_BEGIN(400__tms__1__derived_beliefs_stay_and_readding_rederives)
+    BeliefSystem bs;
+    add_cyclic_rules(bs);
+    add_tms_beliefs(bs);
+    auto belief_set = bs.belief_set();
+
+    // Retracting a belief that's still derived from others doesn't withdraw it.
+    LVD_TEST_REQ_IS_TRUE(bs.remove_belief(SubjVerbObj(Charlie, LikesA, Cat)).empty());
+    LVD_TEST_REQ_IS_TRUE(bs.contains_belief(SubjVerbObj(Charlie, LikesA, Cat)));
+    // Nor does retracting a belief that isn't held.
+    LVD_TEST_REQ_IS_TRUE(bs.remove_belief(SubjVerbObj(Dave, LikesA, Cat)).empty());
+
+    // Re-adding a retracted belief re-derives exactly what was withdrawn.
+    auto withdrawn_beliefs = bs.remove_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    LVD_TEST_REQ_EQ(bs.belief_set().size() + withdrawn_beliefs.size(), belief_set.size());
+    bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set() == belief_set);
+LVD_TEST_END
+
+LVD_TEST_BEGIN(400__tms__2__remove_applies_to_the_canonical_form)
+    sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+    sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+    BeliefSystem bs;
+
+    // A Predicate_And is added as its operands, and removing it retracts each of them.
+    bs.add_belief(Predicate_And(And, sept::Tuple(a, b)));
+    LVD_TEST_REQ_EQ(bs.belief_set().size(), size_t(2));
+    LVD_TEST_REQ_EQ(bs.remove_belief(Predicate_And(And, sept::Tuple(a, b))).size(), size_t(2));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+
+    // not(a or b) is added as not(a) and not(b), and removing it retracts both.
+    bs.add_belief(Predicate_Not(Not, Predicate_Or(Or, sept::Tuple(a, b))));
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(a), Deny);
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(b), Deny);
+    LVD_TEST_REQ_EQ(bs.remove_belief(Predicate_Not(Not, Predicate_Or(Or, sept::Tuple(a, b)))).size(), size_t(2));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+
+    // not(a and b) is added as not(a) or not(b).
+    bs.add_belief(Predicate_Not(Not, Predicate_And(And, sept::Tuple(a, b))));
+    LVD_TEST_REQ_EQ(bs.belief_set().size(), size_t(1));
+    LVD_TEST_REQ_EQ(bs.remove_belief(Predicate_Not(Not, Predicate_And(And, sept::Tuple(a, b)))).size(), size_t(1));
+    LVD_TEST_REQ_IS_TRUE(bs.belief_set().empty());
+    LVD_TEST_REQ_EQ(bs.evaluate_predicate(Predicate_Not(Not, Predicate_And(And, sept::Tuple(a, b)))), Unknown);
+LVD_TEST_END
@@ -2,8 +2,11 @@
 
 #include "ast.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include "sept/DataVector.hpp"
 #include "sept/FormalTypeOf.hpp"
+#include "sept/FreeVar.hpp"
 #include "sept/Tuple.hpp"
 
 sept::TupleTerm_c const SubjVerbObj = sept::Tuple(sept::Term, Verb, sept::Term);
@@ -23,6 +26,17 @@ ThinkyNPTerm demorganize_bool_bin_op (ThinkyNPTerm t) {
     }
 }
 
+// Sorts the operands, since And, Or and Xor are commutative, and removes duplicates for And and Or, which
+// are idempotent (unlike Xor, for which a duplicate pair cancels out).
+sept::Data canonical_bool_bin_op_predicate (ThinkyNPTerm bool_bin_op, sept::DataVector &&operands) {
+    std::sort(operands.begin(), operands.end(), [](sept::Data const &lhs, sept::Data const &rhs){
+        return compare_predicates(lhs, rhs) < 0;
+    });
+    if (bool_bin_op != Xor)
+        operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+    return sept::Tuple(bool_bin_op, sept::TupleTerm_c(std::move(operands)));
+}
+
 sept::Data negated_demorganize_data (sept::Data const &predicate) {
     if (false) {
         // SPLUNGE
@@ -42,7 +56,7 @@ sept::Data negated_demorganize_data (sept::Data const &predicate) {
             negated_elements.emplace_back(negated_demorganize_data(operand));
 
         // demorganize_bool_bin_op switches the op as necessary.
-        return sept::Tuple(demorganize_bool_bin_op(bool_bin_op), sept::TupleTerm_c(std::move(negated_elements)));
+        return canonical_bool_bin_op_predicate(demorganize_bool_bin_op(bool_bin_op), std::move(negated_elements));
     } else {
         // Simply apply the negation to the predicate.
         return Predicate_Not(Not, predicate);
@@ -77,9 +91,112 @@ sept::Data demorganize_data (sept::Data const &predicate) {
         for (auto const &operand : operand_tuple.elements())
             elements.emplace_back(demorganize_data(operand));
 
-        return sept::Tuple(bool_bin_op, sept::TupleTerm_c(std::move(elements)));
+        return canonical_bool_bin_op_predicate(bool_bin_op, std::move(elements));
     } else {
         // If it's not a logical predicate, then there's no transform to do.
         return predicate;
     }
 }
+
+bool can_demorganize (sept::Data const &predicate) {
+    if (false) {
+        // SPLUNGE
+    } else if (inhabits_data(predicate, Implication)) {
+        return false;
+    } else if (inhabits_data(predicate, Predicate_Not)) {
+        return can_demorganize(predicate.cast<sept::TupleTerm_c const &>()[1]);
+    } else if (inhabits_data(predicate, Predicate_BoolBinOp)) {
+        auto const &operands = predicate.cast<sept::TupleTerm_c const &>()[1].cast<sept::TupleTerm_c const &>().elements();
+        return std::all_of(operands.begin(), operands.end(), can_demorganize);
+    } else {
+        return true;
+    }
+}
+
+int compare_predicates (sept::Data const &lhs, sept::Data const &rhs) {
+    // ThinkyNPTerms come first, then Tuples, then FreeVars, then anything else.
+    auto kind_of = [](sept::Data const &data) -> int {
+        if (data.can_cast<ThinkyNPTerm>())
+            return 0;
+        else if (data.can_cast<sept::TupleTerm_c>())
+            return 1;
+        else if (data.can_cast<sept::FreeVarTerm_c>())
+            return 2;
+        else
+            return 3;
+    };
+    auto lhs_kind = kind_of(lhs);
+    auto rhs_kind = kind_of(rhs);
+    if (lhs_kind != rhs_kind)
+        return lhs_kind - rhs_kind;
+    switch (lhs_kind) {
+        case 0:
+            return compare(ThinkyNPTerm_CType(lhs.cast<ThinkyNPTerm>()), ThinkyNPTerm_CType(rhs.cast<ThinkyNPTerm>()));
+        case 1: {
+            auto const &lhs_elements = lhs.cast<sept::TupleTerm_c const &>().elements();
+            auto const &rhs_elements = rhs.cast<sept::TupleTerm_c const &>().elements();
+            if (lhs_elements.size() != rhs_elements.size())
+                return lhs_elements.size() < rhs_elements.size() ? -1 : 1;
+            for (size_t i = 0; i < lhs_elements.size(); ++i)
+                if (auto c = compare_predicates(lhs_elements[i], rhs_elements[i]); c != 0)
+                    return c;
+            return 0;
+        }
+        case 2:
+            return lhs.cast<sept::FreeVarTerm_c const &>().free_var_id__as_string().compare(rhs.cast<sept::FreeVarTerm_c const &>().free_var_id__as_string());
+        default: {
+            if (lhs == rhs)
+                return 0;
+            // compare_data doesn't order most term types, so order by type name (not by the address of the
+            // name, which can vary between runs), and then by printed form.
+            if (auto c = std::strcmp(lhs.type().name(), rhs.type().name()); c != 0)
+                return c;
+            return LVD_FMT(lhs).compare(LVD_FMT(rhs));
+        }
+    }
+}
+
+sept::Data const &PredicateCanonicalizer::canonical_form (sept::Data const &predicate) {
+    if (!inhabits_data(predicate, Implication) && !inhabits_data(predicate, Predicate_Not) && !inhabits_data(predicate, Predicate_BoolBinOp))
+        return predicate;
+
+    if (auto it = m_memo.find(predicate); it != m_memo.end()) {
+        ++m_hit_count;
+        return *it->second;
+    }
+
+    ++m_miss_count;
+    auto canonical = demorganize_data(predicate);
+    if (m_memo.size() + 2 > MAX_MEMO_SIZE) {
+        m_memo.clear();
+        m_negation_memo.clear();
+    }
+    // demorganize_data is idempotent, so if the canonical form is already a key, then it's already marked
+    // as canonical.
+    auto canonical_it = m_memo.emplace(std::move(canonical), nullptr).first;
+    canonical_it->second = &canonical_it->first;
+    if (canonical_it->first != predicate)
+        m_memo.emplace(predicate, &canonical_it->first);
+    return canonical_it->first;
+}
+
+sept::Data const &PredicateCanonicalizer::canonical_negation (sept::Data const &predicate) {
+    if (auto it = m_negation_memo.find(predicate); it != m_negation_memo.end()) {
+        ++m_hit_count;
+        return *it->second;
+    }
+
+    // canonical_form counts this as a hit or a miss.  A Predicate_Not is always entered into m_memo, so
+    // the result isn't the temporary.
+    auto const &canonical = canonical_form(Predicate_Not(Not, predicate));
+    if (m_negation_memo.size() + 1 > MAX_MEMO_SIZE)
+        m_negation_memo.clear();
+    m_negation_memo.emplace(predicate, &canonical);
+    return canonical;
+}
+
+sept::Data contrapositive (sept::Data const &implication) {
+    assert(inhabits_data(implication, Implication));
+    // TODO: Write extractions
+    return Implication(Predicate_Not(Not, implication[2]), Implies, Predicate_Not(Not, implication[0]));
+}
@@ -5,6 +5,7 @@
 #include "common.hpp"
 
 #include "sept/TupleTerm.hpp"
+#include <unordered_map>
 
 extern sept::TupleTerm_c const SubjVerbObj;
 extern sept::TupleTerm_c const Implication;
@@ -15,5 +16,60 @@ extern sept::TupleTerm_c const Predicate_Or;
 extern sept::TupleTerm_c const Predicate_Xor;
 extern sept::TupleTerm_c const Predicate_BoolBinOp;
 
-// Changes the given predicate into its canonical form using deMorgan's laws.
+// Changes the given predicate into its canonical form using deMorgan's laws.  The operands of And, Or
+// and Xor are sorted (see compare_predicates), since they commute, and duplicate operands of And and Or
+// are removed, so that equivalent predicates are equal (and hash the same).
 sept::Data demorganize_data (sept::Data const &predicate);
+// Returns false iff demorganize_data would abort, i.e. if the predicate contains an Implication (within
+// Predicate_Nots and Predicate_BoolBinOps), which isn't handled yet.
+bool can_demorganize (sept::Data const &predicate);
+
+// A total order on predicates, used for sorting the operands of commutative predicates.  Unlike
+// compare_data, this orders Tuples elementwise, and it doesn't depend on addresses or hashes, so that
+// canonical forms are the same from run to run (e.g. in a BeliefStore).
+int compare_predicates (sept::Data const &lhs, sept::Data const &rhs);
+
+// Memoizes demorganize_data, since BeliefSystem canonicalizes every belief and premise, and the same
+// compound predicates recur.  A predicate that isn't an Implication, Predicate_Not or Predicate_BoolBinOp
+// is already canonical, which is determined from its top level alone, so it's returned as is, without
+// being looked up or copied.  Each canonical form is entered into the memo as its own canonical form, so
+// canonicalizing it again takes a single lookup.  The canonical forms of negations are memoized too (see
+// canonical_negation), since BeliefSystem::evaluate_predicate looks them up.  Not thread-safe.
+class PredicateCanonicalizer {
+public:
+
+    PredicateCanonicalizer ()
+        :   m_hit_count(0)
+        ,   m_miss_count(0)
+    { }
+
+    // Returns the canonical form of the predicate, which is either the predicate itself or an element of
+    // the memo, which is only valid until the next call (since that may clear the memo).
+    sept::Data const &canonical_form (sept::Data const &predicate);
+    // Returns the canonical form of Predicate_Not(Not, predicate), which is an element of the memo, and
+    // so is only valid until the next call.  Predicate_Not(Not, predicate) is only constructed the first
+    // time, and after that this takes a single lookup.
+    sept::Data const &canonical_negation (sept::Data const &predicate);
+
+    size_t memo_size () const { return m_memo.size(); }
+    size_t hit_count () const { return m_hit_count; }
+    size_t miss_count () const { return m_miss_count; }
+    void clear () { m_memo.clear(); m_negation_memo.clear(); }
+
+private:
+
+    // Past this, the memo is cleared instead of growing without bound.
+    static size_t constexpr MAX_MEMO_SIZE = size_t(1) << 16;
+
+    // Maps each compound predicate to its canonical form, as a pointer to the key of the latter's entry
+    // (which doesn't move, since this is node-based).
+    std::unordered_map<sept::Data,sept::Data const *> m_memo;
+    // Maps each predicate to the canonical form of its negation, as a pointer to a key of m_memo, so
+    // this is cleared whenever m_memo is.
+    std::unordered_map<sept::Data,sept::Data const *> m_negation_memo;
+    size_t m_hit_count;
+    size_t m_miss_count;
+};
+
+// Returns the contrapositive of the given Implication, i.e. not(q) => not(p) for p => q.
+sept::Data contrapositive (sept::Data const &implication);
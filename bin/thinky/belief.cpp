@@ -2,13 +2,141 @@
 
 #include "belief.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include "ast.hpp"
+#include <chrono>
 #include "common.hpp"
 #include "pattern.hpp"
 #include <lvd/abort.hpp>
 #include <lvd/cloned.hpp>
 #include <lvd/comma.hpp>
 #include <lvd/fmt.hpp>
+#include <memory>
+#include "sept/Match.hpp"
+#include <thread>
+
+namespace {
+
+// One alternative (see rule_alternatives) of a rule of inference, compiled for BeliefSystem::saturate.
+struct SaturationRule {
+    sept::Data m_inference;
+    sept::MatchVars m_vars;
+    std::vector<sept::MatchPattern> m_conjuncts;
+    sept::Data m_conclusion;
+    // Compiled after the conjuncts, so that it shares their slots.
+    std::optional<SubstitutionTemplate> m_conclusion_template;
+
+    SaturationRule (std::vector<sept::Data> const &conjuncts, sept::Data const &inference)
+        :   m_inference(inference)
+        ,   m_conclusion(inference[2])
+    {
+        m_conjuncts.reserve(conjuncts.size());
+        for (auto const &conjunct : conjuncts)
+            m_conjuncts.emplace_back(conjunct, m_vars);
+        m_conclusion_template.emplace(m_conclusion, m_vars);
+    }
+};
+
+// A unit of work within a round of BeliefSystem::saturate: joining rule's premise, with conjunct
+// m_delta_conjunct matched against delta candidates [m_begin, m_end), against the other beliefs.
+struct SaturationTask {
+    SaturationRule const *m_rule;
+    size_t m_rule_index;
+    size_t m_delta_conjunct;
+    size_t m_begin;
+    size_t m_end;
+    // The results: for each complete match, the conclusion, and the beliefs that matched the conjuncts.
+    std::vector<sept::Data> m_conclusions;
+    std::vector<std::vector<sept::Data>> m_premises;
+    size_t m_join_count = 0;
+};
+
+// The candidates (see BeliefIndex::candidate_belief_ptrs) for one conjunct in a round of saturate.
+// m_all is only needed if another conjunct of the rule has delta candidates to join against it, and is
+// otherwise left empty.
+struct SaturationCandidates {
+    std::vector<sept::Data const *> m_delta;
+    std::vector<sept::Data const *> m_all;
+};
+
+class SaturationJoiner {
+public:
+
+    SaturationJoiner (
+        SaturationTask &task,
+        std::vector<SaturationCandidates> const &candidates,
+        std::unordered_set<sept::Data const *> const &delta
+    )   :   m_task(task)
+        ,   m_candidates(candidates)
+        ,   m_delta(delta)
+        ,   m_frame(task.m_rule->m_vars.size())
+        ,   m_premises(task.m_rule->m_conjuncts.size(), nullptr)
+    { }
+
+    void run () {
+        auto i = m_task.m_delta_conjunct;
+        auto const &delta_candidates = m_candidates[i].m_delta;
+        for (size_t k = m_task.m_begin; k < m_task.m_end; ++k) {
+            ++m_task.m_join_count;
+            if (sept::match(m_task.m_rule->m_conjuncts[i], *delta_candidates[k], m_frame)) {
+                m_premises[i] = delta_candidates[k];
+                join(0);
+                m_frame.clear();
+            }
+        }
+    }
+
+private:
+
+    // Extends the current match with conjunct j onward.  Conjuncts before the delta conjunct only match
+    // beliefs from before this round's delta, so that a combination involving several delta beliefs is
+    // only produced by the task whose delta conjunct is the first of them.
+    void join (size_t j) {
+        auto const &conjuncts = m_task.m_rule->m_conjuncts;
+        if (j == m_task.m_delta_conjunct)
+            ++j;
+        if (j == conjuncts.size()) {
+            m_task.m_conclusions.emplace_back(m_task.m_rule->m_conclusion_template->instantiate(m_frame));
+            std::vector<sept::Data> premises;
+            premises.reserve(m_premises.size());
+            for (auto const *premise : m_premises)
+                premises.emplace_back(*premise);
+            m_task.m_premises.emplace_back(std::move(premises));
+            return;
+        }
+        for (auto const *belief : m_candidates[j].m_all) {
+            if (j < m_task.m_delta_conjunct && m_delta.find(belief) != m_delta.end())
+                continue;
+            ++m_task.m_join_count;
+            auto trail_mark = m_frame.trail_mark();
+            if (sept::match(conjuncts[j], *belief, m_frame)) {
+                m_premises[j] = belief;
+                join(j+1);
+                m_frame.undo_to(trail_mark);
+            }
+        }
+    }
+
+    SaturationTask &m_task;
+    std::vector<SaturationCandidates> const &m_candidates;
+    // This round's delta beliefs, which (like the candidates) point into the BeliefSystem's belief set,
+    // so membership is checked by address, without hashing the beliefs.
+    std::unordered_set<sept::Data const *> const &m_delta;
+    sept::MatchFrame m_frame;
+    // The belief matched by each conjunct so far.
+    std::vector<sept::Data const *> m_premises;
+};
+
+} // end namespace
+
+std::ostream &operator<< (std::ostream &out, SaturationRoundStats const &stats) {
+    return out << "SaturationRoundStats{delta_size = " << stats.m_delta_size
+               << ", join_count = " << stats.m_join_count
+               << ", conclusion_count = " << stats.m_conclusion_count
+               << ", new_belief_count = " << stats.m_new_belief_count
+               << ", duration_s = " << stats.m_duration_s << '}';
+}
 
 std::string const &as_string (BeliefState t) {
     static std::array<std::string,BELIEF_STATE_COUNT> const TABLE{
@@ -20,28 +148,58 @@ std::string const &as_string (BeliefState t) {
 }
 
 BeliefState BeliefSystem::evaluate_predicate (sept::Data const &predicate) const {
+    if (m_evaluation_memo_generation != m_generation) {
+        m_evaluation_memo.clear();
+        m_evaluation_memo_generation = m_generation;
+    }
+    auto predicate_hash = std::hash<sept::Data>()(predicate);
+    auto it = m_evaluation_memo.find(predicate_hash);
+    if (it != m_evaluation_memo.end()) {
+        ++m_evaluation_memo_hit_count;
+        return it->second;
+    }
+    ++m_evaluation_memo_miss_count;
+    auto belief_state = evaluate_predicate__uncached(predicate);
+    m_evaluation_memo.emplace(predicate_hash, belief_state);
+    return belief_state;
+}
+
+BeliefState BeliefSystem::evaluate_predicate__uncached (sept::Data const &predicate) const {
     // Check if the predicate is a verbatim belief already.
     if (contains_belief(predicate))
         return Accept;
-    // Also check the negation.  Not very efficient.  Also this won't work in general because
-    // stuff isn't put into a canonical form using deMorgan's laws.
-    if (contains_belief(Predicate_Not(Not, predicate)))
+    // Beliefs are added in canonical form, so e.g. an Or whose operands are in a different order is
+    // still found.
+    bool is_compound = (inhabits_data(predicate, Predicate_Not) || inhabits_data(predicate, Predicate_BoolBinOp)) && can_demorganize(predicate);
+    if (is_compound) {
+        auto const &canonical_predicate = m_canonicalizer.canonical_form(predicate);
+        if (&canonical_predicate != &predicate && contains_belief(canonical_predicate))
+            return Accept;
+    }
+    // Also check the negation.  The negation of a compound predicate is stored in canonical form (e.g.
+    // Not(And(a,b)) as Or(Not(a),Not(b))), and so isn't a Predicate_Not, so look up that form as well.
+    if (contains_negation_of(predicate))
+        return Deny;
+    if (is_compound && contains_belief(m_canonicalizer.canonical_negation(predicate)))
         return Deny;
 
+    // The operands are accessed in place, rather than via element_of_data (i.e. predicate[i]), which
+    // would copy them, and are evaluated via evaluate_predicate, so that a subpredicate shared between
+    // predicates (or evaluated on its own later) is only evaluated once.
     // TODO: Use StaticAssociation_t
     if (false) {
         // SPLUNGE
     } else if (inhabits_data(predicate, Implication)) {
-        // TODO: Extract functions
-        auto premise = predicate[0];
-        auto conclusion = predicate[1];
+        auto const &elements = predicate.cast<sept::TupleTerm_c const &>().elements();
+        auto const &premise = elements[0];
+        auto const &conclusion = elements[2];
         return or__belief_state(not__belief_state(evaluate_predicate(premise)), evaluate_predicate(conclusion));
     } else if (inhabits_data(predicate, Predicate_Not)) {
-        return not__belief_state(evaluate_predicate(predicate[1]));
+        return not__belief_state(evaluate_predicate(predicate.cast<sept::TupleTerm_c const &>()[1]));
     } else if (inhabits_data(predicate, Predicate_And)) {
-        auto operand_tuple = predicate[1].move_cast<sept::TupleTerm_c>();
+        auto const &operands = predicate.cast<sept::TupleTerm_c const &>()[1].cast<sept::TupleTerm_c const &>().elements();
         BeliefState retval = Accept; // Identity element of `and` operation.
-        for (auto const &operand : operand_tuple.elements()) {
+        for (auto const &operand : operands) {
             retval = and__belief_state(retval, evaluate_predicate(operand));
             // If we break away from Accept, then it could be Deny or Unknown, either of which causes an early out.
             if (retval != Accept)
@@ -49,9 +207,9 @@ BeliefState BeliefSystem::evaluate_predicate (sept::Data const &predicate) const
         }
         return retval;
     } else if (inhabits_data(predicate, Predicate_Or)) {
-        auto operand_tuple = predicate[1].move_cast<sept::TupleTerm_c>();
+        auto const &operands = predicate.cast<sept::TupleTerm_c const &>()[1].cast<sept::TupleTerm_c const &>().elements();
         BeliefState retval = Deny; // Identity element of `or` operation.
-        for (auto const &operand : operand_tuple.elements()) {
+        for (auto const &operand : operands) {
             retval = or__belief_state(retval, evaluate_predicate(operand));
             // If we break away from Deny, then it could be Accept or Unknown, either of which causes an early out.
             if (retval != Deny)
@@ -59,11 +217,13 @@ BeliefState BeliefSystem::evaluate_predicate (sept::Data const &predicate) const
         }
         return retval;
     } else if (inhabits_data(predicate, Predicate_Xor)) {
-        auto operand_tuple = predicate[1].move_cast<sept::TupleTerm_c>();
-        BeliefState retval = Deny; // Identity element of `or` operation.
-        for (auto const &operand : operand_tuple.elements()) {
-            retval = or__belief_state(retval, evaluate_predicate(operand));
-            // There is no early out for xor.
+        auto const &operands = predicate.cast<sept::TupleTerm_c const &>()[1].cast<sept::TupleTerm_c const &>().elements();
+        BeliefState retval = Deny; // Identity element of `xor` operation.
+        for (auto const &operand : operands) {
+            retval = xor__belief_state(retval, evaluate_predicate(operand));
+            // Only Unknown causes an early out for xor.
+            if (retval == Unknown)
+                return retval;
         }
         return retval;
     } else {
@@ -83,6 +243,8 @@ void BeliefSystem::derive_beliefs (sept::Data const &inference) {
 
     // NOTE: Because the direct implication and the contrapositive are both acted upon,
     // this could result in some redundancy.
+    // NOTE: evaluate_predicate doesn't say which beliefs it relied on, so the conclusions are added as
+    // assertions rather than with a Justification, and aren't withdrawn when those beliefs are.
 
     // Direct implication.
     switch (evaluate_predicate(premise)) {
@@ -118,8 +280,8 @@ void BeliefSystem::derive_beliefs_2 (sept::Data const &inference, bool also_deri
     assert(inference[1] == Implies);
     auto conclusion = inference[2];
 
-    // TODO: pre-demorganize premise?
-    auto demorganized_premise = demorganize_data(premise);
+    // Copied, since deriving beliefs uses m_canonicalizer.
+    sept::Data demorganized_premise = m_canonicalizer.canonical_form(premise);
     // If the premise is Predicate_And, then it can be broken up into separate predicates and each one
     // dealt with individually.
     if (inhabits_data(demorganized_premise, Predicate_And)) {
@@ -171,14 +333,23 @@ void BeliefSystem::derive_beliefs_2 (sept::Data const &inference, bool also_deri
         lvd::g_log << lvd::Log::trc() << LVD_CALL_SITE() << " - " << LVD_REFLECT(demorganized_premise) << '\n';
         auto ig = lvd::IndentGuard(lvd::g_log);
 
-        for (auto const &belief : belief_set()) {
-            lvd::g_log << lvd::Log::trc() << LVD_CALL_SITE() << " - checking demorganized_premise against " << LVD_REFLECT(belief) << " ...\n";
-            // Most beliefs won't match, so this clone is wasteful.  TODO: Fix.
-            auto match_o = matched_pattern__data(demorganized_premise, lvd::cloned(belief));
-            if (match_o.has_value()) {
-                auto const &match = match_o.value();
-                lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(match) << " -- adding conclusion to belief_set...\n";
-                add_belief(free_var_substitution__data(conclusion, match.symbol_assignment()));
+        // The premise and conclusion are compiled once, and the same MatchFrame is reused for each
+        // belief, so a belief that doesn't match costs no allocations, and one that does is substituted
+        // into the conclusion directly from the bindings.
+        sept::MatchVars match_vars;
+        sept::MatchPattern match_pattern(demorganized_premise, match_vars);
+        // Compiled after the premise, so that it shares its slots.
+        SubstitutionTemplate conclusion_template(conclusion, match_vars);
+        sept::MatchFrame match_frame(match_vars.size());
+        // Only the beliefs that the index can't rule out are checked.  Adding beliefs below doesn't
+        // remove any, so the pointers stay valid, and only the matching beliefs are copied.
+        for (auto const *belief : m_belief_index.candidate_belief_ptrs(demorganized_premise)) {
+            lvd::g_log << lvd::Log::trc() << LVD_CALL_SITE() << " - checking demorganized_premise against " << LVD_REFLECT(*belief) << " ...\n";
+            if (sept::match(match_pattern, *belief, match_frame)) {
+                auto derived_belief = conclusion_template.instantiate(match_frame);
+                match_frame.clear();
+                lvd::g_log << lvd::Log::dbg() << "matched " << *belief << " -- adding conclusion " << derived_belief << " to belief_set...\n";
+                add_beliefs(std::vector<Derivation>{Derivation{std::move(derived_belief), Justification{inference, {*belief}}}});
             }
         }
     }
@@ -191,18 +362,302 @@ void BeliefSystem::derive_beliefs_2 (sept::Data const &inference, bool also_deri
 }
 
 void BeliefSystem::add_belief (sept::Data const &belief) {
-    auto demorganized_belief = demorganize_data(belief);
-    // If a belief is Predicate_And, then it can be broken up into separate beliefs and each one added.
-    // Otherwise it's just added as is.
-    if (inhabits_data(demorganized_belief, Predicate_And)) {
-        auto operand_tuple = demorganized_belief[1].move_cast<sept::TupleTerm_c>();
-        for (auto const &operand : operand_tuple.elements()) {
-            lvd::g_log << lvd::Log::dbg() << "adding belief: " << operand << '\n';
-            m_belief_set.insert(operand);
+    std::vector<sept::Data const *> new_beliefs;
+    insert_belief(belief, nullptr, new_beliefs);
+    std::vector<Derivation> fired_conclusions;
+    fire_rules(new_beliefs, fired_conclusions);
+    add_beliefs(std::move(fired_conclusions));
+}
+
+std::vector<sept::Data> BeliefSystem::remove_belief (sept::Data const &belief) {
+    std::vector<sept::Data> withdrawn_beliefs;
+    auto retract = [&](sept::Data const &b) {
+        for (auto &withdrawn_belief : m_truth_maintenance.retract(b)) {
+            lvd::g_log << lvd::Log::dbg() << "withdrawing belief: " << withdrawn_belief << '\n';
+            // The RuleNetwork points into m_belief_set, so remove the belief from it first.
+            auto it = m_belief_set.find(withdrawn_belief);
+            if (it != m_belief_set.end())
+                m_rule_network.remove_belief(*it);
+            erase_from_belief_set(withdrawn_belief);
+            withdrawn_beliefs.emplace_back(std::move(withdrawn_belief));
+        }
+    };
+
+    // Retract what insert_belief asserted, i.e. the canonical form, or its operands if it's a
+    // Predicate_And.  This is only valid until the next call to m_canonicalizer, which retract doesn't make.
+    auto const &canonical_belief = m_canonicalizer.canonical_form(belief);
+    if (inhabits_data(canonical_belief, Predicate_And)) {
+        for (auto const &operand : canonical_belief.cast<sept::TupleTerm_c const &>()[1].cast<sept::TupleTerm_c const &>().elements())
+            retract(operand);
+    } else {
+        retract(canonical_belief);
+    }
+    return withdrawn_beliefs;
+}
+
+void BeliefSystem::restore (std::vector<sept::Data> const &assertions, std::vector<Derivation> const &derivations) {
+    if (!m_belief_set.empty())
+        throw std::runtime_error("BeliefSystem::restore requires an empty belief set");
+
+    // This overcounts beliefs that have several justifications, but it avoids rehashing and rebuilding
+    // the filters while inserting.
+    auto expected_count = assertions.size() + derivations.size();
+    auto expected_negated_count =
+        std::count_if(assertions.begin(), assertions.end(), [](sept::Data const &belief){ return inhabits_data(belief, Predicate_Not); }) +
+        std::count_if(derivations.begin(), derivations.end(), [](Derivation const &derivation){ return inhabits_data(derivation.m_belief, Predicate_Not); });
+    m_belief_set.reserve(expected_count);
+    m_belief_filter.reset(expected_count);
+    m_negated_belief_filter.reset(expected_negated_count);
+    std::vector<sept::Data const *> new_beliefs;
+    for (auto const &belief : assertions)
+        if (auto const *inserted_belief = insert_into_belief_set(belief))
+            new_beliefs.push_back(inserted_belief);
+    for (auto const &derivation : derivations)
+        if (auto const *inserted_belief = insert_into_belief_set(derivation.m_belief))
+            new_beliefs.push_back(inserted_belief);
+    m_truth_maintenance.restore(assertions, derivations);
+
+    // The rules' conclusions are normally already present, in which case this only records them.
+    std::vector<Derivation> fired_conclusions;
+    fire_rules(new_beliefs, fired_conclusions);
+    add_beliefs(std::move(fired_conclusions));
+}
+
+void BeliefSystem::add_rule (sept::Data const &inference, bool also_add_contrapositive) {
+    lvd::g_log << lvd::Log::dbg() << "adding rule: " << inference << '\n';
+    std::vector<Derivation> fired_conclusions;
+    m_rule_network.add_rule(inference, m_belief_index, fired_conclusions);
+    if (also_add_contrapositive) {
+        auto contrapositive_rule = contrapositive(inference);
+        if (RuleNetwork::can_add_rule(contrapositive_rule)) {
+            lvd::g_log << lvd::Log::dbg() << "adding rule: " << contrapositive_rule << '\n';
+            m_rule_network.add_rule(contrapositive_rule, m_belief_index, fired_conclusions);
+        } else {
+            lvd::g_log << lvd::Log::dbg() << "not adding contrapositive " << contrapositive_rule << ", since its conclusion would have unbound FreeVars\n";
+        }
+    }
+    add_beliefs(std::move(fired_conclusions));
+}
+
+std::vector<SaturationRoundStats> BeliefSystem::saturate (std::vector<sept::Data> const &rules, size_t thread_count, bool also_use_contrapositives) {
+    if (thread_count == 0)
+        throw std::runtime_error("saturate needs at least 1 thread");
+
+    // Compile all the rules before deriving anything, so that nothing is added if one of them throws.
+    std::vector<std::unique_ptr<SaturationRule>> compiled_rules;
+    auto compile_rule = [&](sept::Data const &inference) {
+        for (auto const &conjuncts : rule_alternatives(inference))
+            compiled_rules.emplace_back(std::make_unique<SaturationRule>(conjuncts, inference));
+    };
+    for (auto const &rule : rules) {
+        lvd::g_log << lvd::Log::dbg() << "saturating with rule: " << rule << '\n';
+        compile_rule(rule);
+        if (also_use_contrapositives) {
+            auto contrapositive_rule = contrapositive(rule);
+            if (RuleNetwork::can_add_rule(contrapositive_rule))
+                compile_rule(contrapositive_rule);
+            else
+                lvd::g_log << lvd::Log::dbg() << "not using contrapositive " << contrapositive_rule << ", since its conclusion would have unbound FreeVars\n";
+        }
+    }
+
+    std::vector<SaturationRoundStats> round_stats;
+    // The delta beliefs point into m_belief_set, which saturate only adds to.  The first round's delta
+    // is all the beliefs, so every combination is joined once.
+    std::vector<sept::Data const *> delta_beliefs;
+    delta_beliefs.reserve(m_belief_set.size());
+    for (auto const &belief : m_belief_set)
+        delta_beliefs.push_back(&belief);
+    bool is_first_round = true;
+    while (!delta_beliefs.empty() || is_first_round) {
+        auto start_time = std::chrono::steady_clock::now();
+        SaturationRoundStats stats{delta_beliefs.size(), 0, 0, 0, 0.0};
+
+        std::unordered_set<sept::Data const *> delta(delta_beliefs.begin(), delta_beliefs.end());
+        BeliefIndex delta_index;
+        for (auto const *belief : delta_beliefs)
+            delta_index.insert(*belief);
+
+        // The candidates are found up front, so the tasks only read shared state.  They point into
+        // m_belief_set, which doesn't change until the conclusions are added.
+        std::vector<std::vector<SaturationCandidates>> candidates(compiled_rules.size());
+        std::vector<SaturationTask> tasks;
+        // A rule with no conjuncts fires unconditionally, so only in the first round.
+        std::vector<size_t> unconditional_rule_indices;
+        for (size_t r = 0; r < compiled_rules.size(); ++r) {
+            auto const &conjuncts = compiled_rules[r]->m_conjuncts;
+            if (conjuncts.empty()) {
+                if (is_first_round)
+                    unconditional_rule_indices.push_back(r);
+                continue;
+            }
+            candidates[r].resize(conjuncts.size());
+            size_t nonempty_delta_count = 0;
+            for (size_t i = 0; i < conjuncts.size(); ++i) {
+                candidates[r][i].m_delta = delta_index.candidate_belief_ptrs(conjuncts[i].pattern());
+                if (!candidates[r][i].m_delta.empty())
+                    ++nonempty_delta_count;
+            }
+            // Conjunct i's full candidates are only joined against if some other conjunct has delta
+            // candidates, so that a round with a small delta doesn't cost as much as the whole index.
+            for (size_t i = 0; i < conjuncts.size(); ++i) {
+                bool is_joined_against = nonempty_delta_count > (candidates[r][i].m_delta.empty() ? 0 : 1);
+                if (is_joined_against)
+                    candidates[r][i].m_all = m_belief_index.candidate_belief_ptrs(conjuncts[i].pattern());
+            }
+            for (size_t i = 0; i < conjuncts.size(); ++i) {
+                // Split the delta candidates into chunks so that the threads can share the work.
+                auto delta_candidate_count = candidates[r][i].m_delta.size();
+                auto chunk_size = std::max(size_t(1), (delta_candidate_count + 4*thread_count - 1) / (4*thread_count));
+                for (size_t begin = 0; begin < delta_candidate_count; begin += chunk_size)
+                    tasks.push_back(SaturationTask{compiled_rules[r].get(), r, i, begin, std::min(begin + chunk_size, delta_candidate_count), {}, {}, 0});
+            }
+        }
+
+        // The tasks don't log or modify anything but themselves.
+        auto run_task = [&](SaturationTask &task) {
+            SaturationJoiner(task, candidates[task.m_rule_index], delta).run();
+        };
+        if (thread_count == 1 || tasks.size() <= 1) {
+            for (auto &task : tasks)
+                run_task(task);
+        } else {
+            std::atomic<size_t> next_task_index{0};
+            auto worker = [&]() {
+                for (size_t t = next_task_index++; t < tasks.size(); t = next_task_index++)
+                    run_task(tasks[t]);
+            };
+            std::vector<std::thread> threads;
+            for (size_t k = 1; k < std::min(thread_count, tasks.size()); ++k)
+                threads.emplace_back(worker);
+            worker();
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+        // Merge the conclusions in task order, which doesn't depend on thread_count.  Only the first
+        // derivation of each new conclusion is added; the others only contribute their justifications.
+        std::vector<Derivation> pending;
+        std::vector<Derivation> redundant;
+        std::unordered_set<sept::Data> conclusion_set;
+        auto add_conclusion = [&](Derivation &&derivation) {
+            ++stats.m_conclusion_count;
+            if (!contains_belief(derivation.m_belief) && conclusion_set.insert(derivation.m_belief).second)
+                pending.emplace_back(std::move(derivation));
+            else
+                redundant.emplace_back(std::move(derivation));
+        };
+        for (auto r : unconditional_rule_indices)
+            add_conclusion(Derivation{compiled_rules[r]->m_conclusion, Justification{compiled_rules[r]->m_inference, {}}});
+        for (auto &task : tasks) {
+            stats.m_join_count += task.m_join_count;
+            for (size_t m = 0; m < task.m_conclusions.size(); ++m)
+                add_conclusion(Derivation{std::move(task.m_conclusions[m]), Justification{task.m_rule->m_inference, std::move(task.m_premises[m])}});
+        }
+
+        delta_beliefs.clear();
+        add_beliefs(std::move(pending), &delta_beliefs);
+        for (auto const &derivation : redundant) {
+            std::vector<sept::Data const *> new_beliefs;
+            insert_belief(derivation.m_belief, &derivation.m_justification, new_beliefs);
+            assert(new_beliefs.empty());
         }
+        stats.m_new_belief_count = delta_beliefs.size();
+        stats.m_duration_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        lvd::g_log << lvd::Log::dbg() << "saturate round " << round_stats.size() << ": " << stats << '\n';
+        round_stats.push_back(stats);
+        is_first_round = false;
+    }
+    return round_stats;
+}
+
+sept::Data const *BeliefSystem::insert_into_belief_set (sept::Data const &belief) {
+    auto [it, was_inserted] = m_belief_set.insert(belief);
+    if (!was_inserted)
+        return nullptr;
+    m_belief_index.insert(*it);
+    m_belief_filter.insert(std::hash<sept::Data>()(belief));
+    if (inhabits_data(*it, Predicate_Not)) {
+        auto const &operand = it->cast<sept::TupleTerm_c const &>()[1];
+        m_negated_beliefs.insert(&operand);
+        m_negated_belief_filter.insert(std::hash<sept::Data>()(operand));
+    }
+    rebuild_filters_if_necessary();
+    ++m_generation;
+    return &*it;
+}
+
+bool BeliefSystem::erase_from_belief_set (sept::Data const &belief) {
+    auto it = m_belief_set.find(belief);
+    if (it == m_belief_set.end())
+        return false;
+    if (inhabits_data(*it, Predicate_Not)) {
+        auto const &operand = it->cast<sept::TupleTerm_c const &>()[1];
+        m_negated_belief_filter.erase(std::hash<sept::Data>()(operand));
+        m_negated_beliefs.erase(&operand);
+    }
+    m_belief_filter.erase(std::hash<sept::Data>()(belief));
+    m_belief_index.erase(*it);
+    m_belief_set.erase(it);
+    rebuild_filters_if_necessary();
+    ++m_generation;
+    return true;
+}
+
+void BeliefSystem::rebuild_filters_if_necessary () {
+    if (m_belief_filter.should_rebuild()) {
+        m_belief_filter.reset(m_belief_set.size());
+        for (auto const &belief : m_belief_set)
+            m_belief_filter.insert(std::hash<sept::Data>()(belief));
+    }
+    if (m_negated_belief_filter.should_rebuild()) {
+        m_negated_belief_filter.reset(m_negated_beliefs.size());
+        for (auto const *operand : m_negated_beliefs)
+            m_negated_belief_filter.insert(std::hash<sept::Data>()(*operand));
+    }
+}
+
+void BeliefSystem::insert_belief (sept::Data const &belief, Justification const *justification, std::vector<sept::Data const *> &new_beliefs) {
+    auto insert = [&](sept::Data const &b) {
+        lvd::g_log << lvd::Log::dbg() << "adding belief: " << b << '\n';
+        if (auto const *inserted_belief = insert_into_belief_set(b))
+            new_beliefs.push_back(inserted_belief);
+        // This is recorded even if the belief was already present, so that it stays held if its other
+        // support is retracted.
+        if (justification == nullptr)
+            m_truth_maintenance.add_assertion(b);
+        else
+            m_truth_maintenance.add_justification(b, *justification);
+    };
+
+    // This is only valid until the next call to m_canonicalizer, which insert doesn't make.
+    auto const &canonical_belief = m_canonicalizer.canonical_form(belief);
+    // If a belief is Predicate_And, then it can be broken up into separate beliefs and each one added.
+    // Otherwise it's just added (in canonical form).
+    if (inhabits_data(canonical_belief, Predicate_And)) {
+        for (auto const &operand : canonical_belief.cast<sept::TupleTerm_c const &>()[1].cast<sept::TupleTerm_c const &>().elements())
+            insert(operand);
     } else {
-        lvd::g_log << lvd::Log::dbg() << "adding belief: " << belief << '\n';
-        m_belief_set.insert(belief);
+        insert(canonical_belief);
+    }
+}
+
+void BeliefSystem::fire_rules (std::vector<sept::Data const *> const &new_beliefs, std::vector<Derivation> &fired_conclusions) {
+    if (m_rule_network.rule_count() > 0)
+        for (auto const *new_belief : new_beliefs)
+            m_rule_network.add_belief(*new_belief, fired_conclusions);
+}
+
+void BeliefSystem::add_beliefs (std::vector<Derivation> &&pending, std::vector<sept::Data const *> *added_beliefs) {
+    // Beliefs are added in the order their conclusions were fired, i.e. breadth-first.
+    for (size_t i = 0; i < pending.size(); ++i) {
+        std::vector<sept::Data const *> new_beliefs;
+        // Move out first, since pending may be appended to below.
+        auto derivation = std::move(pending[i]);
+        insert_belief(derivation.m_belief, &derivation.m_justification, new_beliefs);
+        if (added_beliefs != nullptr)
+            added_beliefs->insert(added_beliefs->end(), new_beliefs.begin(), new_beliefs.end());
+        fire_rules(new_beliefs, pending);
     }
 }
 
@@ -1,6 +1,14 @@
 // 2021.05.15 - Victor Dods
 
+#pragma once
+
+#include "ast.hpp"
+#include "filter.hpp"
+#include "index.hpp"
+#include "rete.hpp"
 #include "sept/Data.hpp"
+#include "tms.hpp"
+#include <unordered_map>
 #include <unordered_set>
 
 using BeliefStateRepr = uint8_t;
@@ -55,6 +63,21 @@ inline std::ostream &operator<< (std::ostream &out, BeliefState const &t) {
     return out << as_string(t);
 }
 
+// Statistics for one round of BeliefSystem::saturate.
+struct SaturationRoundStats {
+    // The number of beliefs added in the previous round (or present at the start, for the first round).
+    size_t m_delta_size;
+    // The number of matches of a conjunct's pattern against a belief.
+    size_t m_join_count;
+    // The number of conclusions produced, including duplicates and ones that were already beliefs.
+    size_t m_conclusion_count;
+    // The number of beliefs that were added, which is the next round's delta size.
+    size_t m_new_belief_count;
+    double m_duration_s;
+};
+
+std::ostream &operator<< (std::ostream &out, SaturationRoundStats const &stats);
+
 // TODO: Could use PartiallyOrderedSet_t containing types, where beliefs are stored
 // in the set as FormalTypeOf(belief).
 class BeliefSystem {
@@ -63,11 +86,22 @@ public:
     using BeliefSet = std::unordered_set<sept::Data>;
 //     using InferenceSet = std::unordered_set<sept::Data>;
 
-    BeliefSystem () { }
-
-    // Attempts to evaluate the given predicate as true or false against this BeliefSystem.
+    BeliefSystem ()
+        :   m_generation(0)
+        ,   m_evaluation_memo_generation(0)
+        ,   m_evaluation_memo_hit_count(0)
+        ,   m_evaluation_memo_miss_count(0)
+    { }
+
+    // Attempts to evaluate the given predicate as true or false against this BeliefSystem.  The results
+    // are memoized until the belief set next changes (see generation), since the same compound predicates
+    // tend to be evaluated many times between updates.  The operands of compound predicates are evaluated
+    // (and memoized) the same way.  Because of the memo, this isn't thread-safe.
     // TODO: Implement some limit on the number of search steps.
     BeliefState evaluate_predicate (sept::Data const &predicate) const;
+    // The number of evaluations (including those of operands) that were found in the memo, and that weren't.
+    size_t evaluation_memo_hit_count () const { return m_evaluation_memo_hit_count; }
+    size_t evaluation_memo_miss_count () const { return m_evaluation_memo_miss_count; }
 
     // Attempts to derive new beliefs using a rule of inference.
     void derive_beliefs (sept::Data const &inference);
@@ -77,19 +111,58 @@ public:
     void derive_beliefs_2 (sept::Data const &inference, bool also_derive_using_contrapositive = true);
 
     BeliefSet const &belief_set () const { return m_belief_set; }
+    BeliefIndex const &belief_index () const { return m_belief_index; }
+    // Most probes miss, and the filters answer most of those without looking in the sets.
     bool contains_belief (sept::Data const &belief) const {
-        return m_belief_set.find(belief) != m_belief_set.end();
+        return m_belief_filter.may_contain(std::hash<sept::Data>()(belief)) && m_belief_set.find(belief) != m_belief_set.end();
+    }
+    // Returns true iff Predicate_Not(Not, predicate) is a belief, without constructing it.
+    bool contains_negation_of (sept::Data const &predicate) const {
+        return m_negated_belief_filter.may_contain(std::hash<sept::Data>()(predicate)) && m_negated_beliefs.find(&predicate) != m_negated_beliefs.end();
     }
+    // The canonicalizer that beliefs, premises and predicates are put into canonical form with.
+    PredicateCanonicalizer const &canonicalizer () const { return m_canonicalizer; }
+    BlockedBloomFilter const &belief_filter () const { return m_belief_filter; }
+    BlockedBloomFilter const &negated_belief_filter () const { return m_negated_belief_filter; }
+    // Incremented every time a belief is added to or removed from the belief set.
+    uint64_t generation () const { return m_generation; }
 //     InferenceSet const &inference_set () const { return m_inference_set; }
 //     bool contains_inference (sept::Data const &inference) const {
 //         return m_inference_set.find(inference) != m_inference_set.end();
 //     }
 
-    // This processes the belief down and adds potentially several beliefs in canonical form.
+    // This processes the belief down and adds potentially several beliefs in canonical form, as
+    // assertions (see TruthMaintenance).  The rules added via add_rule are applied to the new beliefs (and
+    // their conclusions, and so on).
     void add_belief (sept::Data const &belief);
-    void remove_belief (sept::Data const &belief) {
-        m_belief_set.erase(belief);
-    }
+    // Retracts the assertion of the belief, and withdraws it and the beliefs derived from it that are left
+    // without support (see TruthMaintenance::retract), including from the RuleNetwork, so that re-adding
+    // the belief re-derives only those.  A belief that's still derived from other beliefs stays.  As in
+    // add_belief, this applies to the belief's canonical form, or to each of its operands if that's a
+    // Predicate_And.  Returns the withdrawn beliefs.
+    std::vector<sept::Data> remove_belief (sept::Data const &belief);
+    TruthMaintenance const &truth_maintenance () const { return m_truth_maintenance; }
+    // Adds recorded beliefs (e.g. from a BeliefStore snapshot) as they are, i.e. already in canonical form
+    // and with their recorded support (see TruthMaintenance::restore), without deriving anything from them
+    // except by the rules added via add_rule.  Throws if the belief set isn't empty.
+    void restore (std::vector<sept::Data> const &assertions, std::vector<Derivation> const &derivations);
+
+    // Adds a rule of inference (an Implication, possibly with FreeVars) which is applied to all beliefs,
+    // both existing and future, so that unlike derive_beliefs_2, it only has to be added once.  The
+    // contrapositive is also added, unless it would have FreeVars in its conclusion that aren't in its
+    // premise.  Throws if RuleNetwork::add_rule does.
+    void add_rule (sept::Data const &inference, bool also_add_contrapositive = true);
+    RuleNetwork const &rule_network () const { return m_rule_network; }
+
+    // Applies the given rules of inference (Implications, possibly with FreeVars, and their contrapositives
+    // as in add_rule) to the beliefs, and to the conclusions, and so on, until nothing new is derived, and
+    // returns the statistics of each round.  Unlike add_rule, the rules aren't kept afterward.  This uses
+    // semi-naive evaluation: each round only produces the conclusions whose premise matches at least one
+    // belief that was added in the previous round (the delta), so no combination of beliefs is joined more
+    // than once.  If thread_count is greater than 1, each round's delta is partitioned across that many
+    // threads.  The conclusions are merged in the same order regardless of thread_count, so the result is
+    // deterministic.  Throws if rule_alternatives does for any of the rules.
+    std::vector<SaturationRoundStats> saturate (std::vector<sept::Data> const &rules, size_t thread_count = 1, bool also_use_contrapositives = true);
 
 //     void add_inference (sept::Data const &inference) {
 //         m_inference_set.insert(inference);
@@ -100,8 +173,62 @@ public:
 
 private:
 
+    struct DataPtrHash {
+        size_t operator() (sept::Data const *data) const { return std::hash<sept::Data>()(*data); }
+    };
+    struct DataPtrEq {
+        bool operator() (sept::Data const *lhs, sept::Data const *rhs) const { return *lhs == *rhs; }
+    };
+
     // For now, just a flat storage of beliefs.
     BeliefSet m_belief_set;
+    // The operands p of the beliefs of the form Predicate_Not(Not, p), pointing into m_belief_set (whose
+    // elements don't move), so that evaluate_predicate can look up the negation of a predicate.
+    std::unordered_set<sept::Data const *,DataPtrHash,DataPtrEq> m_negated_beliefs;
+    // Filters over the hashes of the elements of m_belief_set and m_negated_beliefs respectively.
+    BlockedBloomFilter m_belief_filter;
+    BlockedBloomFilter m_negated_belief_filter;
+    uint64_t m_generation;
+    // The memo of evaluate_predicate, which is only valid if m_evaluation_memo_generation is m_generation.
+    // It's keyed by the predicate's hash rather than by a copy of the predicate, so that memoizing a
+    // predicate doesn't copy it.  Two predicates evaluated in the same generation would only be confused
+    // if their hashes were equal.
+    mutable std::unordered_map<size_t,BeliefState> m_evaluation_memo;
+    mutable uint64_t m_evaluation_memo_generation;
+    mutable size_t m_evaluation_memo_hit_count;
+    mutable size_t m_evaluation_memo_miss_count;
+    // This is mutable since evaluate_predicate also uses it, to look up the canonical form of a predicate.
+    mutable PredicateCanonicalizer m_canonicalizer;
+    // Indexes the elements of m_belief_set, so that derive_beliefs_2 only has to pattern match
+    // against the beliefs that could match.
+    BeliefIndex m_belief_index;
+    RuleNetwork m_rule_network;
+    // Records why each belief in m_belief_set is held.
+    TruthMaintenance m_truth_maintenance;
+
+    BeliefState evaluate_predicate__uncached (sept::Data const &predicate) const;
+
+    // These maintain m_belief_set, m_belief_index, m_negated_beliefs, the filters and m_generation
+    // together.  insert_into_belief_set returns the inserted element of m_belief_set, or null if the
+    // belief was already present, and erase_from_belief_set returns true iff the belief was present.
+    // The RuleNetwork also points into m_belief_set, so a belief has to be removed from it before it's
+    // erased.
+    sept::Data const *insert_into_belief_set (sept::Data const &belief);
+    bool erase_from_belief_set (sept::Data const &belief);
+    // Rebuilds the filters if either of them has gone stale or is over capacity.
+    void rebuild_filters_if_necessary ();
+
+    // Adds the given belief (and its operands, if it's a Predicate_And), without applying any rules, as
+    // an assertion if justification is null, otherwise recording the justification, and appends
+    // whichever ones weren't already present to new_beliefs (as pointers into m_belief_set).
+    void insert_belief (sept::Data const &belief, Justification const *justification, std::vector<sept::Data const *> &new_beliefs);
+    // Pushes the new beliefs (which point into m_belief_set) through the RuleNetwork (if it has any
+    // rules), appending the conclusions to fired_conclusions.
+    void fire_rules (std::vector<sept::Data const *> const &new_beliefs, std::vector<Derivation> &fired_conclusions);
+    // Adds the pending derived beliefs, applying the rules to each new one, until there are no more
+    // conclusions.  If added_beliefs is not null, then the beliefs that weren't already present are
+    // appended to it (as pointers into m_belief_set).
+    void add_beliefs (std::vector<Derivation> &&pending, std::vector<sept::Data const *> *added_beliefs = nullptr);
 //     // For now, have a separate set of rules of inference.  Eventually these would be incorporated
 //     // into the belief set directly and the inference search would be more complex.
 //     InferenceSet m_inference_set;
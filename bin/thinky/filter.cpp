@@ -0,0 +1,27 @@
+// 2021.05.24 - Victor Dods
+
+#include "filter.hpp"
+
+#include <algorithm>
+#include <bitset>
+
+void BlockedBloomFilter::reset (size_t expected_count) {
+    // Leave room to double before needing to be rebuilt.
+    m_capacity = std::max(MIN_CAPACITY, 2*expected_count);
+    auto block_count = (m_capacity*BITS_PER_ELEMENT + 8*sizeof(Block) - 1) / (8*sizeof(Block));
+    m_blocks.assign(block_count, Block{});
+    m_inserted_count = 0;
+    m_erased_count = 0;
+}
+
+double BlockedBloomFilter::false_positive_rate () const {
+    // An absent element is a false positive iff its bit in each word of its block is set.
+    double sum = 0.0;
+    for (auto const &block : m_blocks) {
+        double p = 1.0;
+        for (auto word : block)
+            p *= double(std::bitset<32>(word).count()) / 32.0;
+        sum += p;
+    }
+    return sum / double(m_blocks.size());
+}
@@ -0,0 +1,94 @@
+// 2021.05.24 - Victor Dods
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A split block Bloom filter over hash values, for answering "definitely not present" quickly, so
+// that most lookups of absent elements skip the hash table's bucket walk and equality comparisons.
+// Each element sets one bit in each of the 8 words of a single 32-byte block (chosen by the hash), so a
+// lookup touches one cache line and doesn't branch per bit.
+//
+// A Bloom filter can't remove elements, so erase only counts them, and erased elements may still be
+// reported as present.  Once there are too many erased elements, or the filter is over capacity (both
+// of which raise the false positive rate), should_rebuild returns true, and the owner should call reset
+// and reinsert the current elements.
+class BlockedBloomFilter {
+public:
+
+    explicit BlockedBloomFilter (size_t expected_count = 0) { reset(expected_count); }
+
+    // Clears the filter and sizes it for the given number of elements (with room to grow).
+    void reset (size_t expected_count);
+
+    void insert (size_t hash) {
+        auto &block = m_blocks[block_index(hash)];
+        auto mask = block_mask(hash);
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+            block[i] |= mask[i];
+        ++m_inserted_count;
+    }
+    // Returns false only if no element with the given hash was inserted (since the last reset).
+    bool may_contain (size_t hash) const {
+        auto const &block = m_blocks[block_index(hash)];
+        auto mask = block_mask(hash);
+        uint32_t missing = 0;
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+            missing |= mask[i] & ~block[i];
+        return missing == 0;
+    }
+    void erase (size_t) { ++m_erased_count; }
+
+    bool should_rebuild () const {
+        return m_inserted_count > m_capacity || (m_erased_count > MIN_CAPACITY && 2*m_erased_count > m_inserted_count);
+    }
+
+    // The number of inserted elements, including erased ones, since the last reset.
+    size_t inserted_count () const { return m_inserted_count; }
+    size_t erased_count () const { return m_erased_count; }
+    size_t byte_count () const { return m_blocks.size()*sizeof(Block); }
+    // The probability that may_contain returns true for an absent element, estimated from the fraction of
+    // bits that are set in each block.
+    double false_positive_rate () const;
+
+private:
+
+    static size_t constexpr WORDS_PER_BLOCK = 8;
+    // Roughly 0.2% false positives at capacity.
+    static size_t constexpr BITS_PER_ELEMENT = 16;
+    static size_t constexpr MIN_CAPACITY = 64;
+
+    using Block = std::array<uint32_t,WORDS_PER_BLOCK>;
+
+    // hash_data values aren't necessarily well distributed, so they're mixed first.
+    static uint64_t mixed (size_t hash) {
+        uint64_t x = uint64_t(hash) + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+    size_t block_index (size_t hash) const {
+        // Maps the upper 32 bits onto [0, block count) without a division.
+        return size_t(((mixed(hash) >> 32) * m_blocks.size()) >> 32);
+    }
+    static Block block_mask (size_t hash) {
+        // Each word's bit is picked by the top 5 bits of a different odd multiple of the lower 32 bits.
+        static std::array<uint32_t,WORDS_PER_BLOCK> constexpr SALTS{
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+        };
+        auto key = uint32_t(mixed(hash));
+        Block mask;
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+            mask[i] = uint32_t(1) << ((key * SALTS[i]) >> 27);
+        return mask;
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_capacity;
+    size_t m_inserted_count;
+    size_t m_erased_count;
+};
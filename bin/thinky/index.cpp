@@ -0,0 +1,124 @@
+// 2021.05.17 - Victor Dods
+
+#include "index.hpp"
+
+#include "sept/ArrayTerm.hpp"
+#include "sept/ArrayType.hpp"
+#include "sept/FreeVar.hpp"
+#include "sept/OrderedMapType.hpp"
+#include "sept/Tuple.hpp"
+#include "sept/UnionTerm.hpp"
+
+void append_term_path (sept::Data const &term, std::vector<TermKey> &path) {
+    if (auto const *tuple_term = term.ptr_cast<sept::TupleTerm_c>()) {
+        path.emplace_back(TermKey{TermKeyKind::TUPLE, tuple_term->size(), std::nullopt});
+        for (auto const &element : tuple_term->elements())
+            append_term_path(element, path);
+    } else if (auto const *array_term = term.ptr_cast<sept::ArrayTerm_c>()) {
+        path.emplace_back(TermKey{TermKeyKind::ARRAY, array_term->size(), std::nullopt});
+        for (auto const &element : array_term->elements())
+            append_term_path(element, path);
+    } else {
+        path.emplace_back(TermKey{TermKeyKind::VALUE, 0, term});
+    }
+}
+
+void append_pattern_path (sept::Data const &pattern, PatternPath &path) {
+    if (auto const *tuple_term = pattern.ptr_cast<sept::TupleTerm_c>()) {
+        path.emplace_back(TermKey{TermKeyKind::TUPLE, tuple_term->size(), std::nullopt});
+        for (auto const &element : tuple_term->elements())
+            append_pattern_path(element, path);
+    } else if (auto const *array_term = pattern.ptr_cast<sept::ArrayTerm_c>()) {
+        path.emplace_back(TermKey{TermKeyKind::ARRAY, array_term->size(), std::nullopt});
+        for (auto const &element : array_term->elements())
+            append_pattern_path(element, path);
+    } else if (
+        pattern.ptr_cast<sept::FreeVarTerm_c>() != nullptr ||
+        pattern.ptr_cast<sept::ArrayETerm_c>() != nullptr ||
+        pattern.ptr_cast<sept::OrderedMapDCTerm_c>() != nullptr ||
+        pattern.ptr_cast<sept::OrderedMapDTerm_c>() != nullptr ||
+        pattern.ptr_cast<sept::OrderedMapCTerm_c>() != nullptr ||
+        pattern.ptr_cast<sept::UnionTerm_c>() != nullptr ||
+        pattern.ptr_cast<sept::FormalTypeOf_Term_c>() != nullptr)
+    {
+        // These are the patterns that sept::match doesn't match by direct equality.
+        path.emplace_back(std::nullopt);
+    } else {
+        path.emplace_back(TermKey{TermKeyKind::VALUE, 0, pattern});
+    }
+}
+
+void BeliefIndex::insert (sept::Data const &belief) {
+    std::vector<TermKey> path;
+    append_term_path(belief, path);
+    Node *node = &m_root;
+    for (auto &key : path) {
+        auto &child = node->m_children[std::move(key)];
+        if (child == nullptr)
+            child = std::make_unique<Node>();
+        node = child.get();
+    }
+    node->m_beliefs.insert(&belief);
+}
+
+void BeliefIndex::erase (sept::Data const &belief) {
+    std::vector<TermKey> path;
+    append_term_path(belief, path);
+    erase(m_root, path, 0, belief);
+}
+
+std::vector<sept::Data> BeliefIndex::candidate_beliefs (sept::Data const &pattern) const {
+    std::vector<sept::Data> retval;
+    for (auto const *belief : candidate_belief_ptrs(pattern))
+        retval.emplace_back(*belief);
+    return retval;
+}
+
+std::vector<sept::Data const *> BeliefIndex::candidate_belief_ptrs (sept::Data const &pattern) const {
+    PatternPath path;
+    append_pattern_path(pattern, path);
+    std::vector<sept::Data const *> retval;
+    collect_candidates(m_root, path, 0, retval);
+    return retval;
+}
+
+void BeliefIndex::skip_subterms (Node const &node, size_t pending_subterm_count, std::vector<Node const *> &out) {
+    if (pending_subterm_count == 0) {
+        out.push_back(&node);
+        return;
+    }
+    for (auto const &[key, child] : node.m_children)
+        skip_subterms(*child, pending_subterm_count - 1 + key.arity(), out);
+}
+
+void BeliefIndex::collect_candidates (Node const &node, PatternPath const &path, size_t i, std::vector<sept::Data const *> &out) {
+    if (i == path.size()) {
+        out.insert(out.end(), node.m_beliefs.begin(), node.m_beliefs.end());
+        return;
+    }
+
+    auto const &key_o = path[i];
+    if (key_o.has_value()) {
+        auto it = node.m_children.find(key_o.value());
+        if (it != node.m_children.end())
+            collect_candidates(*it->second, path, i+1, out);
+    } else {
+        std::vector<Node const *> skipped_to;
+        skip_subterms(node, 1, skipped_to);
+        for (auto const *next : skipped_to)
+            collect_candidates(*next, path, i+1, out);
+    }
+}
+
+bool BeliefIndex::erase (Node &node, std::vector<TermKey> const &path, size_t i, sept::Data const &belief) {
+    if (i == path.size()) {
+        node.m_beliefs.erase(&belief);
+    } else {
+        auto it = node.m_children.find(path[i]);
+        if (it == node.m_children.end())
+            return false;
+        if (erase(*it->second, path, i+1, belief))
+            node.m_children.erase(it);
+    }
+    return node.is_empty();
+}
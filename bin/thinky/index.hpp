@@ -0,0 +1,90 @@
+// 2021.05.17 - Victor Dods
+
+#pragma once
+
+#include "common.hpp"
+#include <memory>
+#include <optional>
+#include "sept/Data.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Keys of the preorder flattening of a term, which is what discrimination trees (BeliefIndex here, and
+// the alpha network of RuleNetwork) are built on.  A TupleTerm_c or ArrayTerm_c contributes a key for
+// its shape (i.e. which one it is and its size) followed by the keys of its elements, and anything else
+// (e.g. a ThinkyNPTerm) contributes a key for its value.
+enum class TermKeyKind : uint8_t { TUPLE, ARRAY, VALUE };
+
+struct TermKey {
+    TermKeyKind m_kind;
+    // Element count for TUPLE and ARRAY.
+    size_t m_size;
+    // Only set for VALUE.
+    std::optional<sept::Data> m_value;
+
+    bool operator== (TermKey const &other) const {
+        return m_kind == other.m_kind && m_size == other.m_size && (m_kind != TermKeyKind::VALUE || sept::eq_data(*m_value, *other.m_value));
+    }
+    // The number of subterms that follow this key in the path.
+    size_t arity () const { return m_kind == TermKeyKind::VALUE ? 0 : m_size; }
+};
+
+struct TermKeyHash {
+    size_t operator() (TermKey const &key) const {
+        return key.m_kind == TermKeyKind::VALUE ? lvd::hash(uint8_t(key.m_kind), *key.m_value) : lvd::hash(uint8_t(key.m_kind), key.m_size);
+    }
+};
+
+// A key of std::nullopt (in a pattern's path) is a wildcard, which stands for a whole subterm.  This is
+// used for a FreeVar, as well as for patterns that sept::match matches structurally (e.g.
+// ArrayE(X)), which are conservatively treated as FreeVars.
+using PatternPath = std::vector<std::optional<TermKey>>;
+
+void append_term_path (sept::Data const &term, std::vector<TermKey> &path);
+void append_pattern_path (sept::Data const &pattern, PatternPath &path);
+
+// A discrimination tree over beliefs, used to find the beliefs that could match a pattern without
+// calling matched_pattern__data on every belief.  Each belief is stored at the end of its path (see
+// TermKey), and a wildcard in the pattern's path skips a whole subterm of the belief.
+//
+// The candidates for a pattern are a superset of the beliefs that it matches, so matched_pattern__data
+// still has to be called on each one, e.g. to check repeated FreeVars.
+//
+// The index doesn't copy the beliefs, it points to them (e.g. to the elements of BeliefSystem's belief
+// set), so each belief must stay where it is until it's erased from the index.
+class BeliefIndex {
+public:
+
+    BeliefIndex () = default;
+
+    void insert (sept::Data const &belief);
+    // Erases the belief at the given address, i.e. the one that was inserted, not an equal copy of it.
+    void erase (sept::Data const &belief);
+    void clear () { m_root = Node{}; }
+
+    // Returns copies of the beliefs that could match the given pattern, in no particular order.  These
+    // are copies so that beliefs can be added or removed while iterating over them.
+    std::vector<sept::Data> candidate_beliefs (sept::Data const &pattern) const;
+    // Like candidate_beliefs, but returns the pointers to the beliefs instead of copies.  These stay
+    // valid until the belief they point to is erased.
+    std::vector<sept::Data const *> candidate_belief_ptrs (sept::Data const &pattern) const;
+
+private:
+
+    struct Node {
+        std::unordered_map<TermKey,std::unique_ptr<Node>,TermKeyHash> m_children;
+        // The beliefs whose path ends at this node.
+        std::unordered_set<sept::Data const *> m_beliefs;
+
+        bool is_empty () const { return m_children.empty() && m_beliefs.empty(); }
+    };
+
+    // Collects the nodes reached from node by skipping pending_subterm_count whole subterms.
+    static void skip_subterms (Node const &node, size_t pending_subterm_count, std::vector<Node const *> &out);
+    static void collect_candidates (Node const &node, PatternPath const &path, size_t i, std::vector<sept::Data const *> &out);
+    // Returns true if node became empty (and can be removed from its parent).
+    static bool erase (Node &node, std::vector<TermKey> const &path, size_t i, sept::Data const &belief);
+
+    Node m_root;
+};
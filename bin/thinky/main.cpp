@@ -12,103 +12,6 @@
 #include "sept/Union.hpp"
 #include "sept/UnionTerm.hpp"
 
-//
-// sept data model registrations
-//
-
-namespace sept {
-SEPT__REGISTER__PRINT(Adjective_c)
-SEPT__REGISTER__PRINT(Animal_c)
-SEPT__REGISTER__PRINT(BinOp_c)
-SEPT__REGISTER__PRINT(BoolBinOp_c)
-SEPT__REGISTER__PRINT(Color_c)
-SEPT__REGISTER__PRINT(Entity_c)
-// SEPT__REGISTER__PRINT__GIVE_ID(sem::Expr_Term_c, __sem__Expr_Term_c__)
-SEPT__REGISTER__PRINT(Object_c)
-SEPT__REGISTER__PRINT(Person_c)
-SEPT__REGISTER__PRINT(ThinkyNPTerm)
-SEPT__REGISTER__PRINT(UnOp_c)
-SEPT__REGISTER__PRINT(Verb_c)
-SEPT__REGISTER__PRINT__GIVE_ID(char const *, __char_const_ptr__)
-
-SEPT__REGISTER__HASH(Adjective_c)
-SEPT__REGISTER__HASH(Animal_c)
-SEPT__REGISTER__HASH(BinOp_c)
-SEPT__REGISTER__HASH(BoolBinOp_c)
-SEPT__REGISTER__HASH(Color_c)
-SEPT__REGISTER__HASH(Entity_c)
-// SEPT__REGISTER__HASH__GIVE_ID(sem::Expr_Term_c, __sem__Expr_Term_c__)
-SEPT__REGISTER__HASH(Object_c)
-SEPT__REGISTER__HASH(Person_c)
-SEPT__REGISTER__HASH(ThinkyNPTerm)
-SEPT__REGISTER__HASH(UnOp_c)
-SEPT__REGISTER__HASH(Verb_c)
-
-SEPT__REGISTER__EQ(Adjective_c)
-SEPT__REGISTER__EQ(Animal_c)
-SEPT__REGISTER__EQ(BinOp_c)
-SEPT__REGISTER__EQ(BoolBinOp_c)
-SEPT__REGISTER__EQ(Color_c)
-SEPT__REGISTER__EQ(Entity_c)
-SEPT__REGISTER__EQ(Object_c)
-SEPT__REGISTER__EQ(Person_c)
-SEPT__REGISTER__EQ(ThinkyNPTerm)
-SEPT__REGISTER__EQ(UnOp_c)
-SEPT__REGISTER__EQ(Verb_c)
-
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Adjective_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Animal_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(BinOp_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(BoolBinOp_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Color_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Entity_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Object_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Person_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(UnOp_c)
-SEPT__REGISTER__ABSTRACT_TYPE_OF(Verb_c)
-
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Adjective_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Animal_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, BinOp_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, BoolBinOp_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Color_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Entity_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Object_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Person_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, UnOp_c)
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Verb_c)
-SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(ThinkyNPTerm, FormalTypeOf_Term_c, __ThinkyNPTerm___sem__FormalTypeOf_Term_c__)
-// TODO there are probably some missing
-
-SEPT__REGISTER__COMPARE__SINGLETON(Adjective_c)
-SEPT__REGISTER__COMPARE__SINGLETON(Animal_c)
-SEPT__REGISTER__COMPARE__SINGLETON(BinOp_c)
-SEPT__REGISTER__COMPARE__SINGLETON(BoolBinOp_c)
-SEPT__REGISTER__COMPARE__SINGLETON(Color_c)
-SEPT__REGISTER__COMPARE__SINGLETON(Entity_c)
-SEPT__REGISTER__COMPARE__SINGLETON(Object_c)
-SEPT__REGISTER__COMPARE__SINGLETON(Person_c)
-SEPT__REGISTER__COMPARE__SINGLETON(UnOp_c)
-SEPT__REGISTER__COMPARE__SINGLETON(Verb_c)
-SEPT__REGISTER__COMPARE(ThinkyNPTerm, ThinkyNPTerm)
-
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Adjective_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Animal_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(BinOp_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(BoolBinOp_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Color_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Entity_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Object_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Person_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnOp_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Verb_c, ThinkyNPTerm)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(FormalTypeOf_Term_c, ThinkyNPTerm)
-
-// TEMP HACK
-SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, UnionTerm_c)
-SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnionTerm_c, ThinkyNPTerm)
-} // end namespace sept
-
 // TEMP HACK
 namespace std {
 
@@ -241,6 +144,25 @@ int main (int argc, char **argv) {
         lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(free_var_substitution__data(sept::FormalTypeOf(X), symbol_assignment)) << '\n';
         lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(free_var_substitution__data(sept::Tuple(sept::ArrayE(X), sept::OrderedMapDC(X,Y)), symbol_assignment)) << '\n';
         lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(free_var_substitution__data(sept::OrderedMapDC(sept::ArrayE(X),sept::ArrayE(X)), symbol_assignment)) << '\n';
+
+        // A SubstitutionTemplate substitutes the bindings of a MatchFrame directly.  W is never bound, so
+        // it's left as is.
+        auto W = sept::FreeVar("W");
+        sept::MatchVars vars;
+        sept::MatchPattern pattern(sept::Tuple(X, Y, Z), vars);
+        sept::MatchFrame frame(vars.size());
+        // This must be a Data, since the bindings point into it.
+        sept::Data bound = sept::Tuple(sept::Uint32, sept::Bool, sept::Float64(456.75));
+        if (sept::match(pattern, bound, frame)) {
+            for (auto const &term : {
+                sept::Data{sept::Tuple(X, sept::Tuple(Cup, HasProperty, Red), Y, W)},
+                sept::Data{sept::Tuple(sept::ArrayE(X), sept::OrderedMapDC(X,Y), sept::Union(Z, W))},
+            }) {
+                SubstitutionTemplate substitution_template(term, vars);
+                frame.resize(vars.size());
+                lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(substitution_template.instantiate(frame)) << '\n';
+            }
+        }
     }
 
     //
@@ -267,6 +189,203 @@ int main (int argc, char **argv) {
     lvd::g_log << lvd::Log::dbg() << '\n';
     assert(bs.evaluate_predicate(Predicate_Not(Not, SubjVerbObj(Dave, HasProperty, Smart))));
 
+    // The BeliefIndex narrows down the beliefs to pattern match against.
+    for (auto const &pattern : {SubjVerbObj(X, HasProperty, Smart), Predicate_Not(Not, SubjVerbObj(X, LikesA, Cat)), sept::Tuple(X, Y, Z), SubjVerbObj(Charlie, Says, X)}) {
+        auto candidates = bs.belief_index().candidate_beliefs(pattern);
+        lvd::g_log << lvd::Log::dbg() << "pattern " << pattern << " has " << candidates.size() << " candidate(s) out of " << bs.belief_set().size() << " beliefs\n";
+    }
+    lvd::g_log << lvd::Log::dbg() << '\n';
+
+    //
+    // RuleNetwork
+    //
+
+    {
+        // Rules are added once and applied to each belief as it's added.  Smart people like cats, and
+        // smart people tell the truth.
+        BeliefSystem rete_bs;
+        rete_bs.add_rule(rule0);
+        rete_bs.add_rule(Implication(Predicate_And(And, sept::Tuple(SubjVerbObj(X, HasProperty, Smart), SubjVerbObj(X, Says, Y))), Implies, Y));
+        lvd::g_log << lvd::Log::dbg() << '\n';
+
+        rete_bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+        rete_bs.add_belief(SubjVerbObj(Box, HasProperty, Red));
+        lvd::g_log << lvd::Log::dbg() << "adding the belief that enables a chain of conclusions...\n";
+        rete_bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+        lvd::g_log << lvd::Log::dbg()
+                   << LVD_REFLECT(rete_bs.evaluate_predicate(SubjVerbObj(Alice, LikesA, Cat))) << '\n'
+                   << LVD_REFLECT(rete_bs.evaluate_predicate(SubjVerbObj(Bob, HasProperty, Smart))) << '\n'
+                   << LVD_REFLECT(rete_bs.evaluate_predicate(SubjVerbObj(Bob, LikesA, Cat))) << '\n';
+
+        lvd::g_log << lvd::Log::dbg() << "adding a belief that enables the contrapositive of rule0...\n";
+        rete_bs.add_belief(Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat)));
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(rete_bs.evaluate_predicate(SubjVerbObj(Dave, HasProperty, Smart))) << '\n';
+
+        lvd::g_log << lvd::Log::dbg() << rete_bs
+                   << LVD_REFLECT(rete_bs.rule_network().rule_count()) << '\n'
+                   << LVD_REFLECT(rete_bs.rule_network().alpha_memory_count()) << '\n'
+                   << LVD_REFLECT(rete_bs.rule_network().join_count()) << '\n'
+                   << '\n';
+    }
+
+    //
+    // Semi-naive saturation
+    //
+
+    {
+        // The same rules as above, applied all at once to a fixed set of beliefs.  Each round only joins
+        // against the beliefs added by the previous one, and the parallel version gets the same result.
+        std::vector<sept::Data> rules{
+            rule0,
+            Implication(Predicate_And(And, sept::Tuple(SubjVerbObj(X, HasProperty, Smart), SubjVerbObj(X, Says, Y))), Implies, Y),
+        };
+        auto add_beliefs_to = [&](BeliefSystem &saturated_bs) {
+            saturated_bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+            saturated_bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+            saturated_bs.add_belief(SubjVerbObj(Bob, Says, SubjVerbObj(Charlie, HasProperty, Smart)));
+            saturated_bs.add_belief(SubjVerbObj(Charlie, Says, Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+            saturated_bs.add_belief(SubjVerbObj(Box, HasProperty, Red));
+        };
+
+        BeliefSystem sequential_bs;
+        add_beliefs_to(sequential_bs);
+        auto sequential_round_stats = sequential_bs.saturate(rules);
+        BeliefSystem parallel_bs;
+        add_beliefs_to(parallel_bs);
+        auto parallel_round_stats = parallel_bs.saturate(rules, 2);
+        lvd::g_log << lvd::Log::dbg()
+                   << LVD_REFLECT(sequential_bs.evaluate_predicate(SubjVerbObj(Charlie, LikesA, Cat))) << '\n'
+                   << LVD_REFLECT(sequential_bs.evaluate_predicate(SubjVerbObj(Dave, HasProperty, Smart))) << '\n'
+                   << LVD_REFLECT(sequential_bs.belief_set() == parallel_bs.belief_set()) << '\n';
+
+        lvd::g_log << lvd::Log::dbg() << sequential_bs << "saturated in " << sequential_round_stats.size() << " rounds, and in " << parallel_round_stats.size() << " rounds with 2 threads\n\n";
+    }
+
+    //
+    // Truth maintenance
+    //
+
+    {
+        // Smart people like cats and vice versa (so that Smart and LikesA Cat justify each other in a
+        // cycle), and smart people tell the truth.
+        BeliefSystem tms_bs;
+        tms_bs.add_rule(rule0);
+        tms_bs.add_rule(Implication(SubjVerbObj(X, LikesA, Cat), Implies, SubjVerbObj(X, HasProperty, Smart)));
+        tms_bs.add_rule(Implication(Predicate_And(And, sept::Tuple(SubjVerbObj(X, HasProperty, Smart), SubjVerbObj(X, Says, Y))), Implies, Y));
+        tms_bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+        tms_bs.add_belief(SubjVerbObj(Alice, Says, SubjVerbObj(Bob, HasProperty, Smart)));
+        tms_bs.add_belief(SubjVerbObj(Bob, Says, SubjVerbObj(Charlie, HasProperty, Smart)));
+        tms_bs.add_belief(SubjVerbObj(Charlie, HasProperty, Smart));
+        for (auto const &justification : tms_bs.truth_maintenance().justifications_of(SubjVerbObj(Charlie, HasProperty, Smart)))
+            lvd::g_log << lvd::Log::dbg() << "Charlie is smart because of " << justification << '\n';
+
+        // Retracting Alice being smart withdraws everything derived from it, even though Alice being smart
+        // and liking cats justify each other, but Charlie is still smart, since that was also asserted.
+        lvd::g_log << lvd::Log::dbg() << "retracting the belief that Alice is smart...\n";
+        auto withdrawn_beliefs = tms_bs.remove_belief(SubjVerbObj(Alice, HasProperty, Smart));
+        lvd::g_log << lvd::Log::dbg()
+                   << LVD_REFLECT(withdrawn_beliefs.size()) << '\n'
+                   << LVD_REFLECT(tms_bs.evaluate_predicate(SubjVerbObj(Bob, LikesA, Cat))) << '\n'
+                   << LVD_REFLECT(tms_bs.evaluate_predicate(SubjVerbObj(Charlie, LikesA, Cat))) << '\n';
+
+        // Re-adding it re-derives only what was withdrawn.
+        lvd::g_log << lvd::Log::dbg() << "re-adding the belief that Alice is smart...\n";
+        auto join_count = tms_bs.rule_network().join_count();
+        tms_bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+        lvd::g_log << lvd::Log::dbg() << tms_bs
+                   << "re-deriving took " << tms_bs.rule_network().join_count() - join_count << " joins\n\n";
+    }
+
+    //
+    // evaluate_predicate memoization
+    //
+
+    {
+        BeliefSystem eval_bs;
+        eval_bs.add_belief(SubjVerbObj(Alice, HasProperty, Smart));
+        eval_bs.add_belief(SubjVerbObj(Alice, LikesA, Cat));
+        eval_bs.add_belief(Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat)));
+        auto implication = Implication(SubjVerbObj(Alice, HasProperty, Smart), Implies, SubjVerbObj(Alice, LikesA, Cat));
+        auto compound = Predicate_And(And, sept::Tuple(implication, Predicate_Not(Not, SubjVerbObj(Dave, LikesA, Cat))));
+        // The second and later evaluations come from the memo, as do those of the operands evaluated
+        // along the way.
+        for (size_t i = 0; i < 1000; ++i)
+            eval_bs.evaluate_predicate(compound);
+        eval_bs.evaluate_predicate(implication);
+        lvd::g_log << lvd::Log::dbg()
+                   << LVD_REFLECT(eval_bs.evaluation_memo_hit_count()) << '\n'
+                   << LVD_REFLECT(eval_bs.evaluation_memo_miss_count()) << '\n';
+
+        // Changing the belief set invalidates the memo.
+        eval_bs.remove_belief(SubjVerbObj(Alice, LikesA, Cat));
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(compound) << '\n'
+                   << LVD_REFLECT(eval_bs.evaluate_predicate(compound)) << '\n'
+                   << LVD_REFLECT(eval_bs.generation()) << "\n\n";
+    }
+
+    //
+    // Belief filters
+    //
+
+    {
+        // Enough beliefs to make the filters grow a few times, and then remove most of them, so that
+        // they're rebuilt.
+        BeliefSystem filter_bs;
+        std::vector<sept::Data> beliefs;
+        for (uint32_t i = 0; i < 200; ++i) {
+            beliefs.push_back(sept::Tuple(sept::Uint32(i), LikesA, Cat));
+            beliefs.push_back(Predicate_Not(Not, sept::Tuple(sept::Uint32(i), HasProperty, Red)));
+        }
+        for (auto const &belief : beliefs)
+            filter_bs.add_belief(belief);
+
+        // Count the absent beliefs that get past the filter.
+        size_t false_positive_count = 0;
+        size_t const ABSENT_COUNT = 10000;
+        for (uint32_t i = 200; i < 200+ABSENT_COUNT; ++i)
+            if (filter_bs.belief_filter().may_contain(std::hash<sept::Data>()(sept::Tuple(sept::Uint32(i), LikesA, Cat))))
+                ++false_positive_count;
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(filter_bs.belief_filter().inserted_count()) << '\n'
+                   << LVD_REFLECT(filter_bs.belief_filter().byte_count()) << '\n'
+                   << LVD_REFLECT(filter_bs.belief_filter().false_positive_rate()) << '\n'
+                   << "measured false positive rate = " << double(false_positive_count) / ABSENT_COUNT << '\n';
+
+        for (size_t i = 0; i < beliefs.size(); ++i)
+            if (i % 10 != 0)
+                filter_bs.remove_belief(beliefs[i]);
+        lvd::g_log << lvd::Log::dbg() << "after removing 90% of the beliefs, " << LVD_REFLECT(filter_bs.belief_filter().inserted_count()) << '\n'
+                   << LVD_REFLECT(filter_bs.belief_filter().false_positive_rate()) << "\n\n";
+    }
+
+    //
+    // Canonical forms
+    //
+
+    {
+        sept::Data a = SubjVerbObj(Hat, HasProperty, Green);
+        sept::Data b = SubjVerbObj(Hat, HasProperty, Small);
+        sept::Data c = SubjVerbObj(Cup, HasProperty, Blue);
+        // Commutative operands are sorted, and duplicate And/Or operands are removed, so equivalent
+        // predicates are equal.
+        auto p = Predicate_Or(Or, sept::Tuple(a, Predicate_Not(Not, Predicate_And(And, sept::Tuple(b, c)))));
+        auto q = Predicate_Or(Or, sept::Tuple(Predicate_Not(Not, Predicate_And(And, sept::Tuple(c, b, c))), a, a));
+        lvd::g_log << lvd::Log::dbg()
+                   << LVD_REFLECT(demorganize_data(p)) << '\n'
+                   << LVD_REFLECT(demorganize_data(q)) << '\n';
+
+        PredicateCanonicalizer canonicalizer;
+        for (auto const &predicate : {p, q, p})
+            canonicalizer.canonical_form(predicate);
+        lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(canonicalizer.memo_size()) << ", " << LVD_REFLECT(canonicalizer.hit_count()) << ", " << LVD_REFLECT(canonicalizer.miss_count()) << '\n';
+
+        // Equivalent beliefs are stored once.
+        BeliefSystem canonical_bs;
+        canonical_bs.add_belief(Predicate_Or(Or, sept::Tuple(a, b)));
+        canonical_bs.add_belief(Predicate_Or(Or, sept::Tuple(b, a)));
+        canonical_bs.add_belief(Predicate_Or(Or, sept::Tuple(b, a, b)));
+        lvd::g_log << lvd::Log::dbg() << canonical_bs << '\n';
+    }
+
     auto inference = SubjVerbObj(Predicate_And(And, sept::Tuple(SubjVerbObj(X, HasProperty, Smart), SubjVerbObj(X, Says, Y))), Implies, Y);
     lvd::g_log << lvd::Log::dbg() << LVD_REFLECT(inference) << '\n';
 
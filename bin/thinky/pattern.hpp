@@ -1,8 +1,12 @@
 // 2021.05.16 - Victor Dods
 
+#pragma once
+
 #include "common.hpp"
 #include "sept/Data.hpp"
+#include "sept/Match.hpp"
 #include "sept/SymbolTable.hpp"
+#include <vector>
 
 class Match {
 public:
@@ -26,5 +30,46 @@ std::ostream &operator<< (std::ostream &out, Match const &match);
 // This will return std::nullopt if there is no match, otherwise a populated Match struct.
 std::optional<Match> matched_pattern__data (sept::Data const &pattern, sept::Data &&term, lvd::Log *match_failure_log = nullptr);
 
-// Substitute FreeVars with their SymbolTable-defined values in a term.
+// Substitute FreeVars with their SymbolTable-defined values in a term.  Only the subterms along the paths
+// to substituted FreeVars are rebuilt; the rest are copied whole.  Every subterm is still visited on each
+// call, since nothing records which subterms have no FreeVars, so to substitute into the same term
+// repeatedly (e.g. a rule's conclusion), compile it into a SubstitutionTemplate instead.
 sept::Data free_var_substitution__data (sept::Data const &term, sept::SymbolTable const &symbol_assignment) noexcept;
+
+struct SubstitutionKind;
+
+// A term compiled for repeated substitution of its FreeVars with the bindings of a MatchFrame (e.g. the
+// conclusion of a rule whose premise was compiled into MatchPatterns using the same MatchVars), which
+// avoids copying the bindings into a SymbolTable.  Each subterm without FreeVars is compiled into a
+// single constant, so it's copied whole rather than traversed, and only the subterms containing FreeVars
+// are rebuilt.  FreeVars whose slots aren't bound are left as is.
+class SubstitutionTemplate {
+public:
+
+    SubstitutionTemplate (sept::Data const &term, sept::MatchVars &vars);
+
+    sept::Data instantiate (sept::MatchFrame const &frame) const;
+
+private:
+
+    enum class Op : uint8_t {
+        CONSTANT,   // m_value_index is the subterm, which has no FreeVars.
+        FREE_VAR,   // m_arg is the slot, and m_value_index is the FreeVar itself.
+        COMPOUND,   // m_arg is the subterm count; the subterms follow.
+    };
+
+    struct Node {
+        Op m_op;
+        uint32_t m_arg;
+        uint32_t m_value_index;
+        SubstitutionKind const *m_kind;
+    };
+
+    // Returns true iff term contains a FreeVar.
+    bool compile (sept::Data const &term, sept::MatchVars &vars);
+    sept::Data instantiate (size_t &i, sept::MatchFrame const &frame) const;
+
+    // The term in preorder.
+    std::vector<Node> m_nodes;
+    std::vector<sept::Data> m_values;
+};
@@ -0,0 +1,107 @@
+// 2021.05.29 - Victor Dods
+
+// The sept data model registrations for the types in thinky.  These are in their own translation unit so
+// that both thinky and test-thinky can link them in.
+
+// Includes from this program's source
+#include "common.hpp"
+
+#include "sept/FormalTypeOf.hpp"
+#include "sept/UnionTerm.hpp"
+
+//
+// sept data model registrations
+//
+
+namespace sept {
+SEPT__REGISTER__PRINT(Adjective_c)
+SEPT__REGISTER__PRINT(Animal_c)
+SEPT__REGISTER__PRINT(BinOp_c)
+SEPT__REGISTER__PRINT(BoolBinOp_c)
+SEPT__REGISTER__PRINT(Color_c)
+SEPT__REGISTER__PRINT(Entity_c)
+// SEPT__REGISTER__PRINT__GIVE_ID(sem::Expr_Term_c, __sem__Expr_Term_c__)
+SEPT__REGISTER__PRINT(Object_c)
+SEPT__REGISTER__PRINT(Person_c)
+SEPT__REGISTER__PRINT(ThinkyNPTerm)
+SEPT__REGISTER__PRINT(UnOp_c)
+SEPT__REGISTER__PRINT(Verb_c)
+SEPT__REGISTER__PRINT__GIVE_ID(char const *, __char_const_ptr__)
+
+SEPT__REGISTER__HASH(Adjective_c)
+SEPT__REGISTER__HASH(Animal_c)
+SEPT__REGISTER__HASH(BinOp_c)
+SEPT__REGISTER__HASH(BoolBinOp_c)
+SEPT__REGISTER__HASH(Color_c)
+SEPT__REGISTER__HASH(Entity_c)
+// SEPT__REGISTER__HASH__GIVE_ID(sem::Expr_Term_c, __sem__Expr_Term_c__)
+SEPT__REGISTER__HASH(Object_c)
+SEPT__REGISTER__HASH(Person_c)
+SEPT__REGISTER__HASH(ThinkyNPTerm)
+SEPT__REGISTER__HASH(UnOp_c)
+SEPT__REGISTER__HASH(Verb_c)
+
+SEPT__REGISTER__EQ(Adjective_c)
+SEPT__REGISTER__EQ(Animal_c)
+SEPT__REGISTER__EQ(BinOp_c)
+SEPT__REGISTER__EQ(BoolBinOp_c)
+SEPT__REGISTER__EQ(Color_c)
+SEPT__REGISTER__EQ(Entity_c)
+SEPT__REGISTER__EQ(Object_c)
+SEPT__REGISTER__EQ(Person_c)
+SEPT__REGISTER__EQ(ThinkyNPTerm)
+SEPT__REGISTER__EQ(UnOp_c)
+SEPT__REGISTER__EQ(Verb_c)
+
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Adjective_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Animal_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(BinOp_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(BoolBinOp_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Color_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Entity_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Object_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Person_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(UnOp_c)
+SEPT__REGISTER__ABSTRACT_TYPE_OF(Verb_c)
+
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Adjective_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Animal_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, BinOp_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, BoolBinOp_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Color_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Entity_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Object_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Person_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, UnOp_c)
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, Verb_c)
+SEPT__REGISTER__INHABITS__GIVE_ID__NONDATA(ThinkyNPTerm, FormalTypeOf_Term_c, __ThinkyNPTerm___sem__FormalTypeOf_Term_c__)
+// TODO there are probably some missing
+
+SEPT__REGISTER__COMPARE__SINGLETON(Adjective_c)
+SEPT__REGISTER__COMPARE__SINGLETON(Animal_c)
+SEPT__REGISTER__COMPARE__SINGLETON(BinOp_c)
+SEPT__REGISTER__COMPARE__SINGLETON(BoolBinOp_c)
+SEPT__REGISTER__COMPARE__SINGLETON(Color_c)
+SEPT__REGISTER__COMPARE__SINGLETON(Entity_c)
+SEPT__REGISTER__COMPARE__SINGLETON(Object_c)
+SEPT__REGISTER__COMPARE__SINGLETON(Person_c)
+SEPT__REGISTER__COMPARE__SINGLETON(UnOp_c)
+SEPT__REGISTER__COMPARE__SINGLETON(Verb_c)
+SEPT__REGISTER__COMPARE(ThinkyNPTerm, ThinkyNPTerm)
+
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Adjective_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Animal_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(BinOp_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(BoolBinOp_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Color_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Entity_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Object_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Person_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnOp_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(Verb_c, ThinkyNPTerm)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(FormalTypeOf_Term_c, ThinkyNPTerm)
+
+// TEMP HACK
+SEPT__REGISTER__INHABITS__NONDATA(ThinkyNPTerm, UnionTerm_c)
+SEPT__REGISTER__CONSTRUCT_INHABITANT_OF__ABSTRACT_TYPE(UnionTerm_c, ThinkyNPTerm)
+} // end namespace sept
@@ -0,0 +1,330 @@
+// 2021.05.22 - Victor Dods
+
+#include "rete.hpp"
+
+#include <algorithm>
+#include "ast.hpp"
+#include <lvd/fmt.hpp>
+#include "pattern.hpp"
+#include "sept/FreeVar.hpp"
+#include "sept/SymbolTable.hpp"
+#include "sept/TupleTerm.hpp"
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace {
+
+// Returns the premise in disjunctive normal form, i.e. a list of alternatives, any of which implies the
+// conclusion, each of which is a list of conjuncts.  The premise should already be in canonical form
+// (see demorganize_data).
+std::vector<std::vector<sept::Data>> premise_alternatives (sept::Data const &premise) {
+    if (inhabits_data(premise, Predicate_Or)) {
+        std::vector<std::vector<sept::Data>> alternatives;
+        auto operand_tuple = premise[1].move_cast<sept::TupleTerm_c>();
+        for (auto const &operand : operand_tuple.elements())
+            for (auto &alternative : premise_alternatives(operand))
+                alternatives.emplace_back(std::move(alternative));
+        return alternatives;
+    } else if (inhabits_data(premise, Predicate_And)) {
+        // Distribute the And over the alternatives of its operands.
+        std::vector<std::vector<sept::Data>> alternatives{{}};
+        auto operand_tuple = premise[1].move_cast<sept::TupleTerm_c>();
+        for (auto const &operand : operand_tuple.elements()) {
+            std::vector<std::vector<sept::Data>> product;
+            for (auto const &operand_alternative : premise_alternatives(operand)) {
+                for (auto const &alternative : alternatives) {
+                    auto conjuncts = alternative;
+                    conjuncts.insert(conjuncts.end(), operand_alternative.begin(), operand_alternative.end());
+                    product.emplace_back(std::move(conjuncts));
+                }
+            }
+            alternatives = std::move(product);
+        }
+        return alternatives;
+    } else if (inhabits_data(premise, Predicate_Xor)) {
+        throw std::runtime_error(LVD_FMT("Predicate_Xor isn't supported in the premise of a rule of inference: " << premise));
+    } else {
+        return {{premise}};
+    }
+}
+
+// Returns true iff every FreeVar in conclusion also occurs in one of the conjuncts.
+bool free_vars_are_bound (std::vector<sept::Data> const &conjuncts, sept::Data const &conclusion) {
+    // Compiling the patterns assigns the slots.
+    sept::MatchVars vars;
+    for (auto const &conjunct : conjuncts)
+        sept::MatchPattern{conjunct, vars};
+    auto bound_var_count = vars.size();
+    sept::MatchPattern{conclusion, vars};
+    return vars.size() == bound_var_count;
+}
+
+// Renames the FreeVars in pattern to FreeVar("0"), FreeVar("1"), etc. in order of first occurrence, so
+// that patterns which are the same up to renaming of FreeVars are equal.
+sept::Data canonicalized_pattern (sept::Data const &pattern) {
+    sept::MatchVars vars;
+    sept::MatchPattern{pattern, vars};
+    sept::SymbolTable renaming;
+    for (uint32_t slot = 0; slot < vars.size(); ++slot)
+        renaming.define_symbol(vars.id(slot), sept::FreeVar(std::to_string(slot)));
+    return free_var_substitution__data(pattern, renaming);
+}
+
+// Returns, for each i, the index in path just past the subterm that starts at path[i].
+std::vector<size_t> subterm_ends_of (std::vector<TermKey> const &path) {
+    std::vector<size_t> subterm_ends(path.size());
+    // Returns the end of the subterm starting at i.
+    auto compute = [&](auto &compute, size_t i) -> size_t {
+        size_t end = i + 1;
+        for (size_t k = 0; k < path[i].arity(); ++k)
+            end = compute(compute, end);
+        subterm_ends[i] = end;
+        return end;
+    };
+    if (!path.empty())
+        compute(compute, 0);
+    return subterm_ends;
+}
+
+} // end namespace
+
+RuleNetwork::AlphaMemory::AlphaMemory (sept::Data const &pattern)
+    :   m_pattern(pattern)
+    ,   m_match_pattern(m_pattern, m_vars)
+{ }
+
+RuleNetwork::RuleNetwork ()
+    :   m_join_count(0)
+{ }
+
+RuleNetwork::~RuleNetwork () = default;
+
+std::vector<std::vector<sept::Data>> rule_alternatives (sept::Data const &inference) {
+    if (!inhabits_data(inference, Implication))
+        throw std::runtime_error(LVD_FMT("expected an Implication as a rule of inference, but got " << inference));
+    // TODO: Write extractions
+    auto premise = inference[0];
+    auto conclusion = inference[2];
+    auto alternatives = premise_alternatives(demorganize_data(premise));
+    for (auto const &conjuncts : alternatives)
+        if (!free_vars_are_bound(conjuncts, conclusion))
+            throw std::runtime_error(LVD_FMT("conclusion " << conclusion << " of rule " << inference << " has a FreeVar that doesn't occur in the premise (or in one of its alternatives)"));
+    return alternatives;
+}
+
+bool RuleNetwork::can_add_rule (sept::Data const &inference) {
+    try {
+        rule_alternatives(inference);
+        return true;
+    } catch (std::runtime_error const &) {
+        return false;
+    }
+}
+
+void RuleNetwork::add_rule (sept::Data const &inference, BeliefIndex const &existing_beliefs, std::vector<Derivation> &fired_conclusions) {
+    // This checks all the alternatives before any of them are added, so that nothing is added if it throws.
+    auto alternatives = rule_alternatives(inference);
+    for (auto const &conjuncts : alternatives)
+        add_rule_for_conjuncts(conjuncts, inference, existing_beliefs, fired_conclusions);
+}
+
+void RuleNetwork::add_belief (sept::Data const &belief, std::vector<Derivation> &fired_conclusions) {
+    std::vector<TermKey> path;
+    append_term_path(belief, path);
+    std::vector<AlphaMemory*> alpha_memories;
+    collect_alpha_memories(m_alpha_root, path, subterm_ends_of(path), 0, alpha_memories);
+
+    // First put the belief into every alpha memory whose pattern it matches, and then do the activations
+    // in decreasing order of conjunct index.  Otherwise, if the belief matched two conjuncts of a rule,
+    // the combination of it with itself would be produced twice -- once by the left activation following
+    // the earlier conjunct's activation, and once by the later conjunct's activation.
+    struct Activation {
+        Rule *m_rule;
+        size_t m_conjunct_index;
+        sept::Data const *m_belief;
+    };
+    std::vector<Activation> activations;
+    for (auto *alpha_memory : alpha_memories) {
+        sept::MatchFrame frame(alpha_memory->m_vars.size());
+        ++m_join_count;
+        if (!sept::match(alpha_memory->m_match_pattern, belief, frame))
+            continue;
+        auto was_inserted = alpha_memory->m_beliefs.insert(&belief).second;
+        assert(was_inserted && "belief is already in the RuleNetwork");
+        std::ignore = was_inserted;
+        for (auto const &[rule, conjunct_index] : alpha_memory->m_successors)
+            activations.push_back(Activation{rule, conjunct_index, &belief});
+    }
+    std::stable_sort(
+        activations.begin(),
+        activations.end(),
+        [](Activation const &lhs, Activation const &rhs){ return lhs.m_conjunct_index > rhs.m_conjunct_index; }
+    );
+    for (auto const &activation : activations)
+        activate_right(*activation.m_rule, activation.m_conjunct_index, *activation.m_belief, fired_conclusions);
+}
+
+void RuleNetwork::remove_belief (sept::Data const &belief) {
+    std::vector<TermKey> path;
+    append_term_path(belief, path);
+    std::vector<AlphaMemory*> alpha_memories;
+    collect_alpha_memories(m_alpha_root, path, subterm_ends_of(path), 0, alpha_memories);
+
+    sept::Data const *belief_ptr = &belief;
+    for (auto *alpha_memory : alpha_memories) {
+        auto it = alpha_memory->m_beliefs.find(belief_ptr);
+        if (it == alpha_memory->m_beliefs.end())
+            continue;
+        for (auto const &[rule, conjunct_index] : alpha_memory->m_successors) {
+            // Only the tokens at or after the conjunct's beta memory can contain the belief.
+            for (size_t i = conjunct_index; i < rule->m_beta_memories.size(); ++i) {
+                auto &tokens = rule->m_beta_memories[i];
+                tokens.erase(
+                    std::remove_if(
+                        tokens.begin(),
+                        tokens.end(),
+                        [belief_ptr, conjunct_index=conjunct_index](Token const &token){ return token.m_beliefs[conjunct_index] == belief_ptr; }
+                    ),
+                    tokens.end()
+                );
+            }
+        }
+        alpha_memory->m_beliefs.erase(it);
+    }
+}
+
+void RuleNetwork::add_rule_for_conjuncts (std::vector<sept::Data> const &conjuncts, sept::Data const &inference, BeliefIndex const &existing_beliefs, std::vector<Derivation> &fired_conclusions) {
+    // A rule with no conjuncts (e.g. one whose premise is an empty Predicate_And) fires unconditionally.
+    auto conclusion = inference[2];
+    if (conjuncts.empty()) {
+        fired_conclusions.push_back(Derivation{conclusion, Justification{inference, {}}});
+        return;
+    }
+
+    auto rule = std::make_unique<Rule>(Rule{inference, sept::MatchVars{}, {}, {}, {}, conclusion, std::nullopt});
+    rule->m_conjuncts.reserve(conjuncts.size());
+    for (auto const &conjunct : conjuncts)
+        rule->m_conjuncts.emplace_back(conjunct, rule->m_vars);
+    rule->m_conclusion_template.emplace(conclusion, rule->m_vars);
+    rule->m_beta_memories.resize(conjuncts.size() - 1);
+    for (size_t i = 0; i < conjuncts.size(); ++i) {
+        auto &alpha_memory = ensure_alpha_memory(conjuncts[i], existing_beliefs);
+        alpha_memory.m_successors.emplace_back(rule.get(), i);
+        rule->m_alpha_memories.push_back(&alpha_memory);
+    }
+
+    // Fire the rule for the existing beliefs.  All its alpha memories are populated, so activating
+    // the first conjunct for each of its beliefs produces every combination exactly once.
+    auto &r = *rule;
+    m_rules.emplace_back(std::move(rule));
+    for (auto const *belief : r.m_alpha_memories[0]->m_beliefs)
+        activate_right(r, 0, *belief, fired_conclusions);
+}
+
+RuleNetwork::AlphaMemory &RuleNetwork::ensure_alpha_memory (sept::Data const &conjunct, BeliefIndex const &existing_beliefs) {
+    auto pattern = canonicalized_pattern(conjunct);
+    auto it = m_alpha_memories.find(pattern);
+    if (it != m_alpha_memories.end())
+        return *it->second;
+
+    auto &alpha_memory = *m_alpha_memories.emplace(pattern, std::make_unique<AlphaMemory>(pattern)).first->second;
+
+    // Add it to the discrimination tree.
+    PatternPath path;
+    append_pattern_path(pattern, path);
+    AlphaNode *node = &m_alpha_root;
+    for (auto &key_o : path) {
+        auto &child = key_o.has_value() ? node->m_children[std::move(key_o.value())] : node->m_wildcard_child;
+        if (child == nullptr)
+            child = std::make_unique<AlphaNode>();
+        node = child.get();
+    }
+    node->m_alpha_memories.push_back(&alpha_memory);
+
+    // Populate it with the existing beliefs that match.
+    sept::MatchFrame frame(alpha_memory.m_vars.size());
+    for (auto const *belief : existing_beliefs.candidate_belief_ptrs(pattern)) {
+        ++m_join_count;
+        if (sept::match(alpha_memory.m_match_pattern, *belief, frame)) {
+            frame.clear();
+            alpha_memory.m_beliefs.insert(belief);
+        }
+    }
+
+    return alpha_memory;
+}
+
+void RuleNetwork::collect_alpha_memories (AlphaNode const &node, std::vector<TermKey> const &path, std::vector<size_t> const &subterm_ends, size_t i, std::vector<AlphaMemory*> &out) const {
+    if (i == path.size()) {
+        out.insert(out.end(), node.m_alpha_memories.begin(), node.m_alpha_memories.end());
+        return;
+    }
+    auto it = node.m_children.find(path[i]);
+    if (it != node.m_children.end())
+        collect_alpha_memories(*it->second, path, subterm_ends, i+1, out);
+    if (node.m_wildcard_child != nullptr)
+        collect_alpha_memories(*node.m_wildcard_child, path, subterm_ends, subterm_ends[i], out);
+}
+
+void RuleNetwork::activate_right (Rule &rule, size_t conjunct_index, sept::Data const &belief, std::vector<Derivation> &fired_conclusions) {
+    auto const &conjunct = rule.m_conjuncts[conjunct_index];
+    if (conjunct_index == 0) {
+        ++m_join_count;
+        Token token{{&belief}, sept::MatchFrame(rule.m_vars.size())};
+        if (sept::match(conjunct, belief, token.m_frame))
+            activate_left(rule, 0, std::move(token), fired_conclusions);
+        return;
+    }
+
+    // Join with the tokens of the preceding conjuncts.  Tokens produced by this are only added to later
+    // beta memories, so the indices stay valid.
+    auto &tokens = rule.m_beta_memories[conjunct_index-1];
+    for (size_t k = 0, token_count = tokens.size(); k < token_count; ++k) {
+        ++m_join_count;
+        // Match directly against the token's frame and undo afterward, so that a failed join doesn't
+        // copy anything.
+        auto &frame = tokens[k].m_frame;
+        auto trail_mark = frame.trail_mark();
+        if (sept::match(conjunct, belief, frame)) {
+            Token token{tokens[k].m_beliefs, frame};
+            token.m_beliefs.push_back(&belief);
+            frame.undo_to(trail_mark);
+            activate_left(rule, conjunct_index, std::move(token), fired_conclusions);
+        }
+    }
+}
+
+void RuleNetwork::activate_left (Rule &rule, size_t conjunct_index, Token &&token, std::vector<Derivation> &fired_conclusions) {
+    if (conjunct_index+1 == rule.m_conjuncts.size()) {
+        std::vector<sept::Data> premises;
+        premises.reserve(token.m_beliefs.size());
+        for (auto const *belief : token.m_beliefs)
+            premises.push_back(*belief);
+        fired_conclusions.push_back(
+            Derivation{
+                rule.m_conclusion_template->instantiate(token.m_frame),
+                Justification{rule.m_inference, std::move(premises)}
+            }
+        );
+        return;
+    }
+
+    auto &tokens = rule.m_beta_memories[conjunct_index];
+    tokens.emplace_back(std::move(token));
+    size_t k = tokens.size() - 1;
+    auto const &next_conjunct = rule.m_conjuncts[conjunct_index+1];
+    // Join with the beliefs of the next conjunct.
+    for (auto const *belief : rule.m_alpha_memories[conjunct_index+1]->m_beliefs) {
+        ++m_join_count;
+        // Only later beta memories are added to below, so tokens[k] stays valid.
+        auto &frame = tokens[k].m_frame;
+        auto trail_mark = frame.trail_mark();
+        if (sept::match(next_conjunct, *belief, frame)) {
+            Token next_token{tokens[k].m_beliefs, frame};
+            next_token.m_beliefs.push_back(belief);
+            frame.undo_to(trail_mark);
+            activate_left(rule, conjunct_index+1, std::move(next_token), fired_conclusions);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+// 2021.05.22 - Victor Dods
+
+#pragma once
+
+#include "common.hpp"
+#include "index.hpp"
+#include <memory>
+#include <optional>
+#include "pattern.hpp"
+#include "sept/Data.hpp"
+#include "sept/Match.hpp"
+#include "tms.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Returns the premise of the given rule of inference in disjunctive normal form (after demorganize_data),
+// i.e. a list of alternatives, any of which implies the conclusion, each of which is a list of conjuncts
+// (patterns).  Throws if the rule isn't an Implication, if the premise contains a Predicate_Xor, or if
+// the conclusion contains a FreeVar that isn't in every alternative (since it would be left
+// unsubstituted).
+std::vector<std::vector<sept::Data>> rule_alternatives (sept::Data const &inference);
+
+// A Rete network for forward chaining of rules of inference (Implications whose premise and conclusion
+// may contain FreeVars).  Instead of matching every rule against every belief whenever something changes
+// (as derive_beliefs_2 does for a single rule), each rule is compiled into the network once, and then
+// each new belief is pushed through the network, which only does work for the rules that it could
+// contribute to, and produces only the conclusions that it newly enables.
+//
+// A rule's premise is split into alternatives (see rule_alternatives), each of which is compiled as a
+// separate rule, since (a or b) => q is equivalent to (a => q) and (b => q).
+//
+// -    The alpha network tests each belief against the conjuncts' patterns.  Conjuncts that are the same
+//      pattern (up to renaming of FreeVars) share an alpha memory, which holds the beliefs that match it.
+//      The alpha memories that a belief could match are found using a discrimination tree over the
+//      patterns (see TermKey), so the cost of adding a belief doesn't depend on the number of unrelated
+//      rules.
+// -    Each rule has a beta memory per conjunct (except the last), holding the partial matches (tokens) of
+//      its conjuncts so far, i.e. the combinations of beliefs whose FreeVar bindings are consistent.  When
+//      a belief enters an alpha memory, it's joined with the tokens of the preceding conjunct of each rule
+//      that uses that alpha memory, and each new token is joined with the beliefs of the next conjunct's
+//      alpha memory, and so on.  A token that completes a rule's premise fires it, i.e. produces the
+//      conclusion with the FreeVars substituted.
+//
+// This class only tracks the beliefs that it's given, and returns the fired conclusions to the caller
+// (see BeliefSystem::add_belief), rather than adding them itself, so that nothing is modified while the
+// network is being traversed.  Each conclusion comes with its Justification, i.e. the rule and the
+// beliefs that matched its conjuncts.  Like BeliefIndex, the network points to the beliefs rather than
+// copying them, so each belief must stay where it is until it's removed.
+class RuleNetwork {
+public:
+
+    RuleNetwork ();
+    ~RuleNetwork ();
+
+    RuleNetwork (RuleNetwork const &) = delete;
+    RuleNetwork &operator= (RuleNetwork const &) = delete;
+
+    size_t rule_count () const { return m_rules.size(); }
+    size_t alpha_memory_count () const { return m_alpha_memories.size(); }
+    // The number of joins (i.e. matches of a conjunct's pattern against a belief) done so far, which is
+    // a measure of how much work the network has done.
+    size_t join_count () const { return m_join_count; }
+
+    // Returns true iff add_rule would accept the given rule of inference.
+    static bool can_add_rule (sept::Data const &inference);
+    // Compiles the given rule of inference into the network, and fires it for the existing beliefs (given
+    // by existing_beliefs, which must be the beliefs added so far), adding the conclusions to
+    // fired_conclusions.  Throws if rule_alternatives does.
+    void add_rule (sept::Data const &inference, BeliefIndex const &existing_beliefs, std::vector<Derivation> &fired_conclusions);
+
+    // Pushes a new belief through the network, adding the conclusions of the rules that it newly enables
+    // to fired_conclusions.  The belief must not already be in the network.
+    void add_belief (sept::Data const &belief, std::vector<Derivation> &fired_conclusions);
+    // Removes the belief at the given address (i.e. the one that was added, or found in existing_beliefs
+    // by add_rule) from the alpha memories, and the tokens that it's a part of.  This doesn't retract
+    // conclusions that have already been fired.
+    void remove_belief (sept::Data const &belief);
+
+private:
+
+    struct AlphaMemory;
+    struct Rule;
+
+    // A partial match of a Rule's premise: the beliefs matched by its first conjuncts, and the resulting
+    // FreeVar bindings (which point into those beliefs).
+    struct Token {
+        std::vector<sept::Data const *> m_beliefs;
+        sept::MatchFrame m_frame;
+    };
+
+    struct AlphaMemory {
+        // The conjunct's pattern, with FreeVars renamed canonically.
+        sept::Data m_pattern;
+        sept::MatchVars m_vars;
+        sept::MatchPattern m_match_pattern;
+        std::unordered_set<sept::Data const *> m_beliefs;
+        // Each element is a Rule and the index of its conjunct that uses this alpha memory.
+        std::vector<std::pair<Rule*,size_t>> m_successors;
+
+        AlphaMemory (sept::Data const &pattern);
+    };
+
+    struct Rule {
+        // The rule of inference that this is (an alternative of).
+        sept::Data m_inference;
+        sept::MatchVars m_vars;
+        std::vector<sept::MatchPattern> m_conjuncts;
+        std::vector<AlphaMemory*> m_alpha_memories;
+        // m_beta_memories[i] holds the tokens matching conjuncts 0 through i.  There's none for the last
+        // conjunct, since those tokens fire the rule and aren't needed afterward.
+        std::vector<std::vector<Token>> m_beta_memories;
+        sept::Data m_conclusion;
+        // Compiled after the conjuncts, so that it shares their slots.
+        std::optional<SubstitutionTemplate> m_conclusion_template;
+    };
+
+    // The alpha network's discrimination tree, whose paths are those of the alpha memories' patterns.
+    struct AlphaNode {
+        std::unordered_map<TermKey,std::unique_ptr<AlphaNode>,TermKeyHash> m_children;
+        std::unique_ptr<AlphaNode> m_wildcard_child;
+        std::vector<AlphaMemory*> m_alpha_memories;
+    };
+
+    void add_rule_for_conjuncts (std::vector<sept::Data> const &conjuncts, sept::Data const &inference, BeliefIndex const &existing_beliefs, std::vector<Derivation> &fired_conclusions);
+    AlphaMemory &ensure_alpha_memory (sept::Data const &conjunct, BeliefIndex const &existing_beliefs);
+    // Collects the alpha memories whose patterns could match the term whose path starts at path[i].
+    void collect_alpha_memories (AlphaNode const &node, std::vector<TermKey> const &path, std::vector<size_t> const &subterm_ends, size_t i, std::vector<AlphaMemory*> &out) const;
+
+    // A belief entered the alpha memory of the given conjunct of rule.
+    void activate_right (Rule &rule, size_t conjunct_index, sept::Data const &belief, std::vector<Derivation> &fired_conclusions);
+    // A token matching conjuncts 0 through conjunct_index of rule was produced.
+    void activate_left (Rule &rule, size_t conjunct_index, Token &&token, std::vector<Derivation> &fired_conclusions);
+
+    std::vector<std::unique_ptr<Rule>> m_rules;
+    std::unordered_map<sept::Data,std::unique_ptr<AlphaMemory>> m_alpha_memories;
+    AlphaNode m_alpha_root;
+    size_t m_join_count;
+};
@@ -0,0 +1,700 @@
+// 2021.05.24 - Victor Dods
+
+#include "store.hpp"
+
+#include <algorithm>
+#include "ast.hpp"
+#include <cerrno>
+#include <chrono>
+#include "common.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <lvd/fmt.hpp>
+#include <lvd/g_log.hpp>
+#include <lvd/literal.hpp>
+#include "sept/FreeVar.hpp"
+#include "sept/TupleTerm.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+// TODO: Windows support
+
+namespace {
+
+char const SNAPSHOT_MAGIC[8] = {'T', 'H', 'N', 'K', 'S', 'N', 'A', 'P'};
+char const JOURNAL_MAGIC[8] = {'T', 'H', 'N', 'K', 'J', 'R', 'N', 'L'};
+uint32_t const STORE_VERSION = 0;
+size_t const JOURNAL_HEADER_SIZE = sizeof(JOURNAL_MAGIC) + sizeof(uint32_t);
+// The op and the payload length.
+size_t const RECORD_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t);
+
+enum class JournalOp : uint8_t {
+    ADD_BELIEF = 0,
+    REMOVE_BELIEF,
+};
+
+enum class TermCode : uint8_t {
+    THINKY_NP_TERM = 0, // The ThinkyNPTerm follows, as a byte.
+    TUPLE,              // The element count follows (as a varint), and then the elements.
+    FREE_VAR,           // The length of the id follows (as a varint), and then the id.
+    SEPT_DATA,          // The length follows (as a varint), and then the term, as written by serialize_data.
+};
+
+uint8_t const BELIEF_IS_ASSERTED = 1;
+
+// FNV-1a, since it has to be stable across processes (unlike std::hash).
+uint32_t checksum (char const *data, size_t size) {
+    uint32_t h = 0x811c9dc5u;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= uint8_t(data[i]);
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+struct DataPtrHash {
+    size_t operator() (sept::Data const *data) const { return std::hash<sept::Data>()(*data); }
+};
+struct DataPtrEq {
+    bool operator() (sept::Data const *lhs, sept::Data const *rhs) const { return *lhs == *rhs; }
+};
+
+// For deserializing directly out of a buffer instead of copying into a std::istringstream.
+class MemoryStreambuf : public std::streambuf {
+public:
+
+    MemoryStreambuf (char const *begin, size_t size) {
+        // std::streambuf's get area is non-const, but nothing writes through it.
+        auto p = const_cast<char *>(begin);
+        setg(p, p, p + size);
+    }
+};
+
+//
+// Encoding
+//
+
+template <typename T_>
+void append_pod (std::string &out, T_ const &value) {
+    out.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+// LEB128, since most counts and indices are small.
+void append_varint (std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(uint8_t(value) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+void append_term (std::string &out, sept::Data const &term) {
+    if (auto const *thinky_np_term = term.ptr_cast<ThinkyNPTerm>()) {
+        append_pod(out, TermCode::THINKY_NP_TERM);
+        append_pod(out, ThinkyNPTerm_CType(*thinky_np_term));
+    } else if (auto const *tuple_term = term.ptr_cast<sept::TupleTerm_c>()) {
+        append_pod(out, TermCode::TUPLE);
+        append_varint(out, tuple_term->size());
+        for (auto const &element : tuple_term->elements())
+            append_term(out, element);
+    } else if (auto const *free_var_term = term.ptr_cast<sept::FreeVarTerm_c>()) {
+        auto const &id = free_var_term->free_var_id__as_string();
+        append_pod(out, TermCode::FREE_VAR);
+        append_varint(out, id.size());
+        out.append(id);
+    } else {
+        std::ostringstream serialized;
+        sept::serialize_data(term, serialized);
+        auto const &bytes = serialized.str();
+        append_pod(out, TermCode::SEPT_DATA);
+        append_varint(out, bytes.size());
+        out.append(bytes);
+    }
+}
+
+std::string encode_record (JournalOp op, sept::Data const &belief) {
+    std::string payload;
+    append_term(payload, belief);
+    std::string record;
+    append_pod(record, op);
+    append_pod(record, uint32_t(payload.size()));
+    record.append(payload);
+    append_pod(record, checksum(record.data(), record.size()));
+    return record;
+}
+
+// Layout (all integers are native-endian unless noted):
+//
+//     Header         : magic "THNKSNAP", uint32_t version, uint64_t journal index, uint64_t rule count,
+//                      uint64_t belief count
+//     Rules          : term[rule count]
+//     Beliefs        : (term, uint8_t flags)[belief count]
+//     Justifications : for each belief, varint count, and then (varint rule index, varint premise count,
+//                      varint belief index[premise count])[count]
+//     Trailer        : uint32_t checksum of everything before it
+//
+// Varints are LEB128.  The journal index is that of the first journal that isn't included.
+std::string encode_snapshot (BeliefSystem const &belief_system, uint64_t journal_index) {
+    auto const &truth_maintenance = belief_system.truth_maintenance();
+
+    // Number the beliefs (so that premises can refer to them by index) and the distinct rules.
+    std::vector<sept::Data const *> beliefs;
+    std::unordered_map<sept::Data const *,uint64_t,DataPtrHash,DataPtrEq> belief_indices;
+    beliefs.reserve(belief_system.belief_set().size());
+    belief_indices.reserve(belief_system.belief_set().size());
+    std::vector<sept::Data const *> rules;
+    std::unordered_map<sept::Data const *,uint64_t,DataPtrHash,DataPtrEq> rule_indices;
+    for (auto const &belief : belief_system.belief_set()) {
+        belief_indices.emplace(&belief, beliefs.size());
+        beliefs.push_back(&belief);
+        for (auto const &justification : truth_maintenance.justifications_of(belief))
+            if (rule_indices.emplace(&justification.m_rule, rules.size()).second)
+                rules.push_back(&justification.m_rule);
+    }
+
+    std::string snapshot;
+    snapshot.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    append_pod(snapshot, STORE_VERSION);
+    append_pod(snapshot, journal_index);
+    append_pod(snapshot, uint64_t(rules.size()));
+    append_pod(snapshot, uint64_t(beliefs.size()));
+    for (auto const *rule : rules)
+        append_term(snapshot, *rule);
+    for (auto const *belief : beliefs) {
+        append_term(snapshot, *belief);
+        append_pod(snapshot, truth_maintenance.is_asserted(*belief) ? BELIEF_IS_ASSERTED : uint8_t(0));
+    }
+    for (auto const *belief : beliefs) {
+        auto const &justifications = truth_maintenance.justifications_of(*belief);
+        append_varint(snapshot, justifications.size());
+        for (auto const &justification : justifications) {
+            append_varint(snapshot, rule_indices.at(&justification.m_rule));
+            append_varint(snapshot, justification.m_premises.size());
+            for (auto const &premise : justification.m_premises)
+                append_varint(snapshot, belief_indices.at(&premise));
+        }
+    }
+    append_pod(snapshot, checksum(snapshot.data(), snapshot.size()));
+    return snapshot;
+}
+
+//
+// Decoding
+//
+
+class Reader {
+public:
+
+    Reader (char const *begin, size_t size, char const *what)
+        :   m_begin(begin)
+        ,   m_size(size)
+        ,   m_offset(0)
+        ,   m_what(what)
+    { }
+
+    size_t offset () const { return m_offset; }
+    size_t remaining () const { return m_size - m_offset; }
+
+    template <typename T_>
+    T_ read_pod () {
+        check(sizeof(T_));
+        T_ value;
+        std::memcpy(&value, m_begin + m_offset, sizeof(T_));
+        m_offset += sizeof(T_);
+        return value;
+    }
+    uint64_t read_varint () {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            auto byte = read_pod<uint8_t>();
+            value |= uint64_t(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        fail("overlong varint");
+    }
+    // Reads a count of things that each take at least one byte, so that a bad count doesn't cause a huge
+    // allocation.
+    size_t read_count () {
+        auto count = read_varint();
+        if (count > remaining())
+            fail("count exceeds the remaining size");
+        return size_t(count);
+    }
+    char const *read_bytes (size_t length) {
+        check(length);
+        auto bytes = m_begin + m_offset;
+        m_offset += length;
+        return bytes;
+    }
+    sept::Data read_term () {
+        switch (TermCode(read_pod<uint8_t>())) {
+            case TermCode::THINKY_NP_TERM: {
+                auto value = read_pod<ThinkyNPTerm_CType>();
+                if (value >= THINKY_NP_TERM_COUNT)
+                    fail("invalid ThinkyNPTerm");
+                return ThinkyNPTerm(value);
+            }
+            case TermCode::TUPLE: {
+                auto element_count = read_count();
+                sept::DataVector elements;
+                elements.reserve(element_count);
+                for (size_t i = 0; i < element_count; ++i)
+                    elements.emplace_back(read_term());
+                return sept::TupleTerm_c(std::move(elements));
+            }
+            case TermCode::FREE_VAR: {
+                auto length = read_count();
+                return sept::FreeVar(std::string(read_bytes(length), length));
+            }
+            case TermCode::SEPT_DATA: {
+                auto length = read_count();
+                MemoryStreambuf streambuf(read_bytes(length), length);
+                std::istream in(&streambuf);
+                in.exceptions(std::ios_base::failbit|std::ios_base::badbit);
+                return sept::deserialize_data(in);
+            }
+            default:
+                fail("invalid TermCode");
+        }
+    }
+
+    [[noreturn]] void fail (char const *reason) const {
+        throw std::runtime_error(LVD_FMT("malformed " << m_what << " (" << reason << " at offset " << m_offset << ')'));
+    }
+
+private:
+
+    void check (size_t length) const {
+        if (length > remaining())
+            fail("unexpected end");
+    }
+
+    char const *m_begin;
+    size_t m_size;
+    size_t m_offset;
+    char const *m_what;
+};
+
+void decode_snapshot (std::string const &snapshot, uint64_t &journal_index, std::vector<sept::Data> &assertions, std::vector<Derivation> &derivations) {
+    if (snapshot.size() < sizeof(SNAPSHOT_MAGIC) + 2*sizeof(uint32_t) || std::memcmp(snapshot.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+        throw std::runtime_error("malformed BeliefStore snapshot (bad magic)");
+    uint32_t version;
+    std::memcpy(&version, snapshot.data() + sizeof(SNAPSHOT_MAGIC), sizeof(version));
+    if (version != STORE_VERSION)
+        throw std::runtime_error(LVD_FMT("unsupported BeliefStore snapshot version " << version << " (expected " << STORE_VERSION << ')'));
+    // The snapshot is renamed into place only once it's durable, so this should only fail if the file was
+    // damaged afterward.
+    auto body_size = snapshot.size() - sizeof(uint32_t);
+    uint32_t expected_checksum;
+    std::memcpy(&expected_checksum, snapshot.data() + body_size, sizeof(expected_checksum));
+    if (checksum(snapshot.data(), body_size) != expected_checksum)
+        throw std::runtime_error("malformed BeliefStore snapshot (bad checksum)");
+
+    Reader reader(snapshot.data(), body_size, "BeliefStore snapshot");
+    reader.read_bytes(sizeof(SNAPSHOT_MAGIC) + sizeof(version));
+    journal_index = reader.read_pod<uint64_t>();
+    auto rule_count = reader.read_pod<uint64_t>();
+    auto belief_count = reader.read_pod<uint64_t>();
+    // Each takes at least one byte.
+    if (rule_count > reader.remaining() || belief_count > reader.remaining())
+        reader.fail("count exceeds the remaining size");
+    std::vector<sept::Data> rules;
+    rules.reserve(rule_count);
+    for (uint64_t i = 0; i < rule_count; ++i)
+        rules.emplace_back(reader.read_term());
+    std::vector<sept::Data> beliefs;
+    std::vector<bool> is_asserted;
+    beliefs.reserve(belief_count);
+    is_asserted.reserve(belief_count);
+    for (uint64_t i = 0; i < belief_count; ++i) {
+        beliefs.emplace_back(reader.read_term());
+        is_asserted.push_back((reader.read_pod<uint8_t>() & BELIEF_IS_ASSERTED) != 0);
+        if (is_asserted.back())
+            assertions.push_back(beliefs.back());
+    }
+    for (uint64_t i = 0; i < belief_count; ++i) {
+        auto justification_count = reader.read_count();
+        // Otherwise TruthMaintenance::restore would be given a belief that isn't held.
+        if (justification_count == 0 && !is_asserted[i])
+            reader.fail("belief has no support");
+        for (size_t j = 0; j < justification_count; ++j) {
+            auto rule_index = reader.read_varint();
+            if (rule_index >= rule_count)
+                reader.fail("rule index out of range");
+            auto premise_count = reader.read_count();
+            std::vector<sept::Data> premises;
+            premises.reserve(premise_count);
+            for (size_t k = 0; k < premise_count; ++k) {
+                auto premise_index = reader.read_varint();
+                if (premise_index >= belief_count)
+                    reader.fail("premise index out of range");
+                premises.push_back(beliefs[premise_index]);
+            }
+            derivations.push_back(Derivation{beliefs[i], Justification{rules[rule_index], std::move(premises)}});
+        }
+    }
+    if (reader.remaining() != 0)
+        reader.fail("trailing bytes");
+}
+
+//
+// File I/O
+//
+
+[[noreturn]] void throw_io_error (char const *action, std::filesystem::path const &path) {
+    throw std::runtime_error(LVD_FMT("BeliefStore couldn't " << action << ' ' << lvd::literal_of(path.string()) << "; " << std::strerror(errno)));
+}
+
+std::string read_file (std::filesystem::path const &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw_io_error("open", path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        auto error = errno;
+        ::close(fd);
+        errno = error;
+        throw_io_error("stat", path);
+    }
+    std::string contents(size_t(st.st_size), '\0');
+    size_t offset = 0;
+    while (offset < contents.size()) {
+        auto n = ::read(fd, &contents[offset], contents.size() - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            auto error = n < 0 ? errno : EIO;
+            ::close(fd);
+            errno = error;
+            throw_io_error("read", path);
+        }
+        offset += size_t(n);
+    }
+    ::close(fd);
+    return contents;
+}
+
+void write_all (int fd, char const *data, size_t size, std::filesystem::path const &path) {
+    while (size > 0) {
+        auto n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw_io_error("write", path);
+        data += n;
+        size -= size_t(n);
+    }
+}
+
+// Makes creating, renaming or deleting an entry of the directory durable.
+void fsync_directory (std::filesystem::path const &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw_io_error("open", path);
+    auto result = ::fsync(fd);
+    auto error = errno;
+    ::close(fd);
+    errno = error;
+    if (result != 0)
+        throw_io_error("fsync", path);
+}
+
+// Writes to a temporary file which is renamed into place once it's durable, so that path always has
+// either the old or the new contents.
+void write_file_durably (std::filesystem::path const &path, std::string const &contents) {
+    auto temp_path = path;
+    temp_path += ".tmp";
+    auto fd = ::open(temp_path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0)
+        throw_io_error("create", temp_path);
+    try {
+        write_all(fd, contents.data(), contents.size(), temp_path);
+        if (::fsync(fd) != 0)
+            throw_io_error("fsync", temp_path);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    if (::rename(temp_path.c_str(), path.c_str()) != 0)
+        throw_io_error("rename", temp_path);
+    fsync_directory(path.parent_path());
+}
+
+// Returns the index of the journal with the given filename, if it is one.
+std::optional<uint64_t> journal_index_of (std::string const &filename) {
+    static std::string const PREFIX = "journal.";
+    if (filename.size() <= PREFIX.size() || filename.compare(0, PREFIX.size(), PREFIX) != 0)
+        return std::nullopt;
+    uint64_t journal_index = 0;
+    for (size_t i = PREFIX.size(); i < filename.size(); ++i) {
+        if (filename[i] < '0' || filename[i] > '9')
+            return std::nullopt;
+        journal_index = 10*journal_index + uint64_t(filename[i] - '0');
+    }
+    return journal_index;
+}
+
+} // end namespace
+
+std::ostream &operator<< (std::ostream &out, RecoveryStats const &stats) {
+    return out << "RecoveryStats{snapshot_belief_count = " << stats.m_snapshot_belief_count
+               << ", snapshot_justification_count = " << stats.m_snapshot_justification_count
+               << ", journal_count = " << stats.m_journal_count
+               << ", journal_record_count = " << stats.m_journal_record_count
+               << ", discarded_byte_count = " << stats.m_discarded_byte_count
+               << ", duration_s = " << stats.m_duration_s << '}';
+}
+
+BeliefStore::BeliefStore (std::filesystem::path const &directory, BeliefSystem &belief_system, size_t sync_batch_size)
+    :   m_directory(directory)
+    ,   m_belief_system(belief_system)
+    ,   m_sync_batch_size(std::max(sync_batch_size, size_t(1)))
+    ,   m_recovery_stats{}
+    ,   m_journal_index(0)
+    ,   m_journal_fd(-1)
+    ,   m_unsynced_record_count(0)
+    ,   m_oldest_journal_index(0)
+    ,   m_compaction_journal_index(0)
+    ,   m_compaction_is_done(true)
+{
+    if (!m_belief_system.belief_set().empty())
+        throw std::runtime_error("BeliefStore requires a BeliefSystem with an empty belief set");
+    std::filesystem::create_directories(m_directory);
+    recover();
+}
+
+BeliefStore::~BeliefStore () {
+    try {
+        wait_for_compaction();
+    } catch (std::exception const &e) {
+        lvd::g_log << lvd::Log::wrn() << "BeliefStore compaction failed: " << e.what() << '\n';
+    }
+    try {
+        sync();
+    } catch (std::exception const &e) {
+        lvd::g_log << lvd::Log::wrn() << "BeliefStore sync failed: " << e.what() << '\n';
+    }
+    if (m_journal_fd >= 0)
+        ::close(m_journal_fd);
+}
+
+void BeliefStore::add_belief (sept::Data const &belief) {
+    auto record = encode_record(JournalOp::ADD_BELIEF, belief);
+    m_belief_system.add_belief(belief);
+    append_record(record);
+}
+
+std::vector<sept::Data> BeliefStore::remove_belief (sept::Data const &belief) {
+    auto record = encode_record(JournalOp::REMOVE_BELIEF, belief);
+    auto withdrawn_beliefs = m_belief_system.remove_belief(belief);
+    append_record(record);
+    return withdrawn_beliefs;
+}
+
+void BeliefStore::sync () {
+    if (m_pending_records.empty())
+        return;
+    auto path = journal_path(m_journal_index);
+    write_all(m_journal_fd, m_pending_records.data(), m_pending_records.size(), path);
+    // Clear these even if fsync fails, since the records have been written, and writing them again
+    // would duplicate them.
+    m_pending_records.clear();
+    m_unsynced_record_count = 0;
+    if (::fsync(m_journal_fd) != 0)
+        throw_io_error("fsync", path);
+}
+
+void BeliefStore::start_compaction () {
+    wait_for_compaction();
+    // The current journal has to be complete, since it's still needed if the snapshot doesn't make it.
+    sync();
+    auto next_journal_index = m_journal_index + 1;
+    auto snapshot = encode_snapshot(m_belief_system, next_journal_index);
+    // Create the next journal before the snapshot that refers to it exists, so that recovery can always
+    // find it.
+    open_journal(next_journal_index, std::nullopt);
+    m_journal_index = next_journal_index;
+
+    m_compaction_journal_index = next_journal_index;
+    m_compaction_is_done.store(false, std::memory_order_relaxed);
+    m_compaction_thread = std::thread(
+        [this, snapshot = std::move(snapshot), snapshot_path = snapshot_path(), superseded_journal_paths = [&]{
+            std::vector<std::filesystem::path> paths;
+            for (auto i = m_oldest_journal_index; i < next_journal_index; ++i)
+                paths.push_back(journal_path(i));
+            return paths;
+        }()]() {
+            try {
+                write_file_durably(snapshot_path, snapshot);
+                for (auto const &path : superseded_journal_paths)
+                    std::filesystem::remove(path);
+            } catch (...) {
+                m_compaction_error = std::current_exception();
+            }
+            m_compaction_is_done.store(true, std::memory_order_release);
+        }
+    );
+}
+
+bool BeliefStore::is_compacting () const {
+    return !m_compaction_is_done.load(std::memory_order_acquire);
+}
+
+void BeliefStore::wait_for_compaction () {
+    if (!m_compaction_thread.joinable())
+        return;
+    m_compaction_thread.join();
+    if (m_compaction_error != nullptr) {
+        auto error = m_compaction_error;
+        m_compaction_error = nullptr;
+        std::rethrow_exception(error);
+    }
+    m_oldest_journal_index = m_compaction_journal_index;
+}
+
+std::filesystem::path BeliefStore::journal_path (uint64_t journal_index) const {
+    return m_directory / ("journal." + std::to_string(journal_index));
+}
+
+void BeliefStore::recover () {
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Left by a compaction that was interrupted.
+    std::filesystem::remove(m_directory / "snapshot.tmp");
+
+    uint64_t snapshot_journal_index = 0;
+    if (std::filesystem::exists(snapshot_path())) {
+        auto snapshot = read_file(snapshot_path());
+        std::vector<sept::Data> assertions;
+        std::vector<Derivation> derivations;
+        decode_snapshot(snapshot, snapshot_journal_index, assertions, derivations);
+        // Free the encoded snapshot before restoring.
+        std::string().swap(snapshot);
+        m_belief_system.restore(assertions, derivations);
+        m_recovery_stats.m_snapshot_belief_count = m_belief_system.belief_set().size();
+        m_recovery_stats.m_snapshot_justification_count = derivations.size();
+    }
+
+    std::vector<uint64_t> journal_indices;
+    for (auto const &entry : std::filesystem::directory_iterator(m_directory))
+        if (auto journal_index_o = journal_index_of(entry.path().filename().string()); journal_index_o.has_value())
+            journal_indices.push_back(*journal_index_o);
+    std::sort(journal_indices.begin(), journal_indices.end());
+
+    m_journal_index = snapshot_journal_index;
+    std::optional<size_t> intact_size;
+    for (auto journal_index : journal_indices) {
+        if (journal_index < snapshot_journal_index) {
+            // Superseded by the snapshot, but the compaction was interrupted before deleting it.
+            std::filesystem::remove(journal_path(journal_index));
+            continue;
+        }
+        if (journal_index != m_journal_index)
+            throw std::runtime_error(LVD_FMT("BeliefStore in " << lvd::literal_of(m_directory.string()) << " is missing journal " << m_journal_index));
+        intact_size = replay_journal(journal_path(journal_index), journal_index == journal_indices.back());
+        ++m_recovery_stats.m_journal_count;
+        ++m_journal_index;
+    }
+    // Continue appending to the last journal, if there was one.
+    if (intact_size.has_value())
+        --m_journal_index;
+    open_journal(m_journal_index, intact_size);
+    m_oldest_journal_index = snapshot_journal_index;
+    m_compaction_journal_index = snapshot_journal_index;
+
+    m_recovery_stats.m_duration_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+size_t BeliefStore::replay_journal (std::filesystem::path const &path, bool is_last) {
+    auto journal = read_file(path);
+    if (journal.size() < JOURNAL_HEADER_SIZE) {
+        // The journal's creation was interrupted.
+        if (!is_last)
+            throw std::runtime_error(LVD_FMT("malformed BeliefStore journal " << lvd::literal_of(path.string()) << " (unexpected end)"));
+        m_recovery_stats.m_discarded_byte_count += journal.size();
+        return 0;
+    }
+    if (std::memcmp(journal.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0)
+        throw std::runtime_error(LVD_FMT("malformed BeliefStore journal " << lvd::literal_of(path.string()) << " (bad magic)"));
+    uint32_t version;
+    std::memcpy(&version, journal.data() + sizeof(JOURNAL_MAGIC), sizeof(version));
+    if (version != STORE_VERSION)
+        throw std::runtime_error(LVD_FMT("unsupported BeliefStore journal version " << version << " (expected " << STORE_VERSION << ')'));
+
+    size_t offset = JOURNAL_HEADER_SIZE;
+    while (offset < journal.size()) {
+        // A record whose write was cut short is either incomplete or fails its checksum.
+        auto remaining = journal.size() - offset;
+        uint32_t payload_size = 0;
+        if (remaining >= RECORD_HEADER_SIZE)
+            std::memcpy(&payload_size, journal.data() + offset + sizeof(uint8_t), sizeof(payload_size));
+        auto record_size = RECORD_HEADER_SIZE + size_t(payload_size) + sizeof(uint32_t);
+        uint32_t expected_checksum = 0;
+        if (remaining >= RECORD_HEADER_SIZE && record_size <= remaining)
+            std::memcpy(&expected_checksum, journal.data() + offset + record_size - sizeof(uint32_t), sizeof(expected_checksum));
+        if (remaining < RECORD_HEADER_SIZE || record_size > remaining || checksum(journal.data() + offset, record_size - sizeof(uint32_t)) != expected_checksum) {
+            if (!is_last)
+                throw std::runtime_error(LVD_FMT("malformed BeliefStore journal " << lvd::literal_of(path.string()) << " (damaged record at offset " << offset << ')'));
+            m_recovery_stats.m_discarded_byte_count += remaining;
+            break;
+        }
+
+        auto op = JournalOp(uint8_t(journal[offset]));
+        Reader reader(journal.data() + offset + RECORD_HEADER_SIZE, payload_size, "BeliefStore journal record");
+        auto belief = reader.read_term();
+        if (reader.remaining() != 0)
+            reader.fail("trailing bytes");
+        switch (op) {
+            case JournalOp::ADD_BELIEF: m_belief_system.add_belief(belief); break;
+            case JournalOp::REMOVE_BELIEF: m_belief_system.remove_belief(belief); break;
+            default: reader.fail("invalid JournalOp");
+        }
+        ++m_recovery_stats.m_journal_record_count;
+        offset += record_size;
+    }
+    return offset;
+}
+
+void BeliefStore::open_journal (uint64_t journal_index, std::optional<size_t> intact_size) {
+    auto path = journal_path(journal_index);
+    auto fd = ::open(path.c_str(), O_WRONLY|O_CREAT|O_APPEND, 0644);
+    if (fd < 0)
+        throw_io_error("open", path);
+    try {
+        if (!intact_size.has_value() || *intact_size < JOURNAL_HEADER_SIZE) {
+            if (::ftruncate(fd, 0) != 0)
+                throw_io_error("truncate", path);
+            std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+            append_pod(header, STORE_VERSION);
+            write_all(fd, header.data(), header.size(), path);
+            if (::fsync(fd) != 0)
+                throw_io_error("fsync", path);
+            fsync_directory(m_directory);
+        } else {
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+                throw_io_error("stat", path);
+            // Discard the damaged end, so that new records follow the intact ones.
+            if (size_t(st.st_size) != *intact_size && (::ftruncate(fd, off_t(*intact_size)) != 0 || ::fsync(fd) != 0))
+                throw_io_error("truncate", path);
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    if (m_journal_fd >= 0)
+        ::close(m_journal_fd);
+    m_journal_fd = fd;
+}
+
+void BeliefStore::append_record (std::string const &record) {
+    m_pending_records.append(record);
+    if (++m_unsynced_record_count >= m_sync_batch_size)
+        sync();
+}
@@ -0,0 +1,127 @@
+// 2021.05.24 - Victor Dods
+
+#pragma once
+
+#include <atomic>
+#include "belief.hpp"
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include "sept/Data.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+
+// Statistics for the recovery done by BeliefStore's constructor.
+struct RecoveryStats {
+    // The number of beliefs in the snapshot (0 if there was none), and of their justifications.
+    size_t m_snapshot_belief_count;
+    size_t m_snapshot_justification_count;
+    // The number of journals replayed, and of the records in them.
+    size_t m_journal_count;
+    size_t m_journal_record_count;
+    // The number of bytes at the end of the last journal that didn't form an intact record (i.e. a write
+    // that was cut short), which were discarded.
+    size_t m_discarded_byte_count;
+    double m_duration_s;
+};
+
+std::ostream &operator<< (std::ostream &out, RecoveryStats const &stats);
+
+// A directory on disk that holds the belief set of a BeliefSystem, so that it can be recovered on the
+// next run instead of being re-derived.  It consists of:
+//
+// -    A snapshot, which is the whole belief set along with each belief's support (whether it's asserted,
+//      and its justifications; see TruthMaintenance), so that it's restored by inserting the beliefs
+//      directly (see BeliefSystem::restore), without matching any rules.
+// -    Journals of the add_belief and remove_belief operations done since the snapshot, which are replayed
+//      on top of it.  Each record is checksummed, so a record whose write was cut short by a crash is
+//      detected and discarded.  Records are buffered and written and fsync'ed in batches, so a crash loses
+//      at most the last sync_batch_size-1 operations (call sync to make sure that everything is durable).
+//
+// Compaction writes a new snapshot of the current belief set, after which the journals before it are
+// deleted.  The belief set is encoded on the calling thread (since BeliefSystem isn't thread-safe), and
+// writing, fsync'ing and renaming the snapshot into place happens on a background thread, while further
+// operations go to a new journal.  A crash at any point leaves either the old snapshot and both journals,
+// or the new snapshot and the new journal, so nothing is lost either way.
+//
+// Rules of inference (see BeliefSystem::add_rule) aren't stored, since they're part of the program; they
+// can be added to the BeliefSystem before or after constructing the BeliefStore.  Beliefs added other than
+// through this class (e.g. by BeliefSystem::saturate) aren't journaled, but are in the next snapshot.
+//
+// Terms are encoded compactly: Tuples, FreeVars and ThinkyNPTerms directly, and anything else in the sept
+// binary format (see serialize_data), which throws for types that have no serialization registered.
+// Integers are native-endian, so the files aren't portable between machines of different endianness.
+class BeliefStore {
+public:
+
+    // Opens (creating if necessary) the store in the given directory, and recovers its belief set into
+    // belief_system, whose belief set must be empty.  Throws if a file is malformed (other than the torn
+    // end of the last journal), or on I/O error.
+    BeliefStore (std::filesystem::path const &directory, BeliefSystem &belief_system, size_t sync_batch_size = 64);
+    // Waits for compaction and syncs.
+    ~BeliefStore ();
+
+    BeliefStore (BeliefStore const &) = delete;
+    BeliefStore &operator= (BeliefStore const &) = delete;
+
+    std::filesystem::path const &directory () const { return m_directory; }
+    BeliefSystem &belief_system () const { return m_belief_system; }
+    RecoveryStats const &recovery_stats () const { return m_recovery_stats; }
+    // The journal that operations are currently appended to.
+    uint64_t journal_index () const { return m_journal_index; }
+    // The number of records that haven't been fsync'ed yet.
+    size_t unsynced_record_count () const { return m_unsynced_record_count; }
+
+    // These apply the operation to the BeliefSystem and then journal it.
+    void add_belief (sept::Data const &belief);
+    std::vector<sept::Data> remove_belief (sept::Data const &belief);
+    // Writes and fsyncs the buffered records.
+    void sync ();
+
+    // Starts writing a snapshot of the BeliefSystem's current belief set in the background, waiting for
+    // the previous compaction first.  The BeliefSystem may be modified while this is in progress.
+    void start_compaction ();
+    bool is_compacting () const;
+    // Waits for the compaction in progress (if any), and rethrows its exception, if it threw.
+    void wait_for_compaction ();
+
+private:
+
+    std::filesystem::path snapshot_path () const { return m_directory / "snapshot"; }
+    std::filesystem::path journal_path (uint64_t journal_index) const;
+
+    // Restores the snapshot (if any) and replays the journals, leaving the last one open.
+    void recover ();
+    // Replays the given journal, and returns the size of its intact prefix (the header and whole records).
+    // Throws if it's malformed, unless is_last, in which case a damaged record and whatever follows it are
+    // counted as discarded.
+    size_t replay_journal (std::filesystem::path const &path, bool is_last);
+    // Opens the journal for appending, after truncating it to intact_size if given, otherwise creating it.
+    void open_journal (uint64_t journal_index, std::optional<size_t> intact_size);
+    // The record is encoded before the operation is applied, so that a belief that can't be encoded
+    // doesn't get applied without being journaled.
+    void append_record (std::string const &record);
+
+    std::filesystem::path m_directory;
+    BeliefSystem &m_belief_system;
+    size_t m_sync_batch_size;
+    RecoveryStats m_recovery_stats;
+
+    uint64_t m_journal_index;
+    int m_journal_fd;
+    // Encoded records that haven't been written yet.
+    std::string m_pending_records;
+    size_t m_unsynced_record_count;
+
+    // The journals before m_oldest_journal_index have been deleted.  Those from it up to (but not
+    // including) m_compaction_journal_index are deleted by the compaction once its snapshot is durable.
+    uint64_t m_oldest_journal_index;
+    uint64_t m_compaction_journal_index;
+    std::thread m_compaction_thread;
+    std::atomic<bool> m_compaction_is_done;
+    // Set by the compaction thread before m_compaction_is_done.
+    std::exception_ptr m_compaction_error;
+};
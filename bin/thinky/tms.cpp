@@ -0,0 +1,152 @@
+// 2021.05.23 - Victor Dods
+
+#include "tms.hpp"
+
+#include <algorithm>
+#include <lvd/abort.hpp>
+#include <lvd/fmt.hpp>
+
+bool operator== (Justification const &lhs, Justification const &rhs) {
+    return lhs.m_rule == rhs.m_rule && lhs.m_premises == rhs.m_premises;
+}
+
+std::ostream &operator<< (std::ostream &out, Justification const &justification) {
+    out << "Justification(" << justification.m_rule << ", premises = (";
+    for (size_t i = 0; i < justification.m_premises.size(); ++i) {
+        if (i > 0)
+            out << ", ";
+        out << justification.m_premises[i];
+    }
+    return out << "))";
+}
+
+bool TruthMaintenance::is_asserted (sept::Data const &belief) const {
+    auto it = m_nodes.find(belief);
+    return it != m_nodes.end() && it->second.m_is_asserted;
+}
+
+std::vector<Justification> const &TruthMaintenance::justifications_of (sept::Data const &belief) const {
+    static std::vector<Justification> const EMPTY;
+    auto it = m_nodes.find(belief);
+    return it != m_nodes.end() ? it->second.m_justifications : EMPTY;
+}
+
+void TruthMaintenance::add_assertion (sept::Data const &belief) {
+    m_nodes[belief].m_is_asserted = true;
+}
+
+bool TruthMaintenance::add_justification (sept::Data const &belief, Justification const &justification) {
+    auto &justifications = m_nodes[belief].m_justifications;
+    if (std::find(justifications.begin(), justifications.end(), justification) != justifications.end())
+        return false;
+    justifications.push_back(justification);
+    for (auto const &premise : justification.m_premises) {
+        auto it = m_nodes.find(premise);
+        if (it == m_nodes.end())
+            LVD_ABORT(LVD_FMT("premise " << premise << " of a justification of " << belief << " isn't held"));
+        it->second.m_consequents.push_back(belief);
+    }
+    return true;
+}
+
+void TruthMaintenance::restore (std::vector<sept::Data> const &assertions, std::vector<Derivation> const &derivations) {
+    m_nodes.clear();
+    m_nodes.reserve(assertions.size() + derivations.size());
+    // Create all the nodes first, so that add_justification finds every premise.
+    for (auto const &belief : assertions)
+        m_nodes[belief].m_is_asserted = true;
+    for (auto const &derivation : derivations)
+        m_nodes[derivation.m_belief];
+    for (auto const &derivation : derivations)
+        add_justification(derivation.m_belief, derivation.m_justification);
+}
+
+std::vector<sept::Data> TruthMaintenance::retract (sept::Data const &belief) {
+    auto belief_it = m_nodes.find(belief);
+    if (belief_it == m_nodes.end())
+        return {};
+    belief_it->second.m_is_asserted = false;
+
+    // Only the belief and its consequences (transitively) can lose support.  Start by assuming that all
+    // of them have, and then bring back the ones that are supported by beliefs outside of that, or by
+    // ones that have been brought back, until nothing changes.  Doing it this way (instead of checking
+    // each one for a valid justification) means that a cycle of beliefs can't support itself.
+    std::vector<sept::Data> affected{belief};
+    std::unordered_set<sept::Data> unsupported{belief};
+    for (size_t i = 0; i < affected.size(); ++i) {
+        for (auto const &consequent : m_nodes.at(affected[i]).m_consequents)
+            if (unsupported.insert(consequent).second)
+                affected.push_back(consequent);
+    }
+
+    std::vector<sept::Data const *> to_check;
+    to_check.reserve(affected.size());
+    for (auto const &b : affected)
+        to_check.push_back(&b);
+    while (!to_check.empty()) {
+        auto const &b = *to_check.back();
+        to_check.pop_back();
+        if (unsupported.find(b) == unsupported.end())
+            continue;
+        auto const &node = m_nodes.at(b);
+        if (!has_support(node, unsupported))
+            continue;
+        unsupported.erase(b);
+        // Its consequences may now be supported too.
+        for (auto const &consequent : node.m_consequents)
+            if (unsupported.find(consequent) != unsupported.end())
+                to_check.push_back(&consequent);
+    }
+
+    // Withdraw the ones that are still unsupported, along with the justifications that they're premises of
+    // (of beliefs that stay held), and the consequent entries of the beliefs that their justifications
+    // refer to.
+    std::vector<sept::Data> withdrawn;
+    for (auto const &b : affected) {
+        if (unsupported.find(b) == unsupported.end())
+            continue;
+        auto const &node = m_nodes.at(b);
+        for (auto const &justification : node.m_justifications) {
+            for (auto const &premise : justification.m_premises) {
+                if (unsupported.find(premise) != unsupported.end())
+                    continue;
+                auto &consequents = m_nodes.at(premise).m_consequents;
+                consequents.erase(std::remove(consequents.begin(), consequents.end(), b), consequents.end());
+            }
+        }
+        for (auto const &consequent : node.m_consequents) {
+            if (unsupported.find(consequent) != unsupported.end())
+                continue;
+            auto &justifications = m_nodes.at(consequent).m_justifications;
+            justifications.erase(
+                std::remove_if(
+                    justifications.begin(),
+                    justifications.end(),
+                    [&b](Justification const &justification){
+                        return std::find(justification.m_premises.begin(), justification.m_premises.end(), b) != justification.m_premises.end();
+                    }
+                ),
+                justifications.end()
+            );
+        }
+        withdrawn.push_back(b);
+    }
+    for (auto const &b : withdrawn)
+        m_nodes.erase(b);
+    return withdrawn;
+}
+
+bool TruthMaintenance::has_support (Node const &node, std::unordered_set<sept::Data> const &unsupported) {
+    if (node.m_is_asserted)
+        return true;
+    for (auto const &justification : node.m_justifications) {
+        auto is_valid = std::none_of(
+            justification.m_premises.begin(),
+            justification.m_premises.end(),
+            [&unsupported](sept::Data const &premise){ return unsupported.find(premise) != unsupported.end(); }
+        );
+        if (is_valid)
+            return true;
+    }
+    return false;
+}
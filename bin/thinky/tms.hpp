@@ -0,0 +1,80 @@
+// 2021.05.23 - Victor Dods
+
+#pragma once
+
+#include "common.hpp"
+#include "sept/Data.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Why a derived belief is held: the rule of inference that concluded it, and the beliefs that matched
+// the rule's premise.  A rule whose premise has no conjuncts has no premises, so its conclusion is
+// always supported.
+struct Justification {
+    sept::Data m_rule;
+    std::vector<sept::Data> m_premises;
+};
+
+bool operator== (Justification const &lhs, Justification const &rhs);
+inline bool operator!= (Justification const &lhs, Justification const &rhs) { return !(lhs == rhs); }
+
+std::ostream &operator<< (std::ostream &out, Justification const &justification);
+
+// A belief concluded by a rule, which hasn't been added yet.
+struct Derivation {
+    sept::Data m_belief;
+    Justification m_justification;
+};
+
+// Justification-based truth maintenance: tracks which beliefs were asserted (i.e. added directly) and
+// the justifications of the derived ones, so that retracting a belief withdraws exactly the beliefs that
+// no longer have any support, instead of the belief system having to be rebuilt and re-derived.
+//
+// A belief is held iff it's asserted or has a justification all of whose premises are held.  Since a
+// justification is removed as soon as one of its premises is withdrawn, the justifications present are
+// exactly the valid ones.  Support has to be well-founded, i.e. beliefs that justify each other in a
+// cycle (e.g. from a rule and its contrapositive) don't keep each other held once nothing outside the
+// cycle supports them.
+class TruthMaintenance {
+public:
+
+    TruthMaintenance () = default;
+
+    bool contains (sept::Data const &belief) const { return m_nodes.find(belief) != m_nodes.end(); }
+    bool is_asserted (sept::Data const &belief) const;
+    // Returns the justifications of the belief, which are empty if it's not derived (or not held).
+    std::vector<Justification> const &justifications_of (sept::Data const &belief) const;
+
+    void add_assertion (sept::Data const &belief);
+    // The premises must all be held.  Returns false if the belief already had this justification.
+    bool add_justification (sept::Data const &belief, Justification const &justification);
+
+    // Retracts the belief's assertion, if any, and withdraws it if that leaves it without support, and
+    // then whichever of its consequences (transitively) are left without support.  Returns the withdrawn
+    // beliefs, which are no longer tracked.  A belief that's also derived from other held beliefs stays.
+    std::vector<sept::Data> retract (sept::Data const &belief);
+
+    // Replaces the tracked beliefs with recorded ones (e.g. from a BeliefStore snapshot): the given
+    // assertions, and each derivation's belief with its justification.  Unlike add_justification, the
+    // premises only have to be among the given beliefs, not held already, so the derivations can be in any
+    // order.  The recorded support must be well-founded.
+    void restore (std::vector<sept::Data> const &assertions, std::vector<Derivation> const &derivations);
+
+    void clear () { m_nodes.clear(); }
+
+private:
+
+    struct Node {
+        bool m_is_asserted = false;
+        std::vector<Justification> m_justifications;
+        // The beliefs that have a justification with this belief as a premise.  May contain duplicates.
+        std::vector<sept::Data> m_consequents;
+    };
+
+    // Returns true iff the node is asserted or has a justification none of whose premises are in
+    // unsupported.
+    static bool has_support (Node const &node, std::unordered_set<sept::Data> const &unsupported);
+
+    std::unordered_map<sept::Data,Node> m_nodes;
+};
@@ -0,0 +1,102 @@
+// 2021.05.22 - Victor Dods
+
+#include "sept/ConcurrentSymbolIndex.hpp"
+
+namespace sept {
+
+ConcurrentSymbolIndex::Table::Table (size_t capacity)
+    :   m_capacity(capacity)
+    ,   m_key(new std::atomic<uint32_t>[capacity])
+    ,   m_value(new std::atomic<Data *>[capacity])
+{
+    for (size_t i = 0; i < m_capacity; ++i) {
+        m_key[i].store(0, std::memory_order_relaxed);
+        m_value[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConcurrentSymbolIndex::ConcurrentSymbolIndex ()
+    :   m_table(nullptr)
+    ,   m_key_count(0)
+{
+    clear();
+}
+
+Data *ConcurrentSymbolIndex::find (InternedId symbol_id) const noexcept {
+    // Acquire pairs with the release in grow, so that the contents of a newly published table are visible.
+    auto table = m_table.load(std::memory_order_acquire);
+    auto key = symbol_id.index() + 1;
+    auto mask = table->m_capacity - 1;
+    // The load factor is at most 1/2, so this will always hit an empty entry eventually.
+    for (auto i = hash(key, table->m_capacity); ; i = (i + 1) & mask) {
+        auto k = table->m_key[i].load(std::memory_order_acquire);
+        if (k == key)
+            return table->m_value[i].load(std::memory_order_acquire);
+        if (k == 0)
+            return nullptr;
+    }
+}
+
+void ConcurrentSymbolIndex::assign (InternedId symbol_id, Data *data) {
+    auto key = symbol_id.index() + 1;
+
+    // Probe for an existing key first, so that overwriting or erasing never grows the table.
+    auto table = m_table.load(std::memory_order_relaxed);
+    auto mask = table->m_capacity - 1;
+    auto i = hash(key, table->m_capacity);
+    for ( ; ; i = (i + 1) & mask) {
+        auto k = table->m_key[i].load(std::memory_order_relaxed);
+        if (k == key) {
+            table->m_value[i].store(data, std::memory_order_release);
+            return;
+        }
+        if (k == 0)
+            break;
+    }
+
+    // The key isn't present.  Erasing it is a no-op, and there's no need to spend an entry on it.
+    if (data == nullptr)
+        return;
+
+    if (2*(m_key_count + 1) > table->m_capacity) {
+        grow();
+        // The key is known to be absent, so just find the first empty entry in the new table.
+        table = m_table.load(std::memory_order_relaxed);
+        mask = table->m_capacity - 1;
+        for (i = hash(key, table->m_capacity); table->m_key[i].load(std::memory_order_relaxed) != 0; i = (i + 1) & mask)
+            ;
+    }
+
+    // The value has to be visible before the key is.
+    table->m_value[i].store(data, std::memory_order_release);
+    table->m_key[i].store(key, std::memory_order_release);
+    ++m_key_count;
+}
+
+void ConcurrentSymbolIndex::clear () {
+    m_tables.clear();
+    m_tables.emplace_back(std::make_unique<Table>(16));
+    m_table.store(m_tables.back().get(), std::memory_order_release);
+    m_key_count = 0;
+}
+
+void ConcurrentSymbolIndex::grow () {
+    auto old_table = m_table.load(std::memory_order_relaxed);
+    auto new_table = std::make_unique<Table>(2*old_table->m_capacity);
+    auto mask = new_table->m_capacity - 1;
+    for (size_t j = 0; j < old_table->m_capacity; ++j) {
+        auto key = old_table->m_key[j].load(std::memory_order_relaxed);
+        if (key == 0)
+            continue;
+        auto i = hash(key, new_table->m_capacity);
+        while (new_table->m_key[i].load(std::memory_order_relaxed) != 0)
+            i = (i + 1) & mask;
+        new_table->m_key[i].store(key, std::memory_order_relaxed);
+        new_table->m_value[i].store(old_table->m_value[j].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    // Readers still using old_table will see a consistent (if slightly stale) view, so it's retired instead of freed.
+    m_table.store(new_table.get(), std::memory_order_release);
+    m_tables.emplace_back(std::move(new_table));
+}
+
+} // end namespace sept
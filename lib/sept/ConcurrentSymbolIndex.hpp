@@ -0,0 +1,61 @@
+// 2021.05.22 - Victor Dods
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "sept/core.hpp"
+#include "sept/Data.hpp"
+#include "sept/Interner.hpp"
+#include <vector>
+
+namespace sept {
+
+// Map from InternedId to Data * which supports lock-free lookup concurrently with a single writer.
+// Writers must be serialized externally (SymbolTable does this with a mutex).  This is an open-addressing
+// hash table whose entries are individually atomic, and whose keys are never removed -- erasing sets the
+// value to nullptr.  When it grows, the old table is retired but not freed until clear() or destruction,
+// so readers never have to be tracked (as they would with RCU or epoch-based reclamation).  Because the
+// capacity doubles each time, the retired tables take at most as much memory as the current one.
+class ConcurrentSymbolIndex {
+public:
+
+    ConcurrentSymbolIndex ();
+
+    // Lock-free.  Returns nullptr if symbol_id isn't present (or was erased).
+    Data *find (InternedId symbol_id) const noexcept;
+    // Writer only.  Assigning nullptr erases (and is a no-op if symbol_id isn't present).  Only inserting
+    // a new key can grow the table; updating or erasing an existing key never does.
+    void assign (InternedId symbol_id, Data *data);
+    // Writer only, and there must be no concurrent readers.
+    void clear ();
+    // Writer only.  The capacity of the current table, mostly for diagnostics.
+    size_t capacity () const { return m_table.load(std::memory_order_relaxed)->m_capacity; }
+
+private:
+
+    struct Table {
+        explicit Table (size_t capacity);
+
+        // Always a power of 2, and always at least twice the number of keys.
+        size_t m_capacity;
+        // Stores InternedId::index() + 1, so that 0 can mean an empty entry.
+        std::unique_ptr<std::atomic<uint32_t>[]> m_key;
+        std::unique_ptr<std::atomic<Data *>[]> m_value;
+    };
+
+    static size_t hash (uint32_t key, size_t capacity) {
+        // Fibonacci hashing, since interned ids are sequential.
+        return size_t(uint64_t(key) * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);
+    }
+
+    void grow ();
+
+    std::atomic<Table *> m_table;
+    // The rest is only accessed by the writer.  m_tables owns the current table and all retired ones.
+    size_t m_key_count;
+    std::vector<std::unique_ptr<Table>> m_tables;
+};
+
+} // end namespace sept
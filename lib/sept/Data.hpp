@@ -113,7 +113,7 @@ public:
         >
     >
     Data &operator = (ValueType_ &&value) {
-        std::any::operator=(std::move(value));
+        std::any::operator=(std::forward<ValueType_>(value));
         return *this;
     }
 
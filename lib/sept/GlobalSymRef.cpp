@@ -11,11 +11,11 @@ GlobalSymRef_c GlobalSymRef;
 GlobalSymRefType_c GlobalSymRefType;
 
 Data const &GlobalSymRefTermImpl::referenced_data () const & {
-    return ms_symbol_table->resolve_symbol_const(m_symbol_id);
+    return ms_symbol_table->resolve_symbol_cached(m_symbol_id, m_resolution_cache);
 }
 
 Data &GlobalSymRefTermImpl::referenced_data () & {
-    return ms_symbol_table->resolve_symbol_nonconst(m_symbol_id);
+    return ms_symbol_table->resolve_symbol_cached(m_symbol_id, m_resolution_cache);
 }
 
 Data GlobalSymRefTermImpl::move_referenced_data () && {
@@ -25,7 +25,7 @@ Data GlobalSymRefTermImpl::move_referenced_data () && {
 GlobalSymRefTermImpl::operator lvd::OstreamDelegate () const {
     return lvd::OstreamDelegate::OutFunc([this](std::ostream &out){
         // Print it as an opaque reference.  Printing through a transparent reference is done by Data methods.
-        out << "GlobalSymRef(" << lvd::literal_of(m_symbol_id) << ')';
+        out << "GlobalSymRef(" << lvd::literal_of(m_symbol_id.as_string()) << ')';
     });
 }
 
@@ -7,9 +7,11 @@
 #include <lvd/fmt.hpp>
 #include <lvd/OstreamDelegate.hpp>
 #include "sept/core.hpp"
+#include "sept/Interner.hpp"
 #include "sept/NPType.hpp"
 #include "sept/RefTerm.hpp"
 #include "sept/SymbolTable.hpp"
+#include <string_view>
 
 namespace sept {
 
@@ -19,17 +21,16 @@ namespace sept {
 class GlobalSymRefTermImpl : public RefTermBase_i {
 public:
 
-    GlobalSymRefTermImpl () = default;
     GlobalSymRefTermImpl (GlobalSymRefTermImpl const &other) = default;
     GlobalSymRefTermImpl (GlobalSymRefTermImpl &&other) = default;
-    explicit GlobalSymRefTermImpl (std::string const &symbol_id) : m_symbol_id(symbol_id) { }
-    explicit GlobalSymRefTermImpl (std::string &&symbol_id) : m_symbol_id(std::move(symbol_id)) { }
+    explicit GlobalSymRefTermImpl (InternedId symbol_id) : m_symbol_id(symbol_id) { }
     virtual ~GlobalSymRefTermImpl () { }
 
     GlobalSymRefTermImpl &operator = (GlobalSymRefTermImpl const &other) = default;
     GlobalSymRefTermImpl &operator = (GlobalSymRefTermImpl &&other) = default;
 
-    virtual lvd::nnup<RefTermBase_i> cloned () const override { return lvd::make_nnup<GlobalSymRefTermImpl>(m_symbol_id); }
+    virtual RefTermBase_i *copy_into (void *storage) const override { return construct_ref_term_impl<GlobalSymRefTermImpl>(storage, *this); }
+    virtual RefTermBase_i *move_into (void *storage) noexcept override { return construct_ref_term_impl<GlobalSymRefTermImpl>(storage, std::move(*this)); }
 
     virtual Data const &referenced_data () const & override;
     virtual Data &referenced_data () & override;
@@ -37,18 +38,22 @@ public:
 
     virtual operator lvd::OstreamDelegate () const override;
 
+    InternedId symbol_id () const { return m_symbol_id; }
     static lvd::nnsp<SymbolTable> const &symbol_table () { return ms_symbol_table; }
 
 private:
 
-    std::string m_symbol_id;
+    InternedId m_symbol_id;
+    // Deref is normally just a generation check against ms_symbol_table.
+    mutable ResolutionCache m_resolution_cache;
 
     static lvd::nnsp<SymbolTable> ms_symbol_table;
 
     friend lvd::nnsp<SymbolTable> const &global_symbol_table ();
 };
 
-// For accessing the global SymbolTable.
+// For accessing the global SymbolTable.  To evaluate against it from several threads, call
+// global_symbol_table()->enable_concurrent_reads() before starting them (see SymbolTable).
 inline lvd::nnsp<SymbolTable> const &global_symbol_table () {
     return GlobalSymRefTermImpl::ms_symbol_table;
 }
@@ -68,13 +73,12 @@ using GlobalSymRefType_c = NonParametricType_t<NPTerm::GLOBAL_SYM_REF_TYPE>;
 class GlobalSymRef_c : public NonParametricType_t<NPTerm::GLOBAL_SYM_REF,RefTerm_c,GlobalSymRef_c> {
 public:
 
-    RefTerm_c operator() (std::string const &symbol_id) const {
+    RefTerm_c operator() (std::string_view symbol_id) const {
 //         return make_global_sym_ref(symbol_id);
-        return RefTerm_c{lvd::make_nnup<GlobalSymRefTermImpl>(symbol_id)};
+        return RefTerm_c{std::in_place_type<GlobalSymRefTermImpl>, intern(symbol_id)};
     }
-    RefTerm_c operator() (std::string &&symbol_id) const {
-//         return make_global_sym_ref(std::move(symbol_id));
-        return RefTerm_c{lvd::make_nnup<GlobalSymRefTermImpl>(std::move(symbol_id))};
+    RefTerm_c operator() (InternedId symbol_id) const {
+        return RefTerm_c{std::in_place_type<GlobalSymRefTermImpl>, symbol_id};
     }
 };
 
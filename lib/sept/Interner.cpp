@@ -0,0 +1,57 @@
+// 2021.05.20 - Victor Dods
+
+#include "sept/Interner.hpp"
+
+#include <limits>
+#include <lvd/fmt.hpp>
+#include <stdexcept>
+
+namespace sept {
+
+std::ostream &operator<< (std::ostream &out, InternedId const &id) {
+    return out << id.as_string();
+}
+
+InternedId Interner::intern (std::string_view s) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index_of.find(s);
+    if (it != m_index_of.end())
+        return InternedId{it->second};
+
+    if (m_strings.size() >= std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error(LVD_FMT("Interner is full; can't intern more than " << std::numeric_limits<uint32_t>::max() << " strings"));
+
+    auto index = uint32_t(m_strings.size());
+    m_strings.emplace_back(s);
+    // The key has to view the stored string, not the argument.
+    m_index_of.emplace(std::string_view{m_strings.back()}, index);
+    return InternedId{index};
+}
+
+std::optional<InternedId> Interner::find (std::string_view s) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index_of.find(s);
+    if (it == m_index_of.end())
+        return std::nullopt;
+    else
+        return InternedId{it->second};
+}
+
+std::string const &Interner::string_of (InternedId id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // References into m_strings remain valid after the lock is released, since strings are never removed.
+    return m_strings[id.index()];
+}
+
+size_t Interner::size () const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_strings.size();
+}
+
+Interner &global_interner () {
+    // Function-local static so that it's usable during static initialization of other translation units.
+    static Interner s_interner;
+    return s_interner;
+}
+
+} // end namespace sept
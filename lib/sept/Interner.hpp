@@ -0,0 +1,94 @@
+// 2021.05.20 - Victor Dods
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace sept {
+
+class Interner;
+
+// A handle to a string that has been interned in the global Interner.  Two InternedId values are equal
+// if and only if the strings they were interned from are equal, so comparison and hashing only operate
+// on a uint32_t.  Use intern("...") to produce one.
+class InternedId {
+public:
+
+    InternedId (InternedId const &other) = default;
+    InternedId &operator = (InternedId const &other) = default;
+
+    uint32_t index () const { return m_index; }
+    // The interned string.  The returned reference is valid for the lifetime of the program.
+    std::string const &as_string () const;
+
+    bool operator == (InternedId const &other) const { return m_index == other.m_index; }
+    bool operator != (InternedId const &other) const { return m_index != other.m_index; }
+    // NOTE: This is the order of interning, not lexicographical order.
+    bool operator < (InternedId const &other) const { return m_index < other.m_index; }
+
+private:
+
+    explicit InternedId (uint32_t index) : m_index(index) { }
+
+    uint32_t m_index;
+
+    friend class Interner;
+};
+
+std::ostream &operator<< (std::ostream &out, InternedId const &id);
+
+// Stores each distinct string exactly once and hands out InternedId values for them.  Lookup is done
+// by std::string_view, so looking up an existing string doesn't allocate.  Strings are never removed.
+// All methods are thread-safe (they're serialized by a mutex), so that the global Interner can be used
+// alongside a SymbolTable that has concurrent reads enabled.  Note that the std::string_view overloads
+// of SymbolTable call find, and therefore take the mutex; only the InternedId overloads are lock-free.
+class Interner {
+public:
+
+    // Returns the id for the given string, interning it if it hasn't been interned already.
+    InternedId intern (std::string_view s);
+    // Returns the id for the given string if it has already been interned, otherwise std::nullopt.
+    // This is useful for lookups, since a string that was never interned can't be a key of anything.
+    std::optional<InternedId> find (std::string_view s) const;
+    std::string const &string_of (InternedId id) const;
+    size_t size () const;
+
+private:
+
+    // std::deque is used so that the std::string_view keys of m_index_of remain valid as strings are added.
+    std::deque<std::string> m_strings;
+    std::unordered_map<std::string_view,uint32_t> m_index_of;
+    mutable std::mutex m_mutex;
+};
+
+// For accessing the global Interner.
+Interner &global_interner ();
+
+inline InternedId intern (std::string_view s) {
+    return global_interner().intern(s);
+}
+
+inline std::string const &InternedId::as_string () const {
+    return global_interner().string_of(*this);
+}
+
+} // end namespace sept
+
+namespace std {
+
+template <>
+struct hash<sept::InternedId> {
+    size_t operator () (sept::InternedId const &id) const {
+        return std::hash<uint32_t>()(id.index());
+    }
+};
+
+} // end namespace std
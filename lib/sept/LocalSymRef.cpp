@@ -15,11 +15,17 @@ LocalSymRefType_c LocalSymRefType;
 //
 
 Data const &LocalSymRefTermImpl::referenced_data () const & {
-    return m_symbol_table->resolve_symbol_const(m_symbol_id);
+    if (m_slot_depth != NO_SYMBOL_SLOT)
+        return m_symbol_table->resolve_slot_cached(SymbolSlot{m_slot_depth, m_slot}, m_symbol_id, m_resolution_cache);
+    else
+        return m_symbol_table->resolve_symbol_cached(m_symbol_id, m_resolution_cache);
 }
 
 Data &LocalSymRefTermImpl::referenced_data () & {
-    return m_symbol_table->resolve_symbol_nonconst(m_symbol_id);
+    if (m_slot_depth != NO_SYMBOL_SLOT)
+        return m_symbol_table->resolve_slot_cached(SymbolSlot{m_slot_depth, m_slot}, m_symbol_id, m_resolution_cache);
+    else
+        return m_symbol_table->resolve_symbol_cached(m_symbol_id, m_resolution_cache);
 }
 
 Data LocalSymRefTermImpl::move_referenced_data () && {
@@ -29,7 +35,10 @@ Data LocalSymRefTermImpl::move_referenced_data () && {
 LocalSymRefTermImpl::operator lvd::OstreamDelegate () const {
     return lvd::OstreamDelegate::OutFunc([this](std::ostream &out){
         // Print it as an opaque reference.  Printing through a transparent reference is done by Data methods.
-        out << "LocalSymRef(" << lvd::literal_of(m_symbol_id) << ", " << m_symbol_table.get() << ')';
+        out << "LocalSymRef(" << lvd::literal_of(m_symbol_id.as_string()) << ", " << m_symbol_table.get();
+        if (auto symbol_slot = this->symbol_slot(); symbol_slot.has_value())
+            out << ", " << *symbol_slot;
+        out << ')';
     });
 }
 
@@ -2,14 +2,19 @@
 
 #pragma once
 
+#include <cstdint>
 #include <lvd/abort.hpp>
 #include <lvd/aliases.hpp>
 #include <lvd/fmt.hpp>
 #include <lvd/OstreamDelegate.hpp>
+#include <optional>
 #include "sept/core.hpp"
+#include "sept/Interner.hpp"
 #include "sept/NPType.hpp"
 #include "sept/RefTerm.hpp"
 #include "sept/SymbolTable.hpp"
+#include <stdexcept>
+#include <string_view>
 
 namespace sept {
 
@@ -21,25 +26,29 @@ namespace sept {
 class LocalSymRefTermImpl : public RefTermBase_i {
 public:
 
-    LocalSymRefTermImpl () = default;
     LocalSymRefTermImpl (LocalSymRefTermImpl const &other) = default;
     LocalSymRefTermImpl (LocalSymRefTermImpl &&other) = default;
-    LocalSymRefTermImpl (std::string const &symbol_id, lvd::nnsp<SymbolTable> const &symbol_table)
+    LocalSymRefTermImpl (InternedId symbol_id, lvd::nnsp<SymbolTable> const &symbol_table)
         :   m_symbol_id(symbol_id)
+        ,   m_slot_depth(NO_SYMBOL_SLOT)
         ,   m_symbol_table(symbol_table)
+        ,   m_slot(0)
     { }
-    LocalSymRefTermImpl (std::string &&symbol_id, lvd::nnsp<SymbolTable> const &symbol_table)
-        :   m_symbol_id(std::move(symbol_id))
+    // Use this when the location of the symbol's binding is known statically, so that deref is
+    // an array index instead of a lookup.  symbol_slot is relative to symbol_table.
+    LocalSymRefTermImpl (InternedId symbol_id, lvd::nnsp<SymbolTable> const &symbol_table, SymbolSlot const &symbol_slot)
+        :   m_symbol_id(symbol_id)
+        ,   m_slot_depth(narrowed_slot_component(symbol_slot.m_depth))
         ,   m_symbol_table(symbol_table)
+        ,   m_slot(narrowed_slot_component(symbol_slot.m_slot))
     { }
     virtual ~LocalSymRefTermImpl () { }
 
     LocalSymRefTermImpl &operator = (LocalSymRefTermImpl const &other) = default;
     LocalSymRefTermImpl &operator = (LocalSymRefTermImpl &&other) = default;
 
-    virtual lvd::nnup<RefTermBase_i> cloned () const override {
-        return lvd::make_nnup<LocalSymRefTermImpl>(m_symbol_id, m_symbol_table);
-    }
+    virtual RefTermBase_i *copy_into (void *storage) const override { return construct_ref_term_impl<LocalSymRefTermImpl>(storage, *this); }
+    virtual RefTermBase_i *move_into (void *storage) noexcept override { return construct_ref_term_impl<LocalSymRefTermImpl>(storage, std::move(*this)); }
 
     virtual Data const &referenced_data () const & override;
     virtual Data &referenced_data () & override;
@@ -47,12 +56,34 @@ public:
 
     virtual operator lvd::OstreamDelegate () const override;
 
+    InternedId symbol_id () const { return m_symbol_id; }
     lvd::nnsp<SymbolTable> const &symbol_table () { return m_symbol_table; }
+    std::optional<SymbolSlot> symbol_slot () const {
+        if (m_slot_depth == NO_SYMBOL_SLOT)
+            return std::nullopt;
+        return SymbolSlot{m_slot_depth, m_slot};
+    }
 
 private:
 
-    std::string m_symbol_id;
+    static constexpr uint32_t NO_SYMBOL_SLOT = UINT32_MAX;
+
+    static uint32_t narrowed_slot_component (size_t value) {
+        if (value >= NO_SYMBOL_SLOT)
+            throw std::runtime_error(LVD_FMT("SymbolSlot component " << value << " is too large for LocalSymRef"));
+        return uint32_t(value);
+    }
+
+    // The members are ordered (and the slot stored as two uint32_t instead of std::optional<SymbolSlot>)
+    // to keep this small, since it's stored inline in RefTerm_c (see REF_TERM_INLINE_CAPACITY).
+    InternedId m_symbol_id;
+    // If this isn't NO_SYMBOL_SLOT, then (m_slot_depth, m_slot) is the SymbolSlot, relative to
+    // m_symbol_table, that is used instead of looking up m_symbol_id.
+    uint32_t m_slot_depth;
     lvd::nnsp<SymbolTable> m_symbol_table;
+    uint32_t m_slot;
+    // Caches the resolution of the slot or m_symbol_id relative to m_symbol_table.
+    mutable ResolutionCache m_resolution_cache;
 };
 
 // inline RefTerm_c make_local_sym_ref (std::string const &symbol_id) {
@@ -70,13 +101,15 @@ using LocalSymRefType_c = NonParametricType_t<NPTerm::LOCAL_SYM_REF_TYPE>;
 class LocalSymRef_c : public NonParametricType_t<NPTerm::LOCAL_SYM_REF,RefTerm_c,LocalSymRef_c> {
 public:
 
-    RefTerm_c operator() (std::string const &symbol_id, lvd::nnsp<SymbolTable> const &symbol_table) const {
+    RefTerm_c operator() (std::string_view symbol_id, lvd::nnsp<SymbolTable> const &symbol_table) const {
 //         return make_local_sym_ref(symbol_id);
-        return RefTerm_c{lvd::make_nnup<LocalSymRefTermImpl>(symbol_id, symbol_table)};
+        return RefTerm_c{std::in_place_type<LocalSymRefTermImpl>, intern(symbol_id), symbol_table};
+    }
+    RefTerm_c operator() (InternedId symbol_id, lvd::nnsp<SymbolTable> const &symbol_table) const {
+        return RefTerm_c{std::in_place_type<LocalSymRefTermImpl>, symbol_id, symbol_table};
     }
-    RefTerm_c operator() (std::string &&symbol_id, lvd::nnsp<SymbolTable> const &symbol_table) const {
-//         return make_local_sym_ref(std::move(symbol_id));
-        return RefTerm_c{lvd::make_nnup<LocalSymRefTermImpl>(std::move(symbol_id), symbol_table)};
+    RefTerm_c operator() (InternedId symbol_id, lvd::nnsp<SymbolTable> const &symbol_table, SymbolSlot const &symbol_slot) const {
+        return RefTerm_c{std::in_place_type<LocalSymRefTermImpl>, symbol_id, symbol_table, symbol_slot};
     }
 };
 
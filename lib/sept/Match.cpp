@@ -0,0 +1,186 @@
+// 2021.05.21 - Victor Dods
+
+#include "sept/Match.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <lvd/abort.hpp>
+#include "sept/ArrayTerm.hpp"
+#include "sept/ArrayType.hpp"
+#include "sept/FormalTypeOf.hpp"
+#include "sept/FreeVar.hpp"
+#include "sept/OrderedMapType.hpp"
+#include "sept/TupleTerm.hpp"
+#include "sept/UnionTerm.hpp"
+
+namespace sept {
+
+uint32_t MatchVars::slot (InternedId id) {
+    if (auto slot_o = find_slot(id); slot_o.has_value())
+        return slot_o.value();
+    m_ids.push_back(id);
+    return uint32_t(m_ids.size() - 1);
+}
+
+std::optional<uint32_t> MatchVars::find_slot (InternedId id) const {
+    auto it = std::find(m_ids.begin(), m_ids.end(), id);
+    if (it == m_ids.end())
+        return std::nullopt;
+    return uint32_t(it - m_ids.begin());
+}
+
+MatchPattern::MatchPattern (Data const &pattern, MatchVars &vars)
+    :   m_pattern(pattern)
+{
+    compile(m_pattern, vars);
+}
+
+void MatchPattern::compile (Data const &pattern, MatchVars &vars) {
+    if (auto const *free_var_term = pattern.ptr_cast<FreeVarTerm_c>()) {
+        m_instrs.push_back(Instr{Op::FREE_VAR, vars.slot(intern(free_var_term->free_var_id__as_string()))});
+    } else if (auto const *tuple_term = pattern.ptr_cast<TupleTerm_c>()) {
+        m_instrs.push_back(Instr{Op::TUPLE, uint32_t(tuple_term->size())});
+        for (auto const &element : tuple_term->elements())
+            compile(element, vars);
+    } else if (auto const *array_e_term = pattern.ptr_cast<ArrayETerm_c>()) {
+        m_instrs.push_back(Instr{Op::ARRAY_E, 0});
+        compile(array_e_term->element_type(), vars);
+    } else if (auto const *array_term = pattern.ptr_cast<ArrayTerm_c>()) {
+        m_instrs.push_back(Instr{Op::ARRAY, uint32_t(array_term->size())});
+        for (auto const &element : array_term->elements())
+            compile(element, vars);
+    } else if (auto const *ordered_map_dc_term = pattern.ptr_cast<OrderedMapDCTerm_c>()) {
+        m_instrs.push_back(Instr{Op::ORDERED_MAP_DC, 0});
+        compile(ordered_map_dc_term->domain(), vars);
+        compile(ordered_map_dc_term->codomain(), vars);
+    } else if (auto const *ordered_map_d_term = pattern.ptr_cast<OrderedMapDTerm_c>()) {
+        m_instrs.push_back(Instr{Op::ORDERED_MAP_D, 0});
+        compile(ordered_map_d_term->domain(), vars);
+    } else if (auto const *ordered_map_c_term = pattern.ptr_cast<OrderedMapCTerm_c>()) {
+        m_instrs.push_back(Instr{Op::ORDERED_MAP_C, 0});
+        compile(ordered_map_c_term->codomain(), vars);
+    } else if (auto const *union_term = pattern.ptr_cast<UnionTerm_c>()) {
+        m_instrs.push_back(Instr{Op::UNION, uint32_t(union_term->size())});
+        for (auto const &element : union_term->elements())
+            compile(element, vars);
+    } else if (auto const *formal_type_of_term = pattern.ptr_cast<FormalTypeOf_Term_c>()) {
+        m_instrs.push_back(Instr{Op::FORMAL_TYPE_OF, 0});
+        compile(formal_type_of_term->term(), vars);
+    } else {
+        m_instrs.push_back(Instr{Op::VALUE, uint32_t(m_values.size())});
+        m_values.push_back(pattern);
+    }
+}
+
+void MatchFrame::undo_to (size_t trail_mark) {
+    assert(trail_mark <= m_trail.size());
+    while (m_trail.size() > trail_mark) {
+        m_bindings[m_trail.back()] = nullptr;
+        m_trail.pop_back();
+    }
+}
+
+class Matcher {
+public:
+
+    Matcher (MatchPattern const &pattern, MatchFrame &frame)
+        :   m_pattern(pattern)
+        ,   m_frame(frame)
+    { }
+
+    // Matches the subpattern starting at m_instrs[i] against term, and advances i past the subpattern,
+    // unless it fails, in which case i is meaningless.
+    bool match (size_t &i, Data const &term) {
+        auto const &instr = m_pattern.m_instrs[i++];
+        switch (instr.m_op) {
+            case MatchPattern::Op::FREE_VAR: {
+                assert(instr.m_arg < m_frame.var_count() && "MatchFrame is too small for this MatchPattern's MatchVars");
+                auto const *bound = m_frame.binding(instr.m_arg);
+                if (bound == nullptr) {
+                    m_frame.bind(instr.m_arg, term);
+                    return true;
+                }
+                // A repeated FreeVar must match an equal subterm.
+                return eq_data(*bound, term);
+            }
+            case MatchPattern::Op::TUPLE: {
+                auto const *tuple_term = term.ptr_cast<TupleTerm_c>();
+                return tuple_term != nullptr && match_elements(i, instr.m_arg, tuple_term->elements());
+            }
+            case MatchPattern::Op::ARRAY: {
+                auto const *array_term = term.ptr_cast<ArrayTerm_c>();
+                return array_term != nullptr && match_elements(i, instr.m_arg, array_term->elements());
+            }
+            case MatchPattern::Op::ARRAY_E: {
+                auto const *array_e_term = term.ptr_cast<ArrayETerm_c>();
+                return array_e_term != nullptr && match(i, array_e_term->element_type());
+            }
+            case MatchPattern::Op::ORDERED_MAP_DC: {
+                auto const *ordered_map_dc_term = term.ptr_cast<OrderedMapDCTerm_c>();
+                return ordered_map_dc_term != nullptr && match(i, ordered_map_dc_term->domain()) && match(i, ordered_map_dc_term->codomain());
+            }
+            case MatchPattern::Op::ORDERED_MAP_D: {
+                auto const *ordered_map_d_term = term.ptr_cast<OrderedMapDTerm_c>();
+                return ordered_map_d_term != nullptr && match(i, ordered_map_d_term->domain());
+            }
+            case MatchPattern::Op::ORDERED_MAP_C: {
+                auto const *ordered_map_c_term = term.ptr_cast<OrderedMapCTerm_c>();
+                return ordered_map_c_term != nullptr && match(i, ordered_map_c_term->codomain());
+            }
+            case MatchPattern::Op::UNION: {
+                auto const *union_term = term.ptr_cast<UnionTerm_c>();
+                return union_term != nullptr && match_elements(i, instr.m_arg, union_term->elements());
+            }
+            case MatchPattern::Op::FORMAL_TYPE_OF: {
+                auto const *formal_type_of_term = term.ptr_cast<FormalTypeOf_Term_c>();
+                return formal_type_of_term != nullptr && match(i, formal_type_of_term->term());
+            }
+            case MatchPattern::Op::VALUE:
+                return eq_data(term, m_pattern.m_values[instr.m_arg]);
+            default:
+                LVD_ABORT("invalid MatchPattern::Op");
+        }
+    }
+
+private:
+
+    bool match_elements (size_t &i, uint32_t element_count, DataVector const &elements) {
+        if (elements.size() != element_count)
+            return false;
+        for (auto const &element : elements)
+            if (!match(i, element))
+                return false;
+        return true;
+    }
+
+    MatchPattern const &m_pattern;
+    MatchFrame &m_frame;
+};
+
+bool match (MatchPattern const &pattern, Data const &term, MatchFrame &frame) {
+    auto trail_mark = frame.trail_mark();
+    size_t i = 0;
+    if (Matcher(pattern, frame).match(i, term))
+        return true;
+    frame.undo_to(trail_mark);
+    return false;
+}
+
+SymbolTable symbol_table_of (MatchVars const &vars, MatchFrame const &frame) {
+    SymbolTable symbol_table;
+    for (auto slot : frame.trail())
+        symbol_table.define_symbol(vars.id(slot), *frame.binding(slot));
+    return symbol_table;
+}
+
+std::optional<SymbolTable> match (Data const &pattern, Data const &term) {
+    MatchVars vars;
+    MatchPattern match_pattern(pattern, vars);
+    MatchFrame frame(vars.size());
+    if (match(match_pattern, term, frame))
+        return symbol_table_of(vars, frame);
+    else
+        return std::nullopt;
+}
+
+} // end namespace sept
@@ -0,0 +1,133 @@
+// 2021.05.21 - Victor Dods
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include "sept/core.hpp"
+#include "sept/Interner.hpp"
+#include "sept/SymbolTable.hpp"
+#include <vector>
+
+namespace sept {
+
+// Pattern matching of Data against patterns containing FreeVars, e.g. Tuple(FreeVar("X"), Red) matches
+// Tuple(Box, Red), binding X to Box.  A FreeVar that occurs more than once must match equal subterms.
+// Tuple, Array, ArrayE, OrderedMapDC/D/C, Union and FormalTypeOf patterns match terms of the same kind
+// elementwise (with Tuple, Array and Union requiring the same element count), and anything else matches
+// by eq_data.
+//
+// A pattern is compiled once into a MatchPattern, in which each FreeVar refers to a slot (an index into a
+// flat array of bindings) that is assigned by MatchVars.  Matching binds slots in a MatchFrame to pointers
+// into the matched term, so it doesn't allocate or copy anything, and the bindings are undone (via a
+// trail) if the match fails.  Several MatchPatterns compiled using the same MatchVars share slots, so a
+// conjunction of patterns can be matched against several terms one at a time, backtracking with
+// MatchFrame::trail_mark and MatchFrame::undo_to.  The bound values are only copied (e.g. by
+// symbol_table_of) once a match is known to have succeeded.
+
+// Assigns each distinct FreeVar id a slot.  FreeVar ids must be std::string.
+class MatchVars {
+public:
+
+    MatchVars () = default;
+
+    size_t size () const { return m_ids.size(); }
+    InternedId const &id (uint32_t slot) const { return m_ids.at(slot); }
+    // Returns the slot for the given id, assigning the next one if it doesn't already have one.
+    uint32_t slot (InternedId id);
+    std::optional<uint32_t> find_slot (InternedId id) const;
+
+private:
+
+    // Patterns typically have only a few FreeVars, so a linear search is fine.
+    std::vector<InternedId> m_ids;
+};
+
+class MatchPattern {
+public:
+
+    // Assigns slots in vars to the pattern's FreeVars.  The MatchFrame used with this MatchPattern must be
+    // sized for vars (see MatchFrame::resize).
+    MatchPattern (Data const &pattern, MatchVars &vars);
+
+    Data const &pattern () const { return m_pattern; }
+
+private:
+
+    enum class Op : uint8_t {
+        FREE_VAR,       // m_arg is the slot.
+        TUPLE,          // m_arg is the element count; the elements follow.
+        ARRAY,          // m_arg is the element count; the elements follow.
+        ARRAY_E,        // The element type follows.
+        ORDERED_MAP_DC, // The domain and then the codomain follow.
+        ORDERED_MAP_D,  // The domain follows.
+        ORDERED_MAP_C,  // The codomain follows.
+        UNION,          // m_arg is the element count; the elements follow.
+        FORMAL_TYPE_OF, // The term follows.
+        VALUE,          // m_arg is the index into m_values.
+    };
+
+    struct Instr {
+        Op m_op;
+        uint32_t m_arg;
+    };
+
+    void compile (Data const &pattern, MatchVars &vars);
+
+    Data m_pattern;
+    // The pattern in preorder.
+    std::vector<Instr> m_instrs;
+    std::vector<Data> m_values;
+
+    friend class Matcher;
+};
+
+// The bindings made by matching, as borrowed pointers into the matched terms, so the terms must outlive
+// the bindings (i.e. until they're undone).
+class MatchFrame {
+public:
+
+    explicit MatchFrame (size_t var_count = 0) : m_bindings(var_count, nullptr) { }
+
+    // Use this if slots are added to the MatchVars after this MatchFrame was constructed.  Existing
+    // bindings are kept.
+    void resize (size_t var_count) { m_bindings.resize(var_count, nullptr); }
+
+    size_t var_count () const { return m_bindings.size(); }
+    bool is_bound (uint32_t slot) const { return m_bindings[slot] != nullptr; }
+    // Returns nullptr if the slot isn't bound.
+    Data const *binding (uint32_t slot) const { return m_bindings[slot]; }
+
+    // Bindings made after a call to trail_mark can be undone by passing its return value to undo_to.
+    size_t trail_mark () const { return m_trail.size(); }
+    void undo_to (size_t trail_mark);
+    // Undoes all bindings.
+    void clear () { undo_to(0); }
+    // The bound slots, in the order they were bound.
+    std::vector<uint32_t> const &trail () const { return m_trail; }
+
+private:
+
+    void bind (uint32_t slot, Data const &term) {
+        m_bindings[slot] = &term;
+        m_trail.push_back(slot);
+    }
+
+    std::vector<Data const *> m_bindings;
+    std::vector<uint32_t> m_trail;
+
+    friend class Matcher;
+};
+
+// Matches the pattern against term, adding bindings to frame (whose existing bindings must be matched
+// consistently).  If this returns false, then frame is left as it was.
+bool match (MatchPattern const &pattern, Data const &term, MatchFrame &frame);
+
+// Copies the bound values into a SymbolTable, keyed by FreeVar id, in the order that they were bound.
+SymbolTable symbol_table_of (MatchVars const &vars, MatchFrame const &frame);
+
+// Convenience function for a one-off match.  Returns the bindings if the pattern matches term, otherwise
+// std::nullopt.
+std::optional<SymbolTable> match (Data const &pattern, Data const &term);
+
+} // end namespace sept
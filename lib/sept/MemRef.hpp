@@ -27,7 +27,8 @@ public:
     MemRefTermImpl &operator = (MemRefTermImpl const &other) = default;
     MemRefTermImpl &operator = (MemRefTermImpl &&other) = default;
 
-    virtual lvd::nnup<RefTermBase_i> cloned () const override { return lvd::make_nnup<MemRefTermImpl>(m_ptr); }
+    virtual RefTermBase_i *copy_into (void *storage) const override { return construct_ref_term_impl<MemRefTermImpl>(storage, *this); }
+    virtual RefTermBase_i *move_into (void *storage) noexcept override { return construct_ref_term_impl<MemRefTermImpl>(storage, std::move(*this)); }
 
     virtual Data const &referenced_data () const & override { return *m_ptr; }
     virtual Data &referenced_data () & override { return *m_ptr; }
@@ -53,7 +54,7 @@ public:
 
     RefTerm_c operator() (lvd::nnp<Data> ref) const {
 //         return make_mem_ref(ref);
-        return RefTerm_c{lvd::make_nnup<MemRefTermImpl>(ref)};
+        return RefTerm_c{std::in_place_type<MemRefTermImpl>, ref};
     }
 };
 
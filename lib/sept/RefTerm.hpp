@@ -2,16 +2,26 @@
 
 #pragma once
 
+#include <cstddef>
 #include <lvd/abort.hpp>
 #include <lvd/aliases.hpp>
 #include <lvd/fmt.hpp>
 #include <lvd/OstreamDelegate.hpp>
+#include <new>
 #include "sept/core.hpp"
+#include <type_traits>
+#include <utility>
 
 namespace sept {
 
 class Data;
 
+// Size of the inline storage in RefTerm_c.  This is enough for each of the builtin ref kinds
+// (LocalSymRefTermImpl is the largest, at 64 bytes on 64-bit platforms).
+inline constexpr size_t REF_TERM_INLINE_CAPACITY = 64;
+// Pointer alignment is enough for the builtin ref kinds, and anything more would pad out RefTerm_c.
+inline constexpr size_t REF_TERM_INLINE_ALIGNMENT = alignof(void *);
+
 //
 // Interface for defining custom transparent reference behavior.
 //
@@ -21,8 +31,10 @@ public:
 
     virtual ~RefTermBase_i () = 0;
 
-    // Returns a clone of this.
-    virtual lvd::nnup<RefTermBase_i> cloned () const = 0;
+    // Copy/move-constructs this into storage, which is the inline storage of a RefTerm_c, and returns
+    // a pointer to the new object.  These should be implemented using construct_ref_term_impl.
+    virtual RefTermBase_i *copy_into (void *storage) const = 0;
+    virtual RefTermBase_i *move_into (void *storage) noexcept = 0;
 
     // Value of the referenced Data.
     virtual Data const &referenced_data () const & = 0;
@@ -36,22 +48,53 @@ public:
 
 inline RefTermBase_i::~RefTermBase_i () = default;
 
+// Constructs a T_ in the inline storage of a RefTerm_c, checking that it fits.
+template <typename T_, typename... Args_>
+RefTermBase_i *construct_ref_term_impl (void *storage, Args_&&... args) {
+    static_assert(std::is_base_of_v<RefTermBase_i,T_>);
+    static_assert(sizeof(T_) <= REF_TERM_INLINE_CAPACITY, "ref term impl is too big for RefTerm_c's inline storage");
+    static_assert(alignof(T_) <= REF_TERM_INLINE_ALIGNMENT, "ref term impl is overaligned for RefTerm_c's inline storage");
+    return new(storage) T_(std::forward<Args_>(args)...);
+}
+
 //
 // RefTerm_c
 //
 
 // This class acts as a delegate for the specific kinds of references, each of which implement
-// the RefTermBase_i interface.
+// the RefTermBase_i interface.  The ref impl is stored inline (it's meant to be small, e.g. a pointer
+// or a symbol id and a table pointer), so copying a RefTerm_c doesn't allocate.
+// NOTE: RefTerm_c is still bigger than std::any's small-object buffer (which is a single pointer in
+// libstdc++), so a Data holding a RefTerm_c stores it on the heap, same as any other non-trivial term.
+// What this saves is the second allocation, for the ref impl, on every copy.
 class RefTerm_c {
 public:
 
-    RefTerm_c () = default;
-    RefTerm_c (RefTerm_c const &other) : m_ref_base(other.m_ref_base->cloned()) { }
-    RefTerm_c (RefTerm_c &&other) = default;
-    explicit RefTerm_c (lvd::nnup<RefTermBase_i> &&ref_base) : m_ref_base(std::move(ref_base)) { }
-
-    RefTerm_c &operator = (RefTerm_c const &other) = default;
-    RefTerm_c &operator = (RefTerm_c &&other) = default;
+    RefTerm_c (RefTerm_c const &other) : m_ref_base(other.m_ref_base->copy_into(&m_storage)) { }
+    RefTerm_c (RefTerm_c &&other) noexcept : m_ref_base(other.m_ref_base->move_into(&m_storage)) { }
+    // Constructs the ref impl T_ in place -- this is the preferred constructor.
+    template <typename T_, typename... Args_>
+    explicit RefTerm_c (std::in_place_type_t<T_>, Args_&&... args)
+        :   m_ref_base(construct_ref_term_impl<T_>(&m_storage, std::forward<Args_>(args)...))
+    { }
+    // The ref impl is moved into the inline storage, and then ref_base is destroyed.
+    explicit RefTerm_c (lvd::nnup<RefTermBase_i> &&ref_base) : m_ref_base(ref_base->move_into(&m_storage)) { }
+    ~RefTerm_c () { m_ref_base->~RefTermBase_i(); }
+
+    RefTerm_c &operator = (RefTerm_c const &other) {
+        if (&other != this) {
+            m_ref_base->~RefTermBase_i();
+            m_ref_base = other.m_ref_base->copy_into(&m_storage);
+        }
+        return *this;
+    }
+    RefTerm_c &operator = (RefTerm_c &&other) noexcept {
+        if (&other != this) {
+            m_ref_base->~RefTermBase_i();
+            m_ref_base = other.m_ref_base->move_into(&m_storage);
+        }
+        return *this;
+    }
 
     // Value of the referenced Data.
     Data const &referenced_data () const & { return ref_base_get().referenced_data(); }
@@ -69,7 +112,7 @@ public:
     operator lvd::OstreamDelegate () const;
 
     // This should only be used by inhabits
-    RefTermBase_i const &ref_base_get () const & { return static_cast<RefTermBase_i const &>(*m_ref_base.get().get()); }
+    RefTermBase_i const &ref_base_get () const & { return *m_ref_base; }
 
     //
     // Frontends for Data::can_cast and Data::cast
@@ -87,11 +130,14 @@ public:
 
 private:
 
-    RefTermBase_i &ref_base_get () & { return static_cast<RefTermBase_i &>(*m_ref_base.get().get()); }
+    RefTermBase_i &ref_base_get () & { return *m_ref_base; }
     // NOTE: Not sure if this is right.
-    RefTermBase_i &&ref_base_get () && { return static_cast<RefTermBase_i &&>(*m_ref_base.get().get()); }
+    RefTermBase_i &&ref_base_get () && { return std::move(*m_ref_base); }
 
-    lvd::nnup<RefTermBase_i> m_ref_base;
+    std::aligned_storage_t<REF_TERM_INLINE_CAPACITY,REF_TERM_INLINE_ALIGNMENT> m_storage;
+    // Always points into m_storage.  This is kept instead of computing it from m_storage, since the
+    // RefTermBase_i subobject isn't necessarily at offset 0 of the ref impl.
+    RefTermBase_i *m_ref_base;
 };
 
 bool operator== (RefTerm_c const &lhs, RefTerm_c const &rhs);
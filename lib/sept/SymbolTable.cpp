@@ -2,50 +2,284 @@
 
 #include "sept/SymbolTable.hpp"
 
+#include <algorithm>
+#include "sept/SymbolTableImage.hpp"
+
 namespace sept {
 
-Data const &SymbolTable::resolve_symbol_const (std::string const &symbol_id) const noexcept(false) {
-    auto it = m_symbol_map.find(symbol_id);
-    if (it != m_symbol_map.end())
-        return it->second;
-    else if (m_parent_symbol_table != nullptr)
-        return m_parent_symbol_table->resolve_symbol_const(symbol_id); // Fall through to parent, if it exists
-    else
-        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id) << " is not defined"));
+namespace {
+
+// Generations are drawn from a single counter shared by all SymbolTables, so that a given generation
+// value only ever belongs to one change of one SymbolTable.  See ResolutionCache.
+std::atomic<uint64_t> g_generation_counter{0};
+
+uint64_t next_generation () {
+    return g_generation_counter.fetch_add(1, std::memory_order_relaxed) + 1;
 }
 
-Data &SymbolTable::resolve_symbol_nonconst (std::string const &symbol_id) noexcept(false) {
-    auto it = m_symbol_map.find(symbol_id);
-    if (it != m_symbol_map.end())
-        return it->second;
-    else if (m_parent_symbol_table != nullptr)
-        return m_parent_symbol_table->resolve_symbol_nonconst(symbol_id); // Fall through to parent, if it exists
-    else
-        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id) << " is not defined"));
+} // end namespace
+
+std::ostream &operator<< (std::ostream &out, SymbolSlot const &symbol_slot) {
+    return out << "SymbolSlot(depth = " << symbol_slot.m_depth << ", slot = " << symbol_slot.m_slot << ')';
 }
 
-bool SymbolTable::symbol_is_defined (std::string const &symbol_id) const noexcept {
-    auto it = m_symbol_map.find(symbol_id);
-    if (it != m_symbol_map.end())
-        return true;
-    else if (m_parent_symbol_table != nullptr)
-        return m_parent_symbol_table->symbol_is_defined(symbol_id); // Fall through to parent, if it exists
-    else
-        return false;
+Data *ResolutionCache::get (SymbolTable const &symbol_table) const noexcept {
+    if (m_data == nullptr)
+        return nullptr;
+    // Common case of depth 0 is a single compare.
+    if (m_depth == 0)
+        return symbol_table.generation() == m_path_generation ? m_data : nullptr;
+    auto path_generation = symbol_table.path_generation(m_depth);
+    return path_generation.has_value() && *path_generation == m_path_generation ? m_data : nullptr;
+}
+
+SymbolTable::SymbolTable (lvd::sp<SymbolTable> const &parent_symbol_table, lvd::nnsp<SymbolTableImage> const &image, size_t image_table_index)
+    :   m_parent_symbol_table(parent_symbol_table)
+    ,   m_image(image)
+    ,   m_image_table_index(image_table_index)
+{
+    if (m_image_table_index >= image->table_count())
+        throw std::runtime_error(LVD_FMT("image_table_index " << m_image_table_index << " is out of range (SymbolTableImage has " << image->table_count() << " tables)"));
+}
+
+SymbolTable::SymbolTable (SymbolTable const &other) {
+    *this = other;
+}
+
+SymbolTable::SymbolTable (SymbolTable &&other) {
+    *this = std::move(other);
+}
+
+SymbolTable &SymbolTable::operator = (SymbolTable const &other) {
+    if (&other == this)
+        return *this;
+    auto other_lock = other.writer_lock();
+    auto lock = writer_lock();
+    m_slot_map = other.m_slot_map;
+    m_slot_value = other.m_slot_value;
+    m_slot_symbol = other.m_slot_symbol;
+    m_slot_is_vacant = other.m_slot_is_vacant;
+    m_reusable_slots = other.m_reusable_slots;
+    m_parent_symbol_table = other.m_parent_symbol_table;
+    m_image = other.m_image;
+    m_image_table_index = other.m_image_table_index;
+    m_erased_image_symbols = other.m_erased_image_symbols;
+    if (m_concurrent_index != nullptr) {
+        m_concurrent_index->clear();
+        for (size_t slot = 0; slot < m_slot_value.size(); ++slot)
+            if (!m_slot_is_vacant[slot])
+                m_concurrent_index->assign(m_slot_symbol[slot], &m_slot_value[slot]);
+    }
+    // Invalidate any ResolutionCache referring to the old contents (or the old parent).
+    bump_generation();
+    return *this;
+}
+
+SymbolTable &SymbolTable::operator = (SymbolTable &&other) {
+    if (&other == this)
+        return *this;
+    auto other_lock = other.writer_lock();
+    auto lock = writer_lock();
+    m_slot_map = std::move(other.m_slot_map);
+    m_slot_value = std::move(other.m_slot_value);
+    m_slot_symbol = std::move(other.m_slot_symbol);
+    m_slot_is_vacant = std::move(other.m_slot_is_vacant);
+    m_reusable_slots = std::move(other.m_reusable_slots);
+    m_parent_symbol_table = std::move(other.m_parent_symbol_table);
+    m_image = std::move(other.m_image);
+    m_image_table_index = other.m_image_table_index;
+    m_erased_image_symbols = std::move(other.m_erased_image_symbols);
+    if (m_concurrent_index != nullptr) {
+        m_concurrent_index->clear();
+        for (size_t slot = 0; slot < m_slot_value.size(); ++slot)
+            if (!m_slot_is_vacant[slot])
+                m_concurrent_index->assign(m_slot_symbol[slot], &m_slot_value[slot]);
+    }
+    // Leave other in a valid, empty state.
+    other.m_slot_map.clear();
+    other.m_slot_value.clear();
+    other.m_slot_symbol.clear();
+    other.m_slot_is_vacant.clear();
+    other.m_reusable_slots.clear();
+    other.m_erased_image_symbols.clear();
+    if (other.m_concurrent_index != nullptr)
+        other.m_concurrent_index->clear();
+    // Invalidate any ResolutionCache referring to the old contents of either.
+    bump_generation();
+    other.bump_generation();
+    return *this;
+}
+
+Data const &SymbolTable::resolve_symbol_const (InternedId symbol_id) const noexcept(false) {
+    // Iterate instead of recursing up the parent chain.
+    for (auto symbol_table = this; symbol_table != nullptr; symbol_table = symbol_table->m_parent_symbol_table.get())
+        if (auto data = symbol_table->find_local(symbol_id))
+            return *data;
+    throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " is not defined"));
+}
+
+Data &SymbolTable::resolve_symbol_nonconst (InternedId symbol_id) noexcept(false) {
+    for (auto symbol_table = this; symbol_table != nullptr; symbol_table = symbol_table->m_parent_symbol_table.get())
+        if (auto data = symbol_table->find_local(symbol_id))
+            return *data;
+    throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " is not defined"));
+}
+
+bool SymbolTable::symbol_is_defined (InternedId symbol_id) const noexcept {
+    for (auto symbol_table = this; symbol_table != nullptr; symbol_table = symbol_table->m_parent_symbol_table.get())
+        if (symbol_table->is_defined_locally(symbol_id))
+            return true;
+    return false;
+}
+
+std::optional<SymbolSlot> SymbolTable::locate_symbol (InternedId symbol_id) const noexcept(false) {
+    size_t depth = 0;
+    for (auto symbol_table = this; symbol_table != nullptr; symbol_table = symbol_table->m_parent_symbol_table.get(), ++depth) {
+        auto lock = symbol_table->writer_lock();
+        // Make sure it has a slot if it's in the image.
+        symbol_table->find_local_locked(symbol_id);
+        if (auto slot = symbol_table->local_slot(symbol_id); slot.has_value())
+            return SymbolSlot{depth, *slot};
+    }
+    return std::nullopt;
+}
+
+size_t SymbolTable::define_symbol (InternedId symbol_id, Data const &value) noexcept(false) {
+    auto lock = writer_lock();
+    if (auto existing = find_local_locked(symbol_id))
+        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " already defined; can't re-define.  Existing value is " << *existing << ", new value is " << value));
+    auto slot = append_slot(symbol_id, Data{value});
+    bump_generation();
+    return slot;
+}
+
+size_t SymbolTable::define_symbol (InternedId symbol_id, Data &&value) noexcept(false) {
+    auto lock = writer_lock();
+    if (auto existing = find_local_locked(symbol_id))
+        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " already defined; can't re-define.  Existing value is " << *existing << ", new value is " << value));
+    auto slot = append_slot(symbol_id, std::move(value));
+    bump_generation();
+    return slot;
+}
+
+void SymbolTable::erase_symbol (InternedId symbol_id) noexcept(false) {
+    auto lock = writer_lock();
+    // Make sure it has a slot if it's in the image.
+    find_local_locked(symbol_id);
+    auto local_slot = this->local_slot(symbol_id);
+    if (!local_slot.has_value())
+        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " is not defined in this SymbolTable; can't erase"));
+    auto slot = *local_slot;
+    if (uses_slot_map())
+        m_slot_map.erase(symbol_id);
+    // The Data itself stays in place so that the slots of other symbols don't change.  It's only reset
+    // (and the slot reused) if there can't be concurrent readers still using it.
+    if (m_concurrent_index != nullptr) {
+        m_concurrent_index->assign(symbol_id, nullptr);
+    } else {
+        m_slot_value[slot].reset();
+        m_reusable_slots.push_back(slot);
+    }
+    m_slot_is_vacant[slot] = true;
+    if (m_image != nullptr)
+        m_erased_image_symbols.insert(symbol_id);
+    bump_generation();
+}
+
+Data const &SymbolTable::resolve_slot_const (SymbolSlot const &symbol_slot) const noexcept(false) {
+    auto symbol_table = ancestor(symbol_slot.m_depth);
+    auto lock = symbol_table != nullptr ? symbol_table->writer_lock() : std::unique_lock<std::mutex>();
+    if (symbol_table == nullptr || symbol_slot.m_slot >= symbol_table->m_slot_value.size() || symbol_table->m_slot_is_vacant[symbol_slot.m_slot])
+        throw std::runtime_error(LVD_FMT(symbol_slot << " does not refer to a defined symbol"));
+    return symbol_table->m_slot_value[symbol_slot.m_slot];
+}
+
+Data &SymbolTable::resolve_slot_nonconst (SymbolSlot const &symbol_slot) noexcept(false) {
+    return resolve_slot_checked(symbol_slot, nullptr);
+}
+
+Data &SymbolTable::resolve_symbol_cached (InternedId symbol_id, ResolutionCache &cache) noexcept(false) {
+    // The cache would be shared by threads reading through the same ref, so don't use it.
+    if (m_concurrent_index != nullptr)
+        return resolve_symbol_nonconst(symbol_id);
+
+    if (auto data = cache.get(*this))
+        return *data;
+
+    uint64_t path_generation = 0;
+    size_t depth = 0;
+    for (auto symbol_table = this; symbol_table != nullptr; symbol_table = symbol_table->m_parent_symbol_table.get(), ++depth) {
+        // The generation has to be read before the lookup, so that a concurrent define in an ancestor
+        // can only cause a spurious cache miss later, not a stale hit.
+        path_generation = std::max(path_generation, symbol_table->generation());
+        if (auto data = symbol_table->find_local(symbol_id)) {
+            cache.set(data, depth, path_generation);
+            return *data;
+        }
+    }
+    cache.reset();
+    throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id.as_string()) << " is not defined"));
+}
+
+Data &SymbolTable::resolve_slot_cached (SymbolSlot const &symbol_slot, InternedId symbol_id, ResolutionCache &cache) noexcept(false) {
+    if (m_concurrent_index != nullptr)
+        return resolve_slot_checked(symbol_slot, &symbol_id);
+
+    if (auto data = cache.get(*this))
+        return *data;
+
+    // As in resolve_symbol_cached, read the generations before resolving.
+    auto path_generation = this->path_generation(symbol_slot.m_depth);
+    auto &data = resolve_slot_checked(symbol_slot, &symbol_id);
+    // If resolve_slot_checked succeeded, then the parent chain is at least symbol_slot.m_depth long.
+    cache.set(&data, symbol_slot.m_depth, *path_generation);
+    return data;
 }
 
-void SymbolTable::define_symbol (std::string const &symbol_id, Data const &value) noexcept(false) {
-    auto it = m_symbol_map.find(symbol_id);
-    if (it != m_symbol_map.end())
-        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id) << " already defined; can't re-define.  Existing value is " << it->second << ", new value is " << value));
-    m_symbol_map.emplace(symbol_id, value);
+std::optional<uint64_t> SymbolTable::path_generation (size_t depth) const noexcept {
+    uint64_t path_generation = 0;
+    auto symbol_table = this;
+    for ( ; depth > 0 && symbol_table != nullptr; --depth) {
+        path_generation = std::max(path_generation, symbol_table->generation());
+        symbol_table = symbol_table->m_parent_symbol_table.get();
+    }
+    if (symbol_table == nullptr)
+        return std::nullopt;
+    return std::max(path_generation, symbol_table->generation());
 }
 
-void SymbolTable::define_symbol (std::string const &symbol_id, Data &&value) noexcept(false) {
-    auto it = m_symbol_map.find(symbol_id);
-    if (it != m_symbol_map.end())
-        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(symbol_id) << " already defined; can't re-define.  Existing value is " << it->second << ", new value is " << value));
-    m_symbol_map.emplace(symbol_id, std::move(value));
+Data const &SymbolTable::resolve_symbol_const (std::string_view symbol_id) const noexcept(false) {
+    // If the string was never interned, then it can't possibly be defined.
+    auto interned_id = global_interner().find(symbol_id);
+    if (!interned_id.has_value())
+        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(std::string(symbol_id)) << " is not defined"));
+    return resolve_symbol_const(*interned_id);
+}
+
+Data &SymbolTable::resolve_symbol_nonconst (std::string_view symbol_id) noexcept(false) {
+    auto interned_id = global_interner().find(symbol_id);
+    if (!interned_id.has_value())
+        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(std::string(symbol_id)) << " is not defined"));
+    return resolve_symbol_nonconst(*interned_id);
+}
+
+bool SymbolTable::symbol_is_defined (std::string_view symbol_id) const noexcept {
+    auto interned_id = global_interner().find(symbol_id);
+    return interned_id.has_value() && symbol_is_defined(*interned_id);
+}
+
+std::optional<SymbolSlot> SymbolTable::locate_symbol (std::string_view symbol_id) const noexcept(false) {
+    auto interned_id = global_interner().find(symbol_id);
+    if (!interned_id.has_value())
+        return std::nullopt;
+    return locate_symbol(*interned_id);
+}
+
+void SymbolTable::erase_symbol (std::string_view symbol_id) noexcept(false) {
+    auto interned_id = global_interner().find(symbol_id);
+    if (!interned_id.has_value())
+        throw std::runtime_error(LVD_FMT("Symbol " << lvd::literal_of(std::string(symbol_id)) << " is not defined in this SymbolTable; can't erase"));
+    erase_symbol(*interned_id);
 }
 
 lvd::nnsp<SymbolTable> SymbolTable::parent_symbol_table () const noexcept(false) {
@@ -55,12 +289,169 @@ lvd::nnsp<SymbolTable> SymbolTable::parent_symbol_table () const noexcept(false)
 }
 
 lvd::nnsp<SymbolTable> SymbolTable::push_symbol_table () {
-    return lvd::make_nnsp<SymbolTable>(SymbolMap{}, shared_from_this());
+    return lvd::make_nnsp<SymbolTable>(shared_from_this());
 }
 
 void SymbolTable::clear () {
-    m_symbol_map.clear();
+    auto lock = writer_lock();
+    m_slot_map.clear();
+    m_slot_value.clear();
+    m_slot_symbol.clear();
+    m_slot_is_vacant.clear();
+    m_reusable_slots.clear();
     m_parent_symbol_table.reset();
+    m_image.reset();
+    m_erased_image_symbols.clear();
+    if (m_concurrent_index != nullptr)
+        m_concurrent_index->clear();
+    bump_generation();
+}
+
+void SymbolTable::reset (lvd::sp<SymbolTable> const &parent_symbol_table) {
+    // clear() bumps the generation, which also accounts for the change of parent.
+    clear();
+    m_parent_symbol_table = parent_symbol_table;
+}
+
+void SymbolTable::enable_concurrent_reads () {
+    if (m_concurrent_index != nullptr)
+        return;
+    auto concurrent_index = std::make_unique<ConcurrentSymbolIndex>();
+    for (size_t slot = 0; slot < m_slot_value.size(); ++slot)
+        if (!m_slot_is_vacant[slot])
+            concurrent_index->assign(m_slot_symbol[slot], &m_slot_value[slot]);
+    m_concurrent_index = std::move(concurrent_index);
+}
+
+void SymbolTable::materialize_image_symbols () const noexcept(false) {
+    if (m_image == nullptr)
+        return;
+    auto lock = writer_lock();
+    for (size_t entry_index = 0; entry_index < m_image->entry_count(m_image_table_index); ++entry_index)
+        find_local_locked(intern(m_image->entry_name(m_image_table_index, entry_index)));
+}
+
+Data *SymbolTable::find_local (InternedId symbol_id) const noexcept(false) {
+    if (m_concurrent_index != nullptr) {
+        if (auto data = m_concurrent_index->find(symbol_id))
+            return data;
+    } else {
+        // The values are owned by this SymbolTable; constness is applied by the public methods.
+        if (auto slot = local_slot(symbol_id); slot.has_value())
+            return const_cast<Data *>(&m_slot_value[*slot]);
+    }
+
+    if (m_image == nullptr)
+        return nullptr;
+    auto lock = writer_lock();
+    return find_local_locked(symbol_id);
+}
+
+Data *SymbolTable::find_local_locked (InternedId symbol_id) const noexcept(false) {
+    if (auto slot = local_slot(symbol_id); slot.has_value())
+        return const_cast<Data *>(&m_slot_value[*slot]);
+
+    if (m_image == nullptr || (!m_erased_image_symbols.empty() && m_erased_image_symbols.find(symbol_id) != m_erased_image_symbols.end()))
+        return nullptr;
+    auto entry_index = m_image->find_entry(m_image_table_index, symbol_id.as_string());
+    if (!entry_index.has_value())
+        return nullptr;
+    // Materializing doesn't change the meaning of this SymbolTable, so this is logically const.
+    auto self = const_cast<SymbolTable *>(this);
+    auto slot = self->append_slot(symbol_id, m_image->entry_value(m_image_table_index, *entry_index));
+    return &self->m_slot_value[slot];
+}
+
+bool SymbolTable::is_defined_locally (InternedId symbol_id) const noexcept {
+    if (m_concurrent_index != nullptr) {
+        if (m_concurrent_index->find(symbol_id) != nullptr)
+            return true;
+    } else {
+        if (local_slot(symbol_id).has_value())
+            return true;
+    }
+
+    if (m_image == nullptr)
+        return false;
+    auto lock = writer_lock();
+    if (local_slot(symbol_id).has_value())
+        return true;
+    if (!m_erased_image_symbols.empty() && m_erased_image_symbols.find(symbol_id) != m_erased_image_symbols.end())
+        return false;
+    return m_image->find_entry(m_image_table_index, symbol_id.as_string()).has_value();
+}
+
+Data &SymbolTable::resolve_slot_checked (SymbolSlot const &symbol_slot, InternedId const *symbol_id) noexcept(false) {
+    // The ancestors are non-const objects, since they're held by non-const shared_ptr.
+    auto symbol_table = const_cast<SymbolTable *>(ancestor(symbol_slot.m_depth));
+    auto lock = symbol_table != nullptr ? symbol_table->writer_lock() : std::unique_lock<std::mutex>();
+    if (symbol_table == nullptr || symbol_slot.m_slot >= symbol_table->m_slot_value.size() || symbol_table->m_slot_is_vacant[symbol_slot.m_slot])
+        throw std::runtime_error(LVD_FMT(symbol_slot << " does not refer to a defined symbol"));
+    if (symbol_id != nullptr && symbol_table->m_slot_symbol[symbol_slot.m_slot] != *symbol_id)
+        throw std::runtime_error(LVD_FMT(symbol_slot << " no longer refers to symbol " << lvd::literal_of(symbol_id->as_string())));
+    return symbol_table->m_slot_value[symbol_slot.m_slot];
+}
+
+size_t SymbolTable::append_slot (InternedId symbol_id, Data &&value) {
+    // Concurrent readers don't expect a slot's value to change, so slots aren't reused in that mode.
+    if (m_concurrent_index == nullptr && !m_reusable_slots.empty()) {
+        auto slot = m_reusable_slots.back();
+        m_reusable_slots.pop_back();
+        m_slot_value[slot] = std::move(value);
+        m_slot_symbol[slot] = symbol_id;
+        m_slot_is_vacant[slot] = false;
+        if (uses_slot_map())
+            m_slot_map.emplace(symbol_id, slot);
+        return slot;
+    }
+
+    auto slot = m_slot_value.size();
+    m_slot_value.emplace_back(std::move(value));
+    m_slot_symbol.emplace_back(symbol_id);
+    m_slot_is_vacant.emplace_back(false);
+    if (m_slot_value.size() == SMALL_SLOT_COUNT+1) {
+        // Switch to the map.
+        for (size_t i = 0; i < m_slot_value.size(); ++i)
+            if (!m_slot_is_vacant[i])
+                m_slot_map.emplace(m_slot_symbol[i], i);
+    } else if (uses_slot_map()) {
+        m_slot_map.emplace(symbol_id, slot);
+    }
+    // This publishes the new value to concurrent readers, so it has to happen after everything else.
+    if (m_concurrent_index != nullptr)
+        m_concurrent_index->assign(symbol_id, &m_slot_value[slot]);
+    return slot;
+}
+
+void SymbolTable::bump_generation () {
+    m_generation.store(next_generation(), std::memory_order_release);
+}
+
+std::optional<size_t> SymbolTable::local_slot (InternedId symbol_id) const noexcept {
+    if (uses_slot_map()) {
+        auto it = m_slot_map.find(symbol_id);
+        if (it == m_slot_map.end())
+            return std::nullopt;
+        return it->second;
+    }
+    for (size_t slot = 0; slot < m_slot_symbol.size(); ++slot)
+        if (m_slot_symbol[slot] == symbol_id && !m_slot_is_vacant[slot])
+            return slot;
+    return std::nullopt;
+}
+
+std::unique_lock<std::mutex> SymbolTable::writer_lock () const {
+    if (m_concurrent_index != nullptr)
+        return std::unique_lock<std::mutex>(m_writer_mutex);
+    else
+        return std::unique_lock<std::mutex>();
+}
+
+SymbolTable const *SymbolTable::ancestor (size_t depth) const noexcept {
+    auto symbol_table = this;
+    for ( ; depth > 0 && symbol_table != nullptr; --depth)
+        symbol_table = symbol_table->m_parent_symbol_table.get();
+    return symbol_table;
 }
 
 std::ostream &operator<< (std::ostream &out, SymbolTable const &symbol_table) {
@@ -71,11 +462,15 @@ std::ostream &operator<< (std::ostream &out, SymbolTable const &symbol_table) {
         log << "symbol_map = {\n";
         {
             auto ig2 = lvd::IndentGuard(log);
-            for (auto const &it : symbol_table.symbol_map())
-                log << lvd::literal_of(it.first) << " -> " << it.second << '\n';
+            // Print in slot order, which is the order of definition.
+            for (size_t slot = 0; slot < symbol_table.slot_count(); ++slot)
+                if (!symbol_table.slot_is_vacant(slot))
+                    log << lvd::literal_of(symbol_table.slot_symbol(slot).as_string()) << " -> " << symbol_table.slot_value(slot) << '\n';
         }
         log << "}\n";
         log << "has_parent_symbol_table = " << std::boolalpha << symbol_table.has_parent_symbol_table() << '\n';
+        if (symbol_table.has_image())
+            log << "has_image = true\n";
     }
     log << ')';
     return out;
@@ -2,61 +2,259 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <lvd/aliases.hpp>
 #include <lvd/fmt.hpp>
 #include <lvd/literal.hpp>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include "sept/ConcurrentSymbolIndex.hpp"
 #include "sept/core.hpp"
 #include "sept/Data.hpp"
+#include "sept/Interner.hpp"
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace sept {
 
+// Location of a symbol relative to a particular SymbolTable.  m_depth is the number of parent links to
+// follow (0 means the table itself) and m_slot is the index of the symbol within that table.  Slots are
+// assigned in order of definition (except that vacant slots are reused, see erase_symbol), so where the
+// binding scope is known statically (e.g. function params) the location can be computed ahead of time
+// and resolving it is just an array index.
+struct SymbolSlot {
+    size_t m_depth;
+    size_t m_slot;
+};
+
+inline bool operator == (SymbolSlot const &lhs, SymbolSlot const &rhs) {
+    return lhs.m_depth == rhs.m_depth && lhs.m_slot == rhs.m_slot;
+}
+inline bool operator != (SymbolSlot const &lhs, SymbolSlot const &rhs) {
+    return !(lhs == rhs);
+}
+
+std::ostream &operator<< (std::ostream &out, SymbolSlot const &symbol_slot);
+
+class SymbolTable;
+class SymbolTableImage;
+
+// Caches the result of resolving a symbol (or slot) relative to a particular SymbolTable, so that
+// repeated resolution is normally a generation check instead of a lookup.  The cached pointer is valid
+// as long as none of the SymbolTables from the referencing one up to the defining one have changed,
+// which is tracked by SymbolTable::generation.  Changing a SymbolTable's parent counts as a change to
+// it, so this also covers the path itself being replaced (e.g. by SymbolTable::reset).  A given
+// ResolutionCache must only be used with a single referencing SymbolTable.
+// NOTE: This is not thread-safe, so SymbolTable doesn't use it if concurrent reads are enabled.
+class ResolutionCache {
+public:
+
+    // Returns nullptr if there's no valid cached value.
+    Data *get (SymbolTable const &symbol_table) const noexcept;
+    void set (Data *data, size_t depth, uint64_t path_generation) noexcept {
+        m_data = data;
+        m_depth = depth;
+        m_path_generation = path_generation;
+    }
+    void reset () noexcept { m_data = nullptr; }
+
+private:
+
+    Data *m_data = nullptr;
+    // Depth of the SymbolTable in which the cached Data lives.
+    size_t m_depth = 0;
+    // Greatest of the generations of the SymbolTables from the referencing one up to the defining one.
+    // Every change to any SymbolTable gets a generation greater than all previous ones, so any change
+    // along the path (including to a parent link, which is the only way for a different SymbolTable to
+    // appear on it) makes this greater.
+    uint64_t m_path_generation = 0;
+};
+
 // TODO: Maybe add an identifier to the table
 // TODO: Maybe add unresolved symbol handler that could either return Data or throw.
 // TODO: Allow the symbol ID to be Data, so that more sophisticated symbols can be used, e.g.
 // canonically induced symbols such as ConcreteTypeOf(x), where x is a symbol; this would theoretically
 // allow the symbol table entry for x to only know its storage layout, because then ConcreteTypeOf(x)
 // would dictate the rest.
+//
+// By default, SymbolTable is not thread-safe.  If enable_concurrent_reads has been called, then symbols
+// can be resolved (via the resolve_symbol_* methods and symbol_is_defined) lock-free from any number of
+// threads, while define_symbol and erase_symbol are serialized by a mutex.  In that mode:
+// - A resolved Data stays valid even if its symbol is erased (the value isn't reset), until clear().
+// - clear() must not run concurrently with anything else.
+// - locate_symbol and the slot-based API take the writer mutex, so they work but aren't lock-free.
+// - Only the InternedId overloads are lock-free; the std::string_view overloads first look up the
+//   string in global_interner(), which takes its mutex.  Intern hot symbols once and reuse the ids.
+// - The local slot accessors (slot_count, local_slot, etc) and operator<< aren't synchronized.
+//
+// A SymbolTable can also be backed by a table in a SymbolTableImage (see load_symbol_table_image),
+// in which case symbols in the image are materialized (deserialized and given a slot) the first time
+// they're looked up.  Materialization doesn't count as a change for the purposes of generation().
+// Until then, they don't appear in the local slot accessors or operator<<.
 class SymbolTable : public std::enable_shared_from_this<SymbolTable> {
 public:
 
-    using SymbolMap = std::unordered_map<std::string,Data>;
+    // While a SymbolTable has at most this many slots, its symbols are looked up by a linear scan of
+    // the slots instead of through a hash map, so that defining a symbol in a small scope (e.g. one
+    // that's reused via reset) doesn't allocate a hash map node.
+    static constexpr size_t SMALL_SLOT_COUNT = 8;
 
     SymbolTable () = default;
-    SymbolTable (SymbolMap &&symbol_map, lvd::sp<SymbolTable> const &parent_symbol_table)
-        :   m_symbol_map(std::move(symbol_map))
-        ,   m_parent_symbol_table(parent_symbol_table)
+    explicit SymbolTable (lvd::sp<SymbolTable> const &parent_symbol_table)
+        :   m_parent_symbol_table(parent_symbol_table)
     { }
+    // Constructs a SymbolTable backed by the given table in image.
+    SymbolTable (lvd::sp<SymbolTable> const &parent_symbol_table, lvd::nnsp<SymbolTableImage> const &image, size_t image_table_index);
+    // Copies and moves don't carry over concurrent reads, and other must not be concurrently modified.
+    // References into a moved SymbolTable remain valid (but belong to the moved-to SymbolTable).
+    SymbolTable (SymbolTable const &other);
+    SymbolTable (SymbolTable &&other);
 
-    Data const &resolve_symbol_const (std::string const &symbol_id) const noexcept(false);
-    // Please don't modify ms_unresolved_symbol_nonconst!
-    Data &resolve_symbol_nonconst (std::string const &symbol_id) noexcept(false);
+    SymbolTable &operator = (SymbolTable const &other);
+    SymbolTable &operator = (SymbolTable &&other);
+
+    //
+    // Interned-id-based API
+    //
 
+    Data const &resolve_symbol_const (InternedId symbol_id) const noexcept(false);
+    Data &resolve_symbol_nonconst (InternedId symbol_id) noexcept(false);
+    bool symbol_is_defined (InternedId symbol_id) const noexcept;
+    // Returns the (depth, slot) of the nearest definition of the symbol, or std::nullopt if it isn't defined.
+    std::optional<SymbolSlot> locate_symbol (InternedId symbol_id) const noexcept(false);
+    // These will throw if the symbol is already defined in this SymbolTable (though it's fine
+    // if it's defined in m_parent_symbol_table or higher).  Returns the slot of the new symbol.
+    size_t define_symbol (InternedId symbol_id, Data const &value) noexcept(false);
+    size_t define_symbol (InternedId symbol_id, Data &&value) noexcept(false);
+    // This will throw if the symbol isn't defined in this SymbolTable (it doesn't look in parents).  The
+    // slot of an erased symbol becomes vacant, so the slots of other symbols don't change.  Unless
+    // concurrent reads are enabled, the vacant slot is reused by the next define_symbol, so that defining
+    // and erasing symbols repeatedly doesn't grow the table.
+    void erase_symbol (InternedId symbol_id) noexcept(false);
+
+    //
+    // Slot-based API
+    //
+
+    // These will throw if the SymbolSlot doesn't refer to a defined slot.
+    Data const &resolve_slot_const (SymbolSlot const &symbol_slot) const noexcept(false);
+    Data &resolve_slot_nonconst (SymbolSlot const &symbol_slot) noexcept(false);
+
+    //
+    // Cached resolution -- these are the same as resolve_symbol_nonconst and resolve_slot_nonconst,
+    // except that they use and update the given ResolutionCache.  Since a vacant slot can be reused by
+    // another symbol, resolve_slot_cached also throws if the slot doesn't hold symbol_id.
+    //
+
+    Data &resolve_symbol_cached (InternedId symbol_id, ResolutionCache &cache) noexcept(false);
+    Data &resolve_slot_cached (SymbolSlot const &symbol_slot, InternedId symbol_id, ResolutionCache &cache) noexcept(false);
+
+    // This changes every time a symbol is defined or erased, or this SymbolTable is cleared, reset or
+    // assigned.  Each change takes the next value of a counter shared by all SymbolTables, so it's
+    // greater than every generation (of any SymbolTable) before it.
+    uint64_t generation () const { return m_generation.load(std::memory_order_acquire); }
+    // Returns the greatest of the generations of this SymbolTable and its first depth ancestors, or
+    // std::nullopt if the parent chain isn't that long.
+    std::optional<uint64_t> path_generation (size_t depth) const noexcept;
+
+    // Number of slots in this SymbolTable, including vacant ones (see erase_symbol).
+    size_t slot_count () const { return m_slot_value.size(); }
+    // These are for local slots only, and don't check the slot index.
+    bool slot_is_vacant (size_t slot) const { return m_slot_is_vacant[slot]; }
+    InternedId slot_symbol (size_t slot) const { return m_slot_symbol[slot]; }
+    Data const &slot_value (size_t slot) const { return m_slot_value[slot]; }
+    Data &slot_value (size_t slot) { return m_slot_value[slot]; }
+    // Returns the slot of the locally defined symbol, or std::nullopt if it isn't locally defined.
+    // This doesn't materialize image symbols.
+    std::optional<size_t> local_slot (InternedId symbol_id) const noexcept;
+
+    //
+    // String-based API -- these are thin wrappers around the interned-id-based API.
+    //
+
+    Data const &resolve_symbol_const (std::string_view symbol_id) const noexcept(false);
+    // Please don't modify ms_unresolved_symbol_nonconst!
+    Data &resolve_symbol_nonconst (std::string_view symbol_id) noexcept(false);
     // TODO: Maybe add a "is locally defined" option
-    bool symbol_is_defined (std::string const &symbol_id) const noexcept;
-    // This will throw if the symbol is already defined in this SymbolTable (though it's fine
-    // if it's defined in m_parent_symbol_table or higher).
-    void define_symbol (std::string const &symbol_id, Data const &value) noexcept(false);
-    // This will throw if the symbol is already defined in this SymbolTable (though it's fine
-    // if it's defined in m_parent_symbol_table or higher).
-    void define_symbol (std::string const &symbol_id, Data &&value) noexcept(false);
-
-    SymbolMap const &symbol_map () const { return m_symbol_map; }
-    SymbolMap &symbol_map () { return m_symbol_map; }
+    bool symbol_is_defined (std::string_view symbol_id) const noexcept;
+    std::optional<SymbolSlot> locate_symbol (std::string_view symbol_id) const noexcept(false);
+    size_t define_symbol (std::string_view symbol_id, Data const &value) noexcept(false) { return define_symbol(intern(symbol_id), value); }
+    size_t define_symbol (std::string_view symbol_id, Data &&value) noexcept(false) { return define_symbol(intern(symbol_id), std::move(value)); }
+    void erase_symbol (std::string_view symbol_id) noexcept(false);
+
     bool has_parent_symbol_table () const { return m_parent_symbol_table != nullptr; }
     // This will throw if there is no parent SymbolTable.
     lvd::nnsp<SymbolTable> parent_symbol_table () const noexcept(false);
 
     // This constructs a symbol table whose parent is this one.
     lvd::nnsp<SymbolTable> push_symbol_table ();
-    // Clears the SymbolMap and nullifies parent_symbol_table
+    // Clears all symbols and nullifies parent_symbol_table
     void clear ();
+    // Clears all symbols and makes parent_symbol_table the parent, keeping allocated storage where
+    // possible, so that this SymbolTable can be reused as a new scope.  As with clear(), this must not
+    // run concurrently with anything else.
+    void reset (lvd::sp<SymbolTable> const &parent_symbol_table);
+
+    // This must be called before the SymbolTable is shared between threads.
+    void enable_concurrent_reads ();
+    // Undoes enable_concurrent_reads, so that resolve_*_cached use their ResolutionCache again.  This
+    // must only be called once no other thread is using the SymbolTable.
+    void disable_concurrent_reads () { m_concurrent_index.reset(); }
+    bool concurrent_reads_enabled () const { return m_concurrent_index != nullptr; }
+
+    bool has_image () const { return m_image != nullptr; }
+    // Materializes all symbols from the backing SymbolTableImage (if any), e.g. so they can all be
+    // iterated over via the local slot accessors.  This doesn't change the meaning of the SymbolTable.
+    void materialize_image_symbols () const noexcept(false);
 
 private:
 
-    SymbolMap m_symbol_map;
+    // Returns the locally defined Data for the symbol, or nullptr if it isn't locally defined.
+    // This is lock-free if concurrent reads are enabled, unless the symbol has to be materialized.
+    Data *find_local (InternedId symbol_id) const noexcept(false);
+    // Same as find_local, but writer_lock() must already be held.
+    Data *find_local_locked (InternedId symbol_id) const noexcept(false);
+    // Returns true iff the symbol is locally defined, without materializing it.
+    bool is_defined_locally (InternedId symbol_id) const noexcept;
+    // Same as resolve_slot_nonconst, but if symbol_id is not null, this also throws if the slot doesn't
+    // hold that symbol.
+    Data &resolve_slot_checked (SymbolSlot const &symbol_slot, InternedId const *symbol_id) noexcept(false);
+    // Appends a slot (or reuses a vacant one) without checking for an existing definition or changing
+    // the generation.
+    size_t append_slot (InternedId symbol_id, Data &&value);
+    // Sets m_generation to the next value of the shared generation counter.
+    void bump_generation ();
+    // Returns a lock on m_writer_mutex if concurrent reads are enabled, otherwise a lock that owns nothing.
+    std::unique_lock<std::mutex> writer_lock () const;
+
+    bool uses_slot_map () const { return m_slot_value.size() > SMALL_SLOT_COUNT; }
+    // Returns the SymbolTable depth levels up the parent chain, or nullptr if the chain isn't that long.
+    SymbolTable const *ancestor (size_t depth) const noexcept;
+
+    // Maps each locally defined symbol to its slot, but only if uses_slot_map(); otherwise it's empty.
+    std::unordered_map<InternedId,size_t> m_slot_map;
+    // std::deque is used so that references to the values remain valid as symbols are defined.
+    std::deque<Data> m_slot_value;
+    std::vector<InternedId> m_slot_symbol;
+    std::vector<bool> m_slot_is_vacant;
+    // The vacant slots that append_slot can reuse.  Slots vacated while concurrent reads are enabled
+    // aren't added, since their values may still be in use by readers.
+    std::vector<size_t> m_reusable_slots;
     lvd::sp<SymbolTable> m_parent_symbol_table;
+    std::atomic<uint64_t> m_generation{0};
+    // Non-null iff concurrent reads are enabled.  This indexes the local slots, but can be read lock-free.
+    std::unique_ptr<ConcurrentSymbolIndex> m_concurrent_index;
+    mutable std::mutex m_writer_mutex;
+    // If non-null, this is the backing image, and m_image_table_index is the table within it.
+    lvd::sp<SymbolTableImage> m_image;
+    size_t m_image_table_index = 0;
+    // Symbols from m_image which have since been erased, so they must not be materialized again.
+    std::unordered_set<InternedId> m_erased_image_symbols;
 };
 
 std::ostream &operator<< (std::ostream &out, SymbolTable const &symbol_table);
@@ -0,0 +1,271 @@
+// 2021.05.23 - Victor Dods
+
+#include "sept/SymbolTableImage.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <lvd/fmt.hpp>
+#include <lvd/literal.hpp>
+#include "sept/SymbolTable.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// TODO: Windows support (CreateFileMapping/MapViewOfFile)
+
+namespace sept {
+
+namespace {
+
+char const IMAGE_MAGIC[8] = {'S', 'E', 'P', 'T', 'S', 'Y', 'M', 'T'};
+uint32_t const IMAGE_VERSION = 0;
+size_t const IMAGE_HEADER_SIZE = sizeof(IMAGE_MAGIC) + 2*sizeof(uint32_t) + sizeof(uint64_t);
+
+// For deserializing directly out of the mapped memory instead of copying into a std::istringstream.
+class MemoryStreambuf : public std::streambuf {
+public:
+
+    MemoryStreambuf (char const *begin, size_t size) {
+        // std::streambuf's get area is non-const, but nothing writes through it.
+        auto p = const_cast<char *>(begin);
+        setg(p, p, p + size);
+    }
+};
+
+template <typename T_>
+void append_pod (std::string &image, T_ const &value) {
+    image.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+template <typename T_>
+void overwrite_pod (std::string &image, size_t offset, T_ const &value) {
+    std::memcpy(&image[offset], &value, sizeof(value));
+}
+
+void align_to_8 (std::string &image) {
+    image.resize((image.size() + 7) & ~size_t(7), '\0');
+}
+
+} // end namespace
+
+SymbolTableImage::SymbolTableImage (char const *base, size_t size) noexcept(false)
+    :   m_base(base)
+    ,   m_size(size)
+    ,   m_table_count(0)
+{
+    check_range(0, IMAGE_HEADER_SIZE);
+    if (std::memcmp(m_base, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+        throw std::runtime_error("not a SymbolTableImage (bad magic)");
+    uint32_t version;
+    uint32_t table_count;
+    uint64_t table_headers_offset;
+    std::memcpy(&version, m_base + 8, sizeof(version));
+    std::memcpy(&table_count, m_base + 12, sizeof(table_count));
+    std::memcpy(&table_headers_offset, m_base + 16, sizeof(table_headers_offset));
+    if (version != IMAGE_VERSION)
+        throw std::runtime_error(LVD_FMT("unsupported SymbolTableImage version " << version << " (expected " << IMAGE_VERSION << ')'));
+    if (table_headers_offset % alignof(TableHeader) != 0)
+        throw std::runtime_error("malformed SymbolTableImage (misaligned table headers)");
+    check_range(table_headers_offset, uint64_t(table_count)*sizeof(TableHeader));
+    m_table_count = table_count;
+
+    // Check the table headers, so that lookups only have to check what they actually read.
+    for (size_t i = 0; i < m_table_count; ++i) {
+        auto const &th = table_header(i);
+        if (th.m_entries_offset % alignof(Entry) != 0 || th.m_buckets_offset % alignof(uint32_t) != 0)
+            throw std::runtime_error("malformed SymbolTableImage (misaligned table)");
+        if (th.m_bucket_count == 0 || (th.m_bucket_count & (th.m_bucket_count - 1)) != 0 || th.m_bucket_count <= th.m_entry_count)
+            throw std::runtime_error("malformed SymbolTableImage (bad bucket count)");
+        check_range(th.m_entries_offset, th.m_entry_count*sizeof(Entry));
+        check_range(th.m_buckets_offset, th.m_bucket_count*sizeof(uint32_t));
+    }
+}
+
+SymbolTableImage::~SymbolTableImage () {
+    ::munmap(const_cast<char *>(m_base), m_size);
+}
+
+lvd::nnsp<SymbolTableImage> SymbolTableImage::map_file (std::string const &path) noexcept(false) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(LVD_FMT("couldn't open SymbolTableImage file " << lvd::literal_of(path) << "; " << std::strerror(errno)));
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        auto error = errno;
+        ::close(fd);
+        throw std::runtime_error(LVD_FMT("couldn't stat SymbolTableImage file " << lvd::literal_of(path) << "; " << std::strerror(error)));
+    }
+    auto size = size_t(st.st_size);
+    // mmap of size 0 fails, but an empty file would be rejected anyway.
+    auto base = size > 0 ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    auto error = errno;
+    // The mapping stays valid after closing the file.
+    ::close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error(LVD_FMT("couldn't map SymbolTableImage file " << lvd::literal_of(path) << "; " << (size > 0 ? std::strerror(error) : "file is empty")));
+
+    try {
+        return lvd::make_nnsp<SymbolTableImage>(static_cast<char const *>(base), size);
+    } catch (...) {
+        ::munmap(base, size);
+        throw;
+    }
+}
+
+size_t SymbolTableImage::entry_count (size_t table_index) const {
+    return table_header(table_index).m_entry_count;
+}
+
+std::string_view SymbolTableImage::entry_name (size_t table_index, size_t entry_index) const {
+    auto const &e = entry(table_index, entry_index);
+    check_range(e.m_name_offset, e.m_name_length);
+    return std::string_view(m_base + e.m_name_offset, e.m_name_length);
+}
+
+std::optional<size_t> SymbolTableImage::find_entry (size_t table_index, std::string_view name) const noexcept {
+    auto const &th = table_header(table_index);
+    auto buckets = reinterpret_cast<uint32_t const *>(m_base + th.m_buckets_offset);
+    auto mask = th.m_bucket_count - 1;
+    // The bucket count exceeds the entry count, so this will always hit an empty bucket eventually.
+    for (auto i = hash(name) & mask; ; i = (i + 1) & mask) {
+        auto bucket = buckets[i];
+        if (bucket == 0)
+            return std::nullopt;
+        auto entry_index = size_t(bucket - 1);
+        if (entry_index >= th.m_entry_count)
+            return std::nullopt; // Malformed, but don't crash.
+        auto const &e = entry(table_index, entry_index);
+        if (e.m_name_length == name.size() && e.m_name_offset <= m_size && e.m_name_length <= m_size - e.m_name_offset && std::memcmp(m_base + e.m_name_offset, name.data(), name.size()) == 0)
+            return entry_index;
+    }
+}
+
+Data SymbolTableImage::entry_value (size_t table_index, size_t entry_index) const noexcept(false) {
+    auto const &e = entry(table_index, entry_index);
+    check_range(e.m_value_offset, e.m_value_length);
+    MemoryStreambuf streambuf(m_base + e.m_value_offset, e.m_value_length);
+    std::istream in(&streambuf);
+    in.exceptions(std::ios_base::failbit|std::ios_base::badbit);
+    return deserialize_data(in);
+}
+
+uint64_t SymbolTableImage::hash (std::string_view name) {
+    // FNV-1a, since it has to be stable across processes (unlike std::hash).
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (auto c : name) {
+        h ^= uint8_t(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+SymbolTableImage::TableHeader const &SymbolTableImage::table_header (size_t table_index) const {
+    assert(table_index < m_table_count);
+    uint64_t table_headers_offset;
+    std::memcpy(&table_headers_offset, m_base + 16, sizeof(table_headers_offset));
+    return reinterpret_cast<TableHeader const *>(m_base + table_headers_offset)[table_index];
+}
+
+SymbolTableImage::Entry const &SymbolTableImage::entry (size_t table_index, size_t entry_index) const {
+    auto const &th = table_header(table_index);
+    assert(entry_index < th.m_entry_count);
+    return reinterpret_cast<Entry const *>(m_base + th.m_entries_offset)[entry_index];
+}
+
+void SymbolTableImage::check_range (uint64_t offset, uint64_t length) const noexcept(false) {
+    if (offset > m_size || length > m_size - offset)
+        throw std::runtime_error(LVD_FMT("malformed SymbolTableImage (range [" << offset << ", " << offset << '+' << length << ") exceeds image size " << m_size << ')'));
+}
+
+void write_symbol_table_image (SymbolTable const &symbol_table, std::ostream &out) noexcept(false) {
+    // Collect the chain, root first.
+    std::vector<SymbolTable const *> tables;
+    for (auto t = &symbol_table; t != nullptr; t = t->has_parent_symbol_table() ? t->parent_symbol_table().get().get() : nullptr)
+        tables.insert(tables.begin(), t);
+
+    using TableHeader = SymbolTableImage::TableHeader;
+    using Entry = SymbolTableImage::Entry;
+
+    std::string image;
+    image.append(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    append_pod(image, IMAGE_VERSION);
+    append_pod(image, uint32_t(tables.size()));
+    append_pod(image, uint64_t(IMAGE_HEADER_SIZE));
+    // Placeholder table headers, filled in below.
+    image.resize(image.size() + tables.size()*sizeof(TableHeader), '\0');
+
+    for (size_t table_index = 0; table_index < tables.size(); ++table_index) {
+        auto const &t = *tables[table_index];
+        // Anything still only in a backing image has to be materialized in order to be written, so that
+        // the new image is self-contained.
+        t.materialize_image_symbols();
+        std::vector<size_t> slots;
+        for (size_t slot = 0; slot < t.slot_count(); ++slot)
+            if (!t.slot_is_vacant(slot))
+                slots.push_back(slot);
+
+        TableHeader th;
+        th.m_entry_count = slots.size();
+        th.m_bucket_count = 16;
+        while (th.m_bucket_count < 2*th.m_entry_count)
+            th.m_bucket_count *= 2;
+
+        align_to_8(image);
+        th.m_entries_offset = image.size();
+        image.resize(image.size() + th.m_entry_count*sizeof(Entry), '\0');
+        th.m_buckets_offset = image.size();
+        std::vector<uint32_t> buckets(th.m_bucket_count, 0);
+
+        for (size_t entry_index = 0; entry_index < slots.size(); ++entry_index) {
+            auto slot = slots[entry_index];
+            auto const &name = t.slot_symbol(slot).as_string();
+            auto mask = th.m_bucket_count - 1;
+            auto i = SymbolTableImage::hash(name) & mask;
+            while (buckets[i] != 0)
+                i = (i + 1) & mask;
+            buckets[i] = uint32_t(entry_index + 1);
+        }
+        for (auto bucket : buckets)
+            append_pod(image, bucket);
+
+        for (size_t entry_index = 0; entry_index < slots.size(); ++entry_index) {
+            auto slot = slots[entry_index];
+            Entry e;
+            auto const &name = t.slot_symbol(slot).as_string();
+            e.m_name_offset = image.size();
+            e.m_name_length = name.size();
+            image.append(name);
+            std::ostringstream value_out;
+            serialize_data(t.slot_value(slot), value_out);
+            auto value = value_out.str();
+            e.m_value_offset = image.size();
+            e.m_value_length = value.size();
+            image.append(value);
+            overwrite_pod(image, th.m_entries_offset + entry_index*sizeof(Entry), e);
+        }
+
+        overwrite_pod(image, IMAGE_HEADER_SIZE + table_index*sizeof(TableHeader), th);
+    }
+
+    out.write(image.data(), image.size());
+    if (!out)
+        throw std::runtime_error("error while writing SymbolTableImage");
+}
+
+lvd::nnsp<SymbolTable> load_symbol_table_image (std::string const &path) noexcept(false) {
+    auto image = SymbolTableImage::map_file(path);
+    if (image->table_count() == 0)
+        throw std::runtime_error(LVD_FMT("SymbolTableImage file " << lvd::literal_of(path) << " contains no tables"));
+    lvd::sp<SymbolTable> symbol_table;
+    for (size_t table_index = 0; table_index < image->table_count(); ++table_index)
+        symbol_table = lvd::make_nnsp<SymbolTable>(symbol_table, image, table_index);
+    return symbol_table;
+}
+
+} // end namespace sept
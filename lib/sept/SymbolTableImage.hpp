@@ -0,0 +1,100 @@
+// 2021.05.23 - Victor Dods
+
+#pragma once
+
+#include <cstdint>
+#include <lvd/aliases.hpp>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include "sept/core.hpp"
+#include "sept/Data.hpp"
+#include <string>
+#include <string_view>
+
+namespace sept {
+
+class SymbolTable;
+
+// A read-only, memory-mapped image of a SymbolTable and its parent chain, as written by
+// write_symbol_table_image.  Values are stored serialized (see serialize_data), and are only
+// deserialized when a SymbolTable backed by the image first resolves them, so loading an image
+// only touches the pages that are actually used.
+//
+// Layout (all integers are native-endian, all offsets are from the start of the image):
+//
+//     Header            : magic "SEPTSYMT", uint32_t version, uint32_t table count, uint64_t offset of table headers
+//     TableHeader[]     : uint64_t entry count, uint64_t offset of entries, uint64_t bucket count, uint64_t offset of buckets
+//     Entry[]           : uint64_t name offset, uint64_t name length, uint64_t value offset, uint64_t value length
+//     uint32_t[]        : hash buckets, each is (entry index + 1), or 0 for an empty bucket
+//     bytes             : names and serialized values
+//
+// Table 0 is the root of the parent chain, and the last table is the one that was written.  Each
+// table's entries are in slot order.  Each table's buckets form an open-addressing hash table (with
+// linear probing) keyed by the FNV-1a hash of the symbol name, and the bucket count is a power of 2.
+class SymbolTableImage {
+public:
+
+    // Takes ownership of the mapping [base, base+size), which is unmapped in the destructor.
+    // Use map_file instead of calling this directly.
+    SymbolTableImage (char const *base, size_t size) noexcept(false);
+    SymbolTableImage (SymbolTableImage const &) = delete;
+    SymbolTableImage (SymbolTableImage &&) = delete;
+    ~SymbolTableImage ();
+
+    SymbolTableImage &operator = (SymbolTableImage const &) = delete;
+    SymbolTableImage &operator = (SymbolTableImage &&) = delete;
+
+    // Maps the given file, checking its header and table headers (but not its contents, since that
+    // would touch every page).  Will throw if the file can't be mapped or is malformed.
+    // NOTE: The file must not be modified while it's mapped (e.g. truncating it will cause SIGBUS).
+    static lvd::nnsp<SymbolTableImage> map_file (std::string const &path) noexcept(false);
+
+    size_t table_count () const { return m_table_count; }
+    size_t entry_count (size_t table_index) const;
+    std::string_view entry_name (size_t table_index, size_t entry_index) const;
+    // Returns the index of the entry for the given name, or std::nullopt if there is none.
+    std::optional<size_t> find_entry (size_t table_index, std::string_view name) const noexcept;
+    // Deserializes the value of the given entry.
+    Data entry_value (size_t table_index, size_t entry_index) const noexcept(false);
+
+    static uint64_t hash (std::string_view name);
+
+private:
+
+    struct TableHeader {
+        uint64_t m_entry_count;
+        uint64_t m_entries_offset;
+        uint64_t m_bucket_count;
+        uint64_t m_buckets_offset;
+    };
+    struct Entry {
+        uint64_t m_name_offset;
+        uint64_t m_name_length;
+        uint64_t m_value_offset;
+        uint64_t m_value_length;
+    };
+
+    TableHeader const &table_header (size_t table_index) const;
+    Entry const &entry (size_t table_index, size_t entry_index) const;
+    // Throws if [offset, offset+length) isn't within the image.
+    void check_range (uint64_t offset, uint64_t length) const noexcept(false);
+
+    char const *m_base;
+    size_t m_size;
+    size_t m_table_count;
+
+    friend void write_symbol_table_image (SymbolTable const &symbol_table, std::ostream &out) noexcept(false);
+};
+
+// Writes symbol_table and its parent chain to out as a SymbolTableImage.  All values must be serializable.
+// Vacant slots (see SymbolTable::erase_symbol) are skipped.
+void write_symbol_table_image (SymbolTable const &symbol_table, std::ostream &out) noexcept(false);
+
+// Maps the image file and constructs a SymbolTable chain backed by it, returning the table corresponding
+// to the one passed to write_symbol_table_image.  This is O(number of tables), not O(number of symbols);
+// symbols are materialized into their SymbolTable on first use.  To use it as the global SymbolTable,
+// move-assign it, e.g. `*global_symbol_table() = std::move(*load_symbol_table_image(path));`.
+lvd::nnsp<SymbolTable> load_symbol_table_image (std::string const &path) noexcept(false);
+
+} // end namespace sept
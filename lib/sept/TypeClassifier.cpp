@@ -0,0 +1,472 @@
+// 2021.05.24 - Victor Dods
+
+#include "sept/TypeClassifier.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include "sept/FormalTypeOf.hpp"
+#include "sept/NPType.hpp"
+#include "sept/UnionTerm.hpp"
+#include <set>
+
+namespace sept {
+
+namespace {
+
+// Determines which C++ types have their own inhabits predicate for the given type.  If one is registered
+// for Data, then any C++ type could inhabit it, and any_value_type is set to true.
+std::unordered_set<std::type_index> registered_value_types_of (std::type_index type_ti, bool &any_value_type) {
+    std::unordered_set<std::type_index> value_types;
+    any_value_type = false;
+    auto const &predicate_map = lvd::static_association_singleton<sept::_Data_Inhabits>();
+    for (auto const &[type_index_pair, predicate] : predicate_map) {
+        if (type_index_pair.m_type_ti != type_ti)
+            continue;
+        if (type_index_pair.m_value_ti == std::type_index(typeid(Data)))
+            any_value_type = true;
+        else
+            value_types.insert(type_index_pair.m_value_ti);
+    }
+    return value_types;
+}
+
+bool terms_are_equal (Data const &lhs, Data const &rhs) {
+    return lhs.type() == rhs.type() && eq_data(lhs, rhs);
+}
+
+} // end namespace
+
+void TypeClassifier::ValueTypeSet::add (ValueTypeSet const &other) {
+    if (other.m_any) {
+        if (m_any) {
+            // Only what's excluded from both is excluded from the union.
+            for (auto it = m_excluded.begin(); it != m_excluded.end(); )
+                it = other.m_excluded.count(*it) == 0 ? m_excluded.erase(it) : std::next(it);
+        } else {
+            m_any = true;
+            m_excluded = other.m_excluded;
+            for (auto type : m_types)
+                m_excluded.erase(type);
+            m_types.clear();
+        }
+    } else {
+        if (m_any)
+            for (auto type : other.m_types)
+                m_excluded.erase(type);
+        else
+            m_types.insert(other.m_types.begin(), other.m_types.end());
+    }
+}
+
+void TypeClassifier::ValueTypeSet::remove (std::unordered_set<std::type_index> const &types) {
+    if (m_any)
+        m_excluded.insert(types.begin(), types.end());
+    else
+        for (auto type : types)
+            m_types.erase(type);
+}
+
+TypeClassifier::Constraint const *TypeClassifier::Entry::constraint_at (Path const &path) const {
+    for (auto const &constraint : m_constraints)
+        if (constraint.m_path == path)
+            return &constraint;
+    return nullptr;
+}
+
+TypeClassifier::TypeClassifier (DataVector const &candidate_types)
+    :   m_candidate_types(candidate_types)
+{
+    for (size_t i = 0; i < m_candidate_types.size(); ++i)
+        add_entries(i, m_candidate_types[i].deref(), {});
+
+    std::vector<size_t> entries(m_entries.size());
+    std::iota(entries.begin(), entries.end(), size_t(0));
+    std::map<std::vector<size_t>,size_t> node_for_entries;
+    m_root = add_node(entries, node_for_entries);
+}
+
+std::optional<size_t> TypeClassifier::classify (Data const &value) const {
+    auto const &v = value.deref();
+    auto const &leaf = find_leaf(Located{std::type_index(v.type()), &v, v.type() == typeid(TupleTerm_c) ? &v.cast<TupleTerm_c const &>() : nullptr});
+    for (auto e : leaf.m_entries)
+        if (inhabits_data(v, m_entries[e].m_type))
+            return m_entries[e].m_candidate_index;
+    return std::nullopt;
+}
+
+std::optional<size_t> TypeClassifier::classify (TupleTerm_c const &value) const {
+    auto const &leaf = find_leaf(Located{std::type_index(typeid(TupleTerm_c)), nullptr, &value});
+    std::optional<Data> value_data;
+    for (auto e : leaf.m_entries) {
+        auto const &type = m_entries[e].m_type;
+        bool inhabits_type;
+        if (type.type() == typeid(TupleTerm_c)) {
+            inhabits_type = inhabits(value, type.cast<TupleTerm_c const &>());
+        } else {
+            if (!value_data.has_value())
+                value_data.emplace(value);
+            inhabits_type = inhabits_data(*value_data, type);
+        }
+        if (inhabits_type)
+            return m_entries[e].m_candidate_index;
+    }
+    return std::nullopt;
+}
+
+std::optional<size_t> TypeClassifier::classify_shallowly (Data const &value) const {
+    auto const &v = value.deref();
+    return classify_shallowly(Located{std::type_index(v.type()), &v, v.type() == typeid(TupleTerm_c) ? &v.cast<TupleTerm_c const &>() : nullptr});
+}
+
+std::optional<size_t> TypeClassifier::classify_shallowly (TupleTerm_c const &value) const {
+    // Terms are only tested on elements, so the missing Data for the value itself is never needed.
+    return classify_shallowly(Located{std::type_index(typeid(TupleTerm_c)), nullptr, &value});
+}
+
+std::optional<size_t> TypeClassifier::classify_shallowly (Located const &root) const {
+    auto const &leaf = find_leaf(root);
+    // Prefer the candidate that checks the most, e.g. (Array, SquareExpr) satisfies both (Array, Expr) and
+    // the more specific (Expr, SquareExpr), and only the latter is possible if SquareExpr isn't an Expr.
+    Entry const *best_entry = nullptr;
+    for (auto e : leaf.m_entries) {
+        auto const &entry = m_entries[e];
+        if ((best_entry == nullptr || entry.m_constraints.size() > best_entry->m_constraints.size()) && satisfies_constraints(entry, root))
+            best_entry = &entry;
+    }
+    if (best_entry == nullptr)
+        return std::nullopt;
+    return best_entry->m_candidate_index;
+}
+
+TypeClassifier::ValueTypeSet TypeClassifier::value_types_of (Data const &type) const {
+    ValueTypeSet value_types;
+    if (type.type() == typeid(Term_c)) {
+        value_types.m_any = true;
+        return value_types;
+    }
+    if (type.type() == typeid(FormalTypeOf_Term_c)) {
+        // Either something equal to the term, or a FormalTypeOf_Term_c (which is checked structurally).
+        value_types.m_types.insert(std::type_index(type.cast<FormalTypeOf_Term_c const &>().term().type()));
+        value_types.m_types.insert(std::type_index(typeid(FormalTypeOf_Term_c)));
+        return value_types;
+    }
+
+    bool any_value_type;
+    value_types.m_types = registered_value_types_of(std::type_index(type.type()), any_value_type);
+    if (type.type() == typeid(UnionTerm_c)) {
+        // The predicate for Data checks each element.
+        if (any_value_type)
+            for (auto const &element : type.cast<UnionTerm_c const &>().elements())
+                value_types.add(value_types_of(element.deref()));
+        return value_types;
+    }
+    if (any_value_type) {
+        value_types.m_any = true;
+        value_types.m_types.clear();
+    }
+    return value_types;
+}
+
+void TypeClassifier::add_entries (size_t candidate_index, Data const &type, std::unordered_set<std::type_index> const &excluded_value_types) {
+    if (type.type() == typeid(UnionTerm_c)) {
+        // Values whose C++ type has its own predicate for UnionTerm_c (e.g. UnionTerm_c itself, which is
+        // element-wise) have to be checked against the union as a whole.  All others inhabit the union
+        // iff they inhabit one of its elements (via the predicate for Data).
+        bool any_value_type;
+        auto specific_value_types = registered_value_types_of(std::type_index(typeid(UnionTerm_c)), any_value_type);
+        Constraint whole_constraint{Path{}, ValueTypeSet{}, std::nullopt, std::nullopt};
+        whole_constraint.m_value_types.m_types = specific_value_types;
+        whole_constraint.m_value_types.remove(excluded_value_types);
+        if (!whole_constraint.m_value_types.m_types.empty())
+            m_entries.emplace_back(Entry{candidate_index, type, {std::move(whole_constraint)}});
+
+        if (any_value_type) {
+            auto element_excluded_value_types = excluded_value_types;
+            element_excluded_value_types.insert(specific_value_types.begin(), specific_value_types.end());
+            for (auto const &element : type.cast<UnionTerm_c const &>().elements())
+                add_entries(candidate_index, element.deref(), element_excluded_value_types);
+        }
+        return;
+    }
+
+    Entry entry{candidate_index, type, {}};
+    Constraint root_constraint{Path{}, value_types_of(type), std::nullopt, std::nullopt};
+    // The size and elements of the value are only constrained if only a TupleTerm_c can inhabit the type.
+    bool const is_tuple_shaped =
+        type.type() == typeid(TupleTerm_c) &&
+        !root_constraint.m_value_types.m_any &&
+        root_constraint.m_value_types.m_types.size() == 1 &&
+        root_constraint.m_value_types.contains(std::type_index(typeid(TupleTerm_c)));
+    root_constraint.m_value_types.remove(excluded_value_types);
+    if (is_tuple_shaped)
+        root_constraint.m_tuple_size = type.cast<TupleTerm_c const &>().size();
+    entry.m_constraints.emplace_back(std::move(root_constraint));
+    if (is_tuple_shaped) {
+        std::vector<TupleTerm_c const *> visiting;
+        add_element_constraints(entry, Path{}, type.cast<TupleTerm_c const &>(), visiting);
+    }
+    m_entries.emplace_back(std::move(entry));
+}
+
+void TypeClassifier::add_element_constraints (Entry &entry, Path const &path, TupleTerm_c const &tuple, std::vector<TupleTerm_c const *> &visiting) const {
+    // A tuple type can contain itself via refs, in which case the constraints are simply cut off.
+    if (std::find(visiting.begin(), visiting.end(), &tuple) != visiting.end())
+        return;
+    visiting.push_back(&tuple);
+
+    for (size_t i = 0; i < tuple.size(); ++i) {
+        auto const &element = tuple[i].deref();
+        auto element_path = path;
+        element_path.push_back(i);
+        Constraint constraint{element_path, value_types_of(element), std::nullopt, std::nullopt};
+        if (element.type() == typeid(FormalTypeOf_Term_c))
+            constraint.m_term = element.cast<FormalTypeOf_Term_c const &>().term().deref();
+        bool const is_tuple_shaped =
+            element.type() == typeid(TupleTerm_c) &&
+            !constraint.m_value_types.m_any &&
+            constraint.m_value_types.m_types.size() == 1 &&
+            constraint.m_value_types.contains(std::type_index(typeid(TupleTerm_c)));
+        if (is_tuple_shaped)
+            constraint.m_tuple_size = element.cast<TupleTerm_c const &>().size();
+        entry.m_constraints.emplace_back(std::move(constraint));
+        if (is_tuple_shaped)
+            add_element_constraints(entry, element_path, element.cast<TupleTerm_c const &>(), visiting);
+    }
+
+    visiting.pop_back();
+}
+
+size_t TypeClassifier::add_node (std::vector<size_t> const &entries, std::map<std::vector<size_t>,size_t> &node_for_entries) {
+    if (auto it = node_for_entries.find(entries); it != node_for_entries.end())
+        return it->second;
+
+    // The entries remaining for each outcome of a particular test.  Each list stays in priority order.
+    struct Split {
+        std::vector<std::pair<std::type_index,std::vector<size_t>>> m_for_type;
+        std::vector<std::pair<size_t,std::vector<size_t>>> m_for_size;
+        std::vector<std::pair<Data const *,std::vector<size_t>>> m_for_term;
+        std::vector<size_t> m_default;
+        std::vector<size_t> m_missing;
+
+        // The most entries that could remain after the test.
+        size_t worst_case () const {
+            size_t retval = std::max(m_default.size(), m_missing.size());
+            for (auto const &[type, child_entries] : m_for_type)
+                retval = std::max(retval, child_entries.size());
+            for (auto const &[size, child_entries] : m_for_size)
+                retval = std::max(retval, child_entries.size());
+            for (auto const &[term, child_entries] : m_for_term)
+                retval = std::max(retval, child_entries.size());
+            return retval;
+        }
+    };
+    auto split = [this, &entries](TestKind test_kind, Path const &path) {
+        Split s;
+        std::vector<Constraint const *> constraints;
+        for (auto e : entries)
+            constraints.push_back(m_entries[e].constraint_at(path));
+        auto collect = [&entries, &constraints](auto &&accepts) {
+            std::vector<size_t> child_entries;
+            for (size_t i = 0; i < entries.size(); ++i)
+                if (constraints[i] == nullptr || accepts(*constraints[i]))
+                    child_entries.push_back(entries[i]);
+            return child_entries;
+        };
+        switch (test_kind) {
+            case TestKind::VALUE_TYPE: {
+                std::set<std::type_index> mentioned_types;
+                for (auto const *c : constraints) {
+                    if (c != nullptr) {
+                        mentioned_types.insert(c->m_value_types.m_types.begin(), c->m_value_types.m_types.end());
+                        mentioned_types.insert(c->m_value_types.m_excluded.begin(), c->m_value_types.m_excluded.end());
+                    }
+                }
+                for (auto type : mentioned_types)
+                    s.m_for_type.emplace_back(type, collect([type](Constraint const &c){ return c.m_value_types.contains(type); }));
+                s.m_default = collect([](Constraint const &c){ return c.m_value_types.m_any; });
+                for (size_t i = 0; i < entries.size(); ++i)
+                    if (constraints[i] == nullptr)
+                        s.m_missing.push_back(entries[i]);
+                break;
+            }
+
+            case TestKind::TUPLE_SIZE: {
+                std::set<size_t> sizes;
+                for (auto const *c : constraints)
+                    if (c != nullptr && c->m_tuple_size.has_value())
+                        sizes.insert(*c->m_tuple_size);
+                for (auto size : sizes)
+                    s.m_for_size.emplace_back(size, collect([size](Constraint const &c){ return !c.m_tuple_size.has_value() || *c.m_tuple_size == size; }));
+                s.m_default = collect([](Constraint const &c){ return !c.m_tuple_size.has_value(); });
+                break;
+            }
+
+            case TestKind::TERM: {
+                // Distinct terms, in order of first appearance.
+                std::vector<Data const *> terms;
+                for (auto const *c : constraints)
+                    if (c != nullptr && c->m_term.has_value())
+                        if (std::none_of(terms.begin(), terms.end(), [c](Data const *term){ return terms_are_equal(*term, *c->m_term); }))
+                            terms.push_back(&*c->m_term);
+                for (auto const *term : terms)
+                    s.m_for_term.emplace_back(term, collect([term](Constraint const &c){ return !c.m_term.has_value() || terms_are_equal(*c.m_term, *term); }));
+                s.m_default = collect([](Constraint const &c){ return !c.m_term.has_value(); });
+                break;
+            }
+
+            default:
+                LVD_ABORT("this should never happen");
+        }
+        return s;
+    };
+
+    // Every test that some remaining entry could fail.
+    std::set<std::pair<TestKind,Path>> tests;
+    for (auto e : entries) {
+        for (auto const &constraint : m_entries[e].m_constraints) {
+            if (!constraint.m_value_types.is_everything())
+                tests.emplace(TestKind::VALUE_TYPE, constraint.m_path);
+            if (constraint.m_tuple_size.has_value())
+                tests.emplace(TestKind::TUPLE_SIZE, constraint.m_path);
+            if (constraint.m_term.has_value())
+                tests.emplace(TestKind::TERM, constraint.m_path);
+        }
+    }
+
+    // Greedily pick the test that minimizes the most entries that could remain.
+    std::optional<std::pair<TestKind,Path>> best_test;
+    size_t best_worst_case = entries.size();
+    for (auto const &test : tests) {
+        auto worst_case = split(test.first, test.second).worst_case();
+        if (worst_case < best_worst_case) {
+            best_test = test;
+            best_worst_case = worst_case;
+        }
+    }
+    if (!best_test.has_value()) {
+        auto leaf = add_leaf(entries);
+        node_for_entries.emplace(entries, leaf);
+        return leaf;
+    }
+
+    auto s = split(best_test->first, best_test->second);
+    Node node;
+    node.m_test_kind = best_test->first;
+    node.m_path = best_test->second;
+    for (auto const &[type, child_entries] : s.m_for_type)
+        node.m_child_for_type.emplace(type, add_node(child_entries, node_for_entries));
+    for (auto const &[size, child_entries] : s.m_for_size)
+        node.m_child_for_size.emplace(size, add_node(child_entries, node_for_entries));
+    for (auto const &[term, child_entries] : s.m_for_term)
+        node.m_children_for_term[std::type_index(term->type())].emplace_back(*term, add_node(child_entries, node_for_entries));
+    node.m_default_child = add_node(s.m_default, node_for_entries);
+    if (node.m_test_kind == TestKind::VALUE_TYPE)
+        node.m_missing_child = add_node(s.m_missing, node_for_entries);
+    // A FormalTypeOf_Term_c value inhabits FormalTypeOf(x) structurally instead of by equality, so
+    // just check all the entries in that case.
+    if (node.m_test_kind == TestKind::TERM)
+        node.m_fallback_child = add_leaf(entries);
+
+    m_nodes.emplace_back(std::move(node));
+    auto node_index = m_nodes.size() - 1;
+    node_for_entries.emplace(entries, node_index);
+    return node_index;
+}
+
+size_t TypeClassifier::add_leaf (std::vector<size_t> const &entries) {
+    Node node;
+    node.m_test_kind = TestKind::LEAF;
+    node.m_entries = entries;
+    m_nodes.emplace_back(std::move(node));
+    return m_nodes.size() - 1;
+}
+
+std::optional<TypeClassifier::Located> TypeClassifier::locate (Located const &root, Path const &path) {
+    auto located = root;
+    for (auto index : path) {
+        if (located.m_tuple == nullptr || index >= located.m_tuple->size())
+            return std::nullopt;
+        auto const &element = (*located.m_tuple)[index].deref();
+        located = Located{
+            std::type_index(element.type()),
+            &element,
+            element.type() == typeid(TupleTerm_c) ? &element.cast<TupleTerm_c const &>() : nullptr
+        };
+    }
+    return located;
+}
+
+TypeClassifier::Node const &TypeClassifier::find_leaf (Located const &root) const {
+    auto node_index = m_root;
+    while (true) {
+        auto const &node = m_nodes[node_index];
+        if (node.m_test_kind == TestKind::LEAF)
+            return node;
+
+        auto located = locate(root, node.m_path);
+        switch (node.m_test_kind) {
+            case TestKind::VALUE_TYPE: {
+                if (!located.has_value()) {
+                    node_index = node.m_missing_child;
+                    break;
+                }
+                auto it = node.m_child_for_type.find(located->m_type);
+                node_index = it != node.m_child_for_type.end() ? it->second : node.m_default_child;
+                break;
+            }
+
+            case TestKind::TUPLE_SIZE: {
+                node_index = node.m_default_child;
+                if (located.has_value() && located->m_tuple != nullptr)
+                    if (auto it = node.m_child_for_size.find(located->m_tuple->size()); it != node.m_child_for_size.end())
+                        node_index = it->second;
+                break;
+            }
+
+            case TestKind::TERM: {
+                node_index = node.m_default_child;
+                if (!located.has_value())
+                    break;
+                if (located->m_type == std::type_index(typeid(FormalTypeOf_Term_c))) {
+                    node_index = node.m_fallback_child;
+                    break;
+                }
+                // Terms are only tested on elements, never on the value itself, so m_data is set.
+                assert(located->m_data != nullptr);
+                auto it = node.m_children_for_term.find(located->m_type);
+                if (it != node.m_children_for_term.end()) {
+                    for (auto const &[term, child] : it->second) {
+                        if (eq_data(*located->m_data, term)) {
+                            node_index = child;
+                            break;
+                        }
+                    }
+                }
+                break;
+            }
+
+            default:
+                LVD_ABORT("this should never happen");
+        }
+    }
+}
+
+bool TypeClassifier::satisfies_constraints (Entry const &entry, Located const &root) {
+    for (auto const &constraint : entry.m_constraints) {
+        auto located = locate(root, constraint.m_path);
+        if (!located.has_value() || !constraint.m_value_types.contains(located->m_type))
+            return false;
+        if (constraint.m_tuple_size.has_value() && (located->m_tuple == nullptr || located->m_tuple->size() != *constraint.m_tuple_size))
+            return false;
+        // A FormalTypeOf_Term_c value is checked structurally by inhabits, which is deeper than this goes.
+        if (constraint.m_term.has_value() && located->m_type != std::type_index(typeid(FormalTypeOf_Term_c))) {
+            assert(located->m_data != nullptr);
+            if (!eq_data(*located->m_data, *constraint.m_term))
+                return false;
+        }
+    }
+    return true;
+}
+
+} // end namespace sept
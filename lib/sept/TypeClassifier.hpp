@@ -0,0 +1,144 @@
+// 2021.05.24 - Victor Dods
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include "sept/core.hpp"
+#include "sept/Data.hpp"
+#include "sept/DataVector.hpp"
+#include "sept/TupleTerm.hpp"
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace sept {
+
+// Determines which of a fixed list of candidate types a value inhabits, i.e. it computes the index of
+// the first candidate type t for which inhabits_data(value, t) is true.  This is equivalent to checking
+// each candidate in order, but instead uses a decision tree that's precomputed from the candidates, so
+// that usually only the candidate that's actually inhabited has to be checked.
+//
+// Each candidate is turned into a set of necessary conditions on the value, each of which is on the
+// value itself or on an element (or element of an element, etc) of a TupleTerm_c value:
+// - Its concrete C++ type.  The C++ types that can inhabit each type are taken from the registered
+//   inhabits predicates (so these must all be registered before construction), and for UnionTerm_c,
+//   from its elements.
+// - If the candidate has a TupleTerm_c there, the size of the tuple.
+// - If the candidate has FormalTypeOf(x) there, that it's equal to x.
+// Each node of the tree tests one of these (whichever best splits the remaining candidates), and each
+// leaf checks its remaining candidates in order.  UnionTerm_c candidates are split into their elements
+// (recursively), each of which is classified as the UnionTerm_c.  Refs are dereferenced.
+//
+// NOTE: This assumes that inhabiting FormalTypeOf(x) means being equal to x, which is how the predicate
+// for Data is defined, except for FormalTypeOf_Term_c values (which are handled correctly).
+class TypeClassifier {
+public:
+
+    explicit TypeClassifier (DataVector const &candidate_types);
+
+    size_t candidate_count () const { return m_candidate_types.size(); }
+    Data const &candidate_type (size_t index) const { return m_candidate_types[index]; }
+
+    // Returns the index of the first candidate type that value inhabits, or std::nullopt if none.
+    std::optional<size_t> classify (Data const &value) const;
+    // Same as classify(Data{value}), except that value is only copied into a Data if it has to be checked
+    // against a candidate (or union element) that isn't a TupleTerm_c.
+    std::optional<size_t> classify (TupleTerm_c const &value) const;
+    // Same as classify, except that instead of checking whether value inhabits each remaining candidate,
+    // this only checks the necessary conditions that the decision tree is built from.  These only look
+    // as deep into value as the candidate types do (refs within the candidates are not followed), so
+    // this takes time bounded by the candidates and not by value, which matters for recursive types
+    // (e.g. an AST).  If value could inhabit more than one candidate, then the one with the most specific
+    // conditions is returned (the first one, if tied), but value doesn't necessarily inhabit it.
+    std::optional<size_t> classify_shallowly (Data const &value) const;
+    // Same as classify_shallowly(Data{value}), but without copying value.
+    std::optional<size_t> classify_shallowly (TupleTerm_c const &value) const;
+
+private:
+
+    // Sequence of element indices into nested TupleTerm_c values.  The empty path is the value itself.
+    using Path = std::vector<size_t>;
+
+    // The set of C++ types that a value could have in order to inhabit a particular type.
+    struct ValueTypeSet {
+        bool m_any = false;
+        std::unordered_set<std::type_index> m_types;    // Only used if !m_any
+        std::unordered_set<std::type_index> m_excluded; // Only used if m_any
+
+        bool contains (std::type_index type) const { return m_any ? m_excluded.count(type) == 0 : m_types.count(type) != 0; }
+        bool is_everything () const { return m_any && m_excluded.empty(); }
+        void add (ValueTypeSet const &other);
+        void remove (std::unordered_set<std::type_index> const &types);
+    };
+
+    // Necessary conditions on the value at m_path.
+    struct Constraint {
+        Path m_path;
+        ValueTypeSet m_value_types;
+        std::optional<size_t> m_tuple_size;
+        // The x in FormalTypeOf(x).
+        std::optional<Data> m_term;
+    };
+
+    // A single type to check, which is either a candidate type or an element of a UnionTerm_c candidate.
+    struct Entry {
+        size_t m_candidate_index;
+        Data m_type;
+        std::vector<Constraint> m_constraints;
+
+        Constraint const *constraint_at (Path const &path) const;
+    };
+
+    enum class TestKind : uint8_t { LEAF, VALUE_TYPE, TUPLE_SIZE, TERM };
+
+    struct Node {
+        TestKind m_test_kind;
+        // Indices into m_entries, in priority order.  Used by LEAF.
+        std::vector<size_t> m_entries;
+        Path m_path;
+        // Used by VALUE_TYPE.
+        std::unordered_map<std::type_index,size_t> m_child_for_type;
+        // Used by TUPLE_SIZE.
+        std::unordered_map<size_t,size_t> m_child_for_size;
+        // Used by TERM.
+        std::unordered_map<std::type_index,std::vector<std::pair<Data,size_t>>> m_children_for_term;
+        // For any outcome not covered above.
+        size_t m_default_child = 0;
+        // Used by VALUE_TYPE when there's no value at m_path.
+        size_t m_missing_child = 0;
+        // Used by TERM when the value at m_path is FormalTypeOf_Term_c.
+        size_t m_fallback_child = 0;
+    };
+
+    // The value at a particular path.
+    struct Located {
+        std::type_index m_type;
+        Data const *m_data;          // Only null if this is the TupleTerm_c passed to classify.
+        TupleTerm_c const *m_tuple;  // Non-null iff m_type is TupleTerm_c.
+    };
+
+    ValueTypeSet value_types_of (Data const &type) const;
+    // Adds the entries for type (which must already be dereferenced), not including the given value types.
+    void add_entries (size_t candidate_index, Data const &type, std::unordered_set<std::type_index> const &excluded_value_types);
+    void add_element_constraints (Entry &entry, Path const &path, TupleTerm_c const &tuple, std::vector<TupleTerm_c const *> &visiting) const;
+    // Identical sets of entries get identical subtrees, so they're shared via node_for_entries.
+    size_t add_node (std::vector<size_t> const &entries, std::map<std::vector<size_t>,size_t> &node_for_entries);
+    size_t add_leaf (std::vector<size_t> const &entries);
+
+    // Returns std::nullopt if there's no value at path.
+    static std::optional<Located> locate (Located const &root, Path const &path);
+    Node const &find_leaf (Located const &root) const;
+    static bool satisfies_constraints (Entry const &entry, Located const &root);
+    std::optional<size_t> classify_shallowly (Located const &root) const;
+
+    DataVector m_candidate_types;
+    std::vector<Entry> m_entries;
+    std::vector<Node> m_nodes;
+    size_t m_root;
+};
+
+} // end namespace sept